@@ -3,58 +3,708 @@
  * Copyright (c) 2020 Microchip Corporation
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include "common.h"
 
-int mchp_genl_start(const char *family_name, uint8_t cmd,
-		       uint8_t version, struct nl_sock **skp,
-		       struct nl_msg **msgp)
+static const size_t mchp_genl_msg_size[MCHP_GENL_MSG_CLASSES] = {
+	[MCHP_GENL_MSG_SMALL] = MCHP_GENL_MSG_SMALL_SIZE,
+	[MCHP_GENL_MSG_LARGE] = MCHP_GENL_MSG_LARGE_SIZE,
+};
+
+/* Size the socket buffers for the in-flight window. The kernel clamps
+ * SO_RCVBUF to net.core.rmem_max, so the window is shrunk to whatever the
+ * granted buffer can hold without dropping replies.
+ */
+static int mchp_genl_set_buffers(struct mchp_genl_session *s)
+{
+	struct timeval tv = {
+		.tv_sec = MCHP_GENL_RECV_TIMEOUT_MS / 1000,
+		.tv_usec = (MCHP_GENL_RECV_TIMEOUT_MS % 1000) * 1000,
+	};
+	int fd = nl_socket_get_fd(s->sk);
+	socklen_t len = sizeof(int);
+	int rcvbuf, sndbuf, err;
+	unsigned int fit;
+
+	rcvbuf = s->window_max * MCHP_GENL_RCVBUF_PER_REQ +
+		 MCHP_GENL_RXBUF_SIZE;
+	sndbuf = s->window_max * MCHP_GENL_MSG_SMALL_SIZE +
+		 MCHP_GENL_MSG_LARGE_SLOTS * MCHP_GENL_MSG_LARGE_SIZE;
+
+	err = nl_socket_set_buffer_size(s->sk, rcvbuf, sndbuf);
+	if (err < 0) {
+		printf("nl_socket_set_buffer_size() failed\n");
+		return err;
+	}
+
+	if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0 &&
+	    rcvbuf > MCHP_GENL_RXBUF_SIZE) {
+		fit = (rcvbuf - MCHP_GENL_RXBUF_SIZE) / MCHP_GENL_RCVBUF_PER_REQ;
+		if (fit < s->window_max)
+			s->window_max = fit ? fit : 1;
+	}
+	s->window = s->window_max;
+
+	/* Replies dropped while the socket is congested are not reported */
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+		printf("setsockopt(SO_RCVTIMEO) failed\n");
+		return -nl_syserr2nlerr(errno);
+	}
+
+	return 0;
+}
+
+static int mchp_genl_connect(struct mchp_genl_session *s)
 {
-	int err, family_id;
+	unsigned int cls, i, nreqs = 0;
+	int err;
 
-	*skp = nl_socket_alloc();
-	if (!*skp) {
+	s->sk = nl_socket_alloc();
+	if (!s->sk) {
 		printf("nl_socket_alloc() failed\n");
 		return -1;
 	}
 
-	err = genl_connect(*skp);
+	err = genl_connect(s->sk);
 	if (err < 0) {
 		printf("genl_connect() failed\n");
-		goto err_free_socket;
+		goto err_free;
 	}
 
-	err = genl_ctrl_resolve(*skp, family_name);
+	err = genl_ctrl_resolve(s->sk, s->family_name);
 	if (err < 0) {
 		printf("genl_ctrl_resolve() failed\n");
-		goto err_free_socket;
+		goto err_free;
+	}
+	s->family_id = err;
+
+	/* The arena keeps the configured window, even if the socket buffers
+	 * only allow fewer requests in flight at a time.
+	 */
+	s->pool_size[MCHP_GENL_MSG_SMALL] = s->window_max;
+
+	err = mchp_genl_set_buffers(s);
+	if (err < 0)
+		goto err_free;
+	s->pool_size[MCHP_GENL_MSG_LARGE] = MCHP_GENL_MSG_LARGE_SLOTS;
+
+	for (cls = 0; cls < MCHP_GENL_MSG_CLASSES; cls++) {
+		s->pool[cls] = calloc(s->pool_size[cls], sizeof(struct nl_msg *));
+		if (!s->pool[cls])
+			goto err_nomem;
+
+		for (i = 0; i < s->pool_size[cls]; i++) {
+			s->pool[cls][i] = nlmsg_alloc_size(mchp_genl_msg_size[cls]);
+			if (!s->pool[cls][i])
+				goto err_nomem;
+		}
+		nreqs += s->pool_size[cls];
 	}
-	family_id = err;
 
-	*msgp = nlmsg_alloc();
-	if (!*msgp) {
-		printf("nlmsg_alloc() failed\n");
-		err = -1;
-		goto err_free_socket;
+	s->reqs = calloc(nreqs, sizeof(*s->reqs));
+	s->iov = calloc(nreqs, sizeof(*s->iov));
+	s->inflight = calloc(nreqs, sizeof(*s->inflight));
+	s->rxbuf = malloc(MCHP_GENL_RXBUF_SIZE);
+	if (!s->reqs || !s->iov || !s->inflight || !s->rxbuf)
+		goto err_nomem;
+
+	return 0;
+
+err_nomem:
+	printf("nlmsg_alloc() failed\n");
+	err = -NLE_NOMEM;
+
+err_free:
+	mchp_genl_session_close(s);
+	return err;
+}
+
+/* Rewind a pooled message so it can be built again from scratch */
+static struct nl_msg *mchp_genl_msg_reset(struct nl_msg *msg)
+{
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+
+	memset(nlh, 0, nlh->nlmsg_len);
+	nlh->nlmsg_len = NLMSG_HDRLEN;
+
+	return msg;
+}
+
+/* Reserve a message from the arena, build the generic netlink header and
+ * queue it on the session. The reply messages are handed to @parse together
+ * with @arg, so replies decode straight into the caller's structures. The
+ * request is sent by mchp_genl_flush(), or implicitly when the arena runs
+ * out of messages of the needed size.
+ */
+struct nl_msg *mchp_genl_req_reserve(struct mchp_genl_session *s,
+				     uint8_t cmd, int flags, size_t size,
+				     mchp_genl_parse_t parse, void *arg,
+				     int *err)
+{
+	enum mchp_genl_msg_class cls;
+	struct mchp_genl_req *req;
+	int rc;
+
+	if (!s->sk && mchp_genl_connect(s) < 0)
+		return NULL;
+
+	for (cls = 0; cls < MCHP_GENL_MSG_CLASSES; cls++)
+		if (size <= mchp_genl_msg_size[cls])
+			break;
+
+	if (cls == MCHP_GENL_MSG_CLASSES) {
+		printf("request of %zu bytes is too large\n", size);
+		return NULL;
 	}
 
-	if (!genlmsg_put(*msgp,
-			 NL_AUTO_PORT,
-			 NL_AUTO_SEQ,
-			 family_id,
-			 0,
-			 NLM_F_REQUEST | NLM_F_ACK,
-			 cmd,
-			 version)) {
+	if (s->pool_used[cls] == s->pool_size[cls]) {
+		rc = mchp_genl_flush(s);
+		if (rc < 0 && !s->rc)
+			s->rc = rc;
+	}
+
+	req = &s->reqs[s->nreqs];
+	req->msg = mchp_genl_msg_reset(s->pool[cls][s->pool_used[cls]]);
+	req->cls = cls;
+	req->parse = parse;
+	req->arg = arg;
+	req->err = err;
+	req->rc = 0;
+	req->replay = !(flags & MCHP_GENL_F_NO_REPLAY);
+	req->ack = flags & NLM_F_ACK;
+	req->dump = (flags & NLM_F_DUMP) == NLM_F_DUMP;
+	req->sent = false;
+	req->done = false;
+
+	if (!genlmsg_put(req->msg, NL_AUTO_PORT, NL_AUTO_SEQ, s->family_id,
+			 0, flags & ~MCHP_GENL_F_NO_REPLAY, cmd, s->version)) {
 		printf("genlmsg_put() failed\n");
-		goto nla_put_failure;
+		return NULL;
+	}
+
+	s->pool_used[cls]++;
+	s->nreqs++;
+	s->queued++;
+
+	return req->msg;
+}
+
+/* Drop the most recently queued request, e.g. when building it failed */
+void mchp_genl_req_abort(struct mchp_genl_session *s)
+{
+	if (!s->nreqs)
+		return;
+
+	s->nreqs--;
+	s->queued--;
+	s->pool_used[s->reqs[s->nreqs].cls]--;
+}
+
+/* Drop every request queued since @mark. Requests already sent by an
+ * implicit flush cannot be taken back.
+ */
+void mchp_genl_req_abort_to(struct mchp_genl_session *s, unsigned long mark)
+{
+	while (s->nreqs && s->queued > mark)
+		mchp_genl_req_abort(s);
+}
+
+/* Handle one reply message. Returns true when it completes the request */
+static bool mchp_genl_dispatch(struct mchp_genl_req *req,
+			       struct nlmsghdr *nlh)
+{
+	struct nlmsgerr *e;
+	int rc;
+
+	switch (nlh->nlmsg_type) {
+	case NLMSG_NOOP:
+		return false;
+	case NLMSG_DONE:
+		if (nlmsg_datalen(nlh) >= (int)sizeof(int)) {
+			rc = *(int *)nlmsg_data(nlh);
+			if (rc < 0 && !req->rc)
+				req->rc = -nl_syserr2nlerr(rc);
+		}
+		return true;
+	case NLMSG_OVERRUN:
+		req->rc = -NLE_MSG_OVERFLOW;
+		return true;
+	case NLMSG_ERROR:
+		e = nlmsg_data(nlh);
+		if (e->error && !req->rc)
+			req->rc = -nl_syserr2nlerr(e->error);
+		return true;
+	}
+
+	if (req->parse && !req->rc) {
+		rc = req->parse(nlh, req->arg);
+		if (rc < 0)
+			req->rc = rc;
+	}
+
+	/* Requests complete on their ack, dumps on NLMSG_DONE and requests
+	 * without ack on their reply.
+	 */
+	return !req->ack && !req->dump;
+}
+
+/* Receive until the @n requests in flight are completed. Sets @lost when
+ * the kernel dropped replies, either reported by ENOBUFS or detected by the
+ * receive timeout while the socket stayed congested.
+ */
+static int mchp_genl_recv(struct mchp_genl_session *s, uint32_t base_seq,
+			  unsigned int n, bool *lost)
+{
+	int fd = nl_socket_get_fd(s->sk);
+	unsigned int pending = n;
+	int flags = 0;
+
+	while (pending) {
+		struct iovec iov = {
+			.iov_base = s->rxbuf,
+			.iov_len = MCHP_GENL_RXBUF_SIZE,
+		};
+		struct msghdr mh = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+		};
+		struct mchp_genl_req *req;
+		struct nlmsghdr *nlh;
+		uint32_t idx;
+		ssize_t len;
+		int rem;
+
+		len = recvmsg(fd, &mh, flags);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				/* Reported ahead of the replies still queued,
+				 * drain those before re-issuing the rest.
+				 */
+				*lost = true;
+				flags = MSG_DONTWAIT;
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				*lost = true;
+				return 0;
+			}
+			return -nl_syserr2nlerr(errno);
+		}
+
+		if (mh.msg_flags & MSG_TRUNC)
+			return -NLE_MSG_TRUNC;
+
+		rem = len;
+		for (nlh = s->rxbuf; nlmsg_ok(nlh, rem);
+		     nlh = nlmsg_next(nlh, &rem)) {
+			/* Sequence numbers of one round are consecutive, and
+			 * late replies to an earlier round fall outside it.
+			 */
+			idx = nlh->nlmsg_seq - base_seq;
+			if (idx >= n)
+				continue;
+
+			req = &s->reqs[s->inflight[idx]];
+			if (req->done)
+				continue;
+
+			if (mchp_genl_dispatch(req, nlh)) {
+				req->done = true;
+				pending--;
+			}
+		}
 	}
 
 	return 0;
+}
 
-nla_put_failure:
-	nlmsg_free(*msgp);
+/* Send the @n requests listed in s->inflight in a single sendmsg() */
+static int mchp_genl_send(struct mchp_genl_session *s, unsigned int n,
+			  uint32_t *base_seq, bool *lost)
+{
+	struct sockaddr_nl peer = {
+		.nl_family = AF_NETLINK,
+	};
+	struct msghdr mh = {
+		.msg_name = &peer,
+		.msg_namelen = sizeof(peer),
+		.msg_iov = s->iov,
+		.msg_iovlen = n,
+	};
+	struct mchp_genl_req *req;
+	struct nlmsghdr *nlh;
+	uint32_t port;
+	unsigned int i;
 
-err_free_socket:
-	nl_socket_free(*skp);
-	return err;
+	port = nl_socket_get_local_port(s->sk);
+	for (i = 0; i < n; i++) {
+		req = &s->reqs[s->inflight[i]];
+		nlh = nlmsg_hdr(req->msg);
+		nlh->nlmsg_pid = port;
+		nlh->nlmsg_seq = nl_socket_use_seq(s->sk);
+		if (i == 0)
+			*base_seq = nlh->nlmsg_seq;
+		s->iov[i].iov_base = nlh;
+		s->iov[i].iov_len = nlh->nlmsg_len;
+		req->sent = true;
+		req->rc = 0;
+	}
+
+	if (sendmsg(nl_socket_get_fd(s->sk), &mh, 0) < 0) {
+		/* Nothing was processed, so resending is safe */
+		for (i = 0; i < n; i++)
+			s->reqs[s->inflight[i]].sent = false;
+		if (errno == ENOBUFS || errno == EAGAIN) {
+			*lost = true;
+			return 0;
+		}
+		return -nl_syserr2nlerr(errno);
+	}
+
+	return 0;
+}
+
+/* Send every queued request and wait until all of them are completed.
+ * Requests go out in rounds of at most s->window, each in one sendmsg().
+ * When replies are lost, the requests not completed are re-issued with
+ * new sequence numbers and the window is halved; it grows back by one for
+ * each round without losses. The flush fails with ENOBUFS only when
+ * MCHP_GENL_RETRIES rounds in a row complete nothing. Returns the first
+ * error of any request flushed since the previous call.
+ */
+int mchp_genl_flush(struct mchp_genl_session *s)
+{
+	unsigned int i, n, retries = 0;
+	struct mchp_genl_req *req;
+	uint32_t base_seq = 0;
+	bool lost, progress;
+	int rc = 0;
+
+	if (!s->nreqs)
+		goto out;
+
+	for (;;) {
+		/* Only one dump can run on a socket, so a dump is sent in a
+		 * round of its own.
+		 */
+		n = 0;
+		for (i = 0; i < s->nreqs && n < s->window; i++) {
+			if (s->reqs[i].done)
+				continue;
+			if (s->reqs[i].dump && n)
+				break;
+			s->inflight[n++] = i;
+			if (s->reqs[i].dump)
+				break;
+		}
+		if (!n)
+			break;
+
+		lost = false;
+		rc = mchp_genl_send(s, n, &base_seq, &lost);
+		if (!rc && !lost)
+			rc = mchp_genl_recv(s, base_seq, n, &lost);
+		if (rc < 0)
+			break;
+
+		if (!lost) {
+			if (s->window < s->window_max)
+				s->window++;
+			continue;
+		}
+
+		progress = false;
+		for (i = 0; i < n; i++) {
+			req = &s->reqs[s->inflight[i]];
+			if (req->done) {
+				progress = true;
+			} else if (req->sent && !req->replay) {
+				req->rc = -nl_syserr2nlerr(ENOBUFS);
+				req->done = true;
+			}
+		}
+
+		/* Give up only when rounds keep losing every reply */
+		retries = progress ? 0 : retries + 1;
+		if (retries > MCHP_GENL_RETRIES) {
+			rc = -nl_syserr2nlerr(ENOBUFS);
+			break;
+		}
+		s->window = s->window > 1 ? s->window / 2 : 1;
+	}
+
+	for (i = 0; i < s->nreqs; i++) {
+		req = &s->reqs[i];
+		if (!rc && req->rc)
+			rc = req->rc;
+		if (req->err)
+			*req->err = req->done ? req->rc : rc;
+	}
+
+	if (rc < 0 && !s->rc)
+		s->rc = rc;
+
+	s->nreqs = 0;
+	memset(s->pool_used, 0, sizeof(s->pool_used));
+
+out:
+	rc = s->rc;
+	s->rc = 0;
+
+	return rc;
+}
+
+void mchp_genl_session_close(struct mchp_genl_session *s)
+{
+	unsigned int cls, i;
+
+	for (cls = 0; cls < MCHP_GENL_MSG_CLASSES; cls++) {
+		if (!s->pool[cls])
+			continue;
+
+		for (i = 0; i < s->pool_size[cls]; i++)
+			if (s->pool[cls][i])
+				nlmsg_free(s->pool[cls][i]);
+		free(s->pool[cls]);
+		s->pool[cls] = NULL;
+		s->pool_size[cls] = 0;
+		s->pool_used[cls] = 0;
+	}
+
+	free(s->reqs);
+	free(s->iov);
+	free(s->inflight);
+	free(s->rxbuf);
+	s->reqs = NULL;
+	s->iov = NULL;
+	s->inflight = NULL;
+	s->rxbuf = NULL;
+	s->nreqs = 0;
+
+	if (s->sk)
+		nl_socket_free(s->sk);
+	s->sk = NULL;
+	s->window = s->window_max;
+}
+
+/* Append the IDs of a range list like "3-24,26" to @ids. Returns the
+ * character ending the list, or NULL if it is malformed or too long.
+ */
+static const char *mchp_range_parse(const char *ranges, uint32_t *ids,
+				    unsigned int max, unsigned int *cnt)
+{
+	unsigned long lo, hi, n;
+	char *end;
+
+	for (;;) {
+		lo = strtoul(ranges, &end, 10);
+		if (end == ranges || lo > UINT32_MAX)
+			return NULL;
+		hi = lo;
+		if (*end == '-') {
+			ranges = end + 1;
+			hi = strtoul(ranges, &end, 10);
+			if (end == ranges || hi < lo || hi > UINT32_MAX)
+				return NULL;
+		}
+
+		if (hi - lo >= max - *cnt)
+			return NULL;
+		for (n = lo; n <= hi; n++)
+			ids[(*cnt)++] = n;
+
+		if (*end != ',')
+			return end;
+		ranges = end + 1;
+	}
+}
+
+/* Expand an ID list like "1-100,200" into @ids, in the order given.
+ * Returns the number of IDs, or -1 if the list is malformed or holds more
+ * than @max IDs.
+ */
+int mchp_id_list_parse(const char *list, uint32_t *ids, unsigned int max)
+{
+	unsigned int cnt = 0;
+	const char *end;
+
+	end = mchp_range_parse(list, ids, max, &cnt);
+	if (!end || *end) {
+		fprintf(stderr, "Invalid ID list [%s]\n", list);
+		return -1;
+	}
+
+	return cnt;
+}
+
+/* Print sorted IDs as a list like "1-100,200", the inverse of
+ * mchp_id_list_parse()
+ */
+void mchp_id_list_print(const uint32_t *ids, unsigned int cnt)
+{
+	unsigned int i, first;
+
+	for (i = 0; i < cnt; i++) {
+		first = i;
+		while (i + 1 < cnt && ids[i + 1] == ids[i] + 1)
+			i++;
+
+		printf("%s%" PRIu32, first ? "," : "", ids[first]);
+		if (i > first)
+			printf("-%" PRIu32, ids[i]);
+	}
+	printf("\n");
+}
+
+/* Append @prefix<n><suffix> for every n of the ranges in brackets */
+static int mchp_dev_list_expand(const char *prefix, int plen,
+				const char *ranges, const char *suffix,
+				char (*names)[IF_NAMESIZE], unsigned int max,
+				unsigned int *cnt)
+{
+	uint32_t ids[MCHP_DEV_LIST_MAX];
+	unsigned int i, n = 0;
+	const char *end;
+
+	end = mchp_range_parse(ranges, ids, max - *cnt, &n);
+	if (!end || *end != ']')
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		if (snprintf(names[*cnt], IF_NAMESIZE, "%.*s%" PRIu32 "%s",
+			     plen, prefix, ids[i], suffix) >= IF_NAMESIZE)
+			return -1;
+		(*cnt)++;
+	}
+
+	return 0;
+}
+
+/* Expand a device list like "swp1,swp2,swp[3-24]" into @names, in the
+ * order given. Returns the number of devices, or -1 if the list is
+ * malformed or holds more than @max devices.
+ */
+int mchp_dev_list_parse(const char *list, char (*names)[IF_NAMESIZE],
+			unsigned int max)
+{
+	const char *tok = list, *open, *close, *end;
+	char suffix[IF_NAMESIZE];
+	unsigned int cnt = 0;
+	int len;
+
+	while (*tok) {
+		open = strchr(tok, '[');
+		end = strchr(tok, ',');
+		if (!end)
+			end = tok + strlen(tok);
+
+		if (open && open < end) {
+			close = strchr(open, ']');
+			if (!close)
+				goto err;
+			end = strchr(close, ',');
+			if (!end)
+				end = close + strlen(close);
+
+			/* Suffix after the brackets, e.g. "swp[1-4].100" */
+			len = end - close - 1;
+			if (len >= IF_NAMESIZE)
+				goto err;
+			memcpy(suffix, close + 1, len);
+			suffix[len] = 0;
+
+			if (mchp_dev_list_expand(tok, open - tok, open + 1,
+						 suffix, names, max, &cnt) < 0)
+				goto err;
+		} else {
+			len = end - tok;
+			if (!len || len >= IF_NAMESIZE || cnt == max)
+				goto err;
+			memcpy(names[cnt], tok, len);
+			names[cnt][len] = 0;
+			cnt++;
+		}
+
+		tok = *end ? end + 1 : end;
+	}
+
+	if (!cnt)
+		goto err;
+
+	return cnt;
+
+err:
+	fprintf(stderr, "Invalid device list [%s]\n", list);
+	return -1;
+}
+
+/* Run every line of @name, or of stdin for "-", as one command of the tool.
+ * Arguments are separated by white space, and empty lines and lines starting
+ * with '#' are skipped. Stops at the first command failing, reporting its
+ * line. With @progress, "@line <n>" is printed before every command, so a
+ * caller cut off early can tell which lines were started. A batch keeps
+ * the netlink session of the tool open, so the commands share one socket.
+ */
+int mchp_batch_run(const char *name, bool progress, mchp_batch_cmd_t run)
+{
+	char *argv[MCHP_BATCH_ARGS_MAX + 1];
+	char *line = NULL, *tok, *save;
+	int argc, line_num = 0, rc = 0;
+	size_t size = 0;
+	FILE *f;
+
+	if (strcmp(name, "-") == 0) {
+		f = stdin;
+	} else {
+		f = fopen(name, "r");
+		if (!f) {
+			fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+			return 1;
+		}
+	}
+
+	while (getline(&line, &size, f) != -1) {
+		line_num++;
+
+		argc = 0;
+		for (tok = strtok_r(line, " \t\r\n", &save); tok;
+		     tok = strtok_r(NULL, " \t\r\n", &save)) {
+			if (argc == 0 && tok[0] == '#')
+				break;
+			if (argc == MCHP_BATCH_ARGS_MAX) {
+				fprintf(stderr, "Error on line %d:\n", line_num);
+				fprintf(stderr, "Too many arguments\n");
+				rc = 1;
+				break;
+			}
+			argv[argc++] = tok;
+		}
+		argv[argc] = NULL;
+
+		if (!argc)
+			continue;
+
+		if (!rc) {
+			if (progress) {
+				printf("@line %d\n", line_num);
+				fflush(stdout);
+			}
+			rc = run(argc, argv, line_num);
+		}
+		if (rc) {
+			fprintf(stderr, "Command failed on line %d\n", line_num);
+			break;
+		}
+	}
+
+	free(line);
+	if (f != stdin)
+		fclose(f);
+
+	return rc;
 }
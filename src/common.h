@@ -9,6 +9,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <sys/uio.h>
+#include <net/if.h>
 #include <netlink/genl/genl.h>
 #include <netlink/genl/ctrl.h>
 
@@ -23,8 +25,149 @@
 /* COUNT_OF() is more type safe than traditional ARRAY_SIZE() */
 #define COUNT_OF(x) ((sizeof(x)/sizeof(0[x])) / ((size_t)(!(sizeof(x) % sizeof(0[x])))))
 
-int mchp_genl_start(const char *family_name, uint8_t cmd,
-		       uint8_t version, struct nl_sock **skp,
-		       struct nl_msg **msgp);
+/* Size classes of the request arena owned by a session */
+enum mchp_genl_msg_class {
+	MCHP_GENL_MSG_SMALL, /* Header, a few IDs and one config struct */
+	MCHP_GENL_MSG_LARGE, /* Anything else up to a page */
+
+	/* This must be the last entry */
+	MCHP_GENL_MSG_CLASSES,
+};
+
+#define MCHP_GENL_MSG_SMALL_SIZE  256
+#define MCHP_GENL_MSG_LARGE_SIZE  4096
+#define MCHP_GENL_MSG_LARGE_SLOTS 4
+#define MCHP_GENL_RXBUF_SIZE      32768
+#define MCHP_GENL_WINDOW          64 /* Default # of requests in flight */
+
+/* Receive buffer charged per request in flight: a reply allocated with
+ * NLMSG_GOODSIZE plus its ack, including skb overhead.
+ */
+#define MCHP_GENL_RCVBUF_PER_REQ  6144
+#define MCHP_GENL_RECV_TIMEOUT_MS 1000 /* Replies lost without ENOBUFS */
+#define MCHP_GENL_RETRIES         8
+
+/* Session private request flag, never sent to the kernel. Requests that
+ * must not be executed twice, e.g. allocations, are failed instead of
+ * re-issued when their reply was lost.
+ */
+#define MCHP_GENL_F_NO_REPLAY     (1 << 16)
+
+/* Decodes one reply message of a request into the caller's storage */
+typedef int (*mchp_genl_parse_t)(struct nlmsghdr *nlh, void *arg);
+
+struct mchp_genl_req {
+	struct nl_msg *msg;
+	enum mchp_genl_msg_class cls;
+	mchp_genl_parse_t parse;
+	void *arg;
+	int *err;  /* Optional per-request result */
+	int rc;
+	bool replay;
+	bool ack;
+	bool dump;
+	bool sent;
+	bool done;
+};
+
+/* A netlink session: one socket and one preallocated request arena,
+ * reused for every request issued towards a generic netlink family.
+ * Sockets and buffers are allocated when the first request is built, so
+ * a session can be statically initialized with MCHP_GENL_SESSION_INIT().
+ */
+struct mchp_genl_session {
+	const char *family_name;
+	uint8_t version;
+	unsigned int window_max;
+	unsigned int window; /* Shrinks on ENOBUFS, grows back when idle */
+
+	struct nl_sock *sk;
+	int family_id;
+	struct nl_msg **pool[MCHP_GENL_MSG_CLASSES];
+	unsigned int pool_size[MCHP_GENL_MSG_CLASSES];
+	unsigned int pool_used[MCHP_GENL_MSG_CLASSES];
+	struct mchp_genl_req *reqs;
+	struct iovec *iov;
+	unsigned int *inflight; /* Sequence number offset to request */
+	unsigned int nreqs;
+	unsigned long queued; /* Requests ever queued, see mchp_genl_req_mark() */
+	void *rxbuf;
+	int rc; /* First error of requests flushed implicitly */
+};
+
+#define MCHP_GENL_SESSION_INIT(name, ver) {	\
+	.family_name = (name),			\
+	.version = (ver),			\
+	.window_max = MCHP_GENL_WINDOW,		\
+	.window = MCHP_GENL_WINDOW,		\
+}
+
+struct nl_msg *mchp_genl_req_reserve(struct mchp_genl_session *s,
+				     uint8_t cmd, int flags, size_t size,
+				     mchp_genl_parse_t parse, void *arg,
+				     int *err);
+
+/* Queue a request expecting an ack and optionally a reply */
+static inline struct nl_msg *mchp_genl_req(struct mchp_genl_session *s,
+					   uint8_t cmd,
+					   mchp_genl_parse_t parse, void *arg,
+					   int *err)
+{
+	return mchp_genl_req_reserve(s, cmd, NLM_F_REQUEST | NLM_F_ACK,
+				     MCHP_GENL_MSG_SMALL_SIZE, parse, arg, err);
+}
+
+/* Queue a request completed by its single reply, saving the ack that
+ * would double the replies to receive. Errors are still reported.
+ */
+static inline struct nl_msg *mchp_genl_get(struct mchp_genl_session *s,
+					   uint8_t cmd,
+					   mchp_genl_parse_t parse, void *arg,
+					   int *err)
+{
+	return mchp_genl_req_reserve(s, cmd, NLM_F_REQUEST,
+				     MCHP_GENL_MSG_SMALL_SIZE, parse, arg, err);
+}
+
+/* Queue a dump request, @parse is called for every entry. Entries may be
+ * passed again if the dump has to be restarted after replies were lost.
+ */
+static inline struct nl_msg *mchp_genl_dump(struct mchp_genl_session *s,
+					    uint8_t cmd,
+					    mchp_genl_parse_t parse, void *arg,
+					    int *err)
+{
+	return mchp_genl_req_reserve(s, cmd, NLM_F_REQUEST | NLM_F_DUMP,
+				     MCHP_GENL_MSG_SMALL_SIZE, parse, arg, err);
+}
+
+void mchp_genl_req_abort(struct mchp_genl_session *s);
+
+/* Position of the next request, to abort all requests queued from there */
+static inline unsigned long mchp_genl_req_mark(struct mchp_genl_session *s)
+{
+	return s->queued;
+}
+
+void mchp_genl_req_abort_to(struct mchp_genl_session *s, unsigned long mark);
+int mchp_genl_flush(struct mchp_genl_session *s);
+void mchp_genl_session_close(struct mchp_genl_session *s);
+
+#define MCHP_DEV_LIST_MAX 64
+
+#define MCHP_BATCH_ARGS_MAX 64
+
+/* Runs one command line of a batch, argv[0] being the command name */
+typedef int (*mchp_batch_cmd_t)(int argc, char **argv, int line_num);
+
+int mchp_batch_run(const char *name, bool progress, mchp_batch_cmd_t run);
+
+int mchp_dev_list_parse(const char *list, char (*names)[IF_NAMESIZE],
+			unsigned int max);
+
+#define MCHP_ID_LIST_MAX 4096
+
+int mchp_id_list_parse(const char *list, uint32_t *ids, unsigned int max);
+void mchp_id_list_print(const uint32_t *ids, unsigned int cnt);
 
 #endif /* _COMMON_H_ */
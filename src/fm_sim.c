@@ -0,0 +1,600 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Offline PSFP flow metering.
+ *
+ * Runs the frames of a capture, or of a generated arrival pattern, through
+ * a software model of the flow meter, with the fields of struct
+ * mchp_psfp_fm_conf. Every option takes a list of values, and the frames
+ * are metered by every combination of them, to size a meter before it is
+ * programmed.
+ *
+ * The arrival times and lengths are extracted once. The meters are split
+ * between the worker threads, and every worker runs all frames through its
+ * share of them at once, see psfp_meter.h.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pcap.h"
+#include "psfp_meter.h"
+
+#define FM_SIM_THREADS 16
+#define FM_SIM_VALUES  64    /* Values of one option */
+#define FM_SIM_METERS  65536 /* Combinations of all options */
+#define FM_SIM_SLICE   8     /* Meters of a worker, a multiple of this */
+
+#define ETH_P_8021Q  0x8100
+#define ETH_P_8021AD 0x88a8
+
+#define FM_SIM_NO_VID 0xffff
+#define FM_SIM_IFG    20 /* Preamble and inter frame gap, octets */
+
+enum fm_sim_opt {
+	FM_SIM_CIR,
+	FM_SIM_CBS,
+	FM_SIM_EIR,
+	FM_SIM_EBS,
+	FM_SIM_CF,
+	FM_SIM_DROP_ON_YELLOW,
+	FM_SIM_MARK_RED_ENABLE,
+	FM_SIM_MARK_RED,
+
+	/* This must be the last entry */
+	FM_SIM_OPTS,
+};
+
+struct fm_sim_list {
+	u32 val[FM_SIM_VALUES];
+	unsigned int cnt;
+};
+
+/* Arrival time and length of every frame metered */
+struct fm_sim_trace {
+	u64 *ts_ns;
+	u32 *len;
+	size_t cnt;
+	size_t size;
+	u64 octets;
+};
+
+/* Generated frames, bursts of back to back frames at the average rate */
+struct fm_sim_gen {
+	u32 rate; /* kbit/s */
+	u32 line; /* kbit/s */
+	u32 size; /* octets */
+	u32 burst;
+	u64 frames;
+};
+
+struct fm_sim;
+
+struct fm_sim_worker {
+	struct fm_sim *sim;
+	unsigned int id;
+	struct psfp_meter_set m;
+	unsigned int lo, hi; /* Meters lo up to hi */
+	int rc;
+};
+
+struct fm_sim {
+	struct fm_sim_trace trace;
+	struct mchp_psfp_fm_conf *conf;
+	unsigned int nconf;
+	unsigned int nworkers;
+	struct fm_sim_worker *workers;
+};
+
+static struct option long_options[] =
+{
+	{"cir", required_argument, NULL, 'a'},
+	{"cbs", required_argument, NULL, 'b'},
+	{"eir", required_argument, NULL, 'c'},
+	{"ebs", required_argument, NULL, 'd'},
+	{"cf", required_argument, NULL, 'e'},
+	{"drop_on_yellow", required_argument, NULL, 'f'},
+	{"mark_red_enable", required_argument, NULL, 'g'},
+	{"mark_red", required_argument, NULL, 'i'},
+	{"dmac", required_argument, NULL, 'j'},
+	{"vid", required_argument, NULL, 'k'},
+	{"rate", required_argument, NULL, 'l'},
+	{"line", required_argument, NULL, 'm'},
+	{"size", required_argument, NULL, 'n'},
+	{"burst", required_argument, NULL, 'o'},
+	{"frames", required_argument, NULL, 'p'},
+	{"threads", required_argument, NULL, 'q'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+static void help(void)
+{
+	printf("Usage: fm-sim [options] [trace.pcap]\n");
+	printf("Run the frames of a capture, or generated ones, through flow meters\n");
+	printf("with every combination of the values given, up to %d\n",
+	       FM_SIM_METERS);
+	printf("options:\n");
+	printf(" --cir <kbit/s[,...]>           Committed information rate (default 0)\n");
+	printf(" --cbs <octets[,...]>           Committed burst size (default 0)\n");
+	printf(" --eir <kbit/s[,...]>           Excess information rate (default 0)\n");
+	printf(" --ebs <octets[,...]>           Excess burst size (default 0)\n");
+	printf(" --cf <0|1[,...]>               Coupling flag\n");
+	printf(" --drop_on_yellow <0|1[,...]>   Discard yellow frames\n");
+	printf(" --mark_red_enable <0|1[,...]>  Mark all frames red after a discard\n");
+	printf(" --mark_red <0|1[,...]>         All frames marked red from the start\n");
+	printf(" --dmac <xx:xx:xx:xx:xx:xx>     Only meter frames to this MAC\n");
+	printf(" --vid <vid>                    Only meter frames of this VLAN\n");
+	printf(" --rate <kbit/s>                Generate frames at this average rate\n");
+	printf(" --line <kbit/s>                Line rate of bursts (default 1000000)\n");
+	printf(" --size <octets>                Generated frame size (default 1500)\n");
+	printf(" --burst <n>                    Generated frames per burst (default 1)\n");
+	printf(" --frames <n>                   Generated frames (default 1000000)\n");
+	printf(" --threads <n>                  Worker threads (default: one per CPU)\n");
+	printf(" --help                         Show this help text\n");
+}
+
+/* Parse a comma separated list of values, up to @max each */
+static int fm_sim_list_parse(const char *arg, struct fm_sim_list *list,
+			     unsigned long max)
+{
+	unsigned long val;
+	char *end;
+
+	list->cnt = 0;
+	do {
+		if (list->cnt == FM_SIM_VALUES)
+			return -1;
+		val = strtoul(arg, &end, 0);
+		if (end == arg || val > max || (*end && *end != ','))
+			return -1;
+		list->val[list->cnt++] = val;
+		arg = end + 1;
+	} while (*end);
+
+	return 0;
+}
+
+static void fm_sim_conf_set(struct mchp_psfp_fm_conf *conf,
+			    enum fm_sim_opt opt, u32 val)
+{
+	switch (opt) {
+	case FM_SIM_CIR:
+		conf->cir = val;
+		break;
+	case FM_SIM_CBS:
+		conf->cbs = val;
+		break;
+	case FM_SIM_EIR:
+		conf->eir = val;
+		break;
+	case FM_SIM_EBS:
+		conf->ebs = val;
+		break;
+	case FM_SIM_CF:
+		conf->cf = val;
+		break;
+	case FM_SIM_DROP_ON_YELLOW:
+		conf->drop_on_yellow = val;
+		break;
+	case FM_SIM_MARK_RED_ENABLE:
+		conf->mark_red_enable = val;
+		break;
+	case FM_SIM_MARK_RED:
+		conf->mark_red = val;
+		break;
+	default:
+		break;
+	}
+}
+
+/* One meter per combination of the option values, the last option
+ * changing fastest.
+ */
+static int fm_sim_grid_init(struct fm_sim *sim,
+			    const struct fm_sim_list *lists)
+{
+	struct mchp_psfp_fm_conf *conf;
+	unsigned int i, rest;
+	u64 cnt = 1;
+	int opt;
+
+	for (opt = 0; opt < FM_SIM_OPTS; opt++)
+		cnt *= lists[opt].cnt;
+	if (cnt > FM_SIM_METERS) {
+		fprintf(stderr, "%" PRIu64 " meters, more than %d!\n", cnt,
+			FM_SIM_METERS);
+		return -1;
+	}
+
+	sim->conf = calloc(cnt, sizeof(*sim->conf));
+	if (!sim->conf) {
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+	sim->nconf = cnt;
+
+	for (i = 0; i < sim->nconf; i++) {
+		conf = &sim->conf[i];
+		conf->enable = true;
+		for (rest = i, opt = FM_SIM_OPTS - 1; opt >= 0; opt--) {
+			fm_sim_conf_set(conf, opt,
+					lists[opt].val[rest % lists[opt].cnt]);
+			rest /= lists[opt].cnt;
+		}
+	}
+
+	return 0;
+}
+
+static int fm_sim_trace_add(struct fm_sim_trace *t, u64 ts_ns, u32 len)
+{
+	size_t size;
+	u64 *ts;
+	u32 *l;
+
+	if (t->cnt == t->size) {
+		size = t->size ? t->size * 2 : 65536;
+		ts = realloc(t->ts_ns, size * sizeof(*ts));
+		if (!ts)
+			return -1;
+		t->ts_ns = ts;
+		l = realloc(t->len, size * sizeof(*l));
+		if (!l)
+			return -1;
+		t->len = l;
+		t->size = size;
+	}
+
+	t->ts_ns[t->cnt] = ts_ns;
+	t->len[t->cnt++] = len;
+	t->octets += len;
+
+	return 0;
+}
+
+static u16 fm_sim_be16(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+/* Outer VID of an Ethernet frame, FM_SIM_NO_VID if untagged */
+static u16 fm_sim_vid(const struct pcap_pkt *pkt)
+{
+	const u8 *p = pkt->data + 12;
+	u16 type;
+
+	if (pkt->caplen < 18)
+		return FM_SIM_NO_VID;
+
+	type = fm_sim_be16(p);
+	if (type != ETH_P_8021Q && type != ETH_P_8021AD)
+		return FM_SIM_NO_VID;
+
+	return fm_sim_be16(p + 2) & 0xfff;
+}
+
+/* Extract the frames to @dmac, if given, and VLAN @vid, unless it is
+ * FM_SIM_NO_VID. Frames are metered by their length on the wire.
+ */
+static int fm_sim_extract(struct fm_sim *sim, const struct pcap_file *f,
+			  const u8 *dmac, u16 vid)
+{
+	size_t cursor = PCAP_CURSOR_START;
+	struct pcap_pkt pkt;
+	int rc;
+
+	while ((rc = pcap_next(f, &cursor, &pkt)) > 0) {
+		if (pkt.caplen < 14)
+			continue;
+		if (dmac && memcmp(pkt.data, dmac, 6))
+			continue;
+		if (vid != FM_SIM_NO_VID && fm_sim_vid(&pkt) != vid)
+			continue;
+		if (fm_sim_trace_add(&sim->trace, pkt.ts_ns, pkt.len) < 0) {
+			fprintf(stderr, "Out of memory!\n");
+			return -1;
+		}
+	}
+
+	if (rc < 0)
+		fprintf(stderr, "%s: Truncated, stopping at offset %zu\n",
+			f->name, cursor);
+
+	return 0;
+}
+
+/* Bursts start at the average rate, their frames follow each other at the
+ * line rate.
+ */
+static int fm_sim_generate(struct fm_sim *sim, const struct fm_sim_gen *g)
+{
+	double period, gap;
+	u64 i;
+
+	/* kbit/s is bits per ms, ns per octet 8e6 / rate */
+	period = 8000000.0 * g->size * g->burst / g->rate;
+	gap = 8000000.0 * (g->size + FM_SIM_IFG) / g->line;
+	if (gap * g->burst > period) {
+		fprintf(stderr, "Bursts at %u kbit/s do not fit in a line of %u kbit/s!\n",
+			g->rate, g->line);
+		return -1;
+	}
+
+	for (i = 0; i < g->frames; i++) {
+		if (fm_sim_trace_add(&sim->trace,
+				     (u64)((i / g->burst) * period +
+					   (i % g->burst) * gap),
+				     g->size) < 0) {
+			fprintf(stderr, "Out of memory!\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void *fm_sim_worker(void *data)
+{
+	struct fm_sim_worker *w = data;
+	struct fm_sim *sim = w->sim;
+
+	w->rc = psfp_meter_set_init(&w->m, sim->conf + w->lo, w->hi - w->lo);
+	if (w->rc < 0)
+		return NULL;
+
+	psfp_meter_set_run(&w->m, sim->trace.ts_ns, sim->trace.len,
+			   sim->trace.cnt);
+
+	return NULL;
+}
+
+/* Split the meters into slices of equal size, one per worker */
+static void fm_sim_split(struct fm_sim *sim, unsigned int nthreads)
+{
+	unsigned int slice, i;
+
+	slice = (sim->nconf + nthreads - 1) / nthreads;
+	slice = (slice + FM_SIM_SLICE - 1) / FM_SIM_SLICE * FM_SIM_SLICE;
+	sim->nworkers = (sim->nconf + slice - 1) / slice;
+
+	for (i = 0; i < sim->nworkers; i++) {
+		sim->workers[i].lo = i * slice;
+		sim->workers[i].hi = i * slice + slice > sim->nconf ?
+				     sim->nconf : i * slice + slice;
+	}
+}
+
+static void fm_sim_run(struct fm_sim *sim, pthread_t *threads)
+{
+	unsigned int i, started;
+
+	for (i = 0; i < sim->nworkers; i++) {
+		sim->workers[i].sim = sim;
+		sim->workers[i].id = i;
+	}
+
+	for (started = 0; started < sim->nworkers; started++)
+		if (pthread_create(&threads[started], NULL, fm_sim_worker,
+				   &sim->workers[started]))
+			break;
+
+	for (i = started; i < sim->nworkers; i++)
+		fm_sim_worker(&sim->workers[i]);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/* Time since the first frame, ms */
+static void fm_sim_print_time(const struct fm_sim *sim, u64 ts_ns)
+{
+	if (ts_ns == PSFP_METER_NEVER)
+		printf(" %12s", "-");
+	else
+		printf(" %12.3f", (ts_ns - sim->trace.ts_ns[0]) / 1000000.0);
+}
+
+static void fm_sim_report(const struct fm_sim *sim)
+{
+	const struct mchp_psfp_fm_conf *conf;
+	const struct psfp_meter_set *m;
+	unsigned int i, j, c;
+
+	printf("%10s %8s %10s %8s %2s %3s %3s %2s %12s %12s %12s %16s %16s %16s %12s %12s %12s\n",
+	       "cir", "cbs", "eir", "ebs", "cf", "doy", "mre", "mr",
+	       "Green", "Yellow", "Red", "GreenOctets", "YellowOctets",
+	       "RedOctets", "Dropped", "FirstDrop", "MarkRed");
+
+	for (i = 0; i < sim->nworkers; i++) {
+		m = &sim->workers[i].m;
+		for (j = 0; j < m->cnt; j++) {
+			conf = &sim->conf[sim->workers[i].lo + j];
+			printf("%10u %8u %10u %8u %2u %3u %3u %2u",
+			       conf->cir, conf->cbs, conf->eir, conf->ebs,
+			       conf->cf, conf->drop_on_yellow,
+			       conf->mark_red_enable, conf->mark_red);
+			for (c = 0; c < PSFP_METER_COLORS; c++)
+				printf(" %12" PRIu64, m->frames[c][j]);
+			for (c = 0; c < PSFP_METER_COLORS; c++)
+				printf(" %16" PRIu64, m->octets[c][j]);
+			printf(" %12" PRIu64, m->dropped[j]);
+			fm_sim_print_time(sim, m->first_drop_ns[j]);
+			fm_sim_print_time(sim, m->mark_red_ns[j]);
+			printf("\n");
+		}
+	}
+}
+
+static long fm_sim_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fm_sim_list lists[FM_SIM_OPTS] = {
+		[0 ... FM_SIM_OPTS - 1] = { .cnt = 1 },
+	};
+	struct fm_sim_gen gen = {
+		.line = 1000000,
+		.size = 1500,
+		.burst = 1,
+		.frames = 1000000,
+	};
+	u8 dmac[6], *filter = NULL;
+	struct pcap_file file;
+	struct fm_sim sim = {};
+	pthread_t *threads;
+	long nthreads = 0;
+	u16 vid = FM_SIM_NO_VID;
+	unsigned int i;
+	int ch, rc = 0;
+	long start, ms;
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:g:i:j:k:l:m:n:o:p:q:h",
+				 long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+		case 'b':
+		case 'c':
+		case 'd':
+			if (fm_sim_list_parse(optarg, &lists[ch - 'a'],
+					      UINT32_MAX) < 0)
+				goto err_list;
+			break;
+		case 'e':
+		case 'f':
+		case 'g':
+			if (fm_sim_list_parse(optarg, &lists[ch - 'a'], 1) < 0)
+				goto err_list;
+			break;
+		case 'i':
+			if (fm_sim_list_parse(optarg, &lists[FM_SIM_MARK_RED],
+					      1) < 0)
+				goto err_list;
+			break;
+		case 'j':
+			if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+				   &dmac[0], &dmac[1], &dmac[2], &dmac[3],
+				   &dmac[4], &dmac[5]) != 6) {
+				fprintf(stderr, "Invalid MAC address [%s]!\n",
+					optarg);
+				return 1;
+			}
+			filter = dmac;
+			break;
+		case 'k':
+			vid = atoi(optarg) & 0xfff;
+			break;
+		case 'l':
+			gen.rate = atoi(optarg);
+			break;
+		case 'm':
+			gen.line = atoi(optarg);
+			break;
+		case 'n':
+			gen.size = atoi(optarg);
+			break;
+		case 'o':
+			gen.burst = atoi(optarg);
+			break;
+		case 'p':
+			gen.frames = strtoull(optarg, NULL, 0);
+			break;
+		case 'q':
+			nthreads = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			help();
+			return 0;
+		}
+	}
+
+	if (argc - optind > 1 || (optind == argc) == !gen.rate) {
+		help();
+		return 1;
+	}
+
+	if (!gen.line || !gen.size || !gen.burst) {
+		fprintf(stderr, "Line rate, size and burst must not be 0!\n");
+		return 1;
+	}
+
+	if (fm_sim_grid_init(&sim, lists) < 0)
+		return 1;
+
+	if (optind < argc) {
+		if (pcap_open(&file, argv[optind]) < 0)
+			return 1;
+		if (file.linktype != PCAP_LINKTYPE_ETHERNET) {
+			fprintf(stderr, "%s: Not an Ethernet capture!\n",
+				argv[optind]);
+			return 1;
+		}
+		rc = fm_sim_extract(&sim, &file, filter, vid);
+		pcap_close(&file);
+	} else {
+		rc = fm_sim_generate(&sim, &gen);
+	}
+	if (rc < 0)
+		return 1;
+
+	if (!sim.trace.cnt) {
+		fprintf(stderr, "No frames to meter!\n");
+		return 1;
+	}
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (nthreads > FM_SIM_THREADS)
+		nthreads = FM_SIM_THREADS;
+
+	sim.workers = calloc(nthreads, sizeof(*sim.workers));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!sim.workers || !threads) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+	fm_sim_split(&sim, nthreads);
+
+	start = fm_sim_now_ms();
+	fm_sim_run(&sim, threads);
+	ms = fm_sim_now_ms() - start;
+
+	for (i = 0; i < sim.nworkers; i++)
+		if (sim.workers[i].rc < 0)
+			rc = -1;
+	if (rc < 0) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	fm_sim_report(&sim);
+	printf("%zu frames, %" PRIu64 " octets, %u meters in %ld ms, %u threads, %.1f M frames/s\n",
+	       sim.trace.cnt, sim.trace.octets, sim.nconf, ms, sim.nworkers,
+	       (double)sim.trace.cnt * sim.nconf / (ms ? ms : 1) / 1000);
+
+	for (i = 0; i < sim.nworkers; i++)
+		psfp_meter_set_free(&sim.workers[i].m);
+
+	return 0;
+
+err_list:
+	fprintf(stderr, "Invalid list [%s]!\n", optarg);
+	return 1;
+}
@@ -4,7 +4,9 @@
  */
 
 #include "common.h"
+#include "pool.h"
 #include <getopt.h>
+#include <errno.h>
 #include <net/if.h>
 #include "kernel_types.h"
 #include "mchp_ui_qos.h"
@@ -16,6 +18,23 @@ static struct nla_policy mchp_qos_fp_port_genl_policy[MCHP_QOS_FP_PORT_ATTR_END]
 	[MCHP_QOS_FP_PORT_ATTR_IDX] = { .type = NLA_U32 },
 };
 
+#define MCHP_FP_NETLINK "mchp_netlink"
+
+static struct mchp_genl_pool fp_pool =
+	MCHP_GENL_POOL_INIT(MCHP_FP_NETLINK, 1);
+
+/* A port named in the --dev list */
+struct fp_port {
+	char name[IF_NAMESIZE];
+	uint32_t ifindex;
+	struct mchp_qos_fp_port_conf config;
+	struct mchp_qos_fp_port_conf tmp;
+	struct mchp_qos_fp_port_status status;
+	bool valid;
+	bool set;
+	int rc;
+};
+
 /* From here here there can be changes */
 static char *get_status_verify(enum mchp_mm_status_verify status)
 {
@@ -46,9 +65,9 @@ static struct option long_options[] =
 	{NULL, 0, NULL, 0}
 };
 
-static int mchp_qos_fp_port_read_conf(struct nl_msg *msg, void *arg)
+static int mchp_qos_fp_port_read_conf(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_qos_fp_port_conf *conf = arg;
 	struct nlattr *attrs[MCHP_QOS_FP_PORT_ATTR_END];
 
@@ -69,9 +88,9 @@ static int mchp_qos_fp_port_read_conf(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_qos_fp_port_read_status(struct nl_msg *msg, void *arg)
+static int mchp_qos_fp_port_read_status(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_qos_fp_port_status *status = arg;
 	struct nlattr *attrs[MCHP_QOS_FP_PORT_ATTR_END];
 
@@ -95,7 +114,7 @@ static int mchp_qos_fp_port_read_status(struct nl_msg *msg, void *arg)
 void mchp_help(void)
 {
 	printf("options:\n"
-		"--dev:                    dev name\n"
+		"--dev:                    dev name or list, e.g. swp1,swp[2-24]\n"
 		"--admin_status:           admin status\n"
 		"--enable_tx:              enable tx\n"
 		"--verify_disable_tx:      verify disable tx\n"
@@ -105,133 +124,176 @@ void mchp_help(void)
 		"--help:                   help\n");
 }
 
-void mchp_conf_set(uint32_t index, struct mchp_qos_fp_port_conf *config)
+/* The requests below are queued on the session of a pool worker, which
+ * flushes them and reports the result in @err.
+ */
+static int mchp_conf_set(struct mchp_genl_session *s, uint32_t index,
+			 struct mchp_qos_fp_port_conf *config, int *err)
 {
-	struct nl_sock *sk;
 	struct nl_msg *msg;
-	int rc;
-
-	rc = mchp_genl_start("mchp_netlink",
-				MCHP_QOS_FP_PORT_GENL_CONF_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return;
 
+	msg = mchp_genl_req(s, MCHP_QOS_FP_PORT_GENL_CONF_SET, NULL, NULL,
+			    err);
+	if (!msg)
+		return -1;
 
 	NLA_PUT(msg, MCHP_QOS_FP_PORT_ATTR_CONF, sizeof(*config), config);
 	NLA_PUT_U32(msg, MCHP_QOS_FP_PORT_ATTR_IDX, index);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
+	return 0;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-void mchp_conf_get(uint32_t index, struct mchp_qos_fp_port_conf *config)
+static int mchp_conf_get(struct mchp_genl_session *s, uint32_t index,
+			 struct mchp_qos_fp_port_conf *config, int *err)
 {
-	struct mchp_qos_fp_port_conf tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
-	int rc;
 
-	rc = mchp_genl_start("mchp_netlink",
-				MCHP_QOS_FP_PORT_GENL_CONF_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_qos_fp_port_read_conf, &tmp);
+	msg = mchp_genl_req(s, MCHP_QOS_FP_PORT_GENL_CONF_GET,
+			    mchp_qos_fp_port_read_conf, config, err);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_QOS_FP_PORT_ATTR_IDX, index);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
+	return 0;
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
 
-	memcpy(config, &tmp, sizeof(tmp));
+static int mchp_status_get(struct mchp_genl_session *s, uint32_t index,
+			   struct mchp_qos_fp_port_status *status, int *err)
+{
+	struct nl_msg *msg;
+
+	msg = mchp_genl_req(s, MCHP_QOS_FP_PORT_GENL_STATUS_GET,
+			    mchp_qos_fp_port_read_status, status, err);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_QOS_FP_PORT_ATTR_IDX, index);
+
+	return 0;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-void mchp_status_get(uint32_t index)
+static void fp_status_work(struct mchp_genl_session *s, unsigned int idx,
+			   void *arg)
 {
-	struct mchp_qos_fp_port_status status;
-	char ifname[IF_NAMESIZE];
-	struct nl_sock *sk;
-	struct nl_msg *msg;
+	struct fp_port *port = (struct fp_port *)arg + idx;
 	int rc;
 
-	memset(&status, 0x0, sizeof(status));
-	memset(ifname, 0, IF_NAMESIZE);
+	rc = mchp_status_get(s, port->ifindex, &port->status, &port->rc);
+	if (rc < 0)
+		port->rc = rc;
+}
 
-	rc = mchp_genl_start("mchp_netlink",
-				MCHP_QOS_FP_PORT_GENL_STATUS_GET, 1, &sk, &msg);
+static void fp_conf_get_work(struct mchp_genl_session *s, unsigned int idx,
+			     void *arg)
+{
+	struct fp_port *port = (struct fp_port *)arg + idx;
+	int rc;
+
+	rc = mchp_conf_get(s, port->ifindex, &port->config, &port->rc);
 	if (rc < 0)
+		port->rc = rc;
+}
+
+static void fp_conf_set_work(struct mchp_genl_session *s, unsigned int idx,
+			     void *arg)
+{
+	struct fp_port *port = (struct fp_port *)arg + idx;
+	int rc;
+
+	if (!port->set)
 		return;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_qos_fp_port_read_status, &status);
+	rc = mchp_conf_set(s, port->ifindex, &port->config, &port->rc);
+	if (rc < 0)
+		port->rc = rc;
+}
 
-	NLA_PUT_U32(msg, MCHP_QOS_FP_PORT_ATTR_IDX, index);
+static void fp_port_error(const struct fp_port *port)
+{
+	printf("%s: mchp_genl_flush() failed, rc: %d (%s)\n", port->name,
+	       port->rc, nl_geterror(port->rc));
+}
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
+static void fp_status_show(const struct fp_port *port)
+{
+	printf("dev: %s\n", port->name);
+	printf("hold_advance: %u\n", port->status.hold_advance);
+	printf("release_advance: %u\n", port->status.release_advance);
+	printf("preemption_active: %u\n", port->status.preemption_active);
+	printf("hold_request: %u\n", port->status.hold_request);
+	printf("status_verify: %s\n", get_status_verify(port->status.status_verify));
+}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
+static void fp_conf_show(const struct fp_port *port, int cnt)
+{
+	const struct mchp_qos_fp_port_conf *config = &port->config;
+
+	if (cnt > 1)
+		printf("dev: %s\n", port->name);
+	printf("admin_status: 0x%x\n", config->admin_status);
+	printf("enable_tx: %u\n", config->enable_tx);
+	printf("verify_disable_tx: %u\n", config->verify_disable_tx);
+	printf("verify_time: %u\n", config->verify_time);
+	printf("add_frag_size: %u\n", config->add_frag_size);
+}
 
-	printf("dev: %s\n", if_indextoname(index, ifname));
-	printf("hold_advance: %u\n", status.hold_advance);
-	printf("release_advance: %u\n", status.release_advance);
-	printf("preemption_active: %u\n", status.preemption_active);
-	printf("hold_request: %u\n", status.hold_request);
-	printf("status_verify: %s\n", get_status_verify(status.status_verify));
+static void fp_conf_opts(int argc, char *argv[],
+			 struct mchp_qos_fp_port_conf *config)
+{
+	int ch;
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	/* Rescan the options for every port */
+	optind = 0;
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:gh", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'b':
+			sscanf(optarg, "0x%hhx", &config->admin_status);
+			break;
+		case 'c':
+			config->enable_tx = atoi(optarg);
+			break;
+		case 'd':
+			config->verify_disable_tx = atoi(optarg);
+			break;
+		case 'e':
+			config->verify_time = atoi(optarg);
+			break;
+		case 'f':
+			config->add_frag_size = atoi(optarg);
+			break;
+		}
+	}
 }
 
 int main(int argc, char *argv[])
 {
-	struct mchp_qos_fp_port_conf config = {};
-	struct mchp_qos_fp_port_conf tmp = {};
-	uint32_t ifindex;
-	int rc, ch;
+	static struct fp_port ports[MCHP_DEV_LIST_MAX];
+	char names[MCHP_DEV_LIST_MAX][IF_NAMESIZE];
+	const char *dev = NULL;
+	struct fp_port *port;
+	int cnt = 0, i;
+	int ch;
+	int failed = 0;
 	int status = 0;
 	int help = 0;
 
-	memset(&config, 0, sizeof(config));
-
 	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:gh", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			ifindex = if_nametoindex(optarg);
+			dev = optarg;
 			break;
 		case 'g':
 			status = 1;
@@ -241,54 +303,77 @@ int main(int argc, char *argv[])
 			break;
 		}
 	}
-	optind = 1;
 
 	if (help) {
 		mchp_help();
 		return 0;
 	}
 
-	if (status) {
-		if (ifindex != 0)
-			mchp_status_get(ifindex);
-		else
-			printf("dev is not set\n");
+	if (!dev) {
+		printf("dev is not set\n");
 		return 0;
 	}
 
-	mchp_conf_get(ifindex, &config);
-	memcpy(&tmp, &config, sizeof(config));
+	cnt = mchp_dev_list_parse(dev, names, MCHP_DEV_LIST_MAX);
+	if (cnt < 0)
+		return 1;
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		strcpy(port->name, names[i]);
+		port->ifindex = if_nametoindex(port->name);
+		if (port->ifindex == 0) {
+			fprintf(stderr, "%s: %s!\n", port->name, strerror(errno));
+			return 1;
+		}
+	}
 
-	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:gh", long_options, NULL)) != -1) {
-		switch (ch) {
-		case 'b':
-			sscanf(optarg, "0x%hhx", &config.admin_status);
-			break;
-		case 'c':
-			config.enable_tx = atoi(optarg);
-			break;
-		case 'd':
-			config.verify_disable_tx = atoi(optarg);
-			break;
-		case 'e':
-			config.verify_time = atoi(optarg);
-			break;
-		case 'f':
-			config.add_frag_size = atoi(optarg);
-			break;
+	if (status) {
+		mchp_genl_pool_run(&fp_pool, cnt, fp_status_work, ports);
+		for (i = 0; i < cnt; i++) {
+			if (ports[i].rc < 0) {
+				fp_port_error(&ports[i]);
+				failed = 1;
+			} else {
+				fp_status_show(&ports[i]);
+			}
 		}
+		mchp_genl_pool_close(&fp_pool);
+		return failed;
 	}
 
-	if (memcmp(&tmp, &config, sizeof(config)) == 0) {
-		printf("admin_status: 0x%x\n", config.admin_status);
-		printf("enable_tx: %u\n", config.enable_tx);
-		printf("verify_disable_tx: %u\n", config.verify_disable_tx);
-		printf("verify_time: %u\n", config.verify_time);
-		printf("add_frag_size: %u\n", config.add_frag_size);
-		return 0;
+	mchp_genl_pool_run(&fp_pool, cnt, fp_conf_get_work, ports);
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (port->rc < 0) {
+			fp_port_error(port);
+			failed = 1;
+			continue;
+		}
+		port->valid = true;
+
+		memcpy(&port->tmp, &port->config, sizeof(port->config));
+		fp_conf_opts(argc, argv, &port->config);
+		port->set = memcmp(&port->tmp, &port->config,
+				   sizeof(port->config)) != 0;
 	}
 
-	mchp_conf_set(ifindex, &config);
+	mchp_genl_pool_run(&fp_pool, cnt, fp_conf_set_work, ports);
 
-	return 0;
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (!port->valid)
+			continue;
+
+		if (!port->set)
+			fp_conf_show(port, cnt);
+		else if (port->rc < 0) {
+			fp_port_error(port);
+			failed = 1;
+		}
+	}
+	mchp_genl_pool_close(&fp_pool);
+
+	return failed;
 }
@@ -6,6 +6,11 @@
 #include "common.h"
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <net/if.h>
 #include "kernel_types.h"
 #include "mchp_ui_qos.h"
@@ -32,44 +37,39 @@ static struct nla_policy mchp_frer_genl_policy[MCHP_FRER_ATTR_END] = {
 	[MCHP_FRER_ATTR_VLAN_CFG] = { .type = NLA_BINARY },
 };
 
+static struct mchp_genl_session frer_session =
+	MCHP_GENL_SESSION_INIT(MCHP_FRER_NETLINK, 1);
+
 /* cmd_cs */
-static int mchp_frer_genl_cs_cfg_set(u32 cs_id,
-					const struct mchp_frer_stream_cfg *cfg)
+static int mchp_frer_genl_cs_cfg_set(struct mchp_genl_session *s, u32 cs_id,
+				     const struct mchp_frer_stream_cfg *cfg)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_CS_CFG_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_CS_CFG_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
 	NLA_PUT(msg, MCHP_FRER_ATTR_STREAM_CFG, sizeof(*cfg), cfg);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_frer_genl_cs_cfg_get_cb(struct nl_msg *msg, void *arg)
+static int mchp_frer_genl_cs_cfg_get_cb(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct nlattr *attrs[MCHP_FRER_ATTR_END];
 	struct mchp_frer_stream_cfg *cfg = arg;
 
@@ -90,50 +90,35 @@ static int mchp_frer_genl_cs_cfg_get_cb(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_frer_genl_cs_cfg_get(u32 cs_id,
-					struct mchp_frer_stream_cfg *cfg)
+static int mchp_frer_genl_cs_cfg_get(struct mchp_genl_session *s, u32 cs_id,
+				     struct mchp_frer_stream_cfg *cfg)
 {
 	RETURN_IF_PC;
-	struct mchp_frer_stream_cfg tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_CS_CFG_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_cs_cfg_get_cb, &tmp);
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_CS_CFG_GET,
+			    mchp_frer_genl_cs_cfg_get_cb, cfg, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(cfg, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_frer_genl_cs_cnt_get_cb(struct nl_msg *msg, void *arg)
+static int mchp_frer_genl_cs_cnt_get_cb(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct nlattr *attrs[MCHP_FRER_ATTR_END];
 	struct mchp_frer_cnt *cnt = arg;
 
@@ -154,191 +139,131 @@ static int mchp_frer_genl_cs_cnt_get_cb(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_frer_genl_cs_cnt_get(u32 cs_id, struct mchp_frer_cnt *cnt)
+/* With @clr the counters are cleared after being read, both requests
+ * sent in one round trip. They are still two kernel calls, so packets
+ * counted in between are lost; frer_cnt_delta() gives exact deltas.
+ * Neither request is replayed, as a replayed read would see the cleared
+ * counters.
+ */
+static int mchp_frer_genl_cs_cnt_get(struct mchp_genl_session *s, u32 cs_id,
+				     struct mchp_frer_cnt *cnt, bool clr)
 {
 	RETURN_IF_PC;
-	struct mchp_frer_cnt tmp;
-	struct nl_sock *sk;
+	unsigned long mark = mchp_genl_req_mark(s);
+	int flags = NLM_F_REQUEST | NLM_F_ACK;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_CS_CNT_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	if (clr)
+		flags |= MCHP_GENL_F_NO_REPLAY;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_cs_cnt_get_cb, &tmp);
+	msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_CS_CNT_GET, flags,
+				    MCHP_GENL_MSG_SMALL_SIZE,
+				    mchp_frer_genl_cs_cnt_get_cb, cnt, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	if (clr) {
+		msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_CS_CNT_CLR, flags,
+					    MCHP_GENL_MSG_SMALL_SIZE,
+					    NULL, NULL, NULL);
+		if (!msg) {
+			mchp_genl_req_abort_to(s, mark);
+			return -1;
+		}
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
 	}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(cnt, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort_to(s, mark);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_frer_genl_cs_cnt_clr(u32 cs_id)
+static int mchp_frer_genl_cs_cnt_clr(struct mchp_genl_session *s, u32 cs_id)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_CS_CNT_CLR, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_CS_CNT_CLR, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
-}
 
-static char *mchp_frer_cs_help(void)
-{
-	return "--enable:                 Enable recovery\n"
-		" --alg:                    frerSeqRcvyAlgorithm (0: Vector, 1: Match)\n"
-		" --hlen:                   frerSeqRcvyHistoryLength\n"
-		" --reset_time:             frerSeqRcvyResetMSec\n"
-		" --take_no_seq:            frerSeqRcvyTakeNoSequence\n"
-		" --cnt:                    Show counters\n"
-		" --clr:                    Clear counters\n"
-		" --help:                   Show this help text\n";
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int cmd_cs(const struct command *cmd, int argc, char *const *argv)
-{
-	static struct option long_options[] =
-	{
-		{"enable", required_argument, NULL, 'a'},
-		{"alg", required_argument, NULL, 'b'},
-		{"hlen", required_argument, NULL, 'c'},
-		{"reset_time", required_argument, NULL, 'd'},
-		{"take_no_seq", required_argument, NULL, 'e'},
-		{"cnt", no_argument, NULL, 'f'},
-		{"clr", no_argument, NULL, 'g'},
-		{"help", no_argument, NULL, 'h'},
-		{NULL, 0, NULL, 0}
-	};
-	struct mchp_frer_stream_cfg cfg = {};
-	struct mchp_frer_stream_cfg tmp;
-	struct mchp_frer_cnt cnt = {};
-	int do_help = 0;
-	int do_cnt = 0;
-	int do_clr = 0;
-	u32 cs_id = 0;
-	int ch, rc;
-
-	/* read the id */
-	cs_id = atoi(argv[0]);
-
-	if (mchp_frer_genl_cs_cfg_get(cs_id, &cfg) < 0)
-		return 0;
+/* Listing of all configured entries, using NLM_F_DUMP */
+struct frer_entry {
+	u32 id;
+	u32 ifindex1;
+	u32 ifindex2;
+	struct mchp_frer_stream_cfg stream;
+	struct mchp_iflow_cfg iflow;
+	struct mchp_frer_cnt cnt;
+	int cfg_rc;
+	int cnt_rc;
+	int clr_rc;
+};
 
-	memcpy(&tmp, &cfg, sizeof(cfg));
+struct frer_dump {
+	struct frer_entry *entries;
+	unsigned int cnt;
+	unsigned int size;
+};
 
-	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:fgh", long_options, NULL)) != -1) {
-		switch (ch) {
-		case 'a':
-			cfg.enable = !!atoi(optarg);
-			break;
-		case 'b':
-			cfg.alg = !!atoi(optarg);
-			break;
-		case 'c':
-			cfg.hlen = atoi(optarg);
-			break;
-		case 'd':
-			cfg.reset_time = atoi(optarg);
-			break;
-		case 'e':
-			cfg.take_no_seq = !!atoi(optarg);
-			break;
-		case 'f':
-			do_cnt = 1;
-			break;
-		case 'g':
-			do_clr = 1;
-			break;
-		case 'h':
-		case '?':
-			do_help = 1;
-			break;
-		}
-	}
+/* The entry array of the largest dump done so far, handed to the next dump
+ * once freed. A batch, or a monitor dumping every interval, then only
+ * allocates when a dump holds more entries than any before it.
+ */
+static struct frer_dump frer_dump_spare;
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+static int frer_dump_grow(struct frer_dump *d)
+{
+	struct frer_entry *e;
 
-	if (do_cnt) {
-		rc = mchp_frer_genl_cs_cnt_get(cs_id, &cnt);
-		if (rc == 0) {
-			printf("%-18s: %16" PRIu64 "\n", "OutOfOrderPackets", cnt.out_of_order_packets);
-			printf("%-18s: %16" PRIu64 "\n", "RoguePackets", cnt.rogue_packets);
-			printf("%-18s: %16" PRIu64 "\n", "PassedPackets", cnt.passed_packets);
-			printf("%-18s: %16" PRIu64 "\n", "DiscardedPackets", cnt.discarded_packets);
-			printf("%-18s: %16" PRIu64 "\n", "LostPackets", cnt.lost_packets);
-			printf("%-18s: %16" PRIu64 "\n", "TaglessPackets", cnt.tagless_packets);
-			printf("%-18s: %16" PRIu64 "\n", "Resets", cnt.resets);
-		}
-		return rc;
+	if (!d->entries && frer_dump_spare.entries) {
+		*d = frer_dump_spare;
+		memset(&frer_dump_spare, 0, sizeof(frer_dump_spare));
+		if (d->cnt < d->size)
+			return 0;
 	}
 
-	if (do_clr)
-		return mchp_frer_genl_cs_cnt_clr(cs_id);
-
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("%-14s %8d\n", "enable:", cfg.enable);
-		printf("%-14s %8d\n", "alg:", cfg.alg);
-		printf("%-14s %8u\n", "hlen:", cfg.hlen);
-		printf("%-14s %8u\n", "reset_time:", cfg.reset_time);
-		printf("%-14s %8d\n", "take_no_seq:", cfg.take_no_seq);
-		return 0;
-	}
+	e = realloc(d->entries, (d->size + 256) * sizeof(*e));
+	if (!e)
+		return -NLE_NOMEM;
+	d->entries = e;
+	d->size += 256;
 
-	return mchp_frer_genl_cs_cfg_set(cs_id, &cfg);
+	return 0;
 }
 
-/* cmd_msa */
-static int mchp_frer_genl_ms_alloc_cb(struct nl_msg *msg, void *arg)
+static int mchp_frer_genl_dump_cb(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct nlattr *attrs[MCHP_FRER_ATTR_END];
-	u32 *id = arg;
+	struct frer_dump *d = arg;
+	struct frer_entry *e;
 
 	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
 		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
@@ -351,390 +276,754 @@ static int mchp_frer_genl_ms_alloc_cb(struct nl_msg *msg, void *arg)
 		return -1;
 	}
 
-	*id = nla_get_u32(attrs[MCHP_FRER_ATTR_ID]);
+	if (d->cnt == d->size && frer_dump_grow(d) < 0)
+		return -NLE_NOMEM;
+
+	e = &d->entries[d->cnt++];
+	memset(e, 0, sizeof(*e));
+	e->id = nla_get_u32(attrs[MCHP_FRER_ATTR_ID]);
+	if (attrs[MCHP_FRER_ATTR_DEV1])
+		e->ifindex1 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV1]);
+	if (attrs[MCHP_FRER_ATTR_DEV2])
+		e->ifindex2 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV2]);
+	if (attrs[MCHP_FRER_ATTR_STREAM_CFG])
+		nla_memcpy(&e->stream, attrs[MCHP_FRER_ATTR_STREAM_CFG],
+			   sizeof(e->stream));
+	if (attrs[MCHP_FRER_ATTR_IFLOW_CFG])
+		nla_memcpy(&e->iflow, attrs[MCHP_FRER_ATTR_IFLOW_CFG],
+			   sizeof(e->iflow));
+	if (attrs[MCHP_FRER_ATTR_STREAM_CNT])
+		nla_memcpy(&e->cnt, attrs[MCHP_FRER_ATTR_STREAM_CNT],
+			   sizeof(e->cnt));
 
 	return NL_OK;
 }
 
-static int mchp_frer_genl_ms_alloc(u32 ifindex1, u32 ifindex2, u32 *ms_id)
+static int frer_entry_cmp(const void *a, const void *b)
 {
-	RETURN_IF_PC;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
-	u32 tmp;
+	const struct frer_entry *ea = a, *eb = b;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-			     MCHP_FRER_GENL_MS_ALLOC, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	if (ea->id != eb->id)
+		return ea->id < eb->id ? -1 : 1;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_ms_alloc_cb, &tmp);
+	return 0;
+}
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex1);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, ifindex2);
+/* Member stream IDs are per device */
+static int frer_entry_cmp_dev(const void *a, const void *b)
+{
+	const struct frer_entry *ea = a, *eb = b;
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	if (ea->ifindex1 != eb->ifindex1)
+		return ea->ifindex1 < eb->ifindex1 ? -1 : 1;
+
+	return frer_entry_cmp(a, b);
+}
+
+/* Sort the entries on ID, and member streams on device first. Entries
+ * passed twice because the dump was restarted are dropped.
+ */
+static void frer_dump_sort(struct frer_dump *d, bool ms)
+{
+	int (*cmp)(const void *, const void *);
+	unsigned int i, n = 0;
+
+	cmp = ms ? frer_entry_cmp_dev : frer_entry_cmp;
+	qsort(d->entries, d->cnt, sizeof(*d->entries), cmp);
+	for (i = 0; i < d->cnt; i++) {
+		if (n && cmp(&d->entries[n - 1], &d->entries[i]) == 0)
+			n--;
+		d->entries[n++] = d->entries[i];
 	}
+	d->cnt = n;
+}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
+static void frer_dump_free(struct frer_dump *d)
+{
+	if (d->size > frer_dump_spare.size) {
+		free(frer_dump_spare.entries);
+		frer_dump_spare.entries = d->entries;
+		frer_dump_spare.size = d->size;
+	} else {
+		free(d->entries);
 	}
+	d->entries = NULL;
+	d->cnt = 0;
+	d->size = 0;
+}
 
-	*ms_id = tmp;
+/* IDs read by mchp_frer_genl_probe(), for member streams on every device */
+#define FRER_PROBE_IDS 1024
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+/* Decode a GET reply into the entry it was sent for */
+static int mchp_frer_genl_probe_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	struct frer_entry *e = arg;
 
-	return rc;
-}
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
 
-static char *mchp_frer_msa_help(void)
-{
-	return "--help:                   Show this help text\n";
+	if (attrs[MCHP_FRER_ATTR_DEV1])
+		e->ifindex1 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV1]);
+	if (attrs[MCHP_FRER_ATTR_DEV2])
+		e->ifindex2 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV2]);
+	if (attrs[MCHP_FRER_ATTR_STREAM_CFG])
+		nla_memcpy(&e->stream, attrs[MCHP_FRER_ATTR_STREAM_CFG],
+			   sizeof(e->stream));
+	if (attrs[MCHP_FRER_ATTR_IFLOW_CFG])
+		nla_memcpy(&e->iflow, attrs[MCHP_FRER_ATTR_IFLOW_CFG],
+			   sizeof(e->iflow));
+
+	return NL_OK;
 }
 
-static int cmd_msa(const struct command *cmd, int argc, char *const *argv)
+/* Collect every entry of a GET command on kernels without a dump handler.
+ * Every ID below FRER_PROBE_IDS is read, for member streams on every
+ * device, pipelined in one flush. IDs that cannot be read are left out.
+ */
+static int mchp_frer_genl_probe(struct mchp_genl_session *s, u8 cmd,
+				struct frer_dump *d)
 {
-	static struct option long_options[] =
-	{
-		{"help", no_argument, NULL, 'h'},
-		{NULL, 0, NULL, 0}
-	};
-	u32 ifindex1 = 0;
-	u32 ifindex2 = 0;
-	int do_help = 0;
-	u32 ms_id = 0;
-	int ch, rc;
+	unsigned long mark = mchp_genl_req_mark(s);
+	bool ms = cmd == MCHP_FRER_GENL_MS_CFG_GET;
+	struct if_nameindex *ifs = NULL;
+	unsigned int i, n, ndev = 1;
+	struct frer_entry *e;
+	struct nl_msg *msg;
+	int rc = 0;
 
-	/* read device 1 and skip it */
-	ifindex1 = if_nametoindex(argv[0]);
-	if (ifindex1 == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
+	if (ms) {
+		ifs = if_nameindex();
+		if (!ifs)
+			return -1;
+		for (ndev = 0; ifs[ndev].if_index; ndev++)
+			;
 	}
-	argc--;
-	argv++;
 
-	if (argc) {
-		/* read optional device 2*/
-		ifindex2 = if_nametoindex(argv[0]);
-		if (ifindex2 == 0) {
-			fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-			return 1;
+	n = ndev * FRER_PROBE_IDS;
+	if (d->size < n) {
+		e = realloc(d->entries, n * sizeof(*e));
+		if (!e) {
+			rc = -NLE_NOMEM;
+			goto out;
 		}
+		d->entries = e;
+		d->size = n;
 	}
+	memset(d->entries, 0, n * sizeof(*d->entries));
+
+	for (i = 0; i < n; i++) {
+		e = &d->entries[i];
+		e->id = i % FRER_PROBE_IDS;
+		msg = mchp_genl_get(s, cmd, mchp_frer_genl_probe_cb, e,
+				    &e->cfg_rc);
+		if (!msg) {
+			mchp_genl_req_abort_to(s, mark);
+			rc = -1;
+			goto out;
+		}
 
-	while ((ch = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
-		switch (ch) {
-		case 'h':
-		case '?':
-			do_help = 1;
-			break;
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, e->id);
+		if (ms) {
+			e->ifindex1 = ifs[i / FRER_PROBE_IDS].if_index;
+			NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, e->ifindex1);
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+	/* Most IDs are not in use, so failed reads are expected */
+	mchp_genl_flush(s);
+	for (i = 0, d->cnt = 0; i < n; i++)
+		if (!d->entries[i].cfg_rc)
+			d->entries[d->cnt++] = d->entries[i];
 
-	rc = mchp_frer_genl_ms_alloc(ifindex1, ifindex2, &ms_id);
-	if (rc == 0) {
-		printf("%u\n", ms_id);
-	}
+out:
+	if (ifs)
+		if_freenameindex(ifs);
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort_to(s, mark);
+	rc = -NLE_MSGSIZE;
+	goto out;
 }
 
-/* cmd_msf */
-static int mchp_frer_genl_ms_free(u32 ms_id)
+/* Collect every entry of a GET command with a single dump request, or by
+ * reading every ID on kernels without a dump handler.
+ */
+static int mchp_frer_genl_dump(struct mchp_genl_session *s, u8 cmd,
+			       struct frer_dump *d)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_MS_FREE, 1, &sk, &msg);
-	if (rc < 0)
+	msg = mchp_genl_dump(s, cmd, mchp_frer_genl_dump_cb, d, NULL);
+	if (!msg)
+		return -1;
+
+	rc = mchp_genl_flush(s);
+	if (rc == -NLE_OPNOTSUPP)
+		rc = mchp_frer_genl_probe(s, cmd, d);
+	if (rc < 0) {
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
 		return rc;
+	}
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	frer_dump_sort(d, cmd == MCHP_FRER_GENL_MS_CFG_GET);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	return 0;
+}
+
+/* Read the counters of the listed streams one by one, pipelined in one
+ * flush. Used for ID lists, and for kernels without a counter dump. With
+ * @clr every read is followed by a clear of the same stream, see
+ * mchp_frer_genl_cs_cnt_get(); with @clr only they are just cleared.
+ */
+static int mchp_frer_genl_get_cnt(struct mchp_genl_session *s, bool ms,
+				  bool get, bool clr, struct frer_dump *d)
+{
+	RETURN_IF_PC;
+	unsigned long mark = mchp_genl_req_mark(s);
+	int flags = NLM_F_REQUEST;
+	struct frer_entry *e;
+	struct nl_msg *msg;
+	unsigned int i;
+	int rc = 0;
+
+	if (clr)
+		flags |= MCHP_GENL_F_NO_REPLAY;
+
+	for (i = 0; i < d->cnt; i++) {
+		e = &d->entries[i];
+		if (e->cfg_rc)
+			continue;
+
+		/* Both counter replies carry ATTR_STREAM_CNT */
+		if (get) {
+			msg = mchp_genl_req_reserve(s, ms ?
+						    MCHP_FRER_GENL_MS_CNT_GET :
+						    MCHP_FRER_GENL_CS_CNT_GET,
+						    flags,
+						    MCHP_GENL_MSG_SMALL_SIZE,
+						    mchp_frer_genl_cs_cnt_get_cb,
+						    &e->cnt, &e->cnt_rc);
+			if (!msg)
+				goto err;
+
+			NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, e->id);
+			if (ms)
+				NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1,
+					    e->ifindex1);
+		}
+
+		if (clr) {
+			msg = mchp_genl_req_reserve(s, ms ?
+						    MCHP_FRER_GENL_MS_CNT_CLR :
+						    MCHP_FRER_GENL_CS_CNT_CLR,
+						    flags | NLM_F_ACK,
+						    MCHP_GENL_MSG_SMALL_SIZE,
+						    NULL, NULL, &e->clr_rc);
+			if (!msg)
+				goto err;
+
+			NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, e->id);
+			if (ms)
+				NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1,
+					    e->ifindex1);
+		}
 	}
 
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	/* Counters not cleared give no valid delta on the next read */
+	for (i = 0; i < d->cnt; i++)
+		if (!d->entries[i].cnt_rc)
+			d->entries[i].cnt_rc = d->entries[i].clr_rc;
 
 	return rc;
-}
 
-static char *mchp_frer_msf_help(void)
-{
-	return "--help:                   Show this help text\n";
+err:
+	mchp_genl_req_abort_to(s, mark);
+	return -1;
+
+nla_put_failure:
+	mchp_genl_req_abort_to(s, mark);
+	return -NLE_MSGSIZE;
 }
 
-static int cmd_msf(const struct command *cmd, int argc, char *const *argv)
+/* Read the counters of all listed streams. The counters of every stream
+ * arrive in one multipart reply, decoded into the scratch array c and
+ * merged into the sorted list. c is emptied first and kept by the caller,
+ * so a caller sampling in a loop reuses it.
+ */
+static int mchp_frer_genl_dump_cnt(struct mchp_genl_session *s, u8 cmd,
+				   struct frer_dump *d, struct frer_dump *c)
 {
-	static struct option long_options[] =
-	{
-		{"help", no_argument, NULL, 'h'},
-		{NULL, 0, NULL, 0}
-	};
-	int do_help = 0;
-	u32 ms_id = 0;
-	int ch;
+	RETURN_IF_PC;
+	bool ms = cmd == MCHP_FRER_GENL_MS_CNT_GET;
+	int (*cmp)(const void *, const void *);
+	unsigned int i, j = 0;
+	struct nl_msg *msg;
+	int rc = 0;
 
-	/* read the id */
-	ms_id = atoi(argv[0]);
+	c->cnt = 0;
+	msg = mchp_genl_dump(s, cmd, mchp_frer_genl_dump_cb, c, NULL);
+	if (!msg)
+		return -1;
 
-	while ((ch = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
-		switch (ch) {
-		case 'h':
-		case '?':
-			do_help = 1;
-			break;
-		}
+	rc = mchp_genl_flush(s);
+	if (rc == -NLE_OPNOTSUPP)
+		return mchp_frer_genl_get_cnt(s, ms, true, false, d);
+	if (rc < 0) {
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+		return rc;
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
+	frer_dump_sort(c, ms);
+	cmp = ms ? frer_entry_cmp_dev : frer_entry_cmp;
+	for (i = 0; i < d->cnt; i++) {
+		while (j < c->cnt && cmp(&c->entries[j], &d->entries[i]) < 0)
+			j++;
+
+		if (j < c->cnt && cmp(&c->entries[j], &d->entries[i]) == 0)
+			d->entries[i].cnt = c->entries[j].cnt;
+		else
+			d->entries[i].cnt_rc = -NLE_OBJ_NOTFOUND;
 	}
 
-	return mchp_frer_genl_ms_free(ms_id);
+	return rc;
 }
 
-/* cmd_ms */
-static int mchp_frer_genl_ms_cfg_set(u32 ifindex, u32 ms_id,
-					const struct mchp_frer_stream_cfg *cfg)
+/* Read the configuration of the streams of an ID list, pipelined in one
+ * flush, and then their counters as mchp_frer_genl_get_cnt().
+ */
+static int mchp_frer_genl_get_list(struct mchp_genl_session *s, bool ms,
+				   bool cnt, bool clr, struct frer_dump *d)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
+	struct frer_entry *e;
 	struct nl_msg *msg;
+	unsigned int i;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_MS_CFG_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
-	NLA_PUT(msg, MCHP_FRER_ATTR_STREAM_CFG, sizeof(*cfg), cfg);
-
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	for (i = 0; i < d->cnt; i++) {
+		e = &d->entries[i];
+		/* Both config replies carry ATTR_STREAM_CFG */
+		msg = mchp_genl_get(s, ms ? MCHP_FRER_GENL_MS_CFG_GET :
+				    MCHP_FRER_GENL_CS_CFG_GET,
+				    mchp_frer_genl_cs_cfg_get_cb,
+				    &e->stream, &e->cfg_rc);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, e->id);
+		if (ms)
+			NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, e->ifindex1);
 	}
 
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	/* Streams that do not exist are left out */
+	if (cnt || clr)
+		rc = mchp_frer_genl_get_cnt(s, ms, cnt, clr, d);
 
 	return rc;
-}
 
-static int mchp_frer_genl_ms_cfg_get_cb(struct nl_msg *msg, void *arg)
-{
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
-	struct nlattr *attrs[MCHP_FRER_ATTR_END];
-	struct mchp_frer_stream_cfg *cfg = arg;
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
 
-	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
-		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
-		printf("nla_parse() failed\n");
-		return NL_STOP;
-	}
+/* Counters of the streams last read with --delta, kept under /run between
+ * runs. Nothing is cleared: every read is subtracted from the one before,
+ * so the deltas of a collector add up to exactly what the streams counted.
+ */
+#define FRER_CNT_PREV "/run/mchp_frer_cnt"
+
+struct frer_cnt_prev {
+	u32 ms;
+	u32 ifindex;
+	u32 id;
+	u32 pad;
+	struct mchp_frer_cnt cnt;
+};
 
-	if (!attrs[MCHP_FRER_ATTR_STREAM_CFG]) {
-		printf("ATTR_STREAM_CFG not found\n");
-		return -1;
-	}
+static int frer_cnt_prev_cmp(const void *a, const void *b)
+{
+	const struct frer_cnt_prev *pa = a, *pb = b;
 
-	nla_memcpy(cfg, attrs[MCHP_FRER_ATTR_STREAM_CFG],
-		   sizeof(struct mchp_frer_stream_cfg));
+	if (pa->ms != pb->ms)
+		return pa->ms < pb->ms ? -1 : 1;
+	if (pa->ifindex != pb->ifindex)
+		return pa->ifindex < pb->ifindex ? -1 : 1;
+	if (pa->id != pb->id)
+		return pa->id < pb->id ? -1 : 1;
 
-	return NL_OK;
+	return 0;
 }
 
-static int mchp_frer_genl_ms_cfg_get(u32 ifindex, u32 ms_id,
-					struct mchp_frer_stream_cfg *cfg)
+/* A counter cleared since the previous read counts from 0 */
+static u64 frer_cnt_diff(u64 now, u64 prev)
 {
-	RETURN_IF_PC;
-	struct mchp_frer_stream_cfg tmp;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
-
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_MS_CFG_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_ms_cfg_get_cb, &tmp);
-
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+	return now >= prev ? now - prev : now;
+}
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
+static void frer_cnt_sub(struct mchp_frer_cnt *c,
+			 const struct mchp_frer_cnt *prev)
+{
+	c->out_of_order_packets = frer_cnt_diff(c->out_of_order_packets,
+						prev->out_of_order_packets);
+	c->rogue_packets = frer_cnt_diff(c->rogue_packets,
+					 prev->rogue_packets);
+	c->passed_packets = frer_cnt_diff(c->passed_packets,
+					  prev->passed_packets);
+	c->discarded_packets = frer_cnt_diff(c->discarded_packets,
+					     prev->discarded_packets);
+	c->lost_packets = frer_cnt_diff(c->lost_packets, prev->lost_packets);
+	c->tagless_packets = frer_cnt_diff(c->tagless_packets,
+					   prev->tagless_packets);
+	c->resets = frer_cnt_diff(c->resets, prev->resets);
+}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
+/* Turn the counters read into @e into the change since the previous
+ * --delta read of the same stream, and keep them for the next one. A
+ * stream read for the first time shows its counters as they are.
+ */
+static int frer_cnt_delta(bool ms, struct frer_entry *e, unsigned int n)
+{
+	struct frer_cnt_prev key = {}, *prev = NULL, *p;
+	unsigned int i, cnt, added = 0;
+	struct mchp_frer_cnt now;
+	ssize_t len;
+	int fd, rc = -1;
+
+	fd = open(FRER_CNT_PREV, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+		goto out;
+
+	if (flock(fd, LOCK_EX) < 0)
+		goto out;
+
+	len = lseek(fd, 0, SEEK_END);
+	if (len < 0)
+		goto out;
+
+	cnt = len / sizeof(*prev);
+	prev = malloc((cnt + n + 1) * sizeof(*prev));
+	if (!prev)
+		goto out;
+
+	len = pread(fd, prev, cnt * sizeof(*prev), 0);
+	if (len < 0)
+		goto out;
+	cnt = len / sizeof(*prev);
+
+	key.ms = ms;
+	for (i = 0; i < n; i++) {
+		if (e[i].cfg_rc || e[i].cnt_rc)
+			continue;
+
+		key.ifindex = e[i].ifindex1;
+		key.id = e[i].id;
+		now = e[i].cnt;
+		p = bsearch(&key, prev, cnt, sizeof(*prev), frer_cnt_prev_cmp);
+		if (p) {
+			frer_cnt_sub(&e[i].cnt, &p->cnt);
+		} else {
+			p = &prev[cnt + added++];
+			*p = key;
+		}
+		p->cnt = now;
 	}
 
-	memcpy(cfg, &tmp, sizeof(tmp));
+	cnt += added;
+	qsort(prev, cnt, sizeof(*prev), frer_cnt_prev_cmp);
+	if (pwrite(fd, prev, cnt * sizeof(*prev), 0) < 0)
+		goto out;
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	rc = 0;
 
+out:
+	if (rc)
+		fprintf(stderr, "%s: %s!\n", FRER_CNT_PREV, strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	free(prev);
 	return rc;
 }
 
-static int mchp_frer_genl_ms_cnt_get_cb(struct nl_msg *msg, void *arg)
+static void frer_stream_title(const char *id, bool dev, bool cs_id, bool cnt)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
-	struct nlattr *attrs[MCHP_FRER_ATTR_END];
-	struct mchp_frer_cnt *cnt = arg;
+	if (dev)
+		printf("%-*s ", IF_NAMESIZE, "dev");
+	printf("%8s %6s %3s %4s %10s %11s", id, "enable", "alg", "hlen",
+	       "reset_time", "take_no_seq");
+	if (cs_id)
+		printf(" %6s", "cs_id");
+	if (cnt)
+		printf(" %16s %16s %16s %16s %16s %16s %16s", "OutOfOrder",
+		       "Rogue", "Passed", "Discarded", "Lost", "Tagless",
+		       "Resets");
+	printf("\n");
+}
 
-	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
-		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
-		printf("nla_parse() failed\n");
-		return NL_STOP;
-	}
+static void frer_stream_row(const struct frer_entry *e, bool dev, bool cs_id,
+			    bool cnt)
+{
+	const struct mchp_frer_stream_cfg *cfg = &e->stream;
+	char ifname[IF_NAMESIZE];
 
-	if (!attrs[MCHP_FRER_ATTR_STREAM_CNT]) {
-		printf("ATTR_STREAM_CNT not found\n");
-		return -1;
+	if (dev) {
+		if (!if_indextoname(e->ifindex1, ifname))
+			strcpy(ifname, "-");
+		printf("%-*s ", IF_NAMESIZE, ifname);
 	}
-
-	nla_memcpy(cnt, attrs[MCHP_FRER_ATTR_STREAM_CNT],
-		   sizeof(struct mchp_frer_cnt));
-
-	return NL_OK;
+	if (e->cfg_rc) {
+		printf("%8u %s\n", e->id, nl_geterror(e->cfg_rc));
+		return;
+	}
+	printf("%8u %6d %3d %4u %10u %11d", e->id, cfg->enable, cfg->alg,
+	       cfg->hlen, cfg->reset_time, cfg->take_no_seq);
+	if (cs_id)
+		printf(" %6u", cfg->cs_id);
+	if (cnt && e->cnt_rc == 0)
+		printf(" %16" PRIu64 " %16" PRIu64 " %16" PRIu64 " %16" PRIu64
+		       " %16" PRIu64 " %16" PRIu64 " %16" PRIu64,
+		       e->cnt.out_of_order_packets, e->cnt.rogue_packets,
+		       e->cnt.passed_packets, e->cnt.discarded_packets,
+		       e->cnt.lost_packets, e->cnt.tagless_packets,
+		       e->cnt.resets);
+	else if (cnt)
+		printf(" %s", nl_geterror(e->cnt_rc));
+	printf("\n");
 }
 
-static int mchp_frer_genl_ms_cnt_get(u32 ifindex, u32 ms_id, struct mchp_frer_cnt *cnt)
+/* One object per stream, the same fields as the table */
+static void frer_stream_json(const struct frer_entry *e, const char *id,
+			     bool dev, bool cs_id, bool cnt, bool last)
 {
-	RETURN_IF_PC;
-	struct mchp_frer_cnt tmp;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
-
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_MS_CNT_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	const struct mchp_frer_stream_cfg *cfg = &e->stream;
+	char ifname[IF_NAMESIZE];
+
+	printf("  {");
+	if (dev) {
+		if (!if_indextoname(e->ifindex1, ifname))
+			strcpy(ifname, "-");
+		printf("\"dev\": \"%s\", ", ifname);
+	}
+	printf("\"%s\": %u, ", id, e->id);
+	if (e->cfg_rc) {
+		printf("\"error\": \"%s\"}%s\n", nl_geterror(e->cfg_rc),
+		       last ? "" : ",");
+		return;
+	}
+	printf("\"enable\": %d, \"alg\": %d, \"hlen\": %u, "
+	       "\"reset_time\": %u, \"take_no_seq\": %d", cfg->enable,
+	       cfg->alg, cfg->hlen, cfg->reset_time, cfg->take_no_seq);
+	if (cs_id)
+		printf(", \"cs_id\": %u", cfg->cs_id);
+	if (cnt && e->cnt_rc == 0)
+		printf(", \"cnt\": {\"out_of_order\": %" PRIu64
+		       ", \"rogue\": %" PRIu64 ", \"passed\": %" PRIu64
+		       ", \"discarded\": %" PRIu64 ", \"lost\": %" PRIu64
+		       ", \"tagless\": %" PRIu64 ", \"resets\": %" PRIu64 "}",
+		       e->cnt.out_of_order_packets, e->cnt.rogue_packets,
+		       e->cnt.passed_packets, e->cnt.discarded_packets,
+		       e->cnt.lost_packets, e->cnt.tagless_packets,
+		       e->cnt.resets);
+	else if (cnt)
+		printf(", \"cnt\": {\"error\": \"%s\"}",
+		       nl_geterror(e->cnt_rc));
+	printf("}%s\n", last ? "" : ",");
+}
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_ms_cnt_get_cb, &tmp);
+/* An ID list like "1-100,200" rather than a single ID */
+static bool frer_is_id_list(const char *arg)
+{
+	return arg[0] != '-' && strpbrk(arg, ",-");
+}
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+/* List compound streams, or member streams when @ms is set. @list is
+ * argv[0], either '--all' for all enabled streams or an ID list like
+ * "1-100,200" of member streams on @ifindex.
+ */
+static int frer_stream_list(const struct command *cmd, int argc,
+			    char *const *argv, bool ms, u32 ifindex)
+{
+	static struct option long_options[] =
+	{
+		{"cnt", no_argument, NULL, 'a'},
+		{"json", no_argument, NULL, 'b'},
+		{"clr", no_argument, NULL, 'c'},
+		{"delta", no_argument, NULL, 'd'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	const char *id = ms ? "ms_id" : "cs_id";
+	struct frer_dump d = {}, c = {};
+	struct frer_entry *e;
+	unsigned int i, n;
+	uint32_t *ids;
+	int do_json = 0;
+	int do_help = 0;
+	int do_delta = 0;
+	int do_cnt = 0;
+	int do_clr = 0;
+	int ch, rc, err;
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	while ((ch = getopt_long(argc, argv, "abcdh", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			do_cnt = 1;
+			break;
+		case 'b':
+			do_json = 1;
+			break;
+		case 'c':
+			do_clr = 1;
+			break;
+		case 'd':
+			do_delta = 1;
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
 	}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
+	if (do_help) {
+		command_help(cmd);
+		return 0;
 	}
 
-	memcpy(cnt, &tmp, sizeof(tmp));
-
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
-}
+	if (do_delta && (!do_cnt || do_clr)) {
+		fprintf(stderr, "--delta needs --cnt and no --clr!\n");
+		return 1;
+	}
 
-static int mchp_frer_genl_ms_cnt_clr(u32 ifindex, u32 ms_id)
-{
-	RETURN_IF_PC;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
+	if (strcmp(argv[0], "--all") == 0) {
+		rc = mchp_frer_genl_dump(&frer_session,
+					 ms ? MCHP_FRER_GENL_MS_CFG_GET :
+					 MCHP_FRER_GENL_CS_CFG_GET, &d);
+		if (rc < 0)
+			goto out;
+
+		/* Keep the enabled streams only */
+		for (i = 0, n = 0; i < d.cnt; i++)
+			if (d.entries[i].stream.enable)
+				d.entries[n++] = d.entries[i];
+		d.cnt = n;
+
+		/* A dump cannot clear, so read and clear stream by stream */
+		if ((do_cnt || do_clr) && d.cnt) {
+			if (do_clr)
+				rc = mchp_frer_genl_get_cnt(&frer_session, ms,
+							    do_cnt, do_clr,
+							    &d);
+			else
+				rc = mchp_frer_genl_dump_cnt(&frer_session,
+							     ms ? MCHP_FRER_GENL_MS_CNT_GET :
+							     MCHP_FRER_GENL_CS_CNT_GET,
+							     &d, &c);
+			if (rc < 0)
+				goto out;
+		}
+	} else {
+		ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+		if (!ids)
+			return -1;
+
+		rc = mchp_id_list_parse(argv[0], ids, MCHP_ID_LIST_MAX);
+		if (rc < 0) {
+			free(ids);
+			return 1;
+		}
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_MS_CNT_CLR, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+		d.entries = calloc(rc, sizeof(*d.entries));
+		if (!d.entries) {
+			free(ids);
+			return -1;
+		}
+		d.cnt = d.size = rc;
+		for (i = 0; i < d.cnt; i++) {
+			d.entries[i].id = ids[i];
+			d.entries[i].ifindex1 = ifindex;
+		}
+		free(ids);
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+		/* Errors of single streams are shown in their row */
+		mchp_frer_genl_get_list(&frer_session, ms, do_cnt, do_clr, &d);
+		rc = 0;
+	}
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	if (do_delta && frer_cnt_delta(ms, d.entries, d.cnt) < 0) {
+		rc = 1;
+		goto out;
 	}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
+	/* Clearing only reports the streams that failed */
+	if (do_clr && !do_cnt) {
+		for (i = 0; i < d.cnt; i++) {
+			e = &d.entries[i];
+			err = e->cfg_rc ? e->cfg_rc : e->cnt_rc;
+			if (!err)
+				continue;
+			printf("%s %u: %s\n", id, e->id, nl_geterror(err));
+			rc = err;
+		}
+		goto out;
+	}
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	if (do_json) {
+		printf("[\n");
+		for (i = 0; i < d.cnt; i++)
+			frer_stream_json(&d.entries[i], id, ms, ms, do_cnt,
+					 i + 1 == d.cnt);
+		printf("]\n");
+	} else {
+		frer_stream_title(id, ms, ms, do_cnt);
+		for (i = 0; i < d.cnt; i++)
+			frer_stream_row(&d.entries[i], ms, ms, do_cnt);
+	}
 
+out:
+	frer_dump_free(&c);
+	frer_dump_free(&d);
 	return rc;
 }
 
-static char *mchp_frer_ms_help(void)
+static char *mchp_frer_cs_help(void)
 {
 	return "--enable:                 Enable recovery\n"
 		" --alg:                    frerSeqRcvyAlgorithm (0: Vector, 1: Match)\n"
 		" --hlen:                   frerSeqRcvyHistoryLength\n"
 		" --reset_time:             frerSeqRcvyResetMSec\n"
 		" --take_no_seq:            frerSeqRcvyTakeNoSequence\n"
-		" --cs_id:                  Compound stream ID\n"
 		" --cnt:                    Show counters\n"
-		" --clr:                    Clear counters\n"
+		" --clr:                    Clear counters, right after reading with --cnt;\n"
+		"                           packets counted in between are lost\n"
+		" --delta:                  With --cnt, show the change since the last --delta\n"
+		"                           read, exact as nothing is cleared\n"
+		" --all:                    List all enabled streams (with --cnt)\n"
+		" --json:                   List in JSON instead of a table\n"
 		" --help:                   Show this help text\n";
 }
 
-static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
+static int cmd_cs(const struct command *cmd, int argc, char *const *argv)
 {
 	static struct option long_options[] =
 	{
@@ -743,41 +1032,34 @@ static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
 		{"hlen", required_argument, NULL, 'c'},
 		{"reset_time", required_argument, NULL, 'd'},
 		{"take_no_seq", required_argument, NULL, 'e'},
-		{"cs_id", required_argument, NULL, 'f'},
-		{"cnt", no_argument, NULL, 'g'},
+		{"cnt", no_argument, NULL, 'f'},
+		{"clr", no_argument, NULL, 'g'},
 		{"help", no_argument, NULL, 'h'},
-		{"clr", no_argument, NULL, 'i'},
+		{"delta", no_argument, NULL, 'i'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_frer_cnt cnt = {};
 	struct mchp_frer_stream_cfg cfg = {};
 	struct mchp_frer_stream_cfg tmp;
-	u32 ifindex = 0;
+	struct frer_entry e = {};
+	int do_delta = 0;
 	int do_help = 0;
 	int do_cnt = 0;
 	int do_clr = 0;
-	u32 ms_id = 0;
+	u32 cs_id = 0;
 	int ch, rc;
 
-	/* read the device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
-	}
-	argc--;
-	argv++;
+	if (strcmp(argv[0], "--all") == 0 || frer_is_id_list(argv[0]))
+		return frer_stream_list(cmd, argc, argv, false, 0);
 
 	/* read the id */
-	ms_id = atoi(argv[0]);
-
+	cs_id = atoi(argv[0]);
 
-	if (mchp_frer_genl_ms_cfg_get(ifindex, ms_id, &cfg) < 0)
+	if (mchp_frer_genl_cs_cfg_get(&frer_session, cs_id, &cfg) < 0)
 		return 0;
 
 	memcpy(&tmp, &cfg, sizeof(cfg));
 
-	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:ghi", long_options, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:fghi", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
 			cfg.enable = !!atoi(optarg);
@@ -795,13 +1077,13 @@ static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
 			cfg.take_no_seq = !!atoi(optarg);
 			break;
 		case 'f':
-			cfg.cs_id = atoi(optarg);
+			do_cnt = 1;
 			break;
 		case 'g':
-			do_cnt = 1;
+			do_clr = 1;
 			break;
 		case 'i':
-			do_clr = 1;
+			do_delta = 1;
 			break;
 		case 'h':
 		case '?':
@@ -815,22 +1097,31 @@ static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
 		return 0;
 	}
 
+	if (do_delta && (!do_cnt || do_clr)) {
+		fprintf(stderr, "--delta needs --cnt and no --clr!\n");
+		return 1;
+	}
+
 	if (do_cnt) {
-		rc = mchp_frer_genl_ms_cnt_get(ifindex, ms_id, &cnt);
+		e.id = cs_id;
+		rc = mchp_frer_genl_cs_cnt_get(&frer_session, cs_id, &e.cnt,
+					       do_clr);
+		if (rc == 0 && do_delta && frer_cnt_delta(false, &e, 1) < 0)
+			return 1;
 		if (rc == 0) {
-			printf("%-18s: %16" PRIu64 "\n", "OutOfOrderPackets", cnt.out_of_order_packets);
-			printf("%-18s: %16" PRIu64 "\n", "RoguePackets", cnt.rogue_packets);
-			printf("%-18s: %16" PRIu64 "\n", "PassedPackets", cnt.passed_packets);
-			printf("%-18s: %16" PRIu64 "\n", "DiscardedPackets", cnt.discarded_packets);
-			printf("%-18s: %16" PRIu64 "\n", "LostPackets", cnt.lost_packets);
-			printf("%-18s: %16" PRIu64 "\n", "TaglessPackets", cnt.tagless_packets);
-			printf("%-18s: %16" PRIu64 "\n", "Resets", cnt.resets);
+			printf("%-18s: %16" PRIu64 "\n", "OutOfOrderPackets", e.cnt.out_of_order_packets);
+			printf("%-18s: %16" PRIu64 "\n", "RoguePackets", e.cnt.rogue_packets);
+			printf("%-18s: %16" PRIu64 "\n", "PassedPackets", e.cnt.passed_packets);
+			printf("%-18s: %16" PRIu64 "\n", "DiscardedPackets", e.cnt.discarded_packets);
+			printf("%-18s: %16" PRIu64 "\n", "LostPackets", e.cnt.lost_packets);
+			printf("%-18s: %16" PRIu64 "\n", "TaglessPackets", e.cnt.tagless_packets);
+			printf("%-18s: %16" PRIu64 "\n", "Resets", e.cnt.resets);
 		}
 		return rc;
 	}
 
 	if (do_clr)
-		return mchp_frer_genl_ms_cnt_clr(ifindex, ms_id);
+		return mchp_frer_genl_cs_cnt_clr(&frer_session, cs_id);
 
 	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
 		printf("%-14s %8d\n", "enable:", cfg.enable);
@@ -838,374 +1129,2660 @@ static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
 		printf("%-14s %8u\n", "hlen:", cfg.hlen);
 		printf("%-14s %8u\n", "reset_time:", cfg.reset_time);
 		printf("%-14s %8d\n", "take_no_seq:", cfg.take_no_seq);
-		printf("%-14s %8d\n", "cs_id:", cfg.cs_id);
 		return 0;
 	}
 
-	return mchp_frer_genl_ms_cfg_set(ifindex, ms_id, &cfg);
+	return mchp_frer_genl_cs_cfg_set(&frer_session, cs_id, &cfg);
 }
 
-/* cmd_iflow */
-/* Transfer split_mask out of band via DEV1 and DEV2 */
-struct mchp_iflow_cmb_cfg {
-	struct mchp_iflow_cfg iflow;
-	u32 ifindex1;
-	u32 ifindex2;
+/* Member stream IDs allocated through this tool are mirrored in a bitmap
+ * under /run, so IDs leaked by scripts can be found and freed again. The
+ * mirror is locked while being updated, and can be rebuilt from a dump.
+ * Every ID carries the time it was allocated, so IDs still being set up
+ * are not taken for leaked.
+ */
+#define FRER_MS_MIRROR     "/run/mchp_frer_ms"
+#define FRER_MS_MIRROR_IDS 65536 /* ms_id is 16 bits in the iflow */
+#define FRER_MS_AGE        60    /* Seconds before an unused ID is freed */
+
+struct frer_ms_mirror {
+	int fd;
+	u8 map[FRER_MS_MIRROR_IDS / 8];
+	u32 stamp[FRER_MS_MIRROR_IDS]; /* Seconds since boot, 0 if unknown */
 };
 
-static int mchp_frer_genl_iflow_cfg_set(u32 id,
-					   const struct mchp_iflow_cmb_cfg *cfg)
+static u32 frer_ms_now(void)
 {
-	RETURN_IF_PC;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
+	struct timespec ts;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_IFLOW_CFG_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, id);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, cfg->ifindex1);
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, cfg->ifindex2);
-	NLA_PUT(msg, MCHP_FRER_ATTR_IFLOW_CFG, sizeof(cfg->iflow), &cfg->iflow);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
+	return ts.tv_sec;
+}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
+static bool frer_ms_map_test(const u8 *map, u32 id)
+{
+	return id < FRER_MS_MIRROR_IDS && (map[id / 8] & (1 << (id % 8)));
+}
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+static void frer_ms_map_set(u8 *map, u32 id, bool set)
+{
+	if (id >= FRER_MS_MIRROR_IDS)
+		return;
 
-	return rc;
+	if (set)
+		map[id / 8] |= 1 << (id % 8);
+	else
+		map[id / 8] &= ~(1 << (id % 8));
 }
 
-static int mchp_frer_genl_iflow_cfg_get_cb(struct nl_msg *msg, void *arg)
+/* Open and lock the mirror, a missing or short file reads as empty */
+static int frer_ms_mirror_open(struct frer_ms_mirror *m)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
-	struct nlattr *attrs[MCHP_FRER_ATTR_END];
-	struct mchp_iflow_cmb_cfg *cfg = arg;
-
-	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
-		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
-		printf("nla_parse() failed\n");
-		return NL_STOP;
-	}
+	memset(m->map, 0, sizeof(m->map));
+	memset(m->stamp, 0, sizeof(m->stamp));
 
-	if (!attrs[MCHP_FRER_ATTR_IFLOW_CFG]) {
-		printf("ATTR_IFLOW_CFG not found\n");
+	m->fd = open(FRER_MS_MIRROR, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (m->fd < 0) {
+		fprintf(stderr, "%s: %s!\n", FRER_MS_MIRROR, strerror(errno));
 		return -1;
 	}
 
-	if (!attrs[MCHP_FRER_ATTR_DEV1]) {
-		printf("ATTR_DEV1 not found\n");
+	/* The stamps follow the bitmap */
+	if (flock(m->fd, LOCK_EX) < 0 ||
+	    pread(m->fd, m->map, sizeof(m->map), 0) < 0 ||
+	    pread(m->fd, m->stamp, sizeof(m->stamp), sizeof(m->map)) < 0) {
+		fprintf(stderr, "%s: %s!\n", FRER_MS_MIRROR, strerror(errno));
+		close(m->fd);
 		return -1;
 	}
 
-	if (!attrs[MCHP_FRER_ATTR_DEV2]) {
-		printf("ATTR_DEV2 not found\n");
-		return -1;
-	}
+	return 0;
+}
 
-	nla_memcpy(&cfg->iflow, attrs[MCHP_FRER_ATTR_IFLOW_CFG],
-		   sizeof(struct mchp_iflow_cfg));
-	cfg->ifindex1 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV1]);
-	cfg->ifindex2 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV2]);
+static void frer_ms_mirror_close(struct frer_ms_mirror *m, bool save)
+{
+	if (save && (pwrite(m->fd, m->map, sizeof(m->map), 0) !=
+		     sizeof(m->map) ||
+		     pwrite(m->fd, m->stamp, sizeof(m->stamp), sizeof(m->map)) !=
+		     sizeof(m->stamp)))
+		fprintf(stderr, "%s: %s!\n", FRER_MS_MIRROR, strerror(errno));
 
-	return NL_OK;
+	close(m->fd);
 }
 
-static int mchp_frer_genl_iflow_cfg_get(u32 id,
-					   struct mchp_iflow_cmb_cfg *cfg)
+/* Add an ID allocated @now, or remove one */
+static void frer_ms_mirror_set(struct frer_ms_mirror *m, u32 id, bool set,
+			       u32 now)
 {
-	RETURN_IF_PC;
-	struct mchp_iflow_cmb_cfg tmp;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
+	if (id >= FRER_MS_MIRROR_IDS)
+		return;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_IFLOW_CFG_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_iflow_cfg_get_cb, &tmp);
+	frer_ms_map_set(m->map, id, set);
+	m->stamp[id] = set ? now : 0;
+}
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, id);
+/* Record allocated (@set) or freed IDs, the results of @err being 0 */
+static void frer_ms_mirror_update(const u32 *ids, const int *err,
+				  unsigned int cnt, bool set)
+{
+	static struct frer_ms_mirror m;
+	u32 now = frer_ms_now();
+	unsigned int i;
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
+	if (frer_ms_mirror_open(&m) < 0)
+		return;
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
+	for (i = 0; i < cnt; i++)
+		if (!err || !err[i])
+			frer_ms_mirror_set(&m, ids[i], set, now);
 
-	memcpy(cfg, &tmp, sizeof(tmp));
+	frer_ms_mirror_close(&m, true);
+}
+
+/* cmd_msa */
+static int mchp_frer_genl_ms_alloc_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	u32 *id = arg;
+
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_ID]) {
+		printf("ATTR_ID not found\n");
+		return -1;
+	}
+
+	*id = nla_get_u32(attrs[MCHP_FRER_ATTR_ID]);
+
+	return NL_OK;
+}
+
+/* Allocate @cnt member streams in one burst, @err may be NULL */
+static int mchp_frer_genl_ms_alloc(struct mchp_genl_session *s, u32 ifindex1,
+				   u32 ifindex2, u32 *ms_id, int *err,
+				   unsigned int cnt)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < cnt; i++) {
+		/* A lost reply must not allocate a second member stream */
+		msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_MS_ALLOC,
+					    NLM_F_REQUEST | NLM_F_ACK |
+					    MCHP_GENL_F_NO_REPLAY,
+					    MCHP_GENL_MSG_SMALL_SIZE,
+					    mchp_frer_genl_ms_alloc_cb,
+					    &ms_id[i], err ? &err[i] : NULL);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex1);
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, ifindex2);
+	}
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static char *mchp_frer_msa_help(void)
+{
+	return "--count:                  Allocate count member streams, printed as an ID list\n"
+		" --help:                   Show this help text\n";
+}
+
+static int u32_cmp(const void *a, const void *b)
+{
+	const u32 *ua = a, *ub = b;
+
+	if (*ua != *ub)
+		return *ua < *ub ? -1 : 1;
+
+	return 0;
+}
+
+static int cmd_msa(const struct command *cmd, int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"count", required_argument, NULL, 'a'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	unsigned int i, n, count = 1;
+	u32 ifindex1 = 0;
+	u32 ifindex2 = 0;
+	int do_help = 0;
+	u32 *ms_id;
+	int ch, rc;
+	int *err;
+
+	/* read device 1, skipped by getopt as argv[0] */
+	ifindex1 = if_nametoindex(argv[0]);
+	if (ifindex1 == 0) {
+		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
+		return 1;
+	}
+
+	if (argc > 1 && argv[1][0] != '-') {
+		/* read optional device 2*/
+		ifindex2 = if_nametoindex(argv[1]);
+		if (ifindex2 == 0) {
+			fprintf(stderr, "%s: %s!\n", argv[1], strerror(errno));
+			return 1;
+		}
+	}
+
+	while ((ch = getopt_long(argc, argv, "a:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			count = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	if (count < 1 || count > MCHP_ID_LIST_MAX) {
+		fprintf(stderr, "Invalid count [%u]\n", count);
+		return 1;
+	}
+
+	ms_id = calloc(count, sizeof(*ms_id));
+	err = calloc(count, sizeof(*err));
+	if (!ms_id || !err) {
+		rc = -1;
+		goto out;
+	}
+
+	rc = mchp_frer_genl_ms_alloc(&frer_session, ifindex1, ifindex2, ms_id,
+				     err, count);
+	frer_ms_mirror_update(ms_id, err, count, true);
+
+	/* Print the IDs allocated, even if not all of them were */
+	for (i = 0, n = 0; i < count; i++)
+		if (!err[i])
+			ms_id[n++] = ms_id[i];
+	if (n < count)
+		fprintf(stderr, "%u of %u allocations failed\n", count - n,
+			count);
+
+	qsort(ms_id, n, sizeof(*ms_id), u32_cmp);
+	if (n)
+		mchp_id_list_print(ms_id, n);
+
+out:
+	free(ms_id);
+	free(err);
+	return rc;
+}
+
+/* cmd_msf */
+/* Free member streams, pipelined in one flush */
+static int mchp_frer_genl_ms_free(struct mchp_genl_session *s,
+				  const u32 *ms_id, int *err, unsigned int cnt)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < cnt; i++) {
+		msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_FREE, NULL, NULL,
+				    &err[i]);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id[i]);
+	}
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* Collect the member streams the kernel knows of in @known, and those
+ * recovering for a compound stream or used by an ingress flow in @used.
+ */
+static int frer_ms_scan(u8 *known, u8 *used)
+{
+	struct frer_dump ms = {}, iflow = {};
+	const struct frer_entry *e;
+	unsigned int i;
+	int rc;
+
+	rc = mchp_frer_genl_dump(&frer_session, MCHP_FRER_GENL_MS_CFG_GET, &ms);
+	if (rc < 0)
+		goto out;
+
+	rc = mchp_frer_genl_dump(&frer_session, MCHP_FRER_GENL_IFLOW_CFG_GET,
+				 &iflow);
+	if (rc < 0)
+		goto out;
+
+	for (i = 0; i < ms.cnt; i++) {
+		e = &ms.entries[i];
+		frer_ms_map_set(known, e->id, true);
+		if (e->stream.enable)
+			frer_ms_map_set(used, e->id, true);
+	}
+
+	for (i = 0; i < iflow.cnt; i++) {
+		e = &iflow.entries[i];
+		if (e->iflow.frer.ms_enable)
+			frer_ms_map_set(used, e->iflow.frer.ms_id, true);
+	}
+
+out:
+	frer_dump_free(&ms);
+	frer_dump_free(&iflow);
+	return rc;
+}
+
+/* Print the IDs of @ids whose result in @err is @rc */
+static void frer_ms_print_rc(const char *title, const u32 *ids,
+			     const int *err, unsigned int cnt, int rc, u32 *buf)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < cnt; i++)
+		if (err[i] == rc)
+			buf[n++] = ids[i];
+	if (n) {
+		printf("%s: ", title);
+		mchp_id_list_print(buf, n);
+	}
+}
+
+/* Free the member streams of the mirror that are not used and were
+ * allocated at least @age seconds ago. IDs the mirror does not hold may be
+ * set up by someone else, e.g. a frer stream add still running, and are
+ * left alone; --sync adds them to the mirror.
+ */
+static int frer_ms_free_unused(u32 age)
+{
+	static u8 known[FRER_MS_MIRROR_IDS / 8], used[FRER_MS_MIRROR_IDS / 8];
+	static struct frer_ms_mirror m;
+	unsigned int i, n = 0, young = 0, foreign = 0;
+	u32 now = frer_ms_now();
+	bool save = false;
+	int *err = NULL;
+	u32 *ids, *buf;
+	int rc;
+
+	ids = malloc(2 * FRER_MS_MIRROR_IDS * sizeof(*ids));
+	if (!ids)
+		return -1;
+	buf = ids + FRER_MS_MIRROR_IDS;
+
+	if (frer_ms_mirror_open(&m) < 0) {
+		free(ids);
+		return 1;
+	}
+
+	memset(known, 0, sizeof(known));
+	memset(used, 0, sizeof(used));
+	rc = frer_ms_scan(known, used);
+	if (rc < 0)
+		goto out;
+	save = true;
+
+	for (i = 0; i < FRER_MS_MIRROR_IDS; i++) {
+		if (frer_ms_map_test(used, i))
+			continue;
+		if (!frer_ms_map_test(m.map, i)) {
+			foreign += frer_ms_map_test(known, i);
+			continue;
+		}
+
+		/* Mirrors written before stamps were kept start aging now */
+		if (!m.stamp[i])
+			m.stamp[i] = now;
+		if (now - m.stamp[i] < age) {
+			young++;
+			continue;
+		}
+		ids[n++] = i;
+	}
+
+	err = calloc(n ? n : 1, sizeof(*err));
+	if (!err) {
+		rc = -1;
+		goto out;
+	}
+
+	if (n)
+		mchp_frer_genl_ms_free(&frer_session, ids, err, n);
+
+	/* IDs the kernel did not know were leaked by the mirror only */
+	for (i = 0; i < n; i++) {
+		if (!err[i] || err[i] == -NLE_OBJ_NOTFOUND) {
+			frer_ms_mirror_set(&m, ids[i], false, now);
+			continue;
+		}
+		printf("ms_id %u: %s\n", ids[i], nl_geterror(err[i]));
+		rc = err[i];
+	}
+
+	frer_ms_print_rc("freed", ids, err, n, 0, buf);
+	frer_ms_print_rc("not in kernel, forgotten", ids, err, n,
+			 -NLE_OBJ_NOTFOUND, buf);
+	if (young)
+		printf("%u unused member streams allocated less than %u s ago kept\n",
+		       young, age);
+	if (foreign)
+		printf("%u unused member streams not in the mirror kept, see --sync\n",
+		       foreign);
+
+out:
+	frer_ms_mirror_close(&m, save);
+	free(ids);
+	free(err);
+	return rc;
+}
+
+static char *mchp_frer_msf_help(void)
+{
+	return "--unused:                 Free the member streams of the list below not in use\n"
+		" --age:                    Seconds since allocation before --unused frees (default 60)\n"
+		" --list:                   List the member streams allocated by this tool\n"
+		" --sync:                   Rebuild that list from the kernel\n"
+		" --help:                   Show this help text\n";
+}
+
+static int cmd_msf(const struct command *cmd, int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"age", required_argument, NULL, 'a'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	static u8 known[FRER_MS_MIRROR_IDS / 8], unused[FRER_MS_MIRROR_IDS / 8];
+	static struct frer_ms_mirror m;
+	u32 age = FRER_MS_AGE, now;
+	unsigned int i, n = 0;
+	int do_help = 0;
+	u32 *ms_id;
+	int ch, rc;
+	int *err;
+	bool in;
+
+	while ((ch = getopt_long(argc, argv, "a:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			age = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	if (strcmp(argv[0], "--unused") == 0)
+		return frer_ms_free_unused(age);
+
+	if (strcmp(argv[0], "--list") == 0 || strcmp(argv[0], "--sync") == 0) {
+		if (frer_ms_mirror_open(&m) < 0)
+			return 1;
+
+		/* IDs kept keep their age, IDs added start aging now */
+		rc = 0;
+		if (strcmp(argv[0], "--sync") == 0) {
+			memset(known, 0, sizeof(known));
+			rc = frer_ms_scan(known, unused);
+			now = frer_ms_now();
+			for (i = 0; i < FRER_MS_MIRROR_IDS && rc >= 0; i++) {
+				in = frer_ms_map_test(known, i);
+				if (in != frer_ms_map_test(m.map, i))
+					frer_ms_mirror_set(&m, i, in, now);
+			}
+		}
+
+		ms_id = malloc(FRER_MS_MIRROR_IDS * sizeof(*ms_id));
+		if (!ms_id || rc < 0) {
+			frer_ms_mirror_close(&m, false);
+			free(ms_id);
+			return rc < 0 ? rc : -1;
+		}
+
+		for (i = 0; i < FRER_MS_MIRROR_IDS; i++)
+			if (frer_ms_map_test(m.map, i))
+				ms_id[n++] = i;
+		if (n)
+			mchp_id_list_print(ms_id, n);
+
+		frer_ms_mirror_close(&m, strcmp(argv[0], "--sync") == 0);
+		free(ms_id);
+		return 0;
+	}
+
+	/* read the id or ID list */
+	ms_id = malloc(MCHP_ID_LIST_MAX * sizeof(*ms_id));
+	err = calloc(MCHP_ID_LIST_MAX, sizeof(*err));
+	if (!ms_id || !err) {
+		rc = -1;
+		goto out;
+	}
+
+	rc = mchp_id_list_parse(argv[0], ms_id, MCHP_ID_LIST_MAX);
+	if (rc < 0) {
+		rc = 1;
+		goto out;
+	}
+	n = rc;
+
+	rc = mchp_frer_genl_ms_free(&frer_session, ms_id, err, n);
+	frer_ms_mirror_update(ms_id, err, n, false);
+	if (n > 1)
+		for (i = 0; i < n; i++)
+			if (err[i])
+				printf("ms_id %u: %s\n", ms_id[i],
+				       nl_geterror(err[i]));
+
+out:
+	free(ms_id);
+	free(err);
+	return rc;
+}
+
+/* cmd_ms */
+static int mchp_frer_genl_ms_cfg_set(struct mchp_genl_session *s, u32 ifindex,
+				     u32 ms_id,
+				     const struct mchp_frer_stream_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_CFG_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+	NLA_PUT(msg, MCHP_FRER_ATTR_STREAM_CFG, sizeof(*cfg), cfg);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int mchp_frer_genl_ms_cfg_get_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	struct mchp_frer_stream_cfg *cfg = arg;
+
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_STREAM_CFG]) {
+		printf("ATTR_STREAM_CFG not found\n");
+		return -1;
+	}
+
+	nla_memcpy(cfg, attrs[MCHP_FRER_ATTR_STREAM_CFG],
+		   sizeof(struct mchp_frer_stream_cfg));
+
+	return NL_OK;
+}
+
+static int mchp_frer_genl_ms_cfg_get(struct mchp_genl_session *s, u32 ifindex,
+				     u32 ms_id,
+				     struct mchp_frer_stream_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_CFG_GET,
+			    mchp_frer_genl_ms_cfg_get_cb, cfg, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int mchp_frer_genl_ms_cnt_get_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	struct mchp_frer_cnt *cnt = arg;
+
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_STREAM_CNT]) {
+		printf("ATTR_STREAM_CNT not found\n");
+		return -1;
+	}
+
+	nla_memcpy(cnt, attrs[MCHP_FRER_ATTR_STREAM_CNT],
+		   sizeof(struct mchp_frer_cnt));
+
+	return NL_OK;
+}
+
+/* Read and optionally clear, see mchp_frer_genl_cs_cnt_get() */
+static int mchp_frer_genl_ms_cnt_get(struct mchp_genl_session *s, u32 ifindex,
+				     u32 ms_id, struct mchp_frer_cnt *cnt,
+				     bool clr)
+{
+	RETURN_IF_PC;
+	unsigned long mark = mchp_genl_req_mark(s);
+	int flags = NLM_F_REQUEST | NLM_F_ACK;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	if (clr)
+		flags |= MCHP_GENL_F_NO_REPLAY;
+
+	msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_MS_CNT_GET, flags,
+				    MCHP_GENL_MSG_SMALL_SIZE,
+				    mchp_frer_genl_ms_cnt_get_cb, cnt, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+
+	if (clr) {
+		msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_MS_CNT_CLR, flags,
+					    MCHP_GENL_MSG_SMALL_SIZE,
+					    NULL, NULL, NULL);
+		if (!msg) {
+			mchp_genl_req_abort_to(s, mark);
+			return -1;
+		}
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+	}
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort_to(s, mark);
+	return -NLE_MSGSIZE;
+}
+
+static int mchp_frer_genl_ms_cnt_clr(struct mchp_genl_session *s, u32 ifindex,
+				     u32 ms_id)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_CNT_CLR, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static char *mchp_frer_ms_help(void)
+{
+	return "--enable:                 Enable recovery\n"
+		" --alg:                    frerSeqRcvyAlgorithm (0: Vector, 1: Match)\n"
+		" --hlen:                   frerSeqRcvyHistoryLength\n"
+		" --reset_time:             frerSeqRcvyResetMSec\n"
+		" --take_no_seq:            frerSeqRcvyTakeNoSequence\n"
+		" --cs_id:                  Compound stream ID\n"
+		" --cnt:                    Show counters\n"
+		" --clr:                    Clear counters, right after reading with --cnt;\n"
+		"                           packets counted in between are lost\n"
+		" --delta:                  With --cnt, show the change since the last --delta\n"
+		"                           read, exact as nothing is cleared\n"
+		" --all:                    List all enabled streams (with --cnt)\n"
+		" --json:                   List in JSON instead of a table\n"
+		" --help:                   Show this help text\n";
+}
+
+static int cmd_ms(const struct command *cmd, int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"enable", required_argument, NULL, 'a'},
+		{"alg", required_argument, NULL, 'b'},
+		{"hlen", required_argument, NULL, 'c'},
+		{"reset_time", required_argument, NULL, 'd'},
+		{"take_no_seq", required_argument, NULL, 'e'},
+		{"cs_id", required_argument, NULL, 'f'},
+		{"cnt", no_argument, NULL, 'g'},
+		{"help", no_argument, NULL, 'h'},
+		{"clr", no_argument, NULL, 'i'},
+		{"delta", no_argument, NULL, 'j'},
+		{NULL, 0, NULL, 0}
+	};
+	struct mchp_frer_stream_cfg cfg = {};
+	struct mchp_frer_stream_cfg tmp;
+	struct frer_entry e = {};
+	u32 ifindex = 0;
+	int do_delta = 0;
+	int do_help = 0;
+	int do_cnt = 0;
+	int do_clr = 0;
+	u32 ms_id = 0;
+	int ch, rc;
+
+	if (strcmp(argv[0], "--all") == 0)
+		return frer_stream_list(cmd, argc, argv, true, 0);
+
+	if (argc < 2) {
+		fprintf(stderr, "Missing argument!\n");
+		command_help(cmd);
+		return 1;
+	}
+
+	/* read the device and skip it */
+	ifindex = if_nametoindex(argv[0]);
+	if (ifindex == 0) {
+		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
+		return 1;
+	}
+	argc--;
+	argv++;
+
+	if (frer_is_id_list(argv[0]))
+		return frer_stream_list(cmd, argc, argv, true, ifindex);
+
+	/* read the id */
+	ms_id = atoi(argv[0]);
+
+	if (mchp_frer_genl_ms_cfg_get(&frer_session, ifindex, ms_id, &cfg) < 0)
+		return 0;
+
+	memcpy(&tmp, &cfg, sizeof(cfg));
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:ghij", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			cfg.enable = !!atoi(optarg);
+			break;
+		case 'b':
+			cfg.alg = !!atoi(optarg);
+			break;
+		case 'c':
+			cfg.hlen = atoi(optarg);
+			break;
+		case 'd':
+			cfg.reset_time = atoi(optarg);
+			break;
+		case 'e':
+			cfg.take_no_seq = !!atoi(optarg);
+			break;
+		case 'f':
+			cfg.cs_id = atoi(optarg);
+			break;
+		case 'g':
+			do_cnt = 1;
+			break;
+		case 'i':
+			do_clr = 1;
+			break;
+		case 'j':
+			do_delta = 1;
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	if (do_delta && (!do_cnt || do_clr)) {
+		fprintf(stderr, "--delta needs --cnt and no --clr!\n");
+		return 1;
+	}
+
+	if (do_cnt) {
+		e.id = ms_id;
+		e.ifindex1 = ifindex;
+		rc = mchp_frer_genl_ms_cnt_get(&frer_session, ifindex, ms_id,
+					       &e.cnt, do_clr);
+		if (rc == 0 && do_delta && frer_cnt_delta(true, &e, 1) < 0)
+			return 1;
+		if (rc == 0) {
+			printf("%-18s: %16" PRIu64 "\n", "OutOfOrderPackets", e.cnt.out_of_order_packets);
+			printf("%-18s: %16" PRIu64 "\n", "RoguePackets", e.cnt.rogue_packets);
+			printf("%-18s: %16" PRIu64 "\n", "PassedPackets", e.cnt.passed_packets);
+			printf("%-18s: %16" PRIu64 "\n", "DiscardedPackets", e.cnt.discarded_packets);
+			printf("%-18s: %16" PRIu64 "\n", "LostPackets", e.cnt.lost_packets);
+			printf("%-18s: %16" PRIu64 "\n", "TaglessPackets", e.cnt.tagless_packets);
+			printf("%-18s: %16" PRIu64 "\n", "Resets", e.cnt.resets);
+		}
+		return rc;
+	}
+
+	if (do_clr)
+		return mchp_frer_genl_ms_cnt_clr(&frer_session, ifindex, ms_id);
+
+	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
+		printf("%-14s %8d\n", "enable:", cfg.enable);
+		printf("%-14s %8d\n", "alg:", cfg.alg);
+		printf("%-14s %8u\n", "hlen:", cfg.hlen);
+		printf("%-14s %8u\n", "reset_time:", cfg.reset_time);
+		printf("%-14s %8d\n", "take_no_seq:", cfg.take_no_seq);
+		printf("%-14s %8d\n", "cs_id:", cfg.cs_id);
+		return 0;
+	}
+
+	return mchp_frer_genl_ms_cfg_set(&frer_session, ifindex, ms_id, &cfg);
+}
+
+/* cmd_iflow */
+/* Transfer split_mask out of band via DEV1 and DEV2 */
+struct mchp_iflow_cmb_cfg {
+	struct mchp_iflow_cfg iflow;
+	u32 ifindex1;
+	u32 ifindex2;
+};
+
+static int mchp_frer_genl_iflow_cfg_set(struct mchp_genl_session *s, u32 id,
+					const struct mchp_iflow_cmb_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_IFLOW_CFG_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, cfg->ifindex1);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, cfg->ifindex2);
+	NLA_PUT(msg, MCHP_FRER_ATTR_IFLOW_CFG, sizeof(cfg->iflow), &cfg->iflow);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int mchp_frer_genl_iflow_cfg_get_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	struct mchp_iflow_cmb_cfg *cfg = arg;
+
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_IFLOW_CFG]) {
+		printf("ATTR_IFLOW_CFG not found\n");
+		return -1;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_DEV1]) {
+		printf("ATTR_DEV1 not found\n");
+		return -1;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_DEV2]) {
+		printf("ATTR_DEV2 not found\n");
+		return -1;
+	}
+
+	nla_memcpy(&cfg->iflow, attrs[MCHP_FRER_ATTR_IFLOW_CFG],
+		   sizeof(struct mchp_iflow_cfg));
+	cfg->ifindex1 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV1]);
+	cfg->ifindex2 = nla_get_u32(attrs[MCHP_FRER_ATTR_DEV2]);
+
+	return NL_OK;
+}
+
+static int mchp_frer_genl_iflow_cfg_get(struct mchp_genl_session *s, u32 id,
+					struct mchp_iflow_cmb_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_IFLOW_CFG_GET,
+			    mchp_frer_genl_iflow_cfg_get_cb, cfg, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, id);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static char *mchp_frer_iflow_help(void)
+{
+	return "--ms_enable:              Enable member stream\n"
+		" --ms_id:                  Allocated member stream ID\n"
+		" --generation:             Enable sequence generation\n"
+		" --pop:                    Enable popping of R-tag\n"
+		" --dev1:                   Split device 1 or '-'\n"
+		" --dev2:                   Split device 2 or '-'\n"
+		" --ms_id-base:             First ms_id of an ID list, counting up per flow\n"
+		" --ms_id-step:             Increment of ms_id per flow (default 1)\n"
+		" --all:                    List all configured ingress flows\n"
+		" --help:                   Show this help text\n";
+}
+
+static void frer_iflow_title(void)
+{
+	printf("%8s %9s %6s %10s %3s %-*s %s\n", "id", "ms_enable",
+	       "ms_id", "generation", "pop", IF_NAMESIZE, "dev1", "dev2");
+}
+
+static void frer_iflow_row(u32 id, const struct mchp_frer_iflow_cfg *cfg,
+			   u32 ifindex1, u32 ifindex2)
+{
+	char if1[IF_NAMESIZE], if2[IF_NAMESIZE];
+
+	if (!if_indextoname(ifindex1, if1))
+		strcpy(if1, "-");
+	if (!if_indextoname(ifindex2, if2))
+		strcpy(if2, "-");
+	printf("%8u %9d %6u %10d %3d %-*s %s\n", id, cfg->ms_enable,
+	       cfg->ms_id, cfg->generation, cfg->pop, IF_NAMESIZE, if1, if2);
+}
+
+struct frer_iflow {
+	u32 id;
+	struct mchp_iflow_cmb_cfg cfg;
+	int rc;
+};
+
+/* Read the ingress flows of an ID list with pipelined GETs in one flush.
+ * The error of every flow is left in its rc.
+ */
+static int mchp_frer_genl_iflow_get_list(struct mchp_genl_session *s,
+					 struct frer_iflow *f,
+					 unsigned int cnt)
+{
+	RETURN_IF_PC;
+	unsigned long mark = mchp_genl_req_mark(s);
+	struct nl_msg *msg;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		msg = mchp_genl_get(s, MCHP_FRER_GENL_IFLOW_CFG_GET,
+				    mchp_frer_genl_iflow_cfg_get_cb,
+				    &f[i].cfg, &f[i].rc);
+		if (!msg) {
+			mchp_genl_req_abort_to(s, mark);
+			return -1;
+		}
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, f[i].id);
+	}
+
+	return mchp_genl_flush(s);
+
+nla_put_failure:
+	mchp_genl_req_abort_to(s, mark);
+	return -NLE_MSGSIZE;
+}
+
+/* Write the ingress flows of an ID list, pipelined in one flush */
+static int mchp_frer_genl_iflow_set_list(struct mchp_genl_session *s,
+					 struct frer_iflow *f,
+					 unsigned int cnt)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < cnt; i++) {
+		if (f[i].rc)
+			continue;
+
+		msg = mchp_genl_req(s, MCHP_FRER_GENL_IFLOW_CFG_SET, NULL,
+				    NULL, &f[i].rc);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, f[i].id);
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, f[i].cfg.ifindex1);
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, f[i].cfg.ifindex2);
+		NLA_PUT(msg, MCHP_FRER_ATTR_IFLOW_CFG, sizeof(f[i].cfg.iflow),
+			&f[i].cfg.iflow);
+	}
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* Read a split device option, '-' removes the device */
+static int frer_iflow_dev(const char *name, u32 *ifindex)
+{
+	if (name[0] == '-') {
+		*ifindex = 0;
+		return 0;
+	}
+
+	*ifindex = if_nametoindex(name);
+	if (*ifindex == 0) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Configure the ingress flows of an ID list identically, except for
+ * ms_id which with --ms_id-base counts up from the base per flow.
+ */
+static int frer_iflow_id_list(const struct command *cmd, int argc,
+			      char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"ms_enable", required_argument, NULL, 'a'},
+		{"ms_id", required_argument, NULL, 'b'},
+		{"generation", required_argument, NULL, 'c'},
+		{"pop", required_argument, NULL, 'd'},
+		{"dev1", required_argument, NULL, 'e'},
+		{"dev2", required_argument, NULL, 'f'},
+		{"ms_id-base", required_argument, NULL, 'g'},
+		{"ms_id-step", required_argument, NULL, 'i'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int ms_enable = -1, generation = -1, pop = -1;
+	long ms_id = -1, ms_id_base = -1, ms_id_step = 1;
+	long ifindex1 = -1, ifindex2 = -1, last = 0;
+	bool ms_id_neg = false;
+	struct frer_iflow *f;
+	struct mchp_frer_iflow_cfg *cfg;
+	unsigned int i, n;
+	int do_help = 0;
+	uint32_t *ids;
+	u32 ifindex;
+	int ch, rc;
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:g:i:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			ms_enable = !!atoi(optarg);
+			break;
+		case 'b':
+			ms_id = atoi(optarg);
+			ms_id_neg |= ms_id < 0;
+			break;
+		case 'c':
+			generation = !!atoi(optarg);
+			break;
+		case 'd':
+			pop = !!atoi(optarg);
+			break;
+		case 'e':
+			if (frer_iflow_dev(optarg, &ifindex) < 0)
+				return 1;
+			ifindex1 = ifindex;
+			break;
+		case 'f':
+			if (frer_iflow_dev(optarg, &ifindex) < 0)
+				return 1;
+			ifindex2 = ifindex;
+			break;
+		case 'g':
+			ms_id_base = atoi(optarg);
+			ms_id_neg |= ms_id_base < 0;
+			break;
+		case 'i':
+			ms_id_step = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+	if (!ids)
+		return -1;
+
+	rc = mchp_id_list_parse(argv[0], ids, MCHP_ID_LIST_MAX);
+	if (rc < 0) {
+		free(ids);
+		return 1;
+	}
+	n = rc;
+
+	/* ms_id is 16 bits, so check the whole range before writing any flow */
+	if (ms_id_base >= 0)
+		last = ms_id_base + (long)(n - 1) * ms_id_step;
+	if (ms_id_neg || ms_id > FRER_MS_MIRROR_IDS - 1 ||
+	    (ms_id_base >= 0 && (last < 0 || last > FRER_MS_MIRROR_IDS - 1 ||
+				 ms_id_base > FRER_MS_MIRROR_IDS - 1))) {
+		fprintf(stderr, "Invalid ms_id range!\n");
+		free(ids);
+		return 1;
+	}
+
+	f = calloc(n, sizeof(*f));
+	if (!f) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		f[i].id = ids[i];
+	free(ids);
+
+	/* Errors of single flows are shown in their row, and those flows
+	 * are not written
+	 */
+	rc = mchp_frer_genl_iflow_get_list(&frer_session, f, n);
+	if (rc == -1 || rc == -NLE_MSGSIZE)
+		goto out;
+	rc = 0;
+
+	if (ms_enable >= 0 || ms_id >= 0 || ms_id_base >= 0 ||
+	    generation >= 0 || pop >= 0 || ifindex1 >= 0 || ifindex2 >= 0) {
+		for (i = 0; i < n; i++) {
+			cfg = &f[i].cfg.iflow.frer;
+			if (ms_enable >= 0)
+				cfg->ms_enable = ms_enable;
+			if (ms_id >= 0)
+				cfg->ms_id = ms_id;
+			if (ms_id_base >= 0)
+				cfg->ms_id = ms_id_base + (long)i * ms_id_step;
+			if (generation >= 0)
+				cfg->generation = generation;
+			if (pop >= 0)
+				cfg->pop = pop;
+			if (ifindex1 >= 0)
+				f[i].cfg.ifindex1 = ifindex1;
+			if (ifindex2 >= 0)
+				f[i].cfg.ifindex2 = ifindex2;
+		}
+
+		mchp_frer_genl_iflow_set_list(&frer_session, f, n);
+	}
+
+	frer_iflow_title();
+	for (i = 0; i < n; i++) {
+		if (f[i].rc) {
+			printf("%8u %s\n", f[i].id, nl_geterror(f[i].rc));
+			rc = f[i].rc;
+			continue;
+		}
+		frer_iflow_row(f[i].id, &f[i].cfg.iflow.frer,
+			       f[i].cfg.ifindex1, f[i].cfg.ifindex2);
+	}
+
+out:
+	free(f);
+	return rc;
+}
+
+static int frer_iflow_list(const struct command *cmd, int argc,
+			   char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	const struct mchp_frer_iflow_cfg *cfg;
+	const struct frer_entry *e;
+	struct frer_dump d = {};
+	unsigned int i;
+	int do_help = 0;
+	int ch, rc;
+
+	/* argv[0] is '--all' */
+	while ((ch = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	rc = mchp_frer_genl_dump(&frer_session, MCHP_FRER_GENL_IFLOW_CFG_GET,
+				 &d);
+	if (rc < 0)
+		goto out;
+
+	frer_iflow_title();
+	for (i = 0; i < d.cnt; i++) {
+		e = &d.entries[i];
+		cfg = &e->iflow.frer;
+
+		/* Skip flows without any FRER configuration */
+		if (!cfg->ms_enable && !cfg->generation && !cfg->pop &&
+		    !e->ifindex1 && !e->ifindex2)
+			continue;
+
+		frer_iflow_row(e->id, cfg, e->ifindex1, e->ifindex2);
+	}
+
+out:
+	frer_dump_free(&d);
+	return rc;
+}
+
+static int cmd_iflow(const struct command *cmd, int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"ms_enable", required_argument, NULL, 'a'},
+		{"ms_id", required_argument, NULL, 'b'},
+		{"generation", required_argument, NULL, 'c'},
+		{"pop", required_argument, NULL, 'd'},
+		{"dev1", required_argument, NULL, 'e'},
+		{"dev2", required_argument, NULL, 'f'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	struct mchp_iflow_cmb_cfg cfg = {};
+	struct mchp_iflow_cmb_cfg tmp;
+	int do_help = 0;
+	u32 id = 0;
+	int ch;
+
+	if (strcmp(argv[0], "--all") == 0)
+		return frer_iflow_list(cmd, argc, argv);
+
+	if (frer_is_id_list(argv[0]))
+		return frer_iflow_id_list(cmd, argc, argv);
+
+	/* read the id */
+	id = atoi(argv[0]);
+
+	if (mchp_frer_genl_iflow_cfg_get(&frer_session, id, &cfg) < 0)
+		return 0;
+
+	memcpy(&tmp, &cfg, sizeof(cfg));
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:fh", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			cfg.iflow.frer.ms_enable = !!atoi(optarg);
+			break;
+		case 'b':
+			cfg.iflow.frer.ms_id = atoi(optarg);
+			break;
+		case 'c':
+			cfg.iflow.frer.generation = !!atoi(optarg);
+			break;
+		case 'd':
+			cfg.iflow.frer.pop = !!atoi(optarg);
+			break;
+		case 'e':
+			if (optarg[0] == '-') {
+				cfg.ifindex1 = 0; /* Remove device */
+			} else {
+				cfg.ifindex1 = if_nametoindex(optarg);
+				if (cfg.ifindex1 == 0) {
+					fprintf(stderr, "%s: %s!\n", optarg, strerror(errno));
+					return 1;
+				}
+			}
+			break;
+		case 'f':
+			if (optarg[0] == '-') {
+				cfg.ifindex2 = 0; /* Remove device */
+			} else {
+				cfg.ifindex2 = if_nametoindex(optarg);
+				if (cfg.ifindex2 == 0) {
+					fprintf(stderr, "%s: %s!\n", optarg, strerror(errno));
+					return 1;
+				}
+			}
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
+		char if1[IF_NAMESIZE] = {};
+		char if2[IF_NAMESIZE] = {};
+		if (!if_indextoname(cfg.ifindex1, if1))
+			if1[0] = '-';
+		if (!if_indextoname(cfg.ifindex2, if2))
+			if2[0] = '-';
+		printf("%-14s %8d\n", "ms_enable:", cfg.iflow.frer.ms_enable);
+		printf("%-14s %8u\n", "ms_id:", cfg.iflow.frer.ms_id);
+		printf("%-14s %8d\n", "generation:", cfg.iflow.frer.generation);
+		printf("%-14s %8d\n", "pop:", cfg.iflow.frer.pop);
+		printf("%-14s %8s\n", "dev1:", if1 ? if1 : "-");
+		printf("%-14s %8s\n", "dev2:", if2 ? if2 : "-");
+		return 0;
+	}
+
+	return mchp_frer_genl_iflow_cfg_set(&frer_session, id, &cfg);
+}
+
+/* cmd_vlan */
+static int mchp_frer_genl_vlan_cfg_set(struct mchp_genl_session *s, u32 vid,
+				       const struct mchp_frer_vlan_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_VLAN_CFG_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, vid);
+	NLA_PUT(msg, MCHP_FRER_ATTR_VLAN_CFG, sizeof(*cfg), cfg);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int mchp_frer_genl_vlan_cfg_get_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
+	struct nlattr *attrs[MCHP_FRER_ATTR_END];
+	struct mchp_frer_vlan_cfg *cfg = arg;
+
+	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
+		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
+		printf("nla_parse() failed\n");
+		return NL_STOP;
+	}
+
+	if (!attrs[MCHP_FRER_ATTR_VLAN_CFG]) {
+		printf("ATTR_VLAN_CFG not found\n");
+		return -1;
+	}
+
+	nla_memcpy(cfg, attrs[MCHP_FRER_ATTR_VLAN_CFG],
+		   sizeof(struct mchp_frer_vlan_cfg));
+
+	return NL_OK;
+}
+
+static int mchp_frer_genl_vlan_cfg_get(struct mchp_genl_session *s, u32 vid,
+				       struct mchp_frer_vlan_cfg *cfg)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	int rc = 0;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_VLAN_CFG_GET,
+			    mchp_frer_genl_vlan_cfg_get_cb, cfg, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, vid);
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+struct frer_vlan {
+	u32 vid;
+	struct mchp_frer_vlan_cfg cfg;
+	int rc;
+};
+
+/* Read, or with @set write, the VLANs of an ID list, pipelined in one
+ * flush. VLANs that failed before are skipped.
+ */
+static int mchp_frer_genl_vlan_bulk(struct mchp_genl_session *s,
+				    struct frer_vlan *v, unsigned int cnt,
+				    bool set)
+{
+	RETURN_IF_PC;
+	struct nl_msg *msg;
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < cnt; i++) {
+		if (v[i].rc)
+			continue;
+
+		if (set)
+			msg = mchp_genl_req(s, MCHP_FRER_GENL_VLAN_CFG_SET,
+					    NULL, NULL, &v[i].rc);
+		else
+			msg = mchp_genl_get(s, MCHP_FRER_GENL_VLAN_CFG_GET,
+					    mchp_frer_genl_vlan_cfg_get_cb,
+					    &v[i].cfg, &v[i].rc);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, v[i].vid);
+		if (set)
+			NLA_PUT(msg, MCHP_FRER_ATTR_VLAN_CFG, sizeof(v[i].cfg),
+				&v[i].cfg);
+	}
+
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
 
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static char *mchp_frer_iflow_help(void)
+static bool frer_vlan_same(const struct frer_vlan *a, const struct frer_vlan *b)
 {
-	return "--ms_enable:              Enable member stream\n"
-		" --ms_id:                  Allocated member stream ID\n"
-		" --generation:             Enable sequence generation\n"
-		" --pop:                    Enable popping of R-tag\n"
-		" --dev1:                   Split device 1 or '-'\n"
-		" --dev2:                   Split device 2 or '-'\n"
+	if (a->rc || b->rc)
+		return a->rc == b->rc;
+
+	return a->cfg.flood_disable == b->cfg.flood_disable &&
+		a->cfg.learn_disable == b->cfg.learn_disable;
+}
+
+/* One line per range of consecutive VLANs with the same result */
+static void frer_vlan_summary(const struct frer_vlan *v, unsigned int cnt)
+{
+	unsigned int i, j;
+	char range[24];
+
+	printf("%-9s %13s %13s\n", "vid", "flood_disable", "learn_disable");
+	for (i = 0; i < cnt; i = j) {
+		for (j = i + 1; j < cnt; j++)
+			if (v[j].vid != v[j - 1].vid + 1 ||
+			    !frer_vlan_same(&v[i], &v[j]))
+				break;
+
+		if (j - i > 1)
+			snprintf(range, sizeof(range), "%u-%u", v[i].vid,
+				 v[j - 1].vid);
+		else
+			snprintf(range, sizeof(range), "%u", v[i].vid);
+
+		if (v[i].rc)
+			printf("%-9s %s\n", range, nl_geterror(v[i].rc));
+		else
+			printf("%-9s %13d %13d\n", range,
+			       v[i].cfg.flood_disable, v[i].cfg.learn_disable);
+	}
+}
+
+/* Configure the VLANs of an ID list: read all, change the options given
+ * and write all, then read back for the summary.
+ */
+static int frer_vlan_list(const struct command *cmd, int argc,
+			  char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"flood_disable", required_argument, NULL, 'a'},
+		{"learn_disable", required_argument, NULL, 'b'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int flood_disable = -1;
+	int learn_disable = -1;
+	struct frer_vlan *v;
+	unsigned int i, n;
+	int do_help = 0;
+	uint32_t *ids;
+	int ch, rc;
+
+	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			flood_disable = !!atoi(optarg);
+			break;
+		case 'b':
+			learn_disable = !!atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
+
+	ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+	if (!ids)
+		return -1;
+
+	rc = mchp_id_list_parse(argv[0], ids, MCHP_ID_LIST_MAX);
+	if (rc < 0) {
+		free(ids);
+		return 1;
+	}
+	n = rc;
+
+	v = calloc(n, sizeof(*v));
+	if (!v) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		v[i].vid = ids[i];
+	free(ids);
+
+	/* Errors of single VLANs are shown in the summary */
+	rc = mchp_frer_genl_vlan_bulk(&frer_session, v, n, false);
+	if (rc >= 0 && (flood_disable >= 0 || learn_disable >= 0)) {
+		for (i = 0; i < n; i++) {
+			if (flood_disable >= 0)
+				v[i].cfg.flood_disable = flood_disable;
+			if (learn_disable >= 0)
+				v[i].cfg.learn_disable = learn_disable;
+		}
+
+		mchp_frer_genl_vlan_bulk(&frer_session, v, n, true);
+		mchp_frer_genl_vlan_bulk(&frer_session, v, n, false);
+	}
+
+	frer_vlan_summary(v, n);
+
+	for (i = 0, rc = 0; i < n; i++)
+		if (v[i].rc)
+			rc = v[i].rc;
+
+	free(v);
+	return rc;
+}
+
+static char *mchp_frer_vlan_help(void)
+{
+	return "--flood_disable:          Disable flooding in VLAN\n"
+		" --learn_disable:          Disable learning in VLAN\n"
 		" --help:                   Show this help text\n";
 }
 
-static int cmd_iflow(const struct command *cmd, int argc, char *const *argv)
+static int cmd_vlan(const struct command *cmd, int argc, char *const *argv)
 {
 	static struct option long_options[] =
 	{
-		{"ms_enable", required_argument, NULL, 'a'},
-		{"ms_id", required_argument, NULL, 'b'},
-		{"generation", required_argument, NULL, 'c'},
-		{"pop", required_argument, NULL, 'd'},
-		{"dev1", required_argument, NULL, 'e'},
-		{"dev2", required_argument, NULL, 'f'},
+		{"flood_disable", required_argument, NULL, 'a'},
+		{"learn_disable", required_argument, NULL, 'b'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_iflow_cmb_cfg cfg = {};
-	struct mchp_iflow_cmb_cfg tmp;
+	struct mchp_frer_vlan_cfg cfg = {};
+	struct mchp_frer_vlan_cfg tmp;
 	int do_help = 0;
-	u32 id = 0;
+	u32 vid = 0;
 	int ch;
 
+	if (frer_is_id_list(argv[0]))
+		return frer_vlan_list(cmd, argc, argv);
+
 	/* read the id */
-	id = atoi(argv[0]);
+	vid = atoi(argv[0]);
+
+	if (mchp_frer_genl_vlan_cfg_get(&frer_session, vid, &cfg) < 0)
+		return 0;
+
+	memcpy(&tmp, &cfg, sizeof(cfg));
+
+	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			cfg.flood_disable = !!atoi(optarg);
+			break;
+		case 'b':
+			cfg.learn_disable = !!atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
+		return 0;
+	}
 
-	if (mchp_frer_genl_iflow_cfg_get(id, &cfg) < 0)
+	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
+		printf("%-14s %8d\n", "flood_disable:", cfg.flood_disable);
+		printf("%-14s %8d\n", "learn_disable:", cfg.learn_disable);
 		return 0;
+	}
+
+	return mchp_frer_genl_vlan_cfg_set(&frer_session, vid, &cfg);
+}
+
+/* cmd_stream */
+enum frer_stream_step {
+	FRER_STREAM_MSA,
+	FRER_STREAM_CS_GET,
+	FRER_STREAM_IFLOW_GET,
+	FRER_STREAM_MS1,
+	FRER_STREAM_MS2,
+	FRER_STREAM_CS,
+	FRER_STREAM_IFLOW,
+	FRER_STREAM_UNDO_IFLOW,
+	FRER_STREAM_UNDO_CS,
+	FRER_STREAM_UNDO_MS1,
+	FRER_STREAM_UNDO_MS2,
+	FRER_STREAM_UNDO_MSA,
+
+	/* This must be the last entry */
+	FRER_STREAM_STEPS,
+};
+
+static const char *frer_stream_step_names[FRER_STREAM_STEPS] = {
+	[FRER_STREAM_MSA] = "msa",
+	[FRER_STREAM_CS_GET] = "cs get",
+	[FRER_STREAM_IFLOW_GET] = "iflow get",
+	[FRER_STREAM_MS1] = "ms dev1",
+	[FRER_STREAM_MS2] = "ms dev2",
+	[FRER_STREAM_CS] = "cs",
+	[FRER_STREAM_IFLOW] = "iflow",
+	[FRER_STREAM_UNDO_IFLOW] = "iflow rollback",
+	[FRER_STREAM_UNDO_CS] = "cs rollback",
+	[FRER_STREAM_UNDO_MS1] = "ms dev1 rollback",
+	[FRER_STREAM_UNDO_MS2] = "ms dev2 rollback",
+	[FRER_STREAM_UNDO_MSA] = "msf",
+};
+
+/* One redundant stream: an ingress flow replicated to or recovered from
+ * two egress ports, through one member stream and one compound stream.
+ */
+struct frer_stream_desc {
+	u32 iflow_id;
+	u32 ifindex1;
+	u32 ifindex2;
+	struct mchp_frer_stream_cfg rcvy; /* Recovery of both cs and ms */
+	bool generation;
+	bool pop;
+	bool split;
+
+	u32 ms_id;
+	struct mchp_frer_stream_cfg cs_old;
+	struct mchp_iflow_cmb_cfg iflow_old;
+	int rc[FRER_STREAM_STEPS];
+};
+
+struct frer_stream_set {
+	struct frer_stream_desc *descs;
+	unsigned int cnt;
+	unsigned int size;
+};
+
+/* Descriptors read with --file, see frer_stream_desc_add() */
+static struct frer_stream_set frer_stream_set;
+
+static int frer_stream_ms_set(struct mchp_genl_session *s, u32 ifindex,
+			      u32 ms_id, const struct mchp_frer_stream_cfg *cfg,
+			      int *err)
+{
+	struct nl_msg *msg;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_CFG_SET, NULL, NULL, err);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, ms_id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, ifindex);
+	NLA_PUT(msg, MCHP_FRER_ATTR_STREAM_CFG, sizeof(*cfg), cfg);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int frer_stream_cs_set(struct mchp_genl_session *s, u32 cs_id,
+			      const struct mchp_frer_stream_cfg *cfg, int *err)
+{
+	struct nl_msg *msg;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_CS_CFG_SET, NULL, NULL, err);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, cs_id);
+	NLA_PUT(msg, MCHP_FRER_ATTR_STREAM_CFG, sizeof(*cfg), cfg);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static int frer_stream_iflow_set(struct mchp_genl_session *s, u32 id,
+				 const struct mchp_iflow_cmb_cfg *cfg, int *err)
+{
+	struct nl_msg *msg;
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_IFLOW_CFG_SET, NULL, NULL, err);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, id);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, cfg->ifindex1);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, cfg->ifindex2);
+	NLA_PUT(msg, MCHP_FRER_ATTR_IFLOW_CFG, sizeof(cfg->iflow), &cfg->iflow);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* Allocate the member stream and save the configuration to restore */
+static int frer_stream_prepare(struct mchp_genl_session *s,
+			       struct frer_stream_desc *d)
+{
+	struct nl_msg *msg;
+
+	/* A lost reply must not allocate a second member stream */
+	msg = mchp_genl_req_reserve(s, MCHP_FRER_GENL_MS_ALLOC,
+				    NLM_F_REQUEST | NLM_F_ACK |
+				    MCHP_GENL_F_NO_REPLAY,
+				    MCHP_GENL_MSG_SMALL_SIZE,
+				    mchp_frer_genl_ms_alloc_cb, &d->ms_id,
+				    &d->rc[FRER_STREAM_MSA]);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV1, d->ifindex1);
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_DEV2, d->ifindex2);
+
+	msg = mchp_genl_get(s, MCHP_FRER_GENL_CS_CFG_GET,
+			    mchp_frer_genl_cs_cfg_get_cb, &d->cs_old,
+			    &d->rc[FRER_STREAM_CS_GET]);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, d->rcvy.cs_id);
+
+	msg = mchp_genl_get(s, MCHP_FRER_GENL_IFLOW_CFG_GET,
+			    mchp_frer_genl_iflow_cfg_get_cb, &d->iflow_old,
+			    &d->rc[FRER_STREAM_IFLOW_GET]);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, d->iflow_id);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* Recovery on the member streams first, the ingress flow last, so no
+ * traffic is steered into the stream before it is complete.
+ */
+static int frer_stream_commit(struct mchp_genl_session *s,
+			      struct frer_stream_desc *d)
+{
+	struct mchp_iflow_cmb_cfg iflow = {};
+	struct mchp_frer_stream_cfg cs;
+	int rc;
+
+	rc = frer_stream_ms_set(s, d->ifindex1, d->ms_id, &d->rcvy,
+				&d->rc[FRER_STREAM_MS1]);
+	if (rc < 0)
+		return rc;
+
+	if (d->ifindex2) {
+		rc = frer_stream_ms_set(s, d->ifindex2, d->ms_id, &d->rcvy,
+					&d->rc[FRER_STREAM_MS2]);
+		if (rc < 0)
+			return rc;
+	}
+
+	cs = d->rcvy;
+	cs.cs_id = 0;
+	rc = frer_stream_cs_set(s, d->rcvy.cs_id, &cs, &d->rc[FRER_STREAM_CS]);
+	if (rc < 0)
+		return rc;
+
+	iflow.iflow.frer.ms_enable = true;
+	iflow.iflow.frer.ms_id = d->ms_id;
+	iflow.iflow.frer.generation = d->generation;
+	iflow.iflow.frer.pop = d->pop;
+	if (d->split) {
+		iflow.ifindex1 = d->ifindex1;
+		iflow.ifindex2 = d->ifindex2;
+	}
+
+	return frer_stream_iflow_set(s, d->iflow_id, &iflow,
+				     &d->rc[FRER_STREAM_IFLOW]);
+}
+
+/* Undo a stream in reverse order. Everything written is restored,
+ * whether the write failed or not.
+ */
+static int frer_stream_rollback(struct mchp_genl_session *s,
+				struct frer_stream_desc *d)
+{
+	struct mchp_frer_stream_cfg off = {};
+	struct nl_msg *msg;
+	int rc;
+
+	if (!d->rc[FRER_STREAM_CS_GET] && !d->rc[FRER_STREAM_IFLOW_GET]) {
+		rc = frer_stream_iflow_set(s, d->iflow_id, &d->iflow_old,
+					   &d->rc[FRER_STREAM_UNDO_IFLOW]);
+		if (rc < 0)
+			return rc;
+
+		rc = frer_stream_cs_set(s, d->rcvy.cs_id, &d->cs_old,
+					&d->rc[FRER_STREAM_UNDO_CS]);
+		if (rc < 0)
+			return rc;
+
+		rc = frer_stream_ms_set(s, d->ifindex1, d->ms_id, &off,
+					&d->rc[FRER_STREAM_UNDO_MS1]);
+		if (rc < 0)
+			return rc;
+
+		if (d->ifindex2) {
+			rc = frer_stream_ms_set(s, d->ifindex2, d->ms_id, &off,
+						&d->rc[FRER_STREAM_UNDO_MS2]);
+			if (rc < 0)
+				return rc;
+		}
+	}
+
+	msg = mchp_genl_req(s, MCHP_FRER_GENL_MS_FREE, NULL, NULL,
+			    &d->rc[FRER_STREAM_UNDO_MSA]);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, d->ms_id);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static bool frer_stream_failed(const struct frer_stream_desc *d,
+			       enum frer_stream_step last)
+{
+	enum frer_stream_step i;
+
+	for (i = 0; i <= last; i++)
+		if (d->rc[i])
+			return true;
+
+	return false;
+}
+
+/* Build all streams in three flushes, regardless of their number: the
+ * allocations, then the configuration, then the rollback of the streams
+ * that failed.
+ */
+static int mchp_frer_genl_stream_add(struct mchp_genl_session *s,
+				     struct frer_stream_desc *descs,
+				     unsigned int cnt)
+{
+	RETURN_IF_PC;
+	struct frer_stream_desc *d;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < cnt; i++) {
+		rc = frer_stream_prepare(s, &descs[i]);
+		if (rc < 0)
+			return rc;
+	}
+	mchp_genl_flush(s);
+
+	for (i = 0; i < cnt; i++) {
+		d = &descs[i];
+		if (frer_stream_failed(d, FRER_STREAM_IFLOW_GET))
+			continue;
+
+		rc = frer_stream_commit(s, d);
+		if (rc < 0)
+			return rc;
+	}
+	mchp_genl_flush(s);
+
+	for (i = 0; i < cnt; i++) {
+		d = &descs[i];
+		if (d->rc[FRER_STREAM_MSA] ||
+		    !frer_stream_failed(d, FRER_STREAM_IFLOW))
+			continue;
+
+		rc = frer_stream_rollback(s, d);
+		if (rc < 0)
+			return rc;
+	}
+	mchp_genl_flush(s);
+
+	return 0;
+}
+
+/* Parse one descriptor, argv[0] being the ingress flow ID */
+static int frer_stream_desc_parse(int argc, char *const *argv,
+				  struct frer_stream_desc *d)
+{
+	static struct option long_options[] =
+	{
+		{"cs_id", required_argument, NULL, 'a'},
+		{"alg", required_argument, NULL, 'b'},
+		{"hlen", required_argument, NULL, 'c'},
+		{"reset_time", required_argument, NULL, 'd'},
+		{"take_no_seq", required_argument, NULL, 'e'},
+		{"generation", required_argument, NULL, 'f'},
+		{"pop", required_argument, NULL, 'g'},
+		{"split", no_argument, NULL, 'i'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	bool cs_id = false;
+	int ch;
 
-	memcpy(&tmp, &cfg, sizeof(cfg));
+	memset(d, 0, sizeof(*d));
+	d->rcvy.enable = true;
+	d->iflow_id = atoi(argv[0]);
 
-	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:fh", long_options, NULL)) != -1) {
+	optind = 0;
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:f:g:ih", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.iflow.frer.ms_enable = !!atoi(optarg);
+			d->rcvy.cs_id = atoi(optarg);
+			cs_id = true;
 			break;
 		case 'b':
-			cfg.iflow.frer.ms_id = atoi(optarg);
+			d->rcvy.alg = !!atoi(optarg);
 			break;
 		case 'c':
-			cfg.iflow.frer.generation = !!atoi(optarg);
+			d->rcvy.hlen = atoi(optarg);
 			break;
 		case 'd':
-			cfg.iflow.frer.pop = !!atoi(optarg);
+			d->rcvy.reset_time = atoi(optarg);
 			break;
 		case 'e':
-			if (optarg[0] == '-') {
-				cfg.ifindex1 = 0; /* Remove device */
-			} else {
-				cfg.ifindex1 = if_nametoindex(optarg);
-				if (cfg.ifindex1 == 0) {
-					fprintf(stderr, "%s: %s!\n", optarg, strerror(errno));
-					return 1;
-				}
-			}
+			d->rcvy.take_no_seq = !!atoi(optarg);
 			break;
 		case 'f':
-			if (optarg[0] == '-') {
-				cfg.ifindex2 = 0; /* Remove device */
-			} else {
-				cfg.ifindex2 = if_nametoindex(optarg);
-				if (cfg.ifindex2 == 0) {
-					fprintf(stderr, "%s: %s!\n", optarg, strerror(errno));
-					return 1;
-				}
-			}
+			d->generation = !!atoi(optarg);
+			break;
+		case 'g':
+			d->pop = !!atoi(optarg);
+			break;
+		case 'i':
+			d->split = true;
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
-			break;
+			return 1;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
+	/* The egress devices follow the options after permutation */
+	if (optind >= argc || argc - optind > 2 || !cs_id) {
+		fprintf(stderr, "Missing argument!\n");
+		return 1;
 	}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		char if1[IF_NAMESIZE] = {};
-		char if2[IF_NAMESIZE] = {};
-		if (!if_indextoname(cfg.ifindex1, if1))
-			if1[0] = '-';
-		if (!if_indextoname(cfg.ifindex2, if2))
-			if2[0] = '-';
-		printf("%-14s %8d\n", "ms_enable:", cfg.iflow.frer.ms_enable);
-		printf("%-14s %8u\n", "ms_id:", cfg.iflow.frer.ms_id);
-		printf("%-14s %8d\n", "generation:", cfg.iflow.frer.generation);
-		printf("%-14s %8d\n", "pop:", cfg.iflow.frer.pop);
-		printf("%-14s %8s\n", "dev1:", if1 ? if1 : "-");
-		printf("%-14s %8s\n", "dev2:", if2 ? if2 : "-");
-		return 0;
+	d->ifindex1 = if_nametoindex(argv[optind]);
+	if (d->ifindex1 == 0) {
+		fprintf(stderr, "%s: %s!\n", argv[optind], strerror(errno));
+		return 1;
+	}
+
+	if (++optind < argc) {
+		d->ifindex2 = if_nametoindex(argv[optind]);
+		if (d->ifindex2 == 0) {
+			fprintf(stderr, "%s: %s!\n", argv[optind],
+				strerror(errno));
+			return 1;
+		}
 	}
 
-	return mchp_frer_genl_iflow_cfg_set(id, &cfg);
+	return 0;
 }
 
-/* cmd_vlan */
-static int mchp_frer_genl_vlan_cfg_set(u32 vid,
-					  const struct mchp_frer_vlan_cfg *cfg)
+/* Called by mchp_batch_run() for every descriptor line of --file. The
+ * rollback of a stream restores its cs and iflow as read before any set,
+ * so streams sharing one of them are refused: a rollback would undo the
+ * stream that succeeded.
+ */
+static int frer_stream_desc_add(int argc, char **argv, int line_num)
 {
-	RETURN_IF_PC;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
+	struct frer_stream_set *set = &frer_stream_set;
+	const struct frer_stream_desc *o;
+	struct frer_stream_desc *d;
+	unsigned int i;
+
+	if (set->cnt == set->size) {
+		d = realloc(set->descs, (set->size + 256) * sizeof(*d));
+		if (!d)
+			return -1;
+		set->descs = d;
+		set->size += 256;
+	}
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_VLAN_CFG_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	d = &set->descs[set->cnt];
+	if (frer_stream_desc_parse(argc, argv, d))
+		return 1;
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, vid);
-	NLA_PUT(msg, MCHP_FRER_ATTR_VLAN_CFG, sizeof(*cfg), cfg);
+	for (i = 0; i < set->cnt; i++) {
+		o = &set->descs[i];
+		if (o->rcvy.cs_id != d->rcvy.cs_id && o->iflow_id != d->iflow_id)
+			continue;
+
+		fprintf(stderr, "Error on line %d:\n", line_num);
+		if (o->iflow_id == d->iflow_id)
+			fprintf(stderr, "iflow %u is in another stream\n",
+				d->iflow_id);
+		else
+			fprintf(stderr, "cs_id %u is in another stream\n",
+				d->rcvy.cs_id);
+		return 1;
+	}
+	set->cnt++;
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	return 0;
+}
+
+static char *mchp_frer_stream_help(void)
+{
+	return "--cs_id:                  Compound stream ID\n"
+		" --alg:                    frerSeqRcvyAlgorithm (0: Vector, 1: Match)\n"
+		" --hlen:                   frerSeqRcvyHistoryLength\n"
+		" --reset_time:             frerSeqRcvyResetMSec\n"
+		" --take_no_seq:            frerSeqRcvyTakeNoSequence\n"
+		" --generation:             Enable sequence generation\n"
+		" --pop:                    Enable popping of R-tag\n"
+		" --split:                  Split the ingress flow to dev1 and dev2\n"
+		" --file:                   Add the streams of a file, one per line,\n"
+		"                           each with an iflow and cs_id of its own\n"
+		" --help:                   Show this help text\n";
+}
+
+static int cmd_stream(const struct command *cmd, int argc, char *const *argv)
+{
+	struct frer_stream_set *set = &frer_stream_set;
+	static struct frer_ms_mirror m;
+	struct frer_stream_desc one;
+	struct frer_stream_desc *d;
+	bool undone;
+	unsigned int i;
+	int j, rc;
+
+	if (strcmp(argv[0], "add") != 0 || argc < 2) {
+		command_help(cmd);
+		return strcmp(argv[0], "--help") != 0;
 	}
+	argc--;
+	argv++;
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	if (strcmp(argv[0], "--help") == 0) {
+		command_help(cmd);
+		return 0;
+	}
+
+	if (strcmp(argv[0], "--file") == 0) {
+		if (argc < 2) {
+			fprintf(stderr, "Missing argument!\n");
+			return 1;
+		}
+		rc = mchp_batch_run(argv[1], false, frer_stream_desc_add);
+		if (rc)
+			goto out;
+		d = set->descs;
+	} else {
+		if (frer_stream_desc_parse(argc, argv, &one)) {
+			command_help(cmd);
+			return 1;
+		}
+		d = &one;
+		set->cnt = 1;
+	}
+
+	rc = mchp_frer_genl_stream_add(&frer_session, d, set->cnt);
+	if (rc < 0) {
+		printf("mchp_frer_genl_stream_add() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
+		goto out;
+	}
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	for (i = 0; i < set->cnt; i++) {
+		if (!frer_stream_failed(&d[i], FRER_STREAM_IFLOW)) {
+			printf("iflow %u: ms_id %u\n", d[i].iflow_id, d[i].ms_id);
+			continue;
+		}
+
+		rc = 1;
+		undone = !d[i].rc[FRER_STREAM_MSA];
+		for (j = 0; j < FRER_STREAM_STEPS; j++) {
+			if (!d[i].rc[j])
+				continue;
+			printf("iflow %u: %s failed (%s)\n", d[i].iflow_id,
+			       frer_stream_step_names[j],
+			       nl_geterror(d[i].rc[j]));
+			if (j > FRER_STREAM_IFLOW)
+				undone = false;
+		}
+		if (undone)
+			printf("iflow %u: rolled back\n", d[i].iflow_id);
+	}
+
+	/* Member streams not freed again by the rollback are kept */
+	if (!frer_ms_mirror_open(&m)) {
+		for (i = 0; i < set->cnt; i++)
+			if (!d[i].rc[FRER_STREAM_MSA] &&
+			    (!frer_stream_failed(&d[i], FRER_STREAM_IFLOW) ||
+			     d[i].rc[FRER_STREAM_UNDO_MSA]))
+				frer_ms_mirror_set(&m, d[i].ms_id, true,
+						   frer_ms_now());
+		frer_ms_mirror_close(&m, true);
+	}
 
+out:
+	free(set->descs);
+	memset(set, 0, sizeof(*set));
 	return rc;
 }
 
-static int mchp_frer_genl_vlan_cfg_get_cb(struct nl_msg *msg, void *arg)
+/* cmd_health */
+#define FRER_HEALTH_DEGRADED (1 << 0) /* Member stream missing packets */
+#define FRER_HEALTH_ROGUE    (1 << 1) /* Burst of rogue packets */
+#define FRER_HEALTH_RESETS   (1 << 2) /* Recovery reset with traffic */
+
+#define FRER_HEALTH_WINDOW_MAX 1000
+
+/* Counter deltas of a stream over one sampling interval */
+struct frer_health_sample {
+	u32 rx; /* Passed, discarded and rogue */
+	u32 passed;
+	u32 lost;
+	u32 rogue;
+	u32 resets;
+};
+
+struct frer_health_stream {
+	struct frer_entry *e;
+	struct mchp_frer_cnt prev;
+	struct frer_health_sample sum;   /* Over the window */
+	struct frer_health_sample *ring; /* The window, oldest at the head */
+	int cs; /* Member streams: index of their compound stream */
+	u32 miss; /* Missing share of a member stream, or best of the
+		   * member streams of a compound stream, in 1/10000
+		   */
+	bool valid;
+	unsigned int flags;
+};
+
+struct frer_health {
+	struct frer_dump cs;
+	struct frer_dump ms;
+	struct frer_dump scratch; /* Counter dumps, reused by every sample */
+	struct frer_health_stream *streams; /* Compound streams first */
+	struct frer_health_sample *ring;
+	unsigned int ncs;
+	unsigned int nms;
+	unsigned int window;
+	unsigned int head;
+	unsigned int interval; /* ms */
+	u32 loss;              /* 1/10000 */
+	u32 burst;
+	unsigned int flagged;
+};
+
+static volatile sig_atomic_t frer_health_stop;
+
+static void frer_health_sigint(int sig)
+{
+	(void)sig;
+	frer_health_stop = 1;
+}
+
+static u64 frer_health_now_ns(void)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
-	struct nlattr *attrs[MCHP_FRER_ATTR_END];
-	struct mchp_frer_vlan_cfg *cfg = arg;
+	struct timespec ts;
 
-	if (nla_parse(attrs, MCHP_FRER_ATTR_MAX, genlmsg_attrdata(hdr, 0),
-		      genlmsg_attrlen(hdr, 0), mchp_frer_genl_policy)) {
-		printf("nla_parse() failed\n");
-		return NL_STOP;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Counters cleared in between start over from 0 */
+static u32 frer_health_delta(u64 now, u64 prev)
+{
+	return now >= prev ? now - prev : now;
+}
+
+/* Replace the oldest sample of the window by the deltas since the last
+ * read, keeping the sum over the window up to date.
+ */
+static void frer_health_push(struct frer_health *h,
+			     struct frer_health_stream *st)
+{
+	struct frer_health_sample *old = &st->ring[h->head];
+	const struct mchp_frer_cnt *c = &st->e->cnt;
+	struct frer_health_sample new = {};
+
+	if (st->valid && !st->e->cnt_rc) {
+		new.passed = frer_health_delta(c->passed_packets,
+					       st->prev.passed_packets);
+		new.lost = frer_health_delta(c->lost_packets,
+					     st->prev.lost_packets);
+		new.rogue = frer_health_delta(c->rogue_packets,
+					      st->prev.rogue_packets);
+		new.resets = frer_health_delta(c->resets, st->prev.resets);
+		new.rx = new.passed + new.rogue +
+			 frer_health_delta(c->discarded_packets,
+					   st->prev.discarded_packets);
+	}
+	if (!st->e->cnt_rc) {
+		st->prev = *c;
+		st->valid = true;
 	}
 
-	if (!attrs[MCHP_FRER_ATTR_VLAN_CFG]) {
-		printf("ATTR_VLAN_CFG not found\n");
-		return -1;
+	st->sum.rx += new.rx - old->rx;
+	st->sum.passed += new.passed - old->passed;
+	st->sum.lost += new.lost - old->lost;
+	st->sum.rogue += new.rogue - old->rogue;
+	st->sum.resets += new.resets - old->resets;
+	*old = new;
+}
+
+static u32 frer_health_rogue_max(const struct frer_health *h,
+				 const struct frer_health_stream *st)
+{
+	unsigned int i;
+	u32 max = 0;
+
+	for (i = 0; i < h->window; i++)
+		if (st->ring[i].rogue > max)
+			max = st->ring[i].rogue;
+
+	return max;
+}
+
+static void frer_health_name(const struct frer_health *h,
+			     const struct frer_health_stream *st)
+{
+	char ifname[IF_NAMESIZE];
+
+	if (st->cs < 0) {
+		printf("cs %u", st->e->id);
+		return;
 	}
+	if (!if_indextoname(st->e->ifindex1, ifname))
+		strcpy(ifname, "-");
+	printf("ms %s %u (cs %u)", ifname, st->e->id,
+	       h->streams[st->cs].e->id);
+}
 
-	nla_memcpy(cfg, attrs[MCHP_FRER_ATTR_VLAN_CFG],
-		   sizeof(struct mchp_frer_vlan_cfg));
+static void frer_health_event(const struct frer_health *h,
+			      const struct frer_health_stream *st,
+			      unsigned int flag, bool set, u64 t_ms)
+{
+	printf("[%8" PRIu64 ".%03u] ", t_ms / 1000, (unsigned int)(t_ms % 1000));
+	frer_health_name(h, st);
+
+	switch (flag) {
+	case FRER_HEALTH_DEGRADED:
+		printf(": path degraded");
+		if (set)
+			printf(", %u.%02u%% missing, best path %u.%02u%%",
+			       st->miss / 100, st->miss % 100,
+			       h->streams[st->cs].miss / 100,
+			       h->streams[st->cs].miss % 100);
+		break;
+	case FRER_HEALTH_ROGUE:
+		printf(": rogue burst");
+		if (set)
+			printf(", %u in %u ms", frer_health_rogue_max(h, st),
+			       h->interval);
+		break;
+	case FRER_HEALTH_RESETS:
+		printf(": resets with traffic");
+		if (set)
+			printf(", %u in %u ms", st->sum.resets,
+			       h->window * h->interval);
+		break;
+	}
+	printf("%s\n", set ? "" : " cleared");
+}
 
-	return NL_OK;
+/* Score the window of every stream after a new sample. A member stream
+ * is missing the packets its compound stream passed or lost but it did
+ * not receive. It is degraded when it misses more than the loss
+ * threshold beyond the best member stream, so loss before replication
+ * does not blame any single path.
+ */
+static void frer_health_update(struct frer_health *h, u64 t_ms)
+{
+	struct frer_health_stream *st, *cs;
+	unsigned int i, flags, bit;
+	u32 total;
+
+	for (i = 0; i < h->ncs + h->nms; i++)
+		frer_health_push(h, &h->streams[i]);
+	h->head = (h->head + 1) % h->window;
+
+	for (i = 0; i < h->ncs; i++)
+		h->streams[i].miss = 10000;
+
+	for (i = h->ncs; i < h->ncs + h->nms; i++) {
+		st = &h->streams[i];
+		cs = &h->streams[st->cs];
+		total = cs->sum.passed + cs->sum.lost;
+		st->miss = 0;
+		if (total > st->sum.rx)
+			st->miss = (u64)(total - st->sum.rx) * 10000 / total;
+		if (st->miss < cs->miss)
+			cs->miss = st->miss;
+	}
+
+	for (i = 0; i < h->ncs + h->nms; i++) {
+		st = &h->streams[i];
+		flags = 0;
+		if (st->cs >= 0 && st->miss >= h->loss &&
+		    st->miss - h->streams[st->cs].miss >= h->loss)
+			flags |= FRER_HEALTH_DEGRADED;
+		if (st->sum.rogue >= h->burst &&
+		    frer_health_rogue_max(h, st) >= h->burst)
+			flags |= FRER_HEALTH_ROGUE;
+		if (st->sum.resets && st->sum.passed)
+			flags |= FRER_HEALTH_RESETS;
+
+		for (bit = 1; bit <= FRER_HEALTH_RESETS; bit <<= 1)
+			if ((flags ^ st->flags) & bit)
+				frer_health_event(h, st, bit, flags & bit,
+						  t_ms);
+		if (flags && !st->flags)
+			h->flagged++;
+		st->flags = flags;
+	}
 }
 
-static int mchp_frer_genl_vlan_cfg_get(u32 vid,
-					  struct mchp_frer_vlan_cfg *cfg)
+/* Find the compound streams to watch, either all enabled ones or those of
+ * an ID list, and the enabled member streams recovering for them.
+ */
+static int frer_health_init(struct frer_health *h, const char *list)
 {
-	RETURN_IF_PC;
-	struct mchp_frer_vlan_cfg tmp;
-	struct nl_sock *sk;
-	struct nl_msg *msg;
-	int rc = 0;
+	struct frer_entry key = {}, *e;
+	unsigned int i, n, size;
+	uint32_t *ids;
+	int rc;
+
+	if (strcmp(list, "--all") == 0) {
+		rc = mchp_frer_genl_dump(&frer_session,
+					 MCHP_FRER_GENL_CS_CFG_GET, &h->cs);
+		if (rc < 0)
+			return rc;
+	} else {
+		ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+		if (!ids)
+			return -1;
+
+		rc = mchp_id_list_parse(list, ids, MCHP_ID_LIST_MAX);
+		if (rc < 0) {
+			free(ids);
+			return rc;
+		}
+
+		h->cs.entries = calloc(rc, sizeof(*h->cs.entries));
+		if (!h->cs.entries) {
+			free(ids);
+			return -1;
+		}
+		h->cs.cnt = h->cs.size = rc;
+		for (i = 0; i < h->cs.cnt; i++)
+			h->cs.entries[i].id = ids[i];
+		free(ids);
+
+		mchp_frer_genl_get_list(&frer_session, false, false, false,
+					&h->cs);
+		for (i = 0; i < h->cs.cnt; i++)
+			if (h->cs.entries[i].cfg_rc)
+				printf("cs %u: %s\n", h->cs.entries[i].id,
+				       nl_geterror(h->cs.entries[i].cfg_rc));
+		frer_dump_sort(&h->cs, false);
+	}
+
+	size = h->cs.cnt;
+	for (i = 0, n = 0; i < h->cs.cnt; i++)
+		if (!h->cs.entries[i].cfg_rc && h->cs.entries[i].stream.enable)
+			h->cs.entries[n++] = h->cs.entries[i];
+	h->cs.cnt = n;
 
-	rc = mchp_genl_start(MCHP_FRER_NETLINK,
-				MCHP_FRER_GENL_VLAN_CFG_GET, 1, &sk, &msg);
+	rc = mchp_frer_genl_dump(&frer_session, MCHP_FRER_GENL_MS_CFG_GET,
+				 &h->ms);
 	if (rc < 0)
 		return rc;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_frer_genl_vlan_cfg_get_cb, &tmp);
+	/* A counter dump returns disabled and unlisted streams too, so size
+	 * the scratch for all streams read above. Only an ID list leaves
+	 * compound streams unread, those the dump callback grows it for.
+	 */
+	if (size < h->ms.cnt)
+		size = h->ms.cnt;
+	h->scratch.size = size;
+	h->scratch.entries = calloc(h->scratch.size ? h->scratch.size : 1,
+				    sizeof(*h->scratch.entries));
+	if (!h->scratch.entries)
+		return -1;
 
-	NLA_PUT_U32(msg, MCHP_FRER_ATTR_ID, vid);
+	h->ncs = h->cs.cnt;
+	h->streams = calloc(h->cs.cnt + h->ms.cnt, sizeof(*h->streams));
+	if (!h->streams)
+		return -1;
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+	for (i = 0; i < h->ncs; i++) {
+		h->streams[i].e = &h->cs.entries[i];
+		h->streams[i].cs = -1;
 	}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
+	for (i = 0, n = 0; i < h->ms.cnt; i++) {
+		if (!h->ms.entries[i].stream.enable)
+			continue;
+		key.id = h->ms.entries[i].stream.cs_id;
+		e = bsearch(&key, h->cs.entries, h->cs.cnt,
+			    sizeof(*h->cs.entries), frer_entry_cmp);
+		if (!e)
+			continue;
+		h->ms.entries[n] = h->ms.entries[i];
+		h->streams[h->ncs + n].e = &h->ms.entries[n];
+		h->streams[h->ncs + n].cs = e - h->cs.entries;
+		n++;
 	}
+	h->ms.cnt = h->nms = n;
 
-	memcpy(cfg, &tmp, sizeof(tmp));
+	/* One block for the windows of all streams, nothing allocated later */
+	h->ring = calloc((size_t)(h->ncs + h->nms) * h->window,
+			 sizeof(*h->ring));
+	if (!h->ring)
+		return -1;
+	for (i = 0; i < h->ncs + h->nms; i++)
+		h->streams[i].ring = &h->ring[(size_t)i * h->window];
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	return 0;
+}
+
+/* Read the counters of all watched streams, two dumps per sample */
+static int frer_health_sample(struct frer_health *h)
+{
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < h->ncs + h->nms; i++)
+		h->streams[i].e->cnt_rc = 0;
+
+	if (h->ncs)
+		rc = mchp_frer_genl_dump_cnt(&frer_session,
+					     MCHP_FRER_GENL_CS_CNT_GET, &h->cs,
+					     &h->scratch);
+	if (!rc && h->nms)
+		rc = mchp_frer_genl_dump_cnt(&frer_session,
+					     MCHP_FRER_GENL_MS_CNT_GET, &h->ms,
+					     &h->scratch);
+
+	/* A failed read keeps the last counters, the next delta spans both */
+	if (rc < 0)
+		for (i = 0; i < h->ncs + h->nms; i++)
+			h->streams[i].e->cnt_rc = rc;
 
 	return rc;
 }
 
-static char *mchp_frer_vlan_help(void)
+static char *mchp_frer_health_help(void)
 {
-	return "--flood_disable:          Disable flooding in VLAN\n"
-		" --learn_disable:          Disable learning in VLAN\n"
-		" --help:                   Show this help text\n";
+	return "--interval:               Sampling interval in ms (default 100)\n"
+		" --window:                 Samples per sliding window (default 10)\n"
+		" --count:                  Samples to take (default: until interrupted)\n"
+		" --loss:                   Missing percentage of a degraded path (default 1)\n"
+		" --burst:                  Rogue packets of a burst in one sample (default 8)\n"
+		" --help:                   Show this help text\n"
+		"Member streams are paths of the compound stream given by their cs_id,\n"
+		"only streams with recovery enabled are watched.\n";
 }
 
-static int cmd_vlan(const struct command *cmd, int argc, char *const *argv)
+static int cmd_health(const struct command *cmd, int argc, char *const *argv)
 {
 	static struct option long_options[] =
 	{
-		{"flood_disable", required_argument, NULL, 'a'},
-		{"learn_disable", required_argument, NULL, 'b'},
+		{"interval", required_argument, NULL, 'a'},
+		{"window", required_argument, NULL, 'b'},
+		{"count", required_argument, NULL, 'c'},
+		{"loss", required_argument, NULL, 'd'},
+		{"burst", required_argument, NULL, 'e'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_frer_vlan_cfg cfg = {};
-	struct mchp_frer_vlan_cfg tmp;
+	struct frer_health h = {
+		.window = 10,
+		.interval = 100,
+		.loss = 100,
+		.burst = 8,
+	};
+	unsigned int n, count = 0, late = 0;
+	u64 start, next, now;
+	struct timespec ts;
 	int do_help = 0;
-	u32 vid = 0;
-	int ch;
-
-	/* read the id */
-	vid = atoi(argv[0]);
-
-	if (mchp_frer_genl_vlan_cfg_get(vid, &cfg) < 0)
-		return 0;
-
-	memcpy(&tmp, &cfg, sizeof(cfg));
+	int ch, rc;
 
-	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.flood_disable = !!atoi(optarg);
+			h.interval = atoi(optarg);
 			break;
 		case 'b':
-			cfg.learn_disable = !!atoi(optarg);
+			h.window = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'd':
+			h.loss = atof(optarg) * 100;
+			break;
+		case 'e':
+			h.burst = atoi(optarg);
 			break;
 		case 'h':
 		case '?':
@@ -1214,29 +3791,70 @@ static int cmd_vlan(const struct command *cmd, int argc, char *const *argv)
 		}
 	}
 
-	if (do_help) {
+	if (do_help || strcmp(argv[0], "--help") == 0) {
 		command_help(cmd);
 		return 0;
 	}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("%-14s %8d\n", "flood_disable:", cfg.flood_disable);
-		printf("%-14s %8d\n", "learn_disable:", cfg.learn_disable);
-		return 0;
+	if (!h.interval || !h.window || h.window > FRER_HEALTH_WINDOW_MAX) {
+		fprintf(stderr, "Invalid interval or window!\n");
+		return 1;
+	}
+
+	rc = frer_health_init(&h, argv[0]);
+	if (rc)
+		goto out;
+
+	printf("Watching %u cs and %u ms streams, %u x %u ms window\n",
+	       h.ncs, h.nms, h.window, h.interval);
+
+	frer_health_stop = 0;
+	signal(SIGINT, frer_health_sigint);
+
+	start = next = frer_health_now_ns();
+	for (n = 0; !frer_health_stop && (!count || n <= count); n++) {
+		if (frer_health_sample(&h) < 0)
+			printf("Sample %u failed\n", n);
+		/* The first sample is the baseline of the deltas */
+		if (n)
+			frer_health_update(&h, (next - start) / 1000000);
+
+		next += h.interval * 1000000ULL;
+		now = frer_health_now_ns();
+		if (now > next) {
+			/* Keep the pace rather than catching up */
+			late++;
+			next = now;
+		}
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
 	}
 
-	return mchp_frer_genl_vlan_cfg_set(vid, &cfg);
+	signal(SIGINT, SIG_DFL);
+	printf("%u samples, %u late, %u streams flagged\n", n ? n - 1 : 0,
+	       late, h.flagged);
+
+out:
+	free(h.ring);
+	free(h.streams);
+	frer_dump_free(&h.scratch);
+	frer_dump_free(&h.cs);
+	frer_dump_free(&h.ms);
+	return rc;
 }
 
 /* commands */
 static const struct command commands[] =
 {
-	{1, "cs", cmd_cs, "cs cs_id [options]", mchp_frer_cs_help},
+	{1, "cs", cmd_cs, "cs cs_id|id_list|--all [options]", mchp_frer_cs_help},
 	{1, "msa", cmd_msa, "msa dev1 [dev2] [options]", mchp_frer_msa_help},
-	{1, "msf", cmd_msf, "msf ms_id [options]", mchp_frer_msf_help},
-	{2, "ms", cmd_ms, "ms dev ms_id [options]", mchp_frer_ms_help},
-	{1, "iflow", cmd_iflow, "iflow id [options]", mchp_frer_iflow_help},
-	{1, "vlan", cmd_vlan, "vlan vid [options]", mchp_frer_vlan_help},
+	{1, "msf", cmd_msf, "msf ms_id|id_list|--unused|--list|--sync [options]", mchp_frer_msf_help},
+	{1, "ms", cmd_ms, "ms {dev ms_id|id_list}|--all [options]", mchp_frer_ms_help},
+	{1, "iflow", cmd_iflow, "iflow id|id_list|--all [options]", mchp_frer_iflow_help},
+	{1, "vlan", cmd_vlan, "vlan vid|id_list [options]", mchp_frer_vlan_help},
+	{1, "stream", cmd_stream, "stream add {iflow_id dev1 [dev2] --cs_id id [options]|--file file}", mchp_frer_stream_help},
+	{1, "health", cmd_health, "health cs_id|id_list|--all [options]", mchp_frer_health_help},
 };
 
 static void command_help(const struct command *cmd)
@@ -1252,9 +3870,11 @@ static void command_help_all(void)
 
 static void help(void)
 {
-	printf("Usage: frer cs|msa|msf|ms|iflow|vlan [options]\n");
+	printf("Usage: frer cs|msa|msf|ms|iflow|vlan|stream|health [options]\n");
 	printf("options:\n");
 	printf(" --help                    Show this help text\n");
+	printf(" --batch <file|->          Run the commands of a file, one per line\n");
+	printf("   --progress              Print \"@line <n>\" before every command\n");
 	printf("commands:\n");
 	command_help_all();
 }
@@ -1288,20 +3908,11 @@ static const struct command *command_lookup_and_validate(int argc,
 	return cmd;
 }
 
-int main(int argc, char *argv[])
+static int command_run(int argc, char **argv, int line_num)
 {
 	const struct command *cmd;
 
-	/* skip program name ('frer') */
-	argv++;
-	argc--;
-
-	if (!argc || (strcmp(argv[0], "--help") == 0)) {
-		help();
-		return 1;
-	}
-
-	cmd = command_lookup_and_validate(argc, argv, 0);
+	cmd = command_lookup_and_validate(argc, argv, line_num);
 	if (!cmd)
 		return 1;
 
@@ -1310,10 +3921,45 @@ int main(int argc, char *argv[])
 	argc--;
 
 	if (argc < cmd->nargs) {
+		if (line_num > 0)
+			fprintf(stderr, "Error on line %d:\n", line_num);
 		fprintf(stderr, "Missing argument!\n");
 		command_help(cmd);
 		return 1;
 	}
 
+	/* getopt state is kept between the commands of a batch */
+	optind = 0;
+
 	return cmd->func(cmd, argc, argv);
 }
+
+int main(int argc, char *argv[])
+{
+	int rc;
+
+	/* skip program name ('frer') */
+	argv++;
+	argc--;
+
+	if (!argc || (strcmp(argv[0], "--help") == 0)) {
+		help();
+		return 1;
+	}
+
+	if (strcmp(argv[0], "--batch") == 0) {
+		if (argc < 2) {
+			fprintf(stderr, "Missing argument!\n");
+			return 1;
+		}
+		rc = mchp_batch_run(argv[1], argc > 2 &&
+				   strcmp(argv[2], "--progress") == 0,
+				   command_run);
+	} else {
+		rc = command_run(argc, argv, 0);
+	}
+	mchp_genl_session_close(&frer_session);
+	free(frer_dump_spare.entries);
+
+	return rc;
+}
@@ -0,0 +1,117 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <string.h>
+#include "frer_rcvy.h"
+
+void frer_rcvy_init(struct frer_rcvy *r, const struct mchp_frer_stream_cfg *cfg)
+{
+	memset(r, 0, sizeof(*r));
+	r->cfg = *cfg;
+	if (r->cfg.hlen < 1)
+		r->cfg.hlen = 1;
+	if (r->cfg.hlen > FRER_RCVY_HLEN_MAX)
+		r->cfg.hlen = FRER_RCVY_HLEN_MAX;
+	r->take_any = true;
+}
+
+static u64 frer_rcvy_mask(unsigned int bits)
+{
+	return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+/* VectorRecoveryAlgorithm, 802.1CB 7.4.3.4 */
+static bool frer_rcvy_vector(struct frer_rcvy *r, u16 seq)
+{
+	int delta = (s16)(seq - r->seq);
+	unsigned int hlen = r->cfg.hlen;
+	u64 out;
+
+	if (delta >= (int)hlen || delta <= -(int)hlen) {
+		r->cnt.rogue_packets++;
+		return false;
+	}
+
+	if (delta <= 0) {
+		if (r->history & (1ULL << -delta)) {
+			r->cnt.discarded_packets++;
+			return false;
+		}
+		r->history |= 1ULL << -delta;
+		r->cnt.out_of_order_packets++;
+		return true;
+	}
+
+	/* Sequence numbers shifted out of the history unseen are lost */
+	out = (r->history >> (hlen - delta)) & frer_rcvy_mask(delta);
+	r->cnt.lost_packets += delta - __builtin_popcountll(out);
+
+	r->history = ((r->history << delta) | 1) & frer_rcvy_mask(hlen);
+	r->seq = seq;
+	if (delta != 1)
+		r->cnt.out_of_order_packets++;
+
+	return true;
+}
+
+/* MatchRecoveryAlgorithm, 802.1CB 7.4.3.5 */
+static bool frer_rcvy_match(struct frer_rcvy *r, u16 seq)
+{
+	int delta = (s16)(seq - r->seq);
+
+	if (delta == 0) {
+		r->cnt.discarded_packets++;
+		return false;
+	}
+
+	r->seq = seq;
+	if (delta != 1)
+		r->cnt.out_of_order_packets++;
+
+	return true;
+}
+
+/* Run one packet received at @ts_ns through recovery, @seq being its
+ * sequence number or -1 without R-tag. Returns true if it is passed.
+ */
+bool frer_rcvy_rx(struct frer_rcvy *r, u64 ts_ns, int seq)
+{
+	bool pass;
+
+	/* The reset timer runs out between packets, there are no ticks */
+	if (r->deadline_ns && ts_ns >= r->deadline_ns) {
+		r->cnt.resets++;
+		r->take_any = true;
+		r->deadline_ns = 0;
+	}
+
+	if (seq < 0) {
+		r->cnt.tagless_packets++;
+		if (!r->cfg.take_no_seq)
+			return false;
+		r->cnt.passed_packets++;
+		return true;
+	}
+
+	if (r->take_any) {
+		/* Sequence numbers before the first one are not lost */
+		r->take_any = false;
+		r->history = frer_rcvy_mask(r->cfg.hlen);
+		r->seq = seq;
+		pass = true;
+	} else if (r->cfg.alg == MCHP_FRER_REC_ALG_MATCH) {
+		pass = frer_rcvy_match(r, seq);
+	} else {
+		pass = frer_rcvy_vector(r, seq);
+	}
+
+	if (pass) {
+		r->cnt.passed_packets++;
+		if (r->cfg.reset_time)
+			r->deadline_ns = ts_ns + r->cfg.reset_time * 1000000ULL;
+	}
+
+	return pass;
+}
@@ -0,0 +1,29 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _FRER_RCVY_H_
+#define _FRER_RCVY_H_
+
+#include "kernel_types.h"
+#include "mchp_ui_qos.h"
+
+#define FRER_RCVY_HLEN_MAX 64
+
+/* Software model of the sequence recovery function of IEEE 802.1CB,
+ * counting into the same counters as the hardware.
+ */
+struct frer_rcvy {
+	struct mchp_frer_stream_cfg cfg;
+	struct mchp_frer_cnt cnt;
+	u64 history;     /* Bit n set: RecovSeqNum - n was passed (vector) */
+	u64 deadline_ns; /* Reset if no packet is passed before, 0: stopped */
+	u16 seq;         /* RecovSeqNum */
+	bool take_any;
+};
+
+void frer_rcvy_init(struct frer_rcvy *r, const struct mchp_frer_stream_cfg *cfg);
+bool frer_rcvy_rx(struct frer_rcvy *r, u64 ts_ns, int seq);
+
+#endif /* _FRER_RCVY_H_ */
@@ -0,0 +1,717 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Offline FRER sequence recovery.
+ *
+ * Reads captures taken on the member paths of redundant streams, merges
+ * them in timestamp order as they would arrive at the recovery point, and
+ * runs the R-tag sequence numbers of every stream through a software model
+ * of vector or match recovery. Streams are identified by destination MAC
+ * and VLAN, as by null stream identification.
+ *
+ * The captures are mapped, and every worker thread walks all of them but
+ * only runs recovery for its share of the streams. Streams need no locks
+ * that way, and parsing a header costs far less than reading it from disk.
+ *
+ * With --sweep the sequence numbers are extracted once, grouped by stream,
+ * and the worker threads take turns at running the whole trace through one
+ * recovery setting each, over a grid of algorithms, history lengths and
+ * reset times.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "frer_rcvy.h"
+#include "pcap.h"
+
+#define FRER_SIM_PATHS_MAX PCAP_MERGE_MAX
+#define FRER_SIM_THREADS   16
+
+#define ETH_P_8021Q  0x8100
+#define ETH_P_8021AD 0x88a8
+#define ETH_P_RTAG   0xf1c1 /* 802.1CB R-tag */
+
+#define FRER_SIM_NO_VID 0xffff
+
+#define FRER_SIM_SWEEP_HLEN  32
+#define FRER_SIM_RESET_TIMES 16
+
+struct frer_sim_stream {
+	u64 key; /* Destination MAC << 16 | VID */
+	bool used; /* Key 0 is a valid stream, so it cannot mark free slots */
+	struct frer_rcvy r;
+	u64 rx[FRER_SIM_PATHS_MAX];
+	unsigned int idx; /* Position in the sweep trace */
+};
+
+/* Open addressing, keyed on the stream */
+struct frer_sim_table {
+	struct frer_sim_stream *streams;
+	unsigned int size;
+	unsigned int cnt;
+};
+
+/* Sequence numbers grouped by stream, events first[i] up to first[i + 1]
+ * belonging to stream i.
+ */
+struct frer_sim_trace {
+	unsigned int nstreams;
+	size_t *first;
+	u64 *ts_ns;
+	int *seq;
+};
+
+struct frer_sim_setting {
+	struct mchp_frer_stream_cfg cfg;
+	struct mchp_frer_cnt cnt; /* Sum over all streams */
+};
+
+struct frer_sim;
+
+struct frer_sim_worker {
+	struct frer_sim *sim;
+	unsigned int id;
+	struct frer_sim_table table;
+	u64 packets;
+	int rc;
+};
+
+struct frer_sim {
+	struct pcap_file files[FRER_SIM_PATHS_MAX];
+	unsigned int nfiles;
+	struct mchp_frer_stream_cfg cfg;
+	unsigned int nworkers;
+	struct frer_sim_worker *workers;
+
+	/* --sweep */
+	struct frer_sim_trace trace;
+	struct frer_sim_setting *settings;
+	unsigned int nsettings;
+	unsigned int next; /* Next setting to be taken by a worker */
+	pthread_mutex_t lock;
+};
+
+static struct option long_options[] =
+{
+	{"alg", required_argument, NULL, 'a'},
+	{"hlen", required_argument, NULL, 'b'},
+	{"reset_time", required_argument, NULL, 'c'},
+	{"take_no_seq", required_argument, NULL, 'd'},
+	{"threads", required_argument, NULL, 'e'},
+	{"sweep", no_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+static void help(void)
+{
+	printf("Usage: frer-sim [options] path.pcap...\n");
+	printf("Run the captures of up to %d member paths through FRER recovery\n",
+	       FRER_SIM_PATHS_MAX);
+	printf("options:\n");
+	printf(" --alg <0|1>               frerSeqRcvyAlgorithm (0: Vector, 1: Match)\n");
+	printf(" --hlen <n>                frerSeqRcvyHistoryLength (default 2)\n");
+	printf(" --reset_time <ms[,ms]...> frerSeqRcvyResetMSec (default 1000)\n");
+	printf(" --take_no_seq <0|1>       frerSeqRcvyTakeNoSequence\n");
+	printf(" --threads <n>             Worker threads (default: one per CPU)\n");
+	printf(" --sweep                   Total the counters of all streams for hlen 1..%d,\n",
+	       FRER_SIM_SWEEP_HLEN);
+	printf("                           each reset time and both algorithms, unless\n");
+	printf("                           --alg is given\n");
+	printf(" --help                    Show this help text\n");
+}
+
+static u16 frer_sim_be16(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+/* Find the stream and the R-tag sequence number of an Ethernet frame.
+ * Returns the sequence number, -1 without R-tag.
+ */
+static int frer_sim_parse(const struct pcap_pkt *pkt, u64 *key)
+{
+	const u8 *p = pkt->data, *end = pkt->data + pkt->caplen;
+	u16 vid = FRER_SIM_NO_VID, type;
+	int i;
+
+	if (pkt->caplen < 14)
+		return -2;
+
+	*key = 0;
+	for (i = 0; i < 6; i++)
+		*key = *key << 8 | p[i];
+
+	for (p += 12; p + 2 <= end; p += 4) {
+		type = frer_sim_be16(p);
+		if (type == ETH_P_8021Q || type == ETH_P_8021AD) {
+			if (p + 4 > end)
+				break;
+			/* The outer tag identifies the stream */
+			if (vid == FRER_SIM_NO_VID)
+				vid = frer_sim_be16(p + 2) & 0xfff;
+			continue;
+		}
+		if (type == ETH_P_RTAG && p + 6 <= end) {
+			*key = *key << 16 | vid;
+			return frer_sim_be16(p + 4);
+		}
+		break;
+	}
+
+	*key = *key << 16 | vid;
+
+	return -1;
+}
+
+static unsigned int frer_sim_hash(u64 key)
+{
+	return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/* The worker of a stream, taken from the high bits of the hash as the
+ * table slots are taken from the low bits.
+ */
+static unsigned int frer_sim_worker_of(u64 key, unsigned int nworkers)
+{
+	return ((u64)frer_sim_hash(key) * nworkers) >> 32;
+}
+
+static int frer_sim_table_grow(struct frer_sim_table *t)
+{
+	struct frer_sim_stream *old = t->streams, *s;
+	unsigned int i, j, size = t->size;
+
+	t->size = size ? size * 2 : 1024;
+	t->streams = calloc(t->size, sizeof(*t->streams));
+	if (!t->streams) {
+		t->streams = old;
+		t->size = size;
+		return -1;
+	}
+
+	for (i = 0; i < size; i++) {
+		if (!old[i].used)
+			continue;
+		for (j = frer_sim_hash(old[i].key);; j++) {
+			s = &t->streams[j & (t->size - 1)];
+			if (!s->used) {
+				*s = old[i];
+				break;
+			}
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+/* Look up a stream, adding it on its first packet */
+static struct frer_sim_stream *frer_sim_lookup(struct frer_sim_table *t,
+					       u64 key,
+					       const struct mchp_frer_stream_cfg *cfg)
+{
+	struct frer_sim_stream *s;
+	unsigned int i;
+
+	if (2 * (t->cnt + 1) > t->size && frer_sim_table_grow(t) < 0)
+		return NULL;
+
+	for (i = frer_sim_hash(key);; i++) {
+		s = &t->streams[i & (t->size - 1)];
+		if (!s->used)
+			break;
+		if (s->key == key)
+			return s;
+	}
+
+	s->key = key;
+	s->used = true;
+	frer_rcvy_init(&s->r, cfg);
+	t->cnt++;
+
+	return s;
+}
+
+static void *frer_sim_worker(void *data)
+{
+	struct frer_sim_worker *w = data;
+	struct frer_sim *sim = w->sim;
+	struct frer_sim_stream *s;
+	struct pcap_merge m;
+	struct pcap_pkt *pkt;
+	int seq, path;
+	u64 key;
+
+	pcap_merge_init(&m, sim->files, sim->nfiles);
+	while ((path = pcap_merge_peek(&m)) >= 0) {
+		pkt = &m.pkt[path];
+		seq = frer_sim_parse(pkt, &key);
+		if (seq >= -1 && frer_sim_worker_of(key, sim->nworkers) == w->id) {
+			s = frer_sim_lookup(&w->table, key, &sim->cfg);
+			if (!s) {
+				w->rc = -1;
+				return NULL;
+			}
+			s->rx[path]++;
+			frer_rcvy_rx(&s->r, pkt->ts_ns, seq);
+			w->packets++;
+		}
+		pcap_merge_pop(&m, path, w->id == 0);
+	}
+
+	return NULL;
+}
+
+static int frer_sim_stream_cmp(const void *a, const void *b)
+{
+	const struct frer_sim_stream *sa = a, *sb = b;
+
+	if (sa->key != sb->key)
+		return sa->key < sb->key ? -1 : 1;
+
+	return 0;
+}
+
+static void frer_sim_report(const struct frer_sim *sim)
+{
+	struct frer_sim_stream *all, *s;
+	unsigned int i, j, n = 0;
+	char path[16];
+	u64 mac;
+
+	for (i = 0; i < sim->nworkers; i++)
+		n += sim->workers[i].table.cnt;
+
+	all = calloc(n ? n : 1, sizeof(*all));
+	if (!all) {
+		fprintf(stderr, "Out of memory!\n");
+		return;
+	}
+
+	for (i = 0, n = 0; i < sim->nworkers; i++)
+		for (j = 0; j < sim->workers[i].table.size; j++)
+			if (sim->workers[i].table.streams[j].used)
+				all[n++] = sim->workers[i].table.streams[j];
+	qsort(all, n, sizeof(*all), frer_sim_stream_cmp);
+
+	printf("%-17s %4s", "dmac", "vid");
+	for (i = 0; i < sim->nfiles; i++) {
+		snprintf(path, sizeof(path), "path%u", i);
+		printf(" %10s", path);
+	}
+	printf(" %16s %16s %16s %16s %16s %16s %16s\n", "OutOfOrder",
+	       "Rogue", "Passed", "Discarded", "Lost", "Tagless", "Resets");
+
+	for (i = 0; i < n; i++) {
+		s = &all[i];
+		mac = s->key >> 16;
+		printf("%02x:%02x:%02x:%02x:%02x:%02x ",
+		       (u8)(mac >> 40), (u8)(mac >> 32), (u8)(mac >> 24),
+		       (u8)(mac >> 16), (u8)(mac >> 8), (u8)mac);
+		if ((s->key & 0xffff) == FRER_SIM_NO_VID)
+			printf("%4s", "-");
+		else
+			printf("%4u", (u16)s->key);
+		for (j = 0; j < sim->nfiles; j++)
+			printf(" %10" PRIu64, s->rx[j]);
+		printf(" %16" PRIu64 " %16" PRIu64 " %16" PRIu64 " %16" PRIu64
+		       " %16" PRIu64 " %16" PRIu64 " %16" PRIu64 "\n",
+		       s->r.cnt.out_of_order_packets, s->r.cnt.rogue_packets,
+		       s->r.cnt.passed_packets, s->r.cnt.discarded_packets,
+		       s->r.cnt.lost_packets, s->r.cnt.tagless_packets,
+		       s->r.cnt.resets);
+	}
+
+	free(all);
+}
+
+/* Extract the sequence numbers of all streams into the sweep trace. The
+ * captures are walked twice, first to count the packets of every stream.
+ */
+static int frer_sim_extract(struct frer_sim *sim, u64 *packets)
+{
+	struct frer_sim_trace *t = &sim->trace;
+	struct frer_sim_table table = {};
+	struct frer_sim_stream *s;
+	struct pcap_merge m;
+	size_t *fill = NULL;
+	unsigned int i, j;
+	int seq, path, pass, rc = -1;
+	u64 key;
+
+	for (pass = 0; pass < 2; pass++) {
+		pcap_merge_init(&m, sim->files, sim->nfiles);
+		while ((path = pcap_merge_peek(&m)) >= 0) {
+			seq = frer_sim_parse(&m.pkt[path], &key);
+			if (seq >= -1) {
+				s = frer_sim_lookup(&table, key, &sim->cfg);
+				if (!s)
+					goto out;
+				if (pass) {
+					t->ts_ns[fill[s->idx]] = m.pkt[path].ts_ns;
+					t->seq[fill[s->idx]++] = seq;
+				} else {
+					s->rx[path]++;
+				}
+			}
+			pcap_merge_pop(&m, path, !pass);
+		}
+
+		if (pass)
+			break;
+
+		t->first = calloc(table.cnt + 1, sizeof(*t->first));
+		fill = calloc(table.cnt + 1, sizeof(*fill));
+		if (!t->first || !fill)
+			goto out;
+
+		for (i = 0; i < table.size; i++) {
+			s = &table.streams[i];
+			if (!s->used)
+				continue;
+			s->idx = t->nstreams;
+			fill[t->nstreams] = t->first[t->nstreams];
+			t->first[t->nstreams + 1] = t->first[t->nstreams];
+			for (j = 0; j < sim->nfiles; j++)
+				t->first[t->nstreams + 1] += s->rx[j];
+			t->nstreams++;
+		}
+
+		*packets = t->first[t->nstreams];
+		t->ts_ns = malloc((*packets ? *packets : 1) * sizeof(*t->ts_ns));
+		t->seq = malloc((*packets ? *packets : 1) * sizeof(*t->seq));
+		if (!t->ts_ns || !t->seq)
+			goto out;
+	}
+
+	rc = 0;
+
+out:
+	free(fill);
+	free(table.streams);
+
+	return rc;
+}
+
+static void frer_sim_cnt_add(struct mchp_frer_cnt *sum,
+			     const struct mchp_frer_cnt *cnt)
+{
+	sum->out_of_order_packets += cnt->out_of_order_packets;
+	sum->rogue_packets += cnt->rogue_packets;
+	sum->passed_packets += cnt->passed_packets;
+	sum->discarded_packets += cnt->discarded_packets;
+	sum->lost_packets += cnt->lost_packets;
+	sum->tagless_packets += cnt->tagless_packets;
+	sum->resets += cnt->resets;
+}
+
+/* Run the whole trace through one setting at a time, until all are done */
+static void *frer_sim_sweep_worker(void *data)
+{
+	struct frer_sim_worker *w = data;
+	struct frer_sim *sim = w->sim;
+	const struct frer_sim_trace *t = &sim->trace;
+	struct frer_sim_setting *set;
+	struct frer_rcvy r;
+	unsigned int i, k;
+	size_t j;
+
+	for (;;) {
+		pthread_mutex_lock(&sim->lock);
+		i = sim->next++;
+		pthread_mutex_unlock(&sim->lock);
+		if (i >= sim->nsettings)
+			break;
+
+		set = &sim->settings[i];
+		for (k = 0; k < t->nstreams; k++) {
+			frer_rcvy_init(&r, &set->cfg);
+			for (j = t->first[k]; j < t->first[k + 1]; j++)
+				frer_rcvy_rx(&r, t->ts_ns[j], t->seq[j]);
+			frer_sim_cnt_add(&set->cnt, &r.cnt);
+		}
+		w->packets += t->first[t->nstreams];
+	}
+
+	return NULL;
+}
+
+/* Whether @set passes more than @best, or as many with a shorter history
+ * or, that too being equal, a shorter reset time.
+ */
+static bool frer_sim_sweep_better(const struct frer_sim_setting *set,
+				  const struct frer_sim_setting *best)
+{
+	if (!best || set->cnt.passed_packets != best->cnt.passed_packets)
+		return !best || set->cnt.passed_packets > best->cnt.passed_packets;
+	if (set->cfg.hlen != best->cfg.hlen)
+		return set->cfg.hlen < best->cfg.hlen;
+	return set->cfg.reset_time < best->cfg.reset_time;
+}
+
+/* The best setting passes the most packets with vector recovery, which
+ * unlike match recovery never passes a duplicate. Only when no vector
+ * setting was swept is it picked among the match settings.
+ */
+static void frer_sim_sweep_report(const struct frer_sim *sim)
+{
+	const struct frer_sim_setting *set, *best = NULL;
+	unsigned int i;
+	bool vector;
+
+	for (i = 0; i < sim->nsettings; i++) {
+		set = &sim->settings[i];
+		if (set->cfg.alg != MCHP_FRER_REC_ALG_VECTOR)
+			continue;
+		if (frer_sim_sweep_better(set, best))
+			best = set;
+	}
+	vector = best != NULL;
+	for (i = 0; !vector && i < sim->nsettings; i++) {
+		if (frer_sim_sweep_better(&sim->settings[i], best))
+			best = &sim->settings[i];
+	}
+
+	printf("%-6s %4s %10s %16s %16s %16s %16s %16s %16s %16s\n", "alg",
+	       "hlen", "reset_time", "OutOfOrder", "Rogue", "Passed",
+	       "Discarded", "Lost", "Tagless", "Resets");
+
+	for (i = 0; i < sim->nsettings; i++) {
+		set = &sim->settings[i];
+		if (set->cfg.alg == MCHP_FRER_REC_ALG_VECTOR)
+			printf("%-6s %4u", "vector", set->cfg.hlen);
+		else
+			printf("%-6s %4s", "match", "-");
+		printf(" %10u %16" PRIu64 " %16" PRIu64 " %16" PRIu64 " %16" PRIu64
+		       " %16" PRIu64 " %16" PRIu64 " %16" PRIu64 "%s\n",
+		       set->cfg.reset_time, set->cnt.out_of_order_packets,
+		       set->cnt.rogue_packets, set->cnt.passed_packets,
+		       set->cnt.discarded_packets, set->cnt.lost_packets,
+		       set->cnt.tagless_packets, set->cnt.resets,
+		       set == best ? " *" : "");
+	}
+
+	printf("%u streams, %u settings, * most passed\n",
+	       sim->trace.nstreams, sim->nsettings);
+}
+
+/* Build the grid of --sweep, one setting per algorithm, history length
+ * and reset time. The history length does not matter to match recovery.
+ */
+static int frer_sim_sweep_init(struct frer_sim *sim, bool all_alg,
+			       const u16 *reset, unsigned int nreset)
+{
+	struct mchp_frer_stream_cfg cfg = sim->cfg;
+	unsigned int alg, hlen, i;
+
+	sim->settings = calloc(2 * (FRER_SIM_SWEEP_HLEN + 1) * nreset,
+			       sizeof(*sim->settings));
+	if (!sim->settings)
+		return -1;
+
+	for (alg = MCHP_FRER_REC_ALG_VECTOR; alg <= MCHP_FRER_REC_ALG_MATCH; alg++) {
+		if (!all_alg && alg != sim->cfg.alg)
+			continue;
+		cfg.alg = alg;
+		for (hlen = 1; hlen <= FRER_SIM_SWEEP_HLEN; hlen++) {
+			if (alg == MCHP_FRER_REC_ALG_MATCH && hlen > 1)
+				break;
+			cfg.hlen = hlen;
+			for (i = 0; i < nreset; i++) {
+				cfg.reset_time = reset[i];
+				sim->settings[sim->nsettings++].cfg = cfg;
+			}
+		}
+	}
+
+	return pthread_mutex_init(&sim->lock, NULL) ? -1 : 0;
+}
+
+/* Parse a comma separated list of reset times */
+static int frer_sim_reset_parse(const char *arg, u16 *reset)
+{
+	unsigned int n = 0;
+	unsigned long ms;
+	char *end;
+
+	do {
+		if (n == FRER_SIM_RESET_TIMES)
+			return -1;
+		ms = strtoul(arg, &end, 0);
+		if (end == arg || ms > 0xffff || (*end && *end != ','))
+			return -1;
+		reset[n++] = ms;
+		arg = end + 1;
+	} while (*end);
+
+	return n;
+}
+
+/* Run @fn in all workers, in this thread for those that cannot start */
+static void frer_sim_run(struct frer_sim *sim, pthread_t *threads,
+			 void *(*fn)(void *))
+{
+	unsigned int i, started;
+
+	for (i = 0; i < sim->nworkers; i++) {
+		sim->workers[i].sim = sim;
+		sim->workers[i].id = i;
+	}
+
+	for (started = 0; started < sim->nworkers; started++)
+		if (pthread_create(&threads[started], NULL, fn,
+				   &sim->workers[started]))
+			break;
+
+	for (i = started; i < sim->nworkers; i++)
+		fn(&sim->workers[i]);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static long frer_sim_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	struct frer_sim sim = {
+		.cfg = {
+			.enable = true,
+			.alg = MCHP_FRER_REC_ALG_VECTOR,
+			.hlen = 2,
+			.reset_time = 1000,
+		},
+	};
+	u16 reset[FRER_SIM_RESET_TIMES] = { 1000 };
+	bool sweep = false, all_alg = true;
+	int ch, nreset = 1, rc = 0;
+	pthread_t *threads;
+	long nthreads = 0;
+	u64 packets = 0;
+	size_t bytes = 0;
+	unsigned int i;
+	long start;
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			sim.cfg.alg = !!atoi(optarg);
+			all_alg = false;
+			break;
+		case 'b':
+			sim.cfg.hlen = atoi(optarg);
+			break;
+		case 'c':
+			nreset = frer_sim_reset_parse(optarg, reset);
+			if (nreset < 0) {
+				fprintf(stderr, "Invalid reset time list [%s]!\n",
+					optarg);
+				return 1;
+			}
+			sim.cfg.reset_time = reset[0];
+			break;
+		case 'd':
+			sim.cfg.take_no_seq = !!atoi(optarg);
+			break;
+		case 'e':
+			nthreads = atoi(optarg);
+			break;
+		case 'f':
+			sweep = true;
+			break;
+		case 'h':
+		case '?':
+			help();
+			return 0;
+		}
+	}
+
+	if (optind == argc || argc - optind > FRER_SIM_PATHS_MAX) {
+		help();
+		return 1;
+	}
+
+	if (nreset > 1 && !sweep) {
+		fprintf(stderr, "More than one reset time needs --sweep!\n");
+		return 1;
+	}
+
+	for (; optind < argc; optind++) {
+		if (pcap_open(&sim.files[sim.nfiles], argv[optind]) < 0)
+			return 1;
+		if (sim.files[sim.nfiles].linktype != PCAP_LINKTYPE_ETHERNET) {
+			fprintf(stderr, "%s: Not an Ethernet capture!\n",
+				argv[optind]);
+			return 1;
+		}
+		bytes += sim.files[sim.nfiles].size;
+		sim.nfiles++;
+	}
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (nthreads > FRER_SIM_THREADS)
+		nthreads = FRER_SIM_THREADS;
+	sim.nworkers = nthreads;
+
+	sim.workers = calloc(sim.nworkers, sizeof(*sim.workers));
+	threads = calloc(sim.nworkers, sizeof(*threads));
+	if (!sim.workers || !threads) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	start = frer_sim_now_ms();
+
+	if (sweep) {
+		if (frer_sim_extract(&sim, &packets) < 0 ||
+		    frer_sim_sweep_init(&sim, all_alg, reset, nreset) < 0) {
+			fprintf(stderr, "Out of memory!\n");
+			return 1;
+		}
+		frer_sim_run(&sim, threads, frer_sim_sweep_worker);
+		frer_sim_sweep_report(&sim);
+		printf("%" PRIu64 " packets, %zu MB in %ld ms, %u threads\n",
+		       packets, bytes >> 20, frer_sim_now_ms() - start,
+		       sim.nworkers);
+		goto out;
+	}
+
+	frer_sim_run(&sim, threads, frer_sim_worker);
+
+	for (i = 0; i < sim.nworkers; i++) {
+		if (sim.workers[i].rc)
+			rc = 1;
+		packets += sim.workers[i].packets;
+	}
+	if (rc)
+		fprintf(stderr, "Out of memory!\n");
+
+	frer_sim_report(&sim);
+	printf("%" PRIu64 " packets, %zu MB in %ld ms, %u threads\n", packets,
+	       bytes >> 20, frer_sim_now_ms() - start, sim.nworkers);
+
+out:
+	for (i = 0; i < sim.nfiles; i++)
+		pcap_close(&sim.files[i]);
+
+	return rc;
+}
@@ -0,0 +1,160 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcap.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+static uint32_t pcap_u32(const struct pcap_file *f, const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return f->swap ? __builtin_bswap32(v) : v;
+}
+
+/* Map a capture and check its header. pcapng is not supported. */
+int pcap_open(struct pcap_file *f, const char *name)
+{
+	struct stat st;
+	uint32_t magic;
+	void *base;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+	f->name = name;
+
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	if (st.st_size < PCAP_CURSOR_START) {
+		fprintf(stderr, "%s: Not a pcap file!\n", name);
+		close(fd);
+		return -1;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	/* Packets are read once, front to back */
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+	f->base = base;
+	f->size = st.st_size;
+
+	memcpy(&magic, f->base, sizeof(magic));
+	switch (magic) {
+	case PCAP_MAGIC_NSEC:
+		f->nsec = true;
+		break;
+	case PCAP_MAGIC_USEC:
+		break;
+	case __builtin_bswap32(PCAP_MAGIC_NSEC):
+		f->nsec = true;
+		/* fall through */
+	case __builtin_bswap32(PCAP_MAGIC_USEC):
+		f->swap = true;
+		break;
+	default:
+		fprintf(stderr, "%s: Not a pcap file!\n", name);
+		pcap_close(f);
+		return -1;
+	}
+
+	f->linktype = pcap_u32(f, f->base + 20) & 0xffff;
+
+	return 0;
+}
+
+/* Read the packet at @cursor and advance it. Returns 1 for a packet, 0 at
+ * the end of the file and -1 if the file is truncated.
+ */
+int pcap_next(const struct pcap_file *f, size_t *cursor, struct pcap_pkt *pkt)
+{
+	const uint8_t *hdr = f->base + *cursor;
+	uint32_t sec, frac;
+
+	if (*cursor == f->size)
+		return 0;
+
+	if (f->size - *cursor < 16)
+		return -1;
+
+	sec = pcap_u32(f, hdr);
+	frac = pcap_u32(f, hdr + 4);
+	pkt->caplen = pcap_u32(f, hdr + 8);
+	pkt->len = pcap_u32(f, hdr + 12);
+
+	if (f->size - *cursor - 16 < pkt->caplen)
+		return -1;
+
+	pkt->ts_ns = sec * 1000000000ULL + (f->nsec ? frac : frac * 1000ULL);
+	pkt->data = hdr + 16;
+	*cursor += 16 + pkt->caplen;
+
+	return 1;
+}
+
+void pcap_close(struct pcap_file *f)
+{
+	if (f->base)
+		munmap((void *)f->base, f->size);
+	f->base = NULL;
+}
+
+void pcap_merge_init(struct pcap_merge *m, const struct pcap_file *files,
+		     unsigned int nfiles)
+{
+	unsigned int i;
+
+	m->files = files;
+	m->nfiles = nfiles;
+	for (i = 0; i < nfiles; i++) {
+		m->cursor[i] = PCAP_CURSOR_START;
+		m->more[i] = pcap_next(&files[i], &m->cursor[i], &m->pkt[i]) > 0;
+	}
+}
+
+int pcap_merge_peek(const struct pcap_merge *m)
+{
+	int i, file = -1;
+
+	for (i = 0; i < (int)m->nfiles; i++)
+		if (m->more[i] && (file < 0 ||
+				   m->pkt[i].ts_ns < m->pkt[file].ts_ns))
+			file = i;
+
+	return file;
+}
+
+/* A truncated file ends there, which is reported if @report is set */
+void pcap_merge_pop(struct pcap_merge *m, int i, bool report)
+{
+	int rc;
+
+	rc = pcap_next(&m->files[i], &m->cursor[i], &m->pkt[i]);
+	if (rc < 0 && report)
+		fprintf(stderr, "%s: Truncated, stopping at offset %zu\n",
+			m->files[i].name, m->cursor[i]);
+	m->more[i] = rc > 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _PCAP_H_
+#define _PCAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/* A classic pcap file mapped read-only. Packets are read through cursors,
+ * so several threads can walk the same file without locking.
+ */
+struct pcap_file {
+	const char *name;
+	const uint8_t *base;
+	size_t size;
+	bool swap; /* File written on a host of the other byte order */
+	bool nsec; /* Nanosecond timestamps */
+	uint32_t linktype;
+};
+
+struct pcap_pkt {
+	uint64_t ts_ns;
+	const uint8_t *data;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/* Offset of the first packet, where a cursor starts */
+#define PCAP_CURSOR_START 24
+
+#define PCAP_MERGE_MAX 8
+
+/* The packets of several captures in timestamp order, pkt[i] being the
+ * next one of file i while more[i] is set.
+ */
+struct pcap_merge {
+	const struct pcap_file *files;
+	unsigned int nfiles;
+	struct pcap_pkt pkt[PCAP_MERGE_MAX];
+	size_t cursor[PCAP_MERGE_MAX];
+	bool more[PCAP_MERGE_MAX];
+};
+
+int pcap_open(struct pcap_file *f, const char *name);
+int pcap_next(const struct pcap_file *f, size_t *cursor, struct pcap_pkt *pkt);
+void pcap_close(struct pcap_file *f);
+
+void pcap_merge_init(struct pcap_merge *m, const struct pcap_file *files,
+		     unsigned int nfiles);
+
+/* Returns the file of the earliest pending packet, -1 when all are done */
+int pcap_merge_peek(const struct pcap_merge *m);
+
+/* Move on from the pending packet of file @i */
+void pcap_merge_pop(struct pcap_merge *m, int i, bool report);
+
+#endif /* _PCAP_H_ */
@@ -0,0 +1,98 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <pthread.h>
+#include "pool.h"
+
+struct mchp_genl_pool_job {
+	struct mchp_genl_pool *pool;
+	unsigned int n;
+	unsigned int nthreads;
+	mchp_genl_pool_work_t work;
+	void *arg;
+};
+
+struct mchp_genl_worker {
+	struct mchp_genl_pool_job *job;
+	pthread_t thread;
+	unsigned int first;
+	int rc;
+};
+
+/* Every worker uses the session of its slot in the pool and takes every
+ * nthreads'th item, so all its requests go out pipelined in a single flush.
+ */
+static void *mchp_genl_worker_run(void *data)
+{
+	struct mchp_genl_worker *w = data;
+	struct mchp_genl_pool_job *j = w->job;
+	struct mchp_genl_session *s = &j->pool->s[w->first];
+	unsigned int idx;
+
+	for (idx = w->first; idx < j->n; idx += j->nthreads)
+		j->work(s, idx, j->arg);
+
+	w->rc = mchp_genl_flush(s);
+
+	return NULL;
+}
+
+/* Run @work for items 0..n-1 on up to MCHP_GENL_POOL_THREADS threads, each
+ * with its own session of @pool. Per item results are reported through the
+ * err pointers of the queued requests. Returns the first error of any
+ * worker.
+ */
+int mchp_genl_pool_run(struct mchp_genl_pool *pool, unsigned int n,
+		       mchp_genl_pool_work_t work, void *arg)
+{
+	struct mchp_genl_worker workers[MCHP_GENL_POOL_THREADS] = {};
+	struct mchp_genl_pool_job job = {
+		.pool = pool,
+		.n = n,
+		.work = work,
+		.arg = arg,
+	};
+	unsigned int i, started;
+	int rc = 0;
+
+	job.nthreads = n < MCHP_GENL_POOL_THREADS ? n : MCHP_GENL_POOL_THREADS;
+
+	for (i = 0; i < job.nthreads; i++) {
+		workers[i].job = &job;
+		workers[i].first = i;
+	}
+
+	/* A single item is not worth a thread */
+	if (job.nthreads == 1) {
+		mchp_genl_worker_run(&workers[0]);
+		return workers[0].rc;
+	}
+
+	for (started = 0; started < job.nthreads; started++)
+		if (pthread_create(&workers[started].thread, NULL,
+				   mchp_genl_worker_run, &workers[started]))
+			break;
+
+	/* Items of workers that could not be started run in this thread */
+	for (i = started; i < job.nthreads; i++)
+		mchp_genl_worker_run(&workers[i]);
+
+	for (i = 0; i < job.nthreads; i++) {
+		if (i < started)
+			pthread_join(workers[i].thread, NULL);
+		if (workers[i].rc < 0 && !rc)
+			rc = workers[i].rc;
+	}
+
+	return rc;
+}
+
+void mchp_genl_pool_close(struct mchp_genl_pool *pool)
+{
+	unsigned int i;
+
+	for (i = 0; i < MCHP_GENL_POOL_THREADS; i++)
+		mchp_genl_session_close(&pool->s[i]);
+}
@@ -0,0 +1,34 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include "common.h"
+
+#define MCHP_GENL_POOL_THREADS 4
+
+/* The sessions of the workers of a pool, one per thread. They connect on
+ * their first request and stay open until mchp_genl_pool_close(), so the
+ * GET and SET rounds of a command and the lines of a batch reuse them.
+ */
+struct mchp_genl_pool {
+	struct mchp_genl_session s[MCHP_GENL_POOL_THREADS];
+};
+
+#define MCHP_GENL_POOL_INIT(name, ver) {				\
+	.s = { [0 ... MCHP_GENL_POOL_THREADS - 1] =			\
+	       MCHP_GENL_SESSION_INIT(name, ver) },			\
+}
+
+/* Queue the requests for item @idx on the session of the calling worker */
+typedef void (*mchp_genl_pool_work_t)(struct mchp_genl_session *s,
+				      unsigned int idx, void *arg);
+
+int mchp_genl_pool_run(struct mchp_genl_pool *pool, unsigned int n,
+		       mchp_genl_pool_work_t work, void *arg);
+void mchp_genl_pool_close(struct mchp_genl_pool *pool);
+
+#endif /* _POOL_H_ */
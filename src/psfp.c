@@ -4,9 +4,16 @@
  */
 
 #include "common.h"
+#include <ctype.h>
 #include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 #include "kernel_types.h"
 #include "mchp_ui_qos.h"
+#include "psfp_index.h"
 
 /* commands */
 struct command
@@ -33,9 +40,84 @@ static struct nla_policy mchp_psfp_genl_policy[MCHP_PSFP_ATTR_END] = {
 	[MCHP_PSFP_FM_ATTR_FMI] = { .type = NLA_U32 },
 };
 
-static int mchp_psfp_sf_conf_read(struct nl_msg *msg, void *arg)
+static struct mchp_genl_session psfp_session =
+	MCHP_GENL_SESSION_INIT(MCHP_PSFP_NETLINK, 1);
+
+static const char *const psfp_index_kinds[PSFP_INDEX_KINDS] = {
+	[PSFP_INDEX_SFI] = "sfi",
+	[PSFP_INDEX_SGI] = "sgi",
+	[PSFP_INDEX_FMI] = "fmi",
+};
+
+/* The stream index is opened on first use, and saved on exit. Name
+ * lookups only load it, commands changing it (@write) keep it locked
+ * until exit, reloading it if it was loaded for lookups before.
+ */
+static struct psfp_index psfp_index;
+static bool psfp_index_opened;
+
+static struct psfp_index *psfp_index_get(bool write)
+{
+	if (psfp_index_opened && write && psfp_index.lock_fd < 0) {
+		psfp_index_close(&psfp_index);
+		psfp_index_opened = false;
+	}
+
+	if (!psfp_index_opened) {
+		if (psfp_index_open(&psfp_index, write) < 0)
+			return NULL;
+		psfp_index_opened = true;
+	}
+
+	return &psfp_index;
+}
+
+/* Read an instance ID, given as a number or as the name of a stream */
+static int psfp_id_parse(const char *arg, enum psfp_index_kind kind,
+			 uint32_t *id)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	const struct psfp_stream *st;
+	struct psfp_index *x;
+
+	if (isdigit((unsigned char)arg[0])) {
+		*id = atoi(arg);
+		return 0;
+	}
+
+	x = psfp_index_get(false);
+	if (!x)
+		return -1;
+
+	st = psfp_index_find(x, arg);
+	if (!st) {
+		fprintf(stderr, "Unknown stream [%s]\n", arg);
+		return -1;
+	}
+	if (st->id[kind] == PSFP_INDEX_NONE) {
+		fprintf(stderr, "Stream %s has no %s!\n", arg,
+			psfp_index_kinds[kind]);
+		return -1;
+	}
+	*id = st->id[kind];
+
+	return 0;
+}
+
+/* Read an ID list like "1-100,200", or the name of a stream. Returns the
+ * number of IDs, -1 on errors.
+ */
+static int psfp_id_list_parse(const char *arg, enum psfp_index_kind kind,
+			      uint32_t *ids)
+{
+	if (isdigit((unsigned char)arg[0]))
+		return mchp_id_list_parse(arg, ids, MCHP_ID_LIST_MAX);
+
+	return psfp_id_parse(arg, kind, ids) < 0 ? -1 : 1;
+}
+
+static int mchp_psfp_sf_conf_read(struct nlmsghdr *nlh, void *arg)
+{
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_sf_conf *conf = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -56,88 +138,59 @@ static int mchp_psfp_sf_conf_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_psfp_sf_conf_get(uint32_t sfi_id,
-				    struct mchp_psfp_sf_conf *conf)
+static int mchp_psfp_sf_conf_get(struct mchp_genl_session *s, uint32_t sfi_id,
+				 struct mchp_psfp_sf_conf *conf)
 {
-	struct mchp_psfp_sf_conf tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SF_GENL_CONF_GET, 1, &sk, &msg);
-	if (rc < 0) {
-		printf("mchp_genl_start() failed, rc: %d (%s)\n", rc,
-				nl_geterror(rc));
-		return rc;
-	}
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_sf_conf_read, &tmp);
+	msg = mchp_genl_req(s, MCHP_PSFP_SF_GENL_CONF_GET,
+			    mchp_psfp_sf_conf_read, conf, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_PSFP_SF_ATTR_SFI, sfi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(conf, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_sf_conf_set(uint32_t sfi_id,
-				    struct mchp_psfp_sf_conf *conf)
+static int mchp_psfp_sf_conf_set(struct mchp_genl_session *s, uint32_t sfi_id,
+				 struct mchp_psfp_sf_conf *conf)
 {
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SF_GENL_CONF_SET, 1, &sk, &msg);
-	if (rc < 0) {
-		printf("mchp_genl_start() failed, rc: %d (%s)\n", rc,
-				nl_geterror(rc));
-		return rc;
-	}
+	msg = mchp_genl_req(s, MCHP_PSFP_SF_GENL_CONF_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT(msg, MCHP_PSFP_SF_ATTR_CONF, sizeof(*conf), conf);
 	NLA_PUT_U32(msg, MCHP_PSFP_SF_ATTR_SFI, sfi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_sf_counters_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_sf_counters_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_sf_counters *counters = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -158,36 +211,27 @@ static int mchp_psfp_sf_counters_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static void mchp_psfp_sf_status_get(uint32_t sfi_id)
+static void mchp_psfp_sf_status_get(struct mchp_genl_session *s,
+				    uint32_t sfi_id)
 {
 	struct mchp_psfp_sf_counters counters;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc;
 
 	memset(&counters, 0x0, sizeof(counters));
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SF_GENL_STATUS_GET, 1, &sk, &msg);
-	if (rc < 0)
+	msg = mchp_genl_req(s, MCHP_PSFP_SF_GENL_STATUS_GET,
+			    mchp_psfp_sf_counters_read, &counters, NULL);
+	if (!msg)
 		return;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_sf_counters_read, &counters);
-
 	NLA_PUT_U32(msg, MCHP_PSFP_SF_ATTR_SFI, sfi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
+		return;
 	}
 
 	printf("matching_frames_count: %" PRIu64 "\n", counters.matching_frames_count);
@@ -197,9 +241,10 @@ static void mchp_psfp_sf_status_get(uint32_t sfi_id)
 	printf("not_passing_sdu_count: %" PRIu64 "\n", counters.not_passing_sdu_count);
 	printf("red_frames_count: %" PRIu64 "\n", counters.red_frames_count);
 
+	return;
+
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
 }
 
 static char *mchp_psfp_sf_help(void)
@@ -229,9 +274,10 @@ static int cmd_sf(int argc, char *const *argv)
 	int ch;
 
 	/* read the id */
-	sfi_id = atoi(argv[0]);
+	if (psfp_id_parse(argv[0], PSFP_INDEX_SFI, &sfi_id) < 0)
+		return 1;
 
-	if (mchp_psfp_sf_conf_get(sfi_id, &config) < 0)
+	if (mchp_psfp_sf_conf_get(&psfp_session, sfi_id, &config) < 0)
 		return 0;
 
 	memcpy(&tmp, &config, sizeof(config));
@@ -257,7 +303,7 @@ static int cmd_sf(int argc, char *const *argv)
 	}
 
 	if (status) {
-		mchp_psfp_sf_status_get(sfi_id);
+		mchp_psfp_sf_status_get(&psfp_session, sfi_id);
 		return 0;
 	}
 
@@ -269,14 +315,14 @@ static int cmd_sf(int argc, char *const *argv)
 		return 0;
 	}
 
-	mchp_psfp_sf_conf_set(sfi_id, &config);
+	mchp_psfp_sf_conf_set(&psfp_session, sfi_id, &config);
 
 	return 0;
 }
 
-static int mchp_psfp_sg_conf_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_sg_conf_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_sg_conf *conf = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -297,82 +343,59 @@ static int mchp_psfp_sg_conf_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_psfp_sg_conf_get(uint32_t sgi_id,
-				    struct mchp_psfp_sg_conf *conf)
+static int mchp_psfp_sg_conf_get(struct mchp_genl_session *s, uint32_t sgi_id,
+				 struct mchp_psfp_sg_conf *conf)
 {
-	struct mchp_psfp_sg_conf tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SG_GENL_CONF_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_sg_conf_read, &tmp);
+	msg = mchp_genl_req(s, MCHP_PSFP_SG_GENL_CONF_GET,
+			    mchp_psfp_sg_conf_read, conf, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, sgi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(conf, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_sg_conf_set(uint32_t sgi_id,
-				    struct mchp_psfp_sg_conf *conf)
+static int mchp_psfp_sg_conf_set(struct mchp_genl_session *s, uint32_t sgi_id,
+				 struct mchp_psfp_sg_conf *conf)
 {
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SG_GENL_CONF_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_PSFP_SG_GENL_CONF_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT(msg, MCHP_PSFP_SG_ATTR_CONF, sizeof(*conf), conf);
 	NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, sgi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_sg_status_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_sg_status_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_sg_status *status = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -393,36 +416,27 @@ static int mchp_psfp_sg_status_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static void mchp_psfp_sg_status_get(uint32_t sgi_id)
+static void mchp_psfp_sg_status_get(struct mchp_genl_session *s,
+				    uint32_t sgi_id)
 {
 	struct mchp_psfp_sg_status status;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc;
 
 	memset(&status, 0x0, sizeof(status));
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_SG_GENL_STATUS_GET, 1, &sk, &msg);
-	if (rc < 0)
+	msg = mchp_genl_req(s, MCHP_PSFP_SG_GENL_STATUS_GET,
+			    mchp_psfp_sg_status_read, &status, NULL);
+	if (!msg)
 		return;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_sg_status_read, &status);
-
 	NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, sgi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
+		return;
 	}
 
 	printf("gate_open: %d\n", status.gate_open);
@@ -436,9 +450,10 @@ static void mchp_psfp_sg_status_get(uint32_t sgi_id)
 	printf("cycle_time_ext: %u\n", status.oper.cycle_time_ext);
 	printf("gcl_length: %u\n", status.oper.gcl_length);
 
+	return;
+
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
 }
 
 static char *mchp_psfp_sg_help(void)
@@ -456,7 +471,349 @@ static char *mchp_psfp_sg_help(void)
 		" --cycle_time:                   PSFPAdminCycleTime/PSFPOperCycleTime\n"
 		" --cycle_time_ext:               PSFPAdminCycleTimeExtension/PSFPOperCycleTimeExtension\n"
 		" --gcl_length:                   PSFPAdminControlListLength/ PSFPOperControlListLength\n"
-		" --status:                       Status\n";
+		" --status:                       Status\n"
+		" --wait-applied:                 Wait for the config change of the sgi list to be applied\n"
+		" --timeout:                      With --wait-applied, ms to wait (default 10000)\n"
+		" --interval:                     With --wait-applied, us between polls (default 1000)\n"
+		" --diff:                         Show where the oper values of the sgi list differ from admin,\n"
+		"                                 --all probes sgi 0-1023\n";
+}
+
+#define PSFP_SG_WAIT_TIMEOUT_MS  10000
+#define PSFP_SG_WAIT_INTERVAL_US 1000
+
+struct psfp_sg_wait {
+	uint32_t sgi;
+	struct mchp_psfp_sg_status status;
+	int rc;
+	int64_t prev_time; /* current_time of the previous poll, 0 before */
+	bool done;
+};
+
+static uint64_t psfp_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Read the status of the gates still pending, all in one flush. Errors
+ * are left in the gates.
+ */
+static int psfp_sg_wait_poll(struct mchp_genl_session *s,
+			     struct psfp_sg_wait *w, unsigned int cnt)
+{
+	struct nl_msg *msg;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		if (w[i].done)
+			continue;
+		w[i].prev_time = w[i].status.current_time;
+		msg = mchp_genl_get(s, MCHP_PSFP_SG_GENL_STATUS_GET,
+				    mchp_psfp_sg_status_read, &w[i].status,
+				    &w[i].rc);
+		if (!msg)
+			return -1;
+
+		NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, w[i].sgi);
+	}
+
+	mchp_genl_flush(s);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* The change happened after the previous poll and by this one, in the
+ * time of the gate.
+ */
+static void psfp_sg_wait_report(const struct psfp_sg_wait *w)
+{
+	int64_t cct = w->status.config_change_time;
+
+	if (!w->prev_time)
+		printf("sg %u: applied by %.3f ms after config_change_time\n",
+		       w->sgi, (w->status.current_time - cct) / 1000000.0);
+	else
+		printf("sg %u: applied %.3f to %.3f ms after config_change_time\n",
+		       w->sgi, (w->prev_time - cct) / 1000000.0,
+		       (w->status.current_time - cct) / 1000000.0);
+}
+
+/* sg sgi_list --wait-applied: poll the gates until none has its config
+ * change pending, or the timeout expires
+ */
+static int psfp_sg_wait(int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"wait-applied", no_argument, NULL, 'a'},
+		{"timeout", required_argument, NULL, 'b'},
+		{"interval", required_argument, NULL, 'c'},
+		{NULL, 0, NULL, 0}
+	};
+	unsigned int timeout = PSFP_SG_WAIT_TIMEOUT_MS;
+	unsigned int interval = PSFP_SG_WAIT_INTERVAL_US;
+	unsigned int cnt, pending, failed = 0, polls = 0, i;
+	uint64_t start, next, now;
+	struct psfp_sg_wait *w;
+	struct timespec ts;
+	uint32_t *ids;
+	int ch, rc;
+
+	while ((ch = getopt_long(argc, argv, "ab:c:", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'b':
+			timeout = atoi(optarg);
+			break;
+		case 'c':
+			interval = atoi(optarg);
+			break;
+		}
+	}
+	if (!interval)
+		interval = 1;
+
+	ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+	if (!ids)
+		return -1;
+
+	rc = psfp_id_list_parse(argv[0], PSFP_INDEX_SGI, ids);
+	if (rc < 0) {
+		free(ids);
+		return 1;
+	}
+	cnt = pending = rc;
+
+	w = calloc(cnt, sizeof(*w));
+	if (!w) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < cnt; i++)
+		w[i].sgi = ids[i];
+	free(ids);
+
+	start = next = psfp_now_ns();
+	while (pending) {
+		if (psfp_sg_wait_poll(&psfp_session, w, cnt) < 0) {
+			rc = 1;
+			goto out;
+		}
+		polls++;
+
+		for (i = 0; i < cnt; i++) {
+			if (w[i].done)
+				continue;
+			if (w[i].rc) {
+				printf("sg %u: %s\n", w[i].sgi,
+				       nl_geterror(w[i].rc));
+				failed++;
+			} else if (!w[i].status.config_pending) {
+				psfp_sg_wait_report(&w[i]);
+			} else {
+				continue;
+			}
+			w[i].done = true;
+			pending--;
+		}
+
+		now = psfp_now_ns();
+		if (!pending || now - start >= timeout * 1000000ULL)
+			break;
+
+		next += interval * 1000ULL;
+		if (now > next)
+			next = now;
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	for (i = 0; i < cnt; i++)
+		if (!w[i].done)
+			printf("sg %u: pending, config_change_time %" PRId64
+			       " current_time %" PRId64 "\n", w[i].sgi,
+			       w[i].status.config_change_time,
+			       w[i].status.current_time);
+
+	printf("%u of %u gates applied in %.3f ms, %u polls\n",
+	       cnt - pending - failed, cnt,
+	       (psfp_now_ns() - start) / 1000000.0, polls);
+	rc = pending || failed;
+
+out:
+	free(w);
+	return rc;
+}
+
+struct psfp_sg_diff {
+	uint32_t sgi;
+	struct mchp_psfp_sg_conf conf;
+	struct mchp_psfp_sg_status status;
+	int conf_rc;
+	int status_rc;
+};
+
+/* Read admin and oper values of all gates, in one flush. Errors are left
+ * in the gates, the first one is returned.
+ */
+static int psfp_sg_diff_get(struct mchp_genl_session *s,
+			    struct psfp_sg_diff *d, unsigned int cnt)
+{
+	struct nl_msg *msg;
+	unsigned int i;
+
+	for (i = 0; i < cnt; i++) {
+		msg = mchp_genl_get(s, MCHP_PSFP_SG_GENL_CONF_GET,
+				    mchp_psfp_sg_conf_read, &d[i].conf,
+				    &d[i].conf_rc);
+		if (!msg)
+			return -1;
+		NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, d[i].sgi);
+
+		msg = mchp_genl_get(s, MCHP_PSFP_SG_GENL_STATUS_GET,
+				    mchp_psfp_sg_status_read, &d[i].status,
+				    &d[i].status_rc);
+		if (!msg)
+			return -1;
+		NLA_PUT_U32(msg, MCHP_PSFP_SG_ATTR_SGI, d[i].sgi);
+	}
+
+	return mchp_genl_flush(s);
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+static bool psfp_sg_diff_field(const struct psfp_sg_diff *d, bool first,
+			       const char *name, int64_t admin, int64_t oper)
+{
+	char sgi[16];
+
+	if (admin == oper)
+		return first;
+
+	snprintf(sgi, sizeof(sgi), "%u", d->sgi);
+	printf("%-6s %-14s %20" PRId64 " %20" PRId64 "%s\n",
+	       first ? sgi : "", name, admin, oper,
+	       first && d->status.config_pending ? "  (config pending)" : "");
+
+	return false;
+}
+
+/* Returns true if the gate differs. The gate state and IPV follow the
+ * control list while one runs, so they are only compared without one.
+ */
+static bool psfp_sg_diff_show(const struct psfp_sg_diff *d)
+{
+	const struct mchp_psfp_gcl_conf *admin = &d->conf.admin;
+	const struct mchp_psfp_gcl_conf *oper = &d->status.oper;
+	bool first = true;
+
+	first = psfp_sg_diff_field(d, first, "base_time", admin->base_time,
+				   oper->base_time);
+	first = psfp_sg_diff_field(d, first, "cycle_time", admin->cycle_time,
+				   oper->cycle_time);
+	first = psfp_sg_diff_field(d, first, "cycle_time_ext",
+				   admin->cycle_time_ext,
+				   oper->cycle_time_ext);
+	first = psfp_sg_diff_field(d, first, "gcl_length", admin->gcl_length,
+				   oper->gcl_length);
+	if (!oper->gcl_length) {
+		first = psfp_sg_diff_field(d, first, "gate_open",
+					   d->conf.gate_open,
+					   d->status.gate_open);
+		first = psfp_sg_diff_field(d, first, "ipv_enable",
+					   d->conf.ipv_enable,
+					   d->status.ipv_enable);
+		if (d->conf.ipv_enable && d->status.ipv_enable)
+			first = psfp_sg_diff_field(d, first, "ipv",
+						   d->conf.ipv,
+						   d->status.ipv);
+	}
+
+	return !first;
+}
+
+/* sg sgi_list|--all --diff: show the enabled gates whose oper values are
+ * not the admin ones. --all probes every sgi from 0 to PSFP_INDEX_IDS - 1,
+ * allocated through the index or not, and leaves out those that cannot be
+ * read.
+ */
+static int psfp_sg_diff(const char *arg)
+{
+	unsigned int cnt, read = 0, enabled = 0, differ = 0, i;
+	bool all = !strcmp(arg, "--all");
+	struct psfp_sg_diff *d;
+	uint32_t *ids;
+	int rc;
+
+	ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+	if (!ids)
+		return -1;
+
+	if (all) {
+		for (i = 0; i < PSFP_INDEX_IDS; i++)
+			ids[i] = i;
+		rc = PSFP_INDEX_IDS;
+	} else {
+		rc = psfp_id_list_parse(arg, PSFP_INDEX_SGI, ids);
+	}
+	if (rc < 0) {
+		free(ids);
+		return 1;
+	}
+	cnt = rc;
+
+	d = calloc(cnt, sizeof(*d));
+	if (!d) {
+		free(ids);
+		return -1;
+	}
+	for (i = 0; i < cnt; i++)
+		d[i].sgi = ids[i];
+	free(ids);
+
+	rc = psfp_sg_diff_get(&psfp_session, d, cnt);
+	if (rc == -1 || rc == -NLE_MSGSIZE) {
+		rc = 1;
+		goto out;
+	}
+
+	printf("%-6s %-14s %20s %20s\n", "sgi", "field", "admin", "oper");
+	for (i = 0; i < cnt; i++) {
+		if (d[i].conf_rc || d[i].status_rc) {
+			if (!all)
+				printf("sg %u: %s\n", d[i].sgi,
+				       nl_geterror(d[i].conf_rc ?
+						   d[i].conf_rc :
+						   d[i].status_rc));
+			continue;
+		}
+		read++;
+		if (!d[i].conf.enable)
+			continue;
+		enabled++;
+		differ += psfp_sg_diff_show(&d[i]);
+	}
+
+	if (all && !read)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
+	printf("%u gates enabled, %u differ\n", enabled, differ);
+	rc = differ || (read < cnt && !all);
+
+out:
+	free(d);
+	return rc;
 }
 
 static int cmd_sg(int argc, char *const *argv)
@@ -483,12 +840,20 @@ static int cmd_sg(int argc, char *const *argv)
 	struct mchp_psfp_sg_conf tmp;
 	uint32_t sgi_id = 0;
 	int status = 0;
-	int ch;
+	int ch, i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--wait-applied"))
+			return psfp_sg_wait(argc, argv);
+		if (!strcmp(argv[i], "--diff"))
+			return psfp_sg_diff(argv[0]);
+	}
 
 	/* read the id */
-	sgi_id = atoi(argv[0]);
+	if (psfp_id_parse(argv[0], PSFP_INDEX_SGI, &sgi_id) < 0)
+		return 1;
 
-	if (mchp_psfp_sg_conf_get(sgi_id, &config) < 0)
+	if (mchp_psfp_sg_conf_get(&psfp_session, sgi_id, &config) < 0)
 		return 0;
 
 	memcpy(&tmp, &config, sizeof(config));
@@ -541,7 +906,7 @@ static int cmd_sg(int argc, char *const *argv)
 	}
 
 	if (status) {
-		mchp_psfp_sg_status_get(sgi_id);
+		mchp_psfp_sg_status_get(&psfp_session, sgi_id);
 		return 0;
 	}
 
@@ -562,14 +927,14 @@ static int cmd_sg(int argc, char *const *argv)
 		return 0;
 	}
 
-	mchp_psfp_sg_conf_set(sgi_id, &config);
+	mchp_psfp_sg_conf_set(&psfp_session, sgi_id, &config);
 
 	return 0;
 }
 
-static int mchp_psfp_gce_conf_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_gce_conf_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_gce *conf = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -590,84 +955,61 @@ static int mchp_psfp_gce_conf_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_psfp_gce_conf_get(uint32_t sgi_id, uint32_t gce_id,
-				     struct mchp_psfp_gce *conf)
+static int mchp_psfp_gce_conf_get(struct mchp_genl_session *s, uint32_t sgi_id,
+				  uint32_t gce_id, struct mchp_psfp_gce *conf)
 {
-	struct mchp_psfp_gce tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_GCE_GENL_CONF_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_gce_conf_read, &tmp);
+	msg = mchp_genl_req(s, MCHP_PSFP_GCE_GENL_CONF_GET,
+			    mchp_psfp_gce_conf_read, conf, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_SGI, sgi_id);
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_GCI, gce_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(conf, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_gce_conf_set(uint32_t sgi_id, uint32_t gce_id,
-				     struct mchp_psfp_gce *conf)
+static int mchp_psfp_gce_conf_set(struct mchp_genl_session *s, uint32_t sgi_id,
+				  uint32_t gce_id, struct mchp_psfp_gce *conf)
 {
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_GCE_GENL_CONF_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_PSFP_GCE_GENL_CONF_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT(msg, MCHP_PSFP_GCE_ATTR_CONF, sizeof(*conf), conf);
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_SGI, sgi_id);
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_GCI, gce_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_gce_status_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_gce_status_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_gce *status = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -688,37 +1030,28 @@ static int mchp_psfp_gce_status_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static void mchp_psfp_gce_status_get(uint32_t sgi_id, uint32_t gce_id)
+static void mchp_psfp_gce_status_get(struct mchp_genl_session *s,
+				     uint32_t sgi_id, uint32_t gce_id)
 {
 	struct mchp_psfp_gce status;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc;
 
 	memset(&status, 0x0, sizeof(status));
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_GCE_GENL_STATUS_GET, 1, &sk, &msg);
-	if (rc < 0)
+	msg = mchp_genl_req(s, MCHP_PSFP_GCE_GENL_STATUS_GET,
+			    mchp_psfp_gce_status_read, &status, NULL);
+	if (!msg)
 		return;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_gce_status_read, &status);
-
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_SGI, sgi_id);
 	NLA_PUT_U32(msg, MCHP_PSFP_GCE_ATTR_GCI, gce_id);
 
-	rc = nl_send_auto(sk, msg);
+	rc = mchp_genl_flush(s);
 	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
+		return;
 	}
 
 	printf("gate_open: %d\n", status.gate_open);
@@ -727,9 +1060,10 @@ static void mchp_psfp_gce_status_get(uint32_t sgi_id, uint32_t gce_id)
 	printf("time_interval: %u\n", status.time_interval);
 	printf("octet_max: %u\n", status.octet_max);
 
+	return;
+
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+	mchp_genl_req_abort(s);
 }
 
 static char *mchp_psfp_gce_help(void)
@@ -762,14 +1096,15 @@ static int cmd_gce(int argc, char *const *argv)
 	int ch;
 
 	/* read the id and skip it */
-	sgi_id = atoi(argv[0]);
+	if (psfp_id_parse(argv[0], PSFP_INDEX_SGI, &sgi_id) < 0)
+		return 1;
 	argc--;
 	argv++;
 
 	/* read the next id */
 	gce_id = atoi(argv[0]);
 
-	if (mchp_psfp_gce_conf_get(sgi_id, gce_id, &config) < 0)
+	if (mchp_psfp_gce_conf_get(&psfp_session, sgi_id, gce_id, &config) < 0)
 		return 0;
 
 	memcpy(&tmp, &config, sizeof(config));
@@ -798,7 +1133,7 @@ static int cmd_gce(int argc, char *const *argv)
 	}
 
 	if (status) {
-		mchp_psfp_gce_status_get(sgi_id, gce_id);
+		mchp_psfp_gce_status_get(&psfp_session, sgi_id, gce_id);
 		return 0;
 	}
 
@@ -811,14 +1146,14 @@ static int cmd_gce(int argc, char *const *argv)
 		return 0;
 	}
 
-	mchp_psfp_gce_conf_set(sgi_id, gce_id, &config);
+	mchp_psfp_gce_conf_set(&psfp_session, sgi_id, gce_id, &config);
 
 	return 0;
 }
 
-static int mchp_psfp_fm_conf_read(struct nl_msg *msg, void *arg)
+static int mchp_psfp_fm_conf_read(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct mchp_psfp_fm_conf *conf = arg;
 	struct nlattr *attrs[MCHP_PSFP_ATTR_END];
 
@@ -839,77 +1174,54 @@ static int mchp_psfp_fm_conf_read(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_psfp_fm_conf_get(uint32_t fmi_id,
-				    struct mchp_psfp_fm_conf *conf)
+static int mchp_psfp_fm_conf_get(struct mchp_genl_session *s, uint32_t fmi_id,
+				 struct mchp_psfp_fm_conf *conf)
 {
-	struct mchp_psfp_fm_conf tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_FM_GENL_CONF_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
-
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_psfp_fm_conf_read, &tmp);
+	msg = mchp_genl_req(s, MCHP_PSFP_FM_GENL_CONF_GET,
+			    mchp_psfp_fm_conf_read, conf, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_PSFP_FM_ATTR_FMI, fmi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+	rc = mchp_genl_flush(s);
+	if (rc < 0)
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
 
-	memcpy(conf, &tmp, sizeof(tmp));
+	return rc;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_psfp_fm_conf_set(uint32_t fmi_id,
-				     struct mchp_psfp_fm_conf *conf)
+static int mchp_psfp_fm_conf_set(struct mchp_genl_session *s, uint32_t fmi_id,
+				 struct mchp_psfp_fm_conf *conf)
 {
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_PSFP_NETLINK,
-				MCHP_PSFP_FM_GENL_CONF_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_PSFP_FM_GENL_CONF_SET, NULL, NULL, NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT(msg, MCHP_PSFP_FM_ATTR_CONF, sizeof(*conf), conf);
 	NLA_PUT_U32(msg, MCHP_PSFP_FM_ATTR_FMI, fmi_id);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
 static char *mchp_psfp_fm_help(void)
@@ -942,14 +1254,16 @@ static int cmd_fm(int argc, char *const *argv)
 	};
 	struct mchp_psfp_fm_conf config;
 	struct mchp_psfp_fm_conf tmp;
+	struct psfp_index *x;
 	uint32_t fmi_id = 0;
 	int status = 0;
 	int ch;
 
 	/* read the id */
-	fmi_id = atoi(argv[0]);
+	if (psfp_id_parse(argv[0], PSFP_INDEX_FMI, &fmi_id) < 0)
+		return 1;
 
-	if (mchp_psfp_fm_conf_get(fmi_id, &config) < 0)
+	if (mchp_psfp_fm_conf_get(&psfp_session, fmi_id, &config) < 0)
 		return 0;
 
 	memcpy(&tmp, &config, sizeof(config));
@@ -999,18 +1313,704 @@ static int cmd_fm(int argc, char *const *argv)
 		return 0;
 	}
 
-	mchp_psfp_fm_conf_set(fmi_id, &config);
+	if (mchp_psfp_fm_conf_set(&psfp_session, fmi_id, &config) < 0)
+		return 0;
+
+	/* Streams added later must not share the instance by its old
+	 * configuration
+	 */
+	if (fmi_id < PSFP_INDEX_IDS && access(PSFP_INDEX_FILE, F_OK) == 0) {
+		x = psfp_index_get(true);
+		if (!x)
+			return 0;
+		if (x->profiles[fmi_id].refs > 1)
+			printf("fmi %u meters %u streams\n", fmi_id,
+			       x->profiles[fmi_id].refs);
+		psfp_index_fm_update(x, fmi_id, &config);
+	}
+
+	return 0;
+}
+
+/* Turn off the instances of a stream, on errors too. A flow meter shared
+ * with other streams is left running.
+ */
+static void psfp_stream_disable(const struct psfp_index *x,
+				const struct psfp_stream *st)
+{
+	struct mchp_psfp_sf_conf sf;
+	struct mchp_psfp_sg_conf sg;
+	struct mchp_psfp_fm_conf fm;
+
+	if (st->id[PSFP_INDEX_SFI] != PSFP_INDEX_NONE &&
+	    mchp_psfp_sf_conf_get(&psfp_session, st->id[PSFP_INDEX_SFI],
+				  &sf) == 0 && sf.enable) {
+		sf.enable = false;
+		mchp_psfp_sf_conf_set(&psfp_session, st->id[PSFP_INDEX_SFI],
+				      &sf);
+	}
+	if (st->id[PSFP_INDEX_SGI] != PSFP_INDEX_NONE &&
+	    mchp_psfp_sg_conf_get(&psfp_session, st->id[PSFP_INDEX_SGI],
+				  &sg) == 0 && sg.enable) {
+		sg.enable = false;
+		sg.config_change = true;
+		mchp_psfp_sg_conf_set(&psfp_session, st->id[PSFP_INDEX_SGI],
+				      &sg);
+	}
+	if (st->id[PSFP_INDEX_FMI] != PSFP_INDEX_NONE &&
+	    x->profiles[st->id[PSFP_INDEX_FMI]].refs <= 1 &&
+	    mchp_psfp_fm_conf_get(&psfp_session, st->id[PSFP_INDEX_FMI],
+				  &fm) == 0 && fm.enable) {
+		fm.enable = false;
+		mchp_psfp_fm_conf_set(&psfp_session, st->id[PSFP_INDEX_FMI],
+				      &fm);
+	}
+}
+
+static void psfp_stream_title(void)
+{
+	printf("%-24s %5s %5s %5s\n", "stream", "sfi", "sgi", "fmi");
+}
+
+static void psfp_stream_row(const struct psfp_stream *st)
+{
+	unsigned int k;
+
+	printf("%-24s", st->name);
+	for (k = 0; k < PSFP_INDEX_KINDS; k++)
+		if (st->id[k] == PSFP_INDEX_NONE)
+			printf(" %5s", "-");
+		else
+			printf(" %5u", st->id[k]);
+	printf("\n");
+}
+
+static int psfp_stream_cmp(const void *a, const void *b)
+{
+	const struct psfp_stream *const *sa = a, *const *sb = b;
+
+	return strcmp((*sa)->name, (*sb)->name);
+}
+
+static int psfp_stream_show(struct psfp_index *x, const char *name)
+{
+	const struct psfp_stream **all, *st;
+	struct mchp_psfp_sf_conf sf;
+	struct mchp_psfp_sg_conf sg;
+	struct mchp_psfp_fm_conf fm;
+	unsigned int i, n;
+
+	if (strcmp(name, "--all") == 0) {
+		all = malloc((x->cnt ? x->cnt : 1) * sizeof(*all));
+		if (!all)
+			return -1;
+		for (i = 0; i < x->cnt; i++)
+			all[i] = &x->streams[i];
+		qsort(all, x->cnt, sizeof(*all), psfp_stream_cmp);
+
+		psfp_stream_title();
+		for (i = 0; i < x->cnt; i++)
+			psfp_stream_row(all[i]);
+		free(all);
+
+		for (i = 0, n = 0; i < PSFP_INDEX_IDS; i++)
+			if (x->profiles[i].refs)
+				n++;
+		printf("%u streams, %u flow meters\n", x->cnt, n);
+		return 0;
+	}
+
+	st = psfp_index_find(x, name);
+	if (!st) {
+		fprintf(stderr, "Unknown stream [%s]\n", name);
+		return 1;
+	}
+
+	psfp_stream_title();
+	psfp_stream_row(st);
+
+	if (st->id[PSFP_INDEX_SFI] != PSFP_INDEX_NONE &&
+	    mchp_psfp_sf_conf_get(&psfp_session, st->id[PSFP_INDEX_SFI],
+				  &sf) == 0)
+		printf("sf: enable %d max_sdu %u\n", sf.enable, sf.max_sdu);
+	if (st->id[PSFP_INDEX_SGI] != PSFP_INDEX_NONE &&
+	    mchp_psfp_sg_conf_get(&psfp_session, st->id[PSFP_INDEX_SGI],
+				  &sg) == 0)
+		printf("sg: enable %d gate_open %d\n", sg.enable, sg.gate_open);
+	if (st->id[PSFP_INDEX_FMI] != PSFP_INDEX_NONE &&
+	    mchp_psfp_fm_conf_get(&psfp_session, st->id[PSFP_INDEX_FMI],
+				  &fm) == 0)
+		printf("fm: enable %d cir %u cbs %u eir %u ebs %u, %u streams\n",
+		       fm.enable, fm.cir, fm.cbs, fm.eir, fm.ebs,
+		       x->profiles[st->id[PSFP_INDEX_FMI]].refs);
+
+	return 0;
+}
+
+static char *mchp_psfp_stream_help(void)
+{
+	return "--sdu:             Maximum SDU size of the stream filter\n"
+		" --cir:             Meter the stream, kbit/s\n"
+		" --cbs:             Meter the stream, octets\n"
+		" --eir:             Meter the stream, kbit/s\n"
+		" --ebs:             Meter the stream, octets\n"
+		" --gate:            Gate the stream, initial gate state\n"
+		" --share-meter:     Share the flow meter of streams metered alike\n"
+		"Instances are allocated on add and freed on del, and are\n"
+		"kept in " PSFP_INDEX_FILE ". Streams sharing a flow meter\n"
+		"are policed as one aggregate: together, not each, at --cir.\n"
+		"The meter is freed with the last of them.\n"
+		"Commands taking an instance ID also take a stream name.\n"
+		"Names use A-Z a-z 0-9 _ . : -, not starting with a digit or -.\n";
+}
+
+/* Add a named stream, using a stream filter and if asked for a flow meter
+ * and a stream gate, all from the free instances of the index. With
+ * --share-meter, a flow meter configured the same way for another sharing
+ * stream is shared, not programmed again.
+ */
+static int cmd_stream(int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"sdu", required_argument, NULL, 'a'},
+		{"cir", required_argument, NULL, 'b'},
+		{"cbs", required_argument, NULL, 'c'},
+		{"eir", required_argument, NULL, 'd'},
+		{"ebs", required_argument, NULL, 'e'},
+		{"gate", required_argument, NULL, 'f'},
+		{"share-meter", no_argument, NULL, 'g'},
+		{NULL, 0, NULL, 0}
+	};
+	struct mchp_psfp_fm_conf fm = { .enable = true };
+	struct mchp_psfp_sf_conf sf;
+	struct mchp_psfp_sg_conf sg;
+	struct psfp_stream *st;
+	struct psfp_index *x;
+	const char *name;
+	bool meter = false, share = false;
+	int shared = 0;
+	int gate = -1;
+	unsigned int k;
+	int ch, rc;
+
+	if (argc < 2) {
+		fprintf(stderr, "Missing argument!\n");
+		return 1;
+	}
+	name = argv[1];
+
+	x = psfp_index_get(strcmp(argv[0], "show") != 0);
+	if (!x)
+		return 1;
+
+	if (strcmp(argv[0], "show") == 0)
+		return psfp_stream_show(x, name);
+
+	if (strcmp(argv[0], "del") == 0) {
+		st = psfp_index_find(x, name);
+		if (!st) {
+			fprintf(stderr, "Unknown stream [%s]\n", name);
+			return 1;
+		}
+		psfp_stream_disable(x, st);
+		psfp_index_del(x, st);
+		return 0;
+	}
+
+	if (strcmp(argv[0], "add") != 0) {
+		fprintf(stderr, "Unknown stream command [%s]\n", argv[0]);
+		return 1;
+	}
+
+	memset(&sf, 0, sizeof(sf));
+	sf.enable = true;
+
+	/* skip 'add', the name takes the place of the program name */
+	while ((ch = getopt_long(argc - 1, argv + 1, "a:b:c:d:e:f:g", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			sf.max_sdu = atoi(optarg);
+			break;
+		case 'b':
+			fm.cir = atoi(optarg);
+			meter = true;
+			break;
+		case 'c':
+			fm.cbs = atoi(optarg);
+			meter = true;
+			break;
+		case 'd':
+			fm.eir = atoi(optarg);
+			meter = true;
+			break;
+		case 'e':
+			fm.ebs = atoi(optarg);
+			meter = true;
+			break;
+		case 'f':
+			gate = !!atoi(optarg);
+			break;
+		case 'g':
+			share = true;
+			break;
+		}
+	}
+
+	if (psfp_index_find(x, name)) {
+		fprintf(stderr, "Stream %s exists!\n", name);
+		return 1;
+	}
+
+	if (!psfp_index_name_valid(name)) {
+		fprintf(stderr, "Invalid stream name [%s]\n", name);
+		return 1;
+	}
+
+	st = psfp_index_add(x, name);
+	if (!st) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	for (k = 0; k < PSFP_INDEX_KINDS; k++) {
+		if ((k == PSFP_INDEX_SGI && gate < 0) ||
+		    (k == PSFP_INDEX_FMI && !meter))
+			continue;
+		if (k == PSFP_INDEX_FMI && share)
+			rc = shared = psfp_index_fm_get(x, &fm, &st->id[k]);
+		else
+			rc = psfp_index_id_alloc(x, k, &st->id[k]);
+		if (rc < 0) {
+			fprintf(stderr, "No free %s!\n", psfp_index_kinds[k]);
+			psfp_index_del(x, st);
+			return 1;
+		}
+	}
+
+	if (mchp_psfp_sf_conf_set(&psfp_session, st->id[PSFP_INDEX_SFI],
+				  &sf) < 0)
+		goto err;
+
+	if (meter && !shared &&
+	    mchp_psfp_fm_conf_set(&psfp_session, st->id[PSFP_INDEX_FMI],
+				  &fm) < 0)
+		goto err;
+
+	if (gate >= 0) {
+		if (mchp_psfp_sg_conf_get(&psfp_session,
+					  st->id[PSFP_INDEX_SGI], &sg) < 0)
+			goto err;
+		sg.enable = true;
+		sg.gate_open = gate;
+		sg.config_change = true;
+		if (mchp_psfp_sg_conf_set(&psfp_session,
+					  st->id[PSFP_INDEX_SGI], &sg) < 0)
+			goto err;
+	}
+
+	psfp_stream_title();
+	psfp_stream_row(st);
+	if (shared)
+		printf("fmi %u meters %u streams, policed as one aggregate\n",
+		       st->id[PSFP_INDEX_FMI],
+		       x->profiles[st->id[PSFP_INDEX_FMI]].refs);
+
+	return 0;
+
+err:
+	psfp_stream_disable(x, st);
+	psfp_index_del(x, st);
+	return 1;
+}
+
+/* cmd_top */
+#define PSFP_TOP_COLS  96
+#define PSFP_TOP_TITLE 3 /* Lines above the streams */
+
+/* A stream filter being watched, with its counters of the last sample */
+struct psfp_top_sf {
+	uint32_t sfi;
+	int rc;
+	bool valid;
+	struct mchp_psfp_sf_counters cnt;
+	struct mchp_psfp_sf_counters prev;
+	u64 match;  /* Deltas over the last interval */
+	u64 sdu;
+	u64 gate;
+	u64 red;
+	u64 drops;  /* All three */
+	u64 total;  /* Drops since the start */
+};
+
+struct psfp_top {
+	struct psfp_top_sf *sf;
+	unsigned int cnt;
+	unsigned int lines;    /* Streams shown */
+	unsigned int interval; /* ms */
+	unsigned int *rank;    /* The lines worst first, in sf */
+	unsigned int nrank;
+	bool tty;
+	char (*screen)[PSFP_TOP_COLS]; /* What the terminal shows */
+};
+
+static volatile sig_atomic_t psfp_top_stop;
+
+static void psfp_top_sigint(int sig)
+{
+	(void)sig;
+	psfp_top_stop = 1;
+}
+
+/* Find the enabled filters of the list, reading all configs in one flush */
+static int psfp_top_init(struct psfp_top *t, const char *arg)
+{
+	struct mchp_psfp_sf_conf *conf;
+	bool all = !strcmp(arg, "--all");
+	unsigned int cnt, i, n;
+	struct nl_msg *msg;
+	uint32_t *ids;
+	int *rc;
+
+	ids = malloc(MCHP_ID_LIST_MAX * sizeof(*ids));
+	if (!ids)
+		return -1;
+
+	if (all) {
+		for (i = 0; i < PSFP_INDEX_IDS; i++)
+			ids[i] = i;
+		cnt = PSFP_INDEX_IDS;
+	} else {
+		n = psfp_id_list_parse(arg, PSFP_INDEX_SFI, ids);
+		if ((int)n < 0) {
+			free(ids);
+			return -1;
+		}
+		cnt = n;
+	}
+
+	conf = calloc(cnt, sizeof(*conf));
+	rc = calloc(cnt, sizeof(*rc));
+	t->sf = calloc(cnt, sizeof(*t->sf));
+	if (!conf || !rc || !t->sf)
+		goto err;
+
+	for (i = 0; i < cnt; i++) {
+		msg = mchp_genl_get(&psfp_session, MCHP_PSFP_SF_GENL_CONF_GET,
+				    mchp_psfp_sf_conf_read, &conf[i], &rc[i]);
+		if (!msg)
+			goto err;
+		NLA_PUT_U32(msg, MCHP_PSFP_SF_ATTR_SFI, ids[i]);
+	}
+	mchp_genl_flush(&psfp_session);
+
+	for (i = 0, n = 0; i < cnt; i++) {
+		if (rc[i]) {
+			if (!all)
+				printf("sf %u: %s\n", ids[i], nl_geterror(rc[i]));
+			continue;
+		}
+		if (conf[i].enable)
+			t->sf[n++].sfi = ids[i];
+	}
+	t->cnt = n;
+
+	free(rc);
+	free(conf);
+	free(ids);
+
+	t->rank = calloc(t->lines, sizeof(*t->rank));
+	t->screen = calloc(PSFP_TOP_TITLE + t->lines, sizeof(*t->screen));
+	if (!t->rank || !t->screen)
+		return -1;
+	memset(t->screen, ' ', (PSFP_TOP_TITLE + t->lines) * sizeof(*t->screen));
 
 	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(&psfp_session);
+err:
+	free(rc);
+	free(conf);
+	free(ids);
+	return -1;
+}
+
+/* Read the counters of all filters, in one flush. Errors are left in the
+ * filters.
+ */
+static int psfp_top_sample(struct psfp_top *t)
+{
+	struct nl_msg *msg;
+	unsigned int i;
+
+	for (i = 0; i < t->cnt; i++) {
+		msg = mchp_genl_get(&psfp_session, MCHP_PSFP_SF_GENL_STATUS_GET,
+				    mchp_psfp_sf_counters_read, &t->sf[i].cnt,
+				    &t->sf[i].rc);
+		if (!msg)
+			return -1;
+		NLA_PUT_U32(msg, MCHP_PSFP_SF_ATTR_SFI, t->sf[i].sfi);
+	}
+
+	mchp_genl_flush(&psfp_session);
+
+	return 0;
+
+nla_put_failure:
+	mchp_genl_req_abort(&psfp_session);
+	return -NLE_MSGSIZE;
+}
+
+/* Counters cleared in between start over from 0 */
+static u64 psfp_top_delta(u64 now, u64 prev)
+{
+	return now >= prev ? now - prev : now;
+}
+
+static bool psfp_top_worse(const struct psfp_top_sf *a,
+			   const struct psfp_top_sf *b)
+{
+	if (a->drops != b->drops)
+		return a->drops > b->drops;
+	return a->match > b->match;
+}
+
+/* Take the deltas of the new sample and keep the worst filters, by
+ * insertion into the few lines shown rather than sorting them all.
+ */
+static void psfp_top_update(struct psfp_top *t)
+{
+	struct psfp_top_sf *sf;
+	unsigned int i, j;
+
+	t->nrank = 0;
+	for (i = 0; i < t->cnt; i++) {
+		sf = &t->sf[i];
+		if (sf->rc) {
+			/* Keep the last counters, the next delta spans both */
+			sf->match = sf->sdu = sf->gate = sf->red = 0;
+			sf->drops = 0;
+			continue;
+		}
+		if (sf->valid) {
+			sf->match = psfp_top_delta(sf->cnt.matching_frames_count,
+						   sf->prev.matching_frames_count);
+			sf->sdu = psfp_top_delta(sf->cnt.not_passing_sdu_count,
+						 sf->prev.not_passing_sdu_count);
+			sf->gate = psfp_top_delta(sf->cnt.not_passing_frames_count,
+						  sf->prev.not_passing_frames_count);
+			sf->red = psfp_top_delta(sf->cnt.red_frames_count,
+						 sf->prev.red_frames_count);
+			sf->drops = sf->sdu + sf->gate + sf->red;
+			sf->total += sf->drops;
+		}
+		sf->prev = sf->cnt;
+		sf->valid = true;
+
+		if (!sf->match && !sf->drops)
+			continue;
+		if (t->nrank == t->lines &&
+		    !psfp_top_worse(sf, &t->sf[t->rank[t->nrank - 1]]))
+			continue;
+
+		j = t->nrank < t->lines ? t->nrank++ : t->nrank - 1;
+		for (; j && psfp_top_worse(sf, &t->sf[t->rank[j - 1]]); j--)
+			t->rank[j] = t->rank[j - 1];
+		t->rank[j] = i;
+	}
+}
+
+/* Put a line on the screen. On a terminal only the columns that changed
+ * since the last frame are written, elsewhere every line is printed.
+ */
+static void psfp_top_line(struct psfp_top *t, unsigned int row,
+			  const char *fmt, ...)
+{
+	char *old = t->screen[row], new[PSFP_TOP_COLS];
+	unsigned int first, last;
+	va_list ap;
+
+	va_start(ap, fmt);
+	memset(new, ' ', sizeof(new));
+	vsnprintf(new, sizeof(new), fmt, ap);
+	va_end(ap);
+	new[strlen(new)] = ' ';
+
+	if (!t->tty) {
+		for (last = PSFP_TOP_COLS; last && new[last - 1] == ' '; last--)
+			;
+		printf("%.*s\n", last, new);
+		return;
+	}
+
+	for (first = 0; first < PSFP_TOP_COLS && new[first] == old[first];
+	     first++)
+		;
+	if (first == PSFP_TOP_COLS)
+		return;
+	for (last = PSFP_TOP_COLS; new[last - 1] == old[last - 1]; last--)
+		;
+
+	printf("\033[%u;%uH%.*s", row + 1, first + 1, last - first,
+	       &new[first]);
+	memcpy(old, new, PSFP_TOP_COLS);
+}
+
+static void psfp_top_show(struct psfp_top *t, unsigned int n, u64 ns)
+{
+	const struct psfp_top_sf *sf;
+	unsigned int i, row = 0;
+
+	psfp_top_line(t, row++, "%u filters, %u ms, sample %u", t->cnt,
+		      t->interval, n);
+	psfp_top_line(t, row++, "");
+	psfp_top_line(t, row++, "%5s %12s %12s %12s %12s %7s %14s", "sfi",
+		      "match/s", "sdu_drop/s", "gate_drop/s", "red/s",
+		      "drop%", "drops");
+
+	for (i = 0; i < t->lines; i++) {
+		if (i >= t->nrank) {
+			psfp_top_line(t, row++, "");
+			continue;
+		}
+		sf = &t->sf[t->rank[i]];
+		psfp_top_line(t, row++,
+			      "%5u %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+			      " %12" PRIu64 " %7.2f %14" PRIu64, sf->sfi,
+			      sf->match * 1000000000ULL / ns,
+			      sf->sdu * 1000000000ULL / ns,
+			      sf->gate * 1000000000ULL / ns,
+			      sf->red * 1000000000ULL / ns,
+			      sf->match ? 100.0 * sf->drops / sf->match : 0.0,
+			      sf->total);
+	}
+
+	if (!t->tty)
+		printf("\n");
+	fflush(stdout);
+}
+
+static char *mchp_psfp_top_help(void)
+{
+	return "--interval:        Refresh interval in ms (default 1000)\n"
+		" --lines:           Filters shown (default 20, or what fits the terminal)\n"
+		" --count:           Refreshes to show (default: until interrupted)\n"
+		" --help:            Show this help text\n"
+		"The enabled filters of the list are ranked by frames dropped per\n"
+		"second, by the SDU filter, the gate and the flow meter.\n";
+}
+
+static int cmd_top(int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"interval", required_argument, NULL, 'a'},
+		{"lines", required_argument, NULL, 'b'},
+		{"count", required_argument, NULL, 'c'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	struct psfp_top t = {
+		.interval = 1000,
+		.lines = 20,
+	};
+	unsigned int n, count = 0;
+	u64 last, next, now;
+	struct timespec ts;
+	struct winsize ws;
+	int do_help = 0;
+	int ch, rc = 0;
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			t.interval = atoi(optarg);
+			break;
+		case 'b':
+			t.lines = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help || strcmp(argv[0], "--help") == 0) {
+		printf("%s", mchp_psfp_top_help());
+		return 0;
+	}
+
+	t.tty = isatty(STDOUT_FILENO);
+	if (t.tty && ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 &&
+	    ws.ws_row > PSFP_TOP_TITLE + 1 &&
+	    t.lines > (unsigned int)ws.ws_row - PSFP_TOP_TITLE - 1)
+		t.lines = ws.ws_row - PSFP_TOP_TITLE - 1;
+
+	if (!t.interval || !t.lines) {
+		fprintf(stderr, "Invalid interval or lines!\n");
+		return 1;
+	}
+
+	if (psfp_top_init(&t, argv[0]) < 0) {
+		rc = 1;
+		goto out;
+	}
+	if (!t.cnt) {
+		printf("No filters enabled\n");
+		goto out;
+	}
+
+	psfp_top_stop = 0;
+	signal(SIGINT, psfp_top_sigint);
+	if (t.tty)
+		printf("\033[2J\033[?25l");
+
+	last = next = psfp_now_ns();
+	for (n = 0; !psfp_top_stop && (!count || n <= count); n++) {
+		if (psfp_top_sample(&t) < 0) {
+			rc = 1;
+			break;
+		}
+		now = psfp_now_ns();
+		psfp_top_update(&t);
+		/* The first sample is the baseline of the deltas */
+		if (n)
+			psfp_top_show(&t, n, now > last ? now - last : 1);
+		last = now;
+
+		next += t.interval * 1000000ULL;
+		if (now > next)
+			next = now;
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	signal(SIGINT, SIG_DFL);
+	if (t.tty)
+		printf("\033[%u;1H\033[?25h\n", PSFP_TOP_TITLE + t.lines);
+
+out:
+	free(t.screen);
+	free(t.rank);
+	free(t.sf);
+	return rc;
 }
 
 static const struct command commands[] =
 {
 	/* Add/delete bridges */
-	{1, "sf", cmd_sf, "sf sfi [options]", mchp_psfp_sf_help},
-	{1, "sg", cmd_sg, "sg sgi [options]", mchp_psfp_sg_help},
-	{2, "gce", cmd_gce, "gce sgi gce [options]", mchp_psfp_gce_help},
-	{1, "fm", cmd_fm, "fm fmi [options]", mchp_psfp_fm_help},
+	{1, "sf", cmd_sf, "sf sfi|stream [options]", mchp_psfp_sf_help},
+	{1, "sg", cmd_sg, "sg sgi|stream [options] | sg sgi_list --wait-applied | sg sgi_list|--all --diff", mchp_psfp_sg_help},
+	{2, "gce", cmd_gce, "gce sgi|stream gce [options]", mchp_psfp_gce_help},
+	{1, "fm", cmd_fm, "fm fmi|stream [options]", mchp_psfp_fm_help},
+	{1, "top", cmd_top, "top sfi_list|--all [options]", mchp_psfp_top_help},
+	{2, "stream", cmd_stream, "stream add|del|show stream|--all [options]", mchp_psfp_stream_help},
 };
 
 static void command_helpall(void)
@@ -1025,9 +2025,11 @@ static void command_helpall(void)
 
 static void help(void)
 {
-	printf("Usage: psfp sf|sg|gce|fm [options]\n");
+	printf("Usage: psfp sf|sg|gce|fm|top|stream [options]\n");
 	printf("options:\n");
 	printf("  -h | --help              Show this help text\n");
+	printf("  --batch <file|->         Run the commands of a file, one per line\n");
+	printf("    --progress             Print \"@line <n>\" before every command\n");
 	printf("options:\n");
 	command_helpall();
 }
@@ -1065,9 +2067,26 @@ static const struct command *command_lookup_and_validate(int argc,
 	return cmd;
 }
 
-int main(int argc, char *argv[])
+static int command_run(int argc, char **argv, int line_num)
 {
 	const struct command *cmd;
+
+	cmd = command_lookup_and_validate(argc, argv, line_num);
+	if (!cmd)
+		return 1;
+
+	/* skip command (e.g. 'sf') */
+	argv++;
+	argc--;
+
+	/* getopt state is kept between the commands of a batch */
+	optind = 0;
+
+	return cmd->func(argc, argv);
+}
+
+int main(int argc, char *argv[])
+{
 	int f;
 	int ret;
 
@@ -1080,15 +2099,24 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	cmd = command_lookup_and_validate(argc, argv, 0);
-	if (!cmd)
-		return 1;
+	if (strcmp(argv[0], "--batch") == 0) {
+		if (argc < 2) {
+			fprintf(stderr, "Missing argument!\n");
+			return 1;
+		}
+		ret = mchp_batch_run(argv[1], argc > 2 &&
+				   strcmp(argv[2], "--progress") == 0,
+				   command_run);
+	} else {
+		ret = command_run(argc, argv, 0);
+	}
+	mchp_genl_session_close(&psfp_session);
 
-	/* skip command (e.g. 'sf') */
-	argv++;
-	argc--;
+	if (psfp_index_opened) {
+		if (psfp_index_save(&psfp_index) < 0)
+			ret = 1;
+		psfp_index_close(&psfp_index);
+	}
 
-	ret = cmd->func(argc, argv);
 	return ret;
 }
-
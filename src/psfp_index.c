@@ -0,0 +1,572 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "psfp_index.h"
+
+/* The file holds one line per stream, instances not used being "-", and
+ * one per flow meter instance with the configuration it is shared by:
+ *
+ *   stream <name> <sfi> <sgi> <fmi>
+ *   profile <fmi> <enable> <cir> <cbs> <eir> <ebs> <cf> <drop_on_yellow>
+ *           <mark_red_enable> <mark_red>
+ */
+#define PSFP_INDEX_HEADER "# psfp stream index v2\n"
+
+#define PSFP_INDEX_FM_SLOTS (2 * PSFP_INDEX_IDS)
+
+static unsigned int psfp_index_fnv(unsigned int h, const void *data,
+				   size_t len)
+{
+	const unsigned char *p = data;
+
+	while (len--)
+		h = (h ^ *p++) * 16777619u;
+
+	return h;
+}
+
+static unsigned int psfp_index_hash(const char *name)
+{
+	return psfp_index_fnv(2166136261u, name, strlen(name));
+}
+
+/* Hash the fields one by one, the padding of the struct is undefined */
+static unsigned int psfp_index_fm_hash(const struct mchp_psfp_fm_conf *c)
+{
+	uint32_t v[] = { c->enable, c->cir, c->cbs, c->eir, c->ebs, c->cf,
+			 c->drop_on_yellow, c->mark_red_enable, c->mark_red };
+
+	return psfp_index_fnv(2166136261u, v, sizeof(v));
+}
+
+static bool psfp_index_fm_same(const struct mchp_psfp_fm_conf *a,
+			       const struct mchp_psfp_fm_conf *b)
+{
+	return a->enable == b->enable && a->cir == b->cir &&
+	       a->cbs == b->cbs && a->eir == b->eir && a->ebs == b->ebs &&
+	       a->cf == b->cf && a->drop_on_yellow == b->drop_on_yellow &&
+	       a->mark_red_enable == b->mark_red_enable &&
+	       a->mark_red == b->mark_red;
+}
+
+static unsigned int psfp_index_home(const struct psfp_index *x,
+				    const unsigned int *slots,
+				    unsigned int entry)
+{
+	if (slots == x->fm_slots)
+		return psfp_index_fm_hash(&x->profiles[entry - 1].conf);
+
+	return psfp_index_hash(x->streams[entry - 1].name);
+}
+
+/* Empty slot @i, shifting back the entries of the probe sequence past it
+ * that would no longer be found.
+ */
+static void psfp_index_slot_clear(const struct psfp_index *x,
+				  unsigned int *slots, unsigned int nslots,
+				  unsigned int i)
+{
+	unsigned int mask = nslots - 1, j, k;
+
+	slots[i] = 0;
+	for (j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+		k = psfp_index_home(x, slots, slots[j]) & mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		slots[i] = slots[j];
+		slots[j] = 0;
+		i = j;
+	}
+}
+
+/* The slot of @name, or the empty slot it would take */
+static unsigned int psfp_index_slot(const struct psfp_index *x,
+				    const char *name)
+{
+	unsigned int mask = x->nslots - 1, i;
+
+	for (i = psfp_index_hash(name) & mask; x->slots[i];
+	     i = (i + 1) & mask)
+		if (strcmp(x->streams[x->slots[i] - 1].name, name) == 0)
+			break;
+
+	return i;
+}
+
+static int psfp_index_rehash(struct psfp_index *x, unsigned int nslots)
+{
+	unsigned int *old = x->slots, i;
+
+	x->slots = calloc(nslots, sizeof(*x->slots));
+	if (!x->slots) {
+		x->slots = old;
+		return -1;
+	}
+	x->nslots = nslots;
+	free(old);
+
+	for (i = 0; i < x->cnt; i++)
+		x->slots[psfp_index_slot(x, x->streams[i].name)] = i + 1;
+
+	return 0;
+}
+
+struct psfp_stream *psfp_index_find(const struct psfp_index *x,
+				    const char *name)
+{
+	unsigned int i;
+
+	if (!x->cnt)
+		return NULL;
+
+	i = psfp_index_slot(x, name);
+
+	return x->slots[i] ? &x->streams[x->slots[i] - 1] : NULL;
+}
+
+bool psfp_index_name_valid(const char *name)
+{
+	const char *p;
+
+	if (!name[0] || strlen(name) >= PSFP_INDEX_NAME_MAX ||
+	    isdigit((unsigned char)name[0]) || name[0] == '-')
+		return false;
+
+	for (p = name; *p; p++)
+		if (!isalnum((unsigned char)*p) && !strchr("_.:-", *p))
+			return false;
+
+	return true;
+}
+
+/* The returned stream is valid until the next add or del */
+struct psfp_stream *psfp_index_add(struct psfp_index *x, const char *name)
+{
+	struct psfp_stream *st;
+	unsigned int i;
+
+	if (!psfp_index_name_valid(name))
+		return NULL;
+
+	if (2 * (x->cnt + 1) > x->nslots &&
+	    psfp_index_rehash(x, x->nslots ? 2 * x->nslots : 256) < 0)
+		return NULL;
+
+	if (x->cnt == x->size) {
+		st = realloc(x->streams, (x->size + 256) * sizeof(*st));
+		if (!st)
+			return NULL;
+		x->streams = st;
+		x->size += 256;
+	}
+
+	i = psfp_index_slot(x, name);
+	if (x->slots[i])
+		return NULL;
+
+	st = &x->streams[x->cnt++];
+	x->slots[i] = x->cnt;
+	strcpy(st->name, name);
+	for (i = 0; i < PSFP_INDEX_KINDS; i++)
+		st->id[i] = PSFP_INDEX_NONE;
+	x->dirty = true;
+
+	return st;
+}
+
+/* The slot of instance @fmi, or of any instance programmed with @conf
+ * when @fmi is PSFP_INDEX_NONE, or the empty slot ending the probe
+ */
+static unsigned int psfp_index_fm_slot(const struct psfp_index *x,
+				       const struct mchp_psfp_fm_conf *conf,
+				       uint32_t fmi)
+{
+	unsigned int mask = PSFP_INDEX_FM_SLOTS - 1, i, id;
+
+	for (i = psfp_index_fm_hash(conf) & mask; x->fm_slots[i];
+	     i = (i + 1) & mask) {
+		id = x->fm_slots[i] - 1;
+		if (fmi == PSFP_INDEX_NONE ?
+		    psfp_index_fm_same(&x->profiles[id].conf, conf) :
+		    id == fmi)
+			break;
+	}
+
+	return i;
+}
+
+static void psfp_index_fm_insert(struct psfp_index *x, uint32_t fmi)
+{
+	unsigned int mask = PSFP_INDEX_FM_SLOTS - 1, i;
+
+	for (i = psfp_index_fm_hash(&x->profiles[fmi].conf) & mask;
+	     x->fm_slots[i]; i = (i + 1) & mask)
+		;
+	x->fm_slots[i] = fmi + 1;
+}
+
+static void psfp_index_fm_remove(struct psfp_index *x, uint32_t fmi)
+{
+	psfp_index_slot_clear(x, x->fm_slots, PSFP_INDEX_FM_SLOTS,
+			      psfp_index_fm_slot(x, &x->profiles[fmi].conf,
+						 fmi));
+}
+
+int psfp_index_fm_get(struct psfp_index *x,
+		      const struct mchp_psfp_fm_conf *conf, uint32_t *fmi)
+{
+	struct psfp_profile *p;
+	unsigned int i;
+
+	i = psfp_index_fm_slot(x, conf, PSFP_INDEX_NONE);
+	if (x->fm_slots[i]) {
+		*fmi = x->fm_slots[i] - 1;
+		x->profiles[*fmi].refs++;
+		return 1;
+	}
+
+	if (psfp_index_id_alloc(x, PSFP_INDEX_FMI, fmi) < 0)
+		return -1;
+
+	p = &x->profiles[*fmi];
+	p->conf = *conf;
+	p->refs = 1;
+	p->known = true;
+	x->fm_slots[i] = *fmi + 1;
+
+	return 0;
+}
+
+/* Drop a reference, the last one frees the instance */
+static void psfp_index_fm_put(struct psfp_index *x, uint32_t fmi)
+{
+	struct psfp_profile *p;
+
+	if (fmi >= PSFP_INDEX_IDS)
+		return;
+
+	p = &x->profiles[fmi];
+	if (p->refs > 1) {
+		p->refs--;
+		return;
+	}
+
+	if (p->known)
+		psfp_index_fm_remove(x, fmi);
+	memset(p, 0, sizeof(*p));
+	psfp_index_id_free(x, PSFP_INDEX_FMI, fmi);
+}
+
+void psfp_index_fm_update(struct psfp_index *x, uint32_t fmi,
+			  const struct mchp_psfp_fm_conf *conf)
+{
+	struct psfp_profile *p;
+
+	/* Instances not handed out by the index are none of its business,
+	 * and instances not shared stay out of the profiles
+	 */
+	if (fmi >= PSFP_INDEX_IDS || !x->profiles[fmi].refs ||
+	    !x->profiles[fmi].known)
+		return;
+
+	p = &x->profiles[fmi];
+	if (p->known)
+		psfp_index_fm_remove(x, fmi);
+	p->conf = *conf;
+	p->known = true;
+	psfp_index_fm_insert(x, fmi);
+	x->dirty = true;
+}
+
+void psfp_index_del(struct psfp_index *x, struct psfp_stream *st)
+{
+	unsigned int pos = st - x->streams, i, k;
+
+	for (k = 0; k < PSFP_INDEX_KINDS; k++)
+		if (k == PSFP_INDEX_FMI)
+			psfp_index_fm_put(x, st->id[k]);
+		else
+			psfp_index_id_free(x, k, st->id[k]);
+
+	psfp_index_slot_clear(x, x->slots, x->nslots,
+			      psfp_index_slot(x, st->name));
+
+	/* Move the last stream into the gap */
+	if (pos != x->cnt - 1) {
+		i = psfp_index_slot(x, x->streams[x->cnt - 1].name);
+		x->slots[i] = pos + 1;
+		x->streams[pos] = x->streams[x->cnt - 1];
+	}
+	x->cnt--;
+	x->dirty = true;
+}
+
+int psfp_index_id_alloc(struct psfp_index *x, enum psfp_index_kind kind,
+			uint32_t *id)
+{
+	uint64_t *map = x->map[kind];
+	unsigned int i;
+
+	for (i = 0; i < PSFP_INDEX_IDS / 64; i++) {
+		if (map[i] == UINT64_MAX)
+			continue;
+		*id = i * 64 + __builtin_ctzll(~map[i]);
+		map[i] |= 1ULL << (*id % 64);
+		x->dirty = true;
+		return 0;
+	}
+
+	return -1;
+}
+
+void psfp_index_id_free(struct psfp_index *x, enum psfp_index_kind kind,
+			uint32_t id)
+{
+	if (id >= PSFP_INDEX_IDS)
+		return;
+
+	x->map[kind][id / 64] &= ~(1ULL << (id % 64));
+	x->dirty = true;
+}
+
+static int psfp_index_id_parse(const char *arg, uint32_t *id)
+{
+	unsigned long val;
+	char *end;
+
+	if (strcmp(arg, "-") == 0) {
+		*id = PSFP_INDEX_NONE;
+		return 0;
+	}
+
+	val = strtoul(arg, &end, 10);
+	if (end == arg || *end || val >= PSFP_INDEX_IDS)
+		return -1;
+	*id = val;
+
+	return 0;
+}
+
+static int psfp_index_profile_parse(struct psfp_index *x, const char *line)
+{
+	int enable, cf, drop_on_yellow, mark_red_enable, mark_red;
+	struct mchp_psfp_fm_conf *c;
+	unsigned int fmi;
+
+	if (sscanf(line, "profile %u", &fmi) != 1 || fmi >= PSFP_INDEX_IDS)
+		return -1;
+
+	c = &x->profiles[fmi].conf;
+	if (sscanf(line, "profile %*u %d %u %u %u %u %d %d %d %d", &enable,
+		   &c->cir, &c->cbs, &c->eir, &c->ebs, &cf, &drop_on_yellow,
+		   &mark_red_enable, &mark_red) != 9)
+		return -1;
+
+	c->enable = enable;
+	c->cf = cf;
+	c->drop_on_yellow = drop_on_yellow;
+	c->mark_red_enable = mark_red_enable;
+	c->mark_red = mark_red;
+	x->profiles[fmi].known = true;
+
+	return 0;
+}
+
+/* Count the streams metered by every instance. Profiles nobody uses are
+ * dropped, and instances without profile, as written by v1, are never
+ * shared.
+ */
+static void psfp_index_profiles_init(struct psfp_index *x)
+{
+	struct psfp_profile *p;
+	unsigned int i;
+
+	for (i = 0; i < x->cnt; i++)
+		if (x->streams[i].id[PSFP_INDEX_FMI] != PSFP_INDEX_NONE)
+			x->profiles[x->streams[i].id[PSFP_INDEX_FMI]].refs++;
+
+	for (i = 0; i < PSFP_INDEX_IDS; i++) {
+		p = &x->profiles[i];
+		if (p->known && !p->refs) {
+			memset(p, 0, sizeof(*p));
+			x->dirty = true;
+		}
+		if (p->known)
+			psfp_index_fm_insert(x, i);
+	}
+}
+
+static int psfp_index_load(struct psfp_index *x, FILE *f)
+{
+	char line[256], name[PSFP_INDEX_NAME_MAX], id[PSFP_INDEX_KINDS][16];
+	struct psfp_stream *st;
+	int line_num = 0;
+	unsigned int k;
+
+	while (fgets(line, sizeof(line), f)) {
+		line_num++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (strncmp(line, "profile ", 8) == 0) {
+			if (psfp_index_profile_parse(x, line) < 0)
+				goto invalid;
+			continue;
+		}
+
+		if (sscanf(line, "stream %63s %15s %15s %15s", name, id[0],
+			   id[1], id[2]) != 4)
+			goto invalid;
+
+		st = psfp_index_add(x, name);
+		if (!st)
+			goto invalid;
+
+		for (k = 0; k < PSFP_INDEX_KINDS; k++) {
+			if (psfp_index_id_parse(id[k], &st->id[k]) < 0)
+				goto invalid;
+			if (st->id[k] != PSFP_INDEX_NONE)
+				x->map[k][st->id[k] / 64] |=
+					1ULL << (st->id[k] % 64);
+		}
+	}
+	x->dirty = false;
+	psfp_index_profiles_init(x);
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "%s: Invalid line %d!\n", PSFP_INDEX_FILE, line_num);
+	return -1;
+}
+
+int psfp_index_open(struct psfp_index *x, bool write)
+{
+	int op = write ? LOCK_EX : LOCK_SH;
+	FILE *f;
+	int rc;
+
+	memset(x, 0, sizeof(*x));
+
+	if (mkdir(PSFP_INDEX_DIR, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "%s: %s!\n", PSFP_INDEX_DIR, strerror(errno));
+		return -1;
+	}
+
+	/* The index file itself is replaced on every save */
+	x->lock_fd = open(PSFP_INDEX_LOCK, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (x->lock_fd < 0)
+		goto err_lock;
+
+	if (flock(x->lock_fd, op | LOCK_NB) < 0) {
+		if (errno != EWOULDBLOCK)
+			goto err_lock;
+		fprintf(stderr, "Stream index busy, waiting for %s\n",
+			PSFP_INDEX_LOCK);
+		if (flock(x->lock_fd, op) < 0)
+			goto err_lock;
+	}
+
+	f = fopen(PSFP_INDEX_FILE, "re");
+	if (!f) {
+		if (errno == ENOENT)
+			goto out;
+		fprintf(stderr, "%s: %s!\n", PSFP_INDEX_FILE, strerror(errno));
+		goto err;
+	}
+
+	rc = psfp_index_load(x, f);
+	fclose(f);
+	if (rc < 0)
+		goto err;
+
+out:
+	/* Lookups work on what was loaded, not blocking writers meanwhile */
+	if (!write) {
+		close(x->lock_fd);
+		x->lock_fd = -1;
+	}
+
+	return 0;
+
+err_lock:
+	fprintf(stderr, "%s: %s!\n", PSFP_INDEX_LOCK, strerror(errno));
+
+err:
+	psfp_index_close(x);
+	return -1;
+}
+
+int psfp_index_save(struct psfp_index *x)
+{
+	const struct psfp_profile *p;
+	const struct psfp_stream *st;
+	unsigned int i, k;
+	FILE *f;
+
+	if (!x->dirty)
+		return 0;
+
+	f = fopen(PSFP_INDEX_FILE ".tmp", "we");
+	if (!f)
+		goto err;
+
+	fputs(PSFP_INDEX_HEADER, f);
+	for (i = 0; i < x->cnt; i++) {
+		st = &x->streams[i];
+		fprintf(f, "stream %s", st->name);
+		for (k = 0; k < PSFP_INDEX_KINDS; k++)
+			if (st->id[k] == PSFP_INDEX_NONE)
+				fprintf(f, " -");
+			else
+				fprintf(f, " %u", st->id[k]);
+		fprintf(f, "\n");
+	}
+
+	for (i = 0; i < PSFP_INDEX_IDS; i++) {
+		p = &x->profiles[i];
+		if (!p->known || !p->refs)
+			continue;
+		fprintf(f, "profile %u %d %u %u %u %u %d %d %d %d\n", i,
+			p->conf.enable, p->conf.cir, p->conf.cbs, p->conf.eir,
+			p->conf.ebs, p->conf.cf, p->conf.drop_on_yellow,
+			p->conf.mark_red_enable, p->conf.mark_red);
+	}
+
+	/* Readers see either the old or the new index, never a part */
+	if (fflush(f) || fsync(fileno(f))) {
+		fclose(f);
+		goto err;
+	}
+	if (fclose(f) || rename(PSFP_INDEX_FILE ".tmp", PSFP_INDEX_FILE) < 0)
+		goto err;
+	x->dirty = false;
+
+	return 0;
+
+err:
+	fprintf(stderr, "%s: %s!\n", PSFP_INDEX_FILE, strerror(errno));
+	unlink(PSFP_INDEX_FILE ".tmp");
+	return -1;
+}
+
+void psfp_index_close(struct psfp_index *x)
+{
+	free(x->streams);
+	free(x->slots);
+	if (x->lock_fd >= 0)
+		close(x->lock_fd);
+	memset(x, 0, sizeof(*x));
+	x->lock_fd = -1;
+}
@@ -0,0 +1,106 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _PSFP_INDEX_H_
+#define _PSFP_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "kernel_types.h"
+#include "mchp_ui_qos.h"
+
+/* Persistent mapping of named streams to the PSFP instances they use */
+#define PSFP_INDEX_DIR      "/var/lib/mchp_psfp"
+#define PSFP_INDEX_FILE     PSFP_INDEX_DIR "/streams"
+#define PSFP_INDEX_LOCK     PSFP_INDEX_DIR "/streams.lock"
+#define PSFP_INDEX_IDS      1024 /* Instances of each kind handed out */
+#define PSFP_INDEX_NAME_MAX 64
+#define PSFP_INDEX_NONE     UINT32_MAX
+
+enum psfp_index_kind {
+	PSFP_INDEX_SFI,
+	PSFP_INDEX_SGI,
+	PSFP_INDEX_FMI,
+
+	/* This must be the last entry */
+	PSFP_INDEX_KINDS,
+};
+
+struct psfp_stream {
+	char name[PSFP_INDEX_NAME_MAX];
+	uint32_t id[PSFP_INDEX_KINDS]; /* PSFP_INDEX_NONE if not used */
+};
+
+/* Flow meter configuration shared by the streams metered by an instance */
+struct psfp_profile {
+	struct mchp_psfp_fm_conf conf;
+	unsigned int refs; /* Streams using the instance */
+	bool known;        /* conf is what the instance was programmed with */
+};
+
+/* The streams are kept in an array, found by name through an open
+ * addressing table of array positions. Instances in use are set in one
+ * bitmap per kind. Flow meters are found by configuration through a
+ * second table, of instance + 1.
+ */
+struct psfp_index {
+	int lock_fd;
+	bool dirty;
+	struct psfp_stream *streams;
+	unsigned int cnt;
+	unsigned int size;
+	unsigned int *slots; /* Position + 1, 0 if empty */
+	unsigned int nslots;
+	uint64_t map[PSFP_INDEX_KINDS][PSFP_INDEX_IDS / 64];
+	struct psfp_profile profiles[PSFP_INDEX_IDS]; /* By FMI */
+	unsigned int fm_slots[2 * PSFP_INDEX_IDS];
+};
+
+/* Load the index. With @write it stays locked until it is closed, else
+ * the lock is dropped once loaded and the index must not be saved.
+ */
+int psfp_index_open(struct psfp_index *x, bool write);
+
+/* Write the index to a new file, which then replaces the old one */
+int psfp_index_save(struct psfp_index *x);
+
+void psfp_index_close(struct psfp_index *x);
+
+struct psfp_stream *psfp_index_find(const struct psfp_index *x,
+				    const char *name);
+
+/* Stream names are made of [A-Za-z0-9_.:-], not starting with a digit or
+ * '-', so they are one word of the file and never taken for an ID
+ */
+bool psfp_index_name_valid(const char *name);
+
+/* Add a stream using no instances yet, NULL if it exists or the name is
+ * invalid
+ */
+struct psfp_stream *psfp_index_add(struct psfp_index *x, const char *name);
+
+/* Remove a stream, freeing its instances, its flow meter only when no
+ * other stream shares it
+ */
+void psfp_index_del(struct psfp_index *x, struct psfp_stream *st);
+
+int psfp_index_id_alloc(struct psfp_index *x, enum psfp_index_kind kind,
+			uint32_t *id);
+void psfp_index_id_free(struct psfp_index *x, enum psfp_index_kind kind,
+			uint32_t id);
+
+/* Take a reference on the flow meter instance programmed with @conf for
+ * sharing, allocating one if there is none. Streams sharing an instance
+ * are policed as one aggregate. Returns 1 when an instance is shared, 0
+ * when a new one must be programmed.
+ */
+int psfp_index_fm_get(struct psfp_index *x,
+		      const struct mchp_psfp_fm_conf *conf, uint32_t *fmi);
+
+/* Record the new configuration of an instance, no matter who changed it */
+void psfp_index_fm_update(struct psfp_index *x, uint32_t fmi,
+			  const struct mchp_psfp_fm_conf *conf);
+
+#endif /* _PSFP_INDEX_H_ */
@@ -0,0 +1,231 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "psfp_meter.h"
+
+/* kbit/s to octets per ns */
+#define PSFP_METER_RATE(kbps) ((kbps) * 1000.0 / 8 / 1000000000.0)
+
+#define PSFP_METER_BLOCK 256
+
+/* Builds of the kernel for x86 CPUs with 64 bit lane compares, picked when
+ * the program is loaded
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PSFP_METER_CLONES __attribute__((target_clones("avx2", "sse4.2", "default")))
+#else
+#define PSFP_METER_CLONES
+#endif
+
+int psfp_meter_set_init(struct psfp_meter_set *m,
+			const struct mchp_psfp_fm_conf *conf, unsigned int cnt)
+{
+	unsigned int i, c;
+
+	memset(m, 0, sizeof(*m));
+	m->cnt = cnt;
+
+	m->cir = calloc(cnt, sizeof(*m->cir));
+	m->eir = calloc(cnt, sizeof(*m->eir));
+	m->cbs = calloc(cnt, sizeof(*m->cbs));
+	m->ebs = calloc(cnt, sizeof(*m->ebs));
+	m->cf = calloc(cnt, sizeof(*m->cf));
+	m->bc = calloc(cnt, sizeof(*m->bc));
+	m->be = calloc(cnt, sizeof(*m->be));
+	m->enable = calloc(cnt, sizeof(*m->enable));
+	m->drop_on_yellow = calloc(cnt, sizeof(*m->drop_on_yellow));
+	m->mark_red_enable = calloc(cnt, sizeof(*m->mark_red_enable));
+	m->mark_red = calloc(cnt, sizeof(*m->mark_red));
+	for (c = 0; c < PSFP_METER_COLORS; c++) {
+		m->frames[c] = calloc(cnt, sizeof(*m->frames[c]));
+		m->octets[c] = calloc(cnt, sizeof(*m->octets[c]));
+		if (!m->frames[c] || !m->octets[c])
+			goto err;
+	}
+	m->dropped = calloc(cnt, sizeof(*m->dropped));
+	m->first_drop_ns = calloc(cnt, sizeof(*m->first_drop_ns));
+	m->mark_red_ns = calloc(cnt, sizeof(*m->mark_red_ns));
+
+	if (!m->cir || !m->eir || !m->cbs || !m->ebs || !m->cf || !m->bc ||
+	    !m->be || !m->enable || !m->drop_on_yellow ||
+	    !m->mark_red_enable || !m->mark_red || !m->dropped ||
+	    !m->first_drop_ns || !m->mark_red_ns)
+		goto err;
+
+	for (i = 0; i < cnt; i++) {
+		m->cir[i] = PSFP_METER_RATE(conf[i].cir);
+		m->eir[i] = PSFP_METER_RATE(conf[i].eir);
+		m->cbs[i] = conf[i].cbs;
+		m->ebs[i] = conf[i].ebs;
+		m->cf[i] = conf[i].cf;
+		m->enable[i] = conf[i].enable;
+		m->drop_on_yellow[i] = conf[i].drop_on_yellow;
+		m->mark_red_enable[i] = conf[i].mark_red_enable;
+		m->mark_red[i] = conf[i].mark_red;
+
+		/* Buckets start full */
+		m->bc[i] = m->cbs[i];
+		m->be[i] = m->ebs[i];
+		m->first_drop_ns[i] = PSFP_METER_NEVER;
+		m->mark_red_ns[i] = PSFP_METER_NEVER;
+	}
+
+	return 0;
+
+err:
+	psfp_meter_set_free(m);
+	return -1;
+}
+
+void psfp_meter_set_free(struct psfp_meter_set *m)
+{
+	unsigned int c;
+
+	free(m->cir);
+	free(m->eir);
+	free(m->cbs);
+	free(m->ebs);
+	free(m->cf);
+	free(m->bc);
+	free(m->be);
+	free(m->enable);
+	free(m->drop_on_yellow);
+	free(m->mark_red_enable);
+	free(m->mark_red);
+	for (c = 0; c < PSFP_METER_COLORS; c++) {
+		free(m->frames[c]);
+		free(m->octets[c]);
+	}
+	free(m->dropped);
+	free(m->first_drop_ns);
+	free(m->mark_red_ns);
+	memset(m, 0, sizeof(*m));
+}
+
+/* MEF 10.3 color blind metering of one frame by meters @lo up to @hi, @dt
+ * ns after the previous frame. Both buckets fill at their rate, and the
+ * overflow of the committed bucket goes to the excess bucket when coupling
+ * (cf) is set. A disabled meter passes every frame green, and once
+ * MarkAllFramesRed is set every frame is red.
+ *
+ * Everything is computed and then selected, no branches, and the arrays
+ * do not alias, which lets the compiler vectorize the loop over meters. It
+ * needs -fno-trapping-math to turn the selects into vector blends, and 64
+ * bit lane compares (NEON, SSE4.2 and up).
+ */
+PSFP_METER_CLONES
+static void psfp_meter_kernel(struct psfp_meter_set *m, unsigned int lo,
+			      unsigned int hi, double dt, u32 len, u64 ts_ns)
+{
+	const double *restrict cir = m->cir, *restrict eir = m->eir;
+	const double *restrict cbs = m->cbs, *restrict ebs = m->ebs;
+	const double *restrict cf = m->cf;
+	const u64 *restrict enable = m->enable;
+	const u64 *restrict drop_on_yellow = m->drop_on_yellow;
+	const u64 *restrict mark_red_enable = m->mark_red_enable;
+	double *restrict bc = m->bc, *restrict be = m->be;
+	u64 *restrict mark_red = m->mark_red;
+	u64 *restrict green_frames = m->frames[PSFP_METER_GREEN];
+	u64 *restrict yellow_frames = m->frames[PSFP_METER_YELLOW];
+	u64 *restrict red_frames = m->frames[PSFP_METER_RED];
+	u64 *restrict green_octets = m->octets[PSFP_METER_GREEN];
+	u64 *restrict yellow_octets = m->octets[PSFP_METER_YELLOW];
+	u64 *restrict red_octets = m->octets[PSFP_METER_RED];
+	u64 *restrict dropped = m->dropped;
+	u64 *restrict first_drop_ns = m->first_drop_ns;
+	u64 *restrict mark_red_ns = m->mark_red_ns;
+	u64 active, green, yellow, red, drop, first, latch, fits_c, fits_e;
+	double l = len, c, e, o;
+	unsigned int i;
+
+#pragma GCC ivdep
+	for (i = lo; i < hi; i++) {
+		c = bc[i] + cir[i] * dt;
+		o = c - cbs[i];
+		o = o > 0.0 ? o : 0.0;
+		c = c > cbs[i] ? cbs[i] : c;
+		e = be[i] + eir[i] * dt + cf[i] * o;
+		e = e > ebs[i] ? ebs[i] : e;
+
+		/* Flags are 0 or 1, combined without short circuits */
+		fits_c = l <= c;
+		fits_e = l <= e;
+		active = enable[i] & (mark_red[i] ^ 1);
+		green = (enable[i] ^ 1) | (active & fits_c);
+		yellow = active & (fits_c ^ 1) & fits_e;
+		red = (green | yellow) ^ 1;
+		drop = red | (yellow & drop_on_yellow[i]);
+		/* A discarded red frame sets MarkAllFramesRed, if enabled */
+		latch = red & active & mark_red_enable[i];
+
+		bc[i] = (active & green) ? c - l : c;
+		be[i] = yellow ? e - l : e;
+
+		green_frames[i] += green;
+		yellow_frames[i] += yellow;
+		red_frames[i] += red;
+		green_octets[i] += green * len;
+		yellow_octets[i] += yellow * len;
+		red_octets[i] += red * len;
+		dropped[i] += drop;
+		first = drop & (first_drop_ns[i] == PSFP_METER_NEVER);
+		first_drop_ns[i] ^= (first_drop_ns[i] ^ ts_ns) & -first;
+		mark_red_ns[i] ^= (mark_red_ns[i] ^ ts_ns) & -latch;
+		mark_red[i] |= latch;
+	}
+}
+
+static double psfp_meter_dt(struct psfp_meter_set *m, u64 ts_ns)
+{
+	double dt = 0.0;
+
+	if (m->started && ts_ns > m->last_ns)
+		dt = ts_ns - m->last_ns;
+	if (!m->started || ts_ns > m->last_ns)
+		m->last_ns = ts_ns;
+	m->started = true;
+
+	return dt;
+}
+
+/* The frames are run through a block of meters at a time, which keeps the
+ * state of the block in cache from one frame to the next.
+ */
+void psfp_meter_set_run(struct psfp_meter_set *m, const u64 *ts_ns,
+			const u32 *len, size_t n)
+{
+	u64 last_ns = m->last_ns;
+	bool started = m->started;
+	unsigned int lo, hi;
+	size_t f;
+
+	for (lo = 0; lo < m->cnt; lo = hi) {
+		hi = m->cnt - lo > PSFP_METER_BLOCK ? lo + PSFP_METER_BLOCK :
+						      m->cnt;
+		m->last_ns = last_ns;
+		m->started = started;
+		for (f = 0; f < n; f++)
+			psfp_meter_kernel(m, lo, hi,
+					  psfp_meter_dt(m, ts_ns[f]),
+					  len[f], ts_ns[f]);
+	}
+}
+
+enum psfp_meter_color psfp_meter_frame(struct psfp_meter_set *m,
+				       unsigned int i, u64 ts_ns, u32 len)
+{
+	u64 green = m->frames[PSFP_METER_GREEN][i];
+	u64 yellow = m->frames[PSFP_METER_YELLOW][i];
+
+	psfp_meter_kernel(m, i, i + 1, psfp_meter_dt(m, ts_ns), len, ts_ns);
+
+	if (m->frames[PSFP_METER_GREEN][i] != green)
+		return PSFP_METER_GREEN;
+
+	return m->frames[PSFP_METER_YELLOW][i] != yellow ?
+	       PSFP_METER_YELLOW : PSFP_METER_RED;
+}
@@ -0,0 +1,74 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _PSFP_METER_H_
+#define _PSFP_METER_H_
+
+#include <stddef.h>
+#include "kernel_types.h"
+#include "mchp_ui_qos.h"
+
+enum psfp_meter_color {
+	PSFP_METER_GREEN,
+	PSFP_METER_YELLOW,
+	PSFP_METER_RED,
+
+	/* This must be the last entry */
+	PSFP_METER_COLORS,
+};
+
+#define PSFP_METER_NEVER UINT64_MAX
+
+/* Software model of the MEF 10.3 two rate, three color flow meter of
+ * IEEE 802.1Qci, color blind, as configured by struct mchp_psfp_fm_conf.
+ *
+ * Any number of meters are run over the same frames at once. The state is
+ * kept as a structure of arrays with one element per meter, so the update
+ * of all meters for a frame is a loop without branches the compiler turns
+ * into vector instructions.
+ */
+struct psfp_meter_set {
+	unsigned int cnt;
+
+	/* Configuration, rates in octets per ns */
+	double *cir;
+	double *eir;
+	double *cbs;
+	double *ebs;
+	double *cf;          /* 1.0 if set */
+	u64 *enable;         /* Flags are 0 or 1, as wide as the rest */
+	u64 *drop_on_yellow;
+	u64 *mark_red_enable;
+
+	/* State */
+	double *bc;          /* Committed tokens, octets */
+	double *be;          /* Excess tokens, octets */
+	u64 *mark_red;       /* MarkAllFramesRed */
+	u64 last_ns;
+	bool started;
+
+	/* Results */
+	u64 *frames[PSFP_METER_COLORS];
+	u64 *octets[PSFP_METER_COLORS];
+	u64 *dropped;        /* Red frames, and yellow with drop_on_yellow */
+	u64 *first_drop_ns;  /* PSFP_METER_NEVER if none */
+	u64 *mark_red_ns;    /* When MarkAllFramesRed was set */
+};
+
+int psfp_meter_set_init(struct psfp_meter_set *m,
+			const struct mchp_psfp_fm_conf *conf, unsigned int cnt);
+void psfp_meter_set_free(struct psfp_meter_set *m);
+
+/* Meter @n frames of @len octets arriving at @ts_ns, in time order */
+void psfp_meter_set_run(struct psfp_meter_set *m, const u64 *ts_ns,
+			const u32 *len, size_t n);
+
+/* Meter one frame with meter @i only, returning its color. Red frames and
+ * yellow ones with drop_on_yellow are to be discarded.
+ */
+enum psfp_meter_color psfp_meter_frame(struct psfp_meter_set *m,
+				       unsigned int i, u64 ts_ns, u32 len);
+
+#endif /* _PSFP_METER_H_ */
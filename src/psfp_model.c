@@ -0,0 +1,168 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <string.h>
+#include "psfp_model.h"
+
+int psfp_model_init(struct psfp_model *p, const struct mchp_psfp_sf_conf *sf,
+		    const struct mchp_psfp_sg_conf *sg,
+		    const struct mchp_psfp_gce *gcl,
+		    const struct mchp_psfp_fm_conf *fm)
+{
+	unsigned int i;
+	u64 end = 0;
+
+	memset(p, 0, sizeof(*p));
+	p->sf = *sf;
+	p->sg = *sg;
+	p->interval = UINT64_MAX;
+
+	if (p->sg.admin.gcl_length > PSFP_MODEL_GCL_MAX)
+		return -1;
+
+	for (i = 0; i < p->sg.admin.gcl_length; i++) {
+		p->gcl[i] = gcl[i];
+		end += gcl[i].time_interval;
+		p->gce_end[i] = end;
+	}
+
+	if (fm) {
+		p->metered = true;
+		return psfp_meter_set_init(&p->fm, fm, 1);
+	}
+
+	return 0;
+}
+
+void psfp_model_free(struct psfp_model *p)
+{
+	if (p->metered)
+		psfp_meter_set_free(&p->fm);
+	p->metered = false;
+}
+
+/* The gate control entry in effect at @ts_ns, NULL before base_time or
+ * without a list. The last entry lasts until the end of the cycle.
+ */
+static const struct mchp_psfp_gce *psfp_model_gce(struct psfp_model *p,
+						  u64 ts_ns, u64 *interval)
+{
+	const struct mchp_psfp_gcl_conf *gcl = &p->sg.admin;
+	unsigned int i;
+	u64 cycle, pos;
+
+	if (!gcl->gcl_length || !gcl->cycle_time ||
+	    (s64)ts_ns < gcl->base_time)
+		return NULL;
+
+	cycle = (ts_ns - gcl->base_time) / gcl->cycle_time;
+	pos = (ts_ns - gcl->base_time) % gcl->cycle_time;
+	for (i = 0; i < gcl->gcl_length - 1; i++)
+		if (pos < p->gce_end[i])
+			break;
+
+	*interval = cycle * gcl->gcl_length + i;
+
+	return &p->gcl[i];
+}
+
+static enum psfp_model_verdict psfp_model_gate(struct psfp_model *p,
+					       u64 ts_ns, u32 sdu, int *ipv)
+{
+	struct mchp_psfp_sg_conf *sg = &p->sg;
+	const struct mchp_psfp_gce *gce;
+	u64 interval = 0;
+
+	*ipv = -1;
+	if (!sg->enable)
+		return PSFP_MODEL_PASS;
+
+	if ((sg->close_invalid_rx_enable && sg->close_invalid_rx) ||
+	    (sg->close_octets_exceeded_enable && sg->close_octets_exceeded))
+		return PSFP_MODEL_GATE;
+
+	gce = psfp_model_gce(p, ts_ns, &interval);
+	if (!gce) {
+		/* The initial gate state until the list starts */
+		if (!sg->gate_open)
+			goto closed;
+		*ipv = sg->ipv_enable ? sg->ipv : -1;
+		return PSFP_MODEL_PASS;
+	}
+
+	if (!gce->gate_open)
+		goto closed;
+
+	if (gce->octet_max) {
+		if (interval != p->interval) {
+			p->interval = interval;
+			p->octets = 0;
+		}
+		if (p->octets + sdu > gce->octet_max) {
+			if (sg->close_octets_exceeded_enable)
+				sg->close_octets_exceeded = true;
+			return PSFP_MODEL_OCTETS;
+		}
+		p->octets += sdu;
+	}
+
+	*ipv = gce->ipv_enable ? gce->ipv : -1;
+	return PSFP_MODEL_PASS;
+
+closed:
+	if (sg->close_invalid_rx_enable)
+		sg->close_invalid_rx = true;
+	return PSFP_MODEL_GATE;
+}
+
+enum psfp_model_verdict psfp_model_rx(struct psfp_model *p, u64 ts_ns,
+				      u32 sdu, int *ipv)
+{
+	struct mchp_psfp_sf_counters *cnt = &p->cnt;
+	enum psfp_model_verdict v;
+
+	*ipv = -1;
+	if (!p->sf.enable)
+		return PSFP_MODEL_PASS;
+
+	cnt->matching_frames_count++;
+
+	/* Stream filter */
+	if (p->sf.block_oversize_enable && p->sf.block_oversize) {
+		cnt->not_passing_sdu_count++;
+		return PSFP_MODEL_SDU;
+	}
+	if (p->sf.max_sdu && sdu > p->sf.max_sdu) {
+		if (p->sf.block_oversize_enable)
+			p->sf.block_oversize = true;
+		cnt->not_passing_sdu_count++;
+		return PSFP_MODEL_SDU;
+	}
+	cnt->passing_sdu_count++;
+
+	/* Stream gate */
+	v = psfp_model_gate(p, ts_ns, sdu, ipv);
+	if (v != PSFP_MODEL_PASS) {
+		cnt->not_passing_frames_count++;
+		return v;
+	}
+	cnt->passing_frames_count++;
+
+	/* Flow meter */
+	if (!p->metered)
+		return PSFP_MODEL_PASS;
+
+	switch (psfp_meter_frame(&p->fm, 0, ts_ns, sdu)) {
+	case PSFP_METER_RED:
+		cnt->red_frames_count++;
+		return PSFP_MODEL_METER;
+	case PSFP_METER_YELLOW:
+		if (p->fm.drop_on_yellow[0])
+			return PSFP_MODEL_METER;
+		/* fall through */
+	default:
+		return PSFP_MODEL_PASS;
+	}
+}
@@ -0,0 +1,52 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _PSFP_MODEL_H_
+#define _PSFP_MODEL_H_
+
+#include "kernel_types.h"
+#include "mchp_ui_qos.h"
+#include "psfp_meter.h"
+
+#define PSFP_MODEL_GCL_MAX 64
+
+enum psfp_model_verdict {
+	PSFP_MODEL_PASS,
+	PSFP_MODEL_SDU,    /* Oversize, or the stream is blocked */
+	PSFP_MODEL_GATE,   /* Gate closed */
+	PSFP_MODEL_OCTETS, /* IntervalOctetMax exceeded */
+	PSFP_MODEL_METER,  /* Red, or yellow with drop_on_yellow */
+};
+
+/* Software model of the IEEE 802.1Qci chain of one stream, its stream
+ * filter, stream gate and flow meter, counting into the same counters as
+ * the hardware. The admin gate control list is taken to be operational.
+ */
+struct psfp_model {
+	struct mchp_psfp_sf_conf sf;
+	struct mchp_psfp_sg_conf sg;
+	struct mchp_psfp_gce gcl[PSFP_MODEL_GCL_MAX];
+	u64 gce_end[PSFP_MODEL_GCL_MAX]; /* Offset in the cycle, ns */
+	bool metered;
+	struct psfp_meter_set fm; /* One meter */
+	struct mchp_psfp_sf_counters cnt;
+	u64 interval; /* GCE intervals since base_time, for IntervalOctetMax */
+	u64 octets;   /* Octets passed in that interval */
+};
+
+/* @fm may be NULL for a stream without flow meter */
+int psfp_model_init(struct psfp_model *p, const struct mchp_psfp_sf_conf *sf,
+		    const struct mchp_psfp_sg_conf *sg,
+		    const struct mchp_psfp_gce *gcl,
+		    const struct mchp_psfp_fm_conf *fm);
+void psfp_model_free(struct psfp_model *p);
+
+/* Run a frame of @sdu octets arriving at @ts_ns through the chain. @ipv is
+ * set to the internal priority value of a passed frame, -1 if unchanged.
+ */
+enum psfp_model_verdict psfp_model_rx(struct psfp_model *p, u64 ts_ns,
+				      u32 sdu, int *ipv);
+
+#endif /* _PSFP_MODEL_H_ */
@@ -0,0 +1,615 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Offline PSFP.
+ *
+ * Replays captures in timestamp order through a software model of the
+ * IEEE 802.1Qci chain of every stream in a configuration file, see
+ * psfp_model.h, and reports the stream filter counters the hardware would
+ * show. Streams are identified by destination MAC and VLAN, as by null
+ * stream identification.
+ *
+ * As in frer-sim, every worker thread walks all captures, but only runs
+ * the chain of its share of the streams. The filter, gate and meter of a
+ * stream act on the verdict of the stage before, so they run back to back
+ * for each frame.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "pcap.h"
+#include "psfp_model.h"
+
+#define PSFP_REPLAY_THREADS 16
+#define PSFP_REPLAY_LINE    4096
+
+#define ETH_P_8021Q  0x8100
+#define ETH_P_8021AD 0x88a8
+
+#define PSFP_REPLAY_NO_VID 0xffff
+
+struct psfp_replay_stream {
+	u64 key; /* Destination MAC << 16 | VID */
+	struct psfp_model model;
+	u64 verdicts[PSFP_MODEL_METER + 1];
+};
+
+struct psfp_replay;
+
+struct psfp_replay_worker {
+	struct psfp_replay *r;
+	unsigned int id;
+	u64 frames;
+	u64 unmatched;
+};
+
+struct psfp_replay {
+	struct pcap_file files[PCAP_MERGE_MAX];
+	unsigned int nfiles;
+	s64 offset_ns; /* Added to capture timestamps */
+	struct psfp_replay_stream *streams;
+	unsigned int nstreams;
+	unsigned int *slots; /* Position + 1, 0 if empty */
+	unsigned int nslots;
+	unsigned int nworkers;
+	struct psfp_replay_worker *workers;
+};
+
+static struct option long_options[] =
+{
+	{"offset", required_argument, NULL, 'a'},
+	{"threads", required_argument, NULL, 'b'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+static void help(void)
+{
+	printf("Usage: psfp-replay [options] streams capture.pcap...\n");
+	printf("Replay up to %d captures through the PSFP streams of a file, one per line:\n",
+	       PCAP_MERGE_MAX);
+	printf("  <dmac> <vid|-> [key=value]...\n");
+	printf("stream filter keys:\n");
+	printf("  max_sdu=<octets>, block_oversize=<0|1>\n");
+	printf("stream gate keys, the gate is enabled by any of them:\n");
+	printf("  gate_open=<0|1>, ipv=<0-7|->, close_invalid_rx=<0|1>,\n");
+	printf("  close_octets_exceeded=<0|1>, base_time=<ns>, cycle_time=<ns>,\n");
+	printf("  gce=<open|closed>:<ns>[:<ipv|->[:<octet_max>]][,...]\n");
+	printf("flow meter keys, the stream is metered by any of them:\n");
+	printf("  cir=<kbit/s>, cbs=<octets>, eir=<kbit/s>, ebs=<octets>, cf=<0|1>,\n");
+	printf("  drop_on_yellow=<0|1>, mark_red_enable=<0|1>\n");
+	printf("options:\n");
+	printf(" --offset <ns>   Added to capture timestamps, e.g. UTC to TAI\n");
+	printf(" --threads <n>   Worker threads (default: one per CPU)\n");
+	printf(" --help          Show this help text\n");
+}
+
+static unsigned int psfp_replay_hash(u64 key)
+{
+	return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+static struct psfp_replay_stream *psfp_replay_lookup(const struct psfp_replay *r,
+						     u64 key)
+{
+	unsigned int i, pos;
+
+	for (i = psfp_replay_hash(key);; i++) {
+		pos = r->slots[i & (r->nslots - 1)];
+		if (!pos)
+			return NULL;
+		if (r->streams[pos - 1].key == key)
+			return &r->streams[pos - 1];
+	}
+}
+
+static u16 psfp_replay_be16(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+/* Destination MAC and outer VID of an Ethernet frame, -1 if too short */
+static int psfp_replay_parse(const struct pcap_pkt *pkt, u64 *key)
+{
+	const u8 *p = pkt->data;
+	u16 vid = PSFP_REPLAY_NO_VID, type;
+	int i;
+
+	if (pkt->caplen < 14)
+		return -1;
+
+	*key = 0;
+	for (i = 0; i < 6; i++)
+		*key = *key << 8 | p[i];
+
+	type = psfp_replay_be16(p + 12);
+	if ((type == ETH_P_8021Q || type == ETH_P_8021AD) && pkt->caplen >= 16)
+		vid = psfp_replay_be16(p + 14) & 0xfff;
+
+	*key = *key << 16 | vid;
+
+	return 0;
+}
+
+static int psfp_replay_bool(const char *val, bool *b)
+{
+	if (strcmp(val, "0") && strcmp(val, "1"))
+		return -1;
+	*b = *val == '1';
+
+	return 0;
+}
+
+static int psfp_replay_u32(const char *val, u32 *v)
+{
+	unsigned long l;
+	char *end;
+
+	errno = 0;
+	l = strtoul(val, &end, 0);
+	if (end == val || *end || errno || l > UINT32_MAX)
+		return -1;
+	*v = l;
+
+	return 0;
+}
+
+static int psfp_replay_ipv(const char *val, bool *enable, u8 *ipv)
+{
+	u32 v;
+
+	if (!strcmp(val, "-")) {
+		*enable = false;
+		return 0;
+	}
+	if (psfp_replay_u32(val, &v) < 0 || v > 7)
+		return -1;
+	*enable = true;
+	*ipv = v;
+
+	return 0;
+}
+
+/* gce=<open|closed>:<ns>[:<ipv|->[:<octet_max>]][,...] */
+static int psfp_replay_gcl(char *val, struct mchp_psfp_gce *gcl, u32 *len)
+{
+	char *entry, *field, *save, *fsave;
+	struct mchp_psfp_gce *gce;
+
+	for (*len = 0; (entry = strtok_r(val, ",", &save)); val = NULL) {
+		if (*len == PSFP_MODEL_GCL_MAX)
+			return -1;
+		gce = &gcl[(*len)++];
+		memset(gce, 0, sizeof(*gce));
+
+		field = strtok_r(entry, ":", &fsave);
+		if (!field || (strcmp(field, "open") && strcmp(field, "closed")))
+			return -1;
+		gce->gate_open = !strcmp(field, "open");
+
+		field = strtok_r(NULL, ":", &fsave);
+		if (!field || psfp_replay_u32(field, &gce->time_interval) < 0)
+			return -1;
+
+		field = strtok_r(NULL, ":", &fsave);
+		if (field && psfp_replay_ipv(field, &gce->ipv_enable,
+					     &gce->ipv) < 0)
+			return -1;
+
+		field = field ? strtok_r(NULL, ":", &fsave) : NULL;
+		if (field && psfp_replay_u32(field, &gce->octet_max) < 0)
+			return -1;
+
+		if (strtok_r(NULL, ":", &fsave))
+			return -1;
+	}
+
+	return *len ? 0 : -1;
+}
+
+/* Apply one key=value of a stream line */
+static int psfp_replay_param(char *tok, struct mchp_psfp_sf_conf *sf,
+			     struct mchp_psfp_sg_conf *sg,
+			     struct mchp_psfp_gce *gcl,
+			     struct mchp_psfp_fm_conf *fm)
+{
+	char *val = strchr(tok, '='), *end;
+	u32 v;
+
+	if (!val)
+		return -1;
+	*val++ = '\0';
+
+	if (!strcmp(tok, "max_sdu")) {
+		if (psfp_replay_u32(val, &v) < 0 || v > 0xffff)
+			return -1;
+		sf->max_sdu = v;
+		return 0;
+	}
+	if (!strcmp(tok, "block_oversize"))
+		return psfp_replay_bool(val, &sf->block_oversize_enable);
+
+	if (!strcmp(tok, "cir")) {
+		fm->enable = true;
+		return psfp_replay_u32(val, &fm->cir);
+	}
+	if (!strcmp(tok, "cbs")) {
+		fm->enable = true;
+		return psfp_replay_u32(val, &fm->cbs);
+	}
+	if (!strcmp(tok, "eir")) {
+		fm->enable = true;
+		return psfp_replay_u32(val, &fm->eir);
+	}
+	if (!strcmp(tok, "ebs")) {
+		fm->enable = true;
+		return psfp_replay_u32(val, &fm->ebs);
+	}
+	if (!strcmp(tok, "cf")) {
+		fm->enable = true;
+		return psfp_replay_bool(val, &fm->cf);
+	}
+	if (!strcmp(tok, "drop_on_yellow")) {
+		fm->enable = true;
+		return psfp_replay_bool(val, &fm->drop_on_yellow);
+	}
+	if (!strcmp(tok, "mark_red_enable")) {
+		fm->enable = true;
+		return psfp_replay_bool(val, &fm->mark_red_enable);
+	}
+
+	/* Anything else configures the gate */
+	sg->enable = true;
+	if (!strcmp(tok, "gate_open"))
+		return psfp_replay_bool(val, &sg->gate_open);
+	if (!strcmp(tok, "ipv"))
+		return psfp_replay_ipv(val, &sg->ipv_enable, &sg->ipv);
+	if (!strcmp(tok, "close_invalid_rx"))
+		return psfp_replay_bool(val, &sg->close_invalid_rx_enable);
+	if (!strcmp(tok, "close_octets_exceeded"))
+		return psfp_replay_bool(val, &sg->close_octets_exceeded_enable);
+	if (!strcmp(tok, "cycle_time"))
+		return psfp_replay_u32(val, &sg->admin.cycle_time);
+	if (!strcmp(tok, "base_time")) {
+		errno = 0;
+		sg->admin.base_time = strtoll(val, &end, 0);
+		return end == val || *end || errno ? -1 : 0;
+	}
+	if (!strcmp(tok, "gce"))
+		return psfp_replay_gcl(val, gcl, &sg->admin.gcl_length);
+
+	return -1;
+}
+
+/* Parse a stream line into @st, 0 for an empty line. On errors @bad is
+ * the offending part of the line, NULL when out of memory.
+ */
+static int psfp_replay_line(char *line, struct psfp_replay_stream *st,
+			    const char **bad)
+{
+	struct mchp_psfp_gce gcl[PSFP_MODEL_GCL_MAX];
+	struct mchp_psfp_sf_conf sf = { .enable = true };
+	struct mchp_psfp_sg_conf sg = { .gate_open = true };
+	struct mchp_psfp_fm_conf fm = {};
+	char *tok, *save;
+	unsigned int vid, i;
+	u8 mac[6];
+	u64 end;
+
+	*bad = line;
+	line[strcspn(line, "#\n")] = '\0';
+	tok = strtok_r(line, " \t", &save);
+	if (!tok)
+		return 0;
+
+	*bad = tok;
+	if (sscanf(tok, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5]) != 6)
+		return -1;
+
+	tok = strtok_r(NULL, " \t", &save);
+	*bad = tok ? tok : "";
+	if (!tok)
+		return -1;
+	if (!strcmp(tok, "-"))
+		vid = PSFP_REPLAY_NO_VID;
+	else if (sscanf(tok, "%u", &vid) != 1 || vid > 0xfff)
+		return -1;
+
+	st->key = 0;
+	for (i = 0; i < 6; i++)
+		st->key = st->key << 8 | mac[i];
+	st->key = st->key << 16 | vid;
+
+	while ((tok = strtok_r(NULL, " \t", &save))) {
+		*bad = tok;
+		if (psfp_replay_param(tok, &sf, &sg, gcl, &fm) < 0)
+			return -1;
+	}
+
+	/* A list without cycle time repeats as it is */
+	if (!sg.admin.cycle_time) {
+		for (i = 0, end = 0; i < sg.admin.gcl_length; i++)
+			end += gcl[i].time_interval;
+		if (end > UINT32_MAX)
+			return -1;
+		sg.admin.cycle_time = end;
+	}
+
+	*bad = NULL;
+	if (psfp_model_init(&st->model, &sf, &sg, gcl,
+			    fm.enable ? &fm : NULL) < 0)
+		return -1;
+
+	return 1;
+}
+
+static int psfp_replay_load(struct psfp_replay *r, const char *name)
+{
+	char line[PSFP_REPLAY_LINE], copy[PSFP_REPLAY_LINE];
+	struct psfp_replay_stream *streams, *st;
+	unsigned int size = 0, n = 0, i, j;
+	const char *bad;
+	FILE *f;
+	int rc;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		if (r->nstreams == size) {
+			size = size ? size * 2 : 64;
+			streams = realloc(r->streams, size * sizeof(*streams));
+			if (!streams) {
+				fprintf(stderr, "Out of memory!\n");
+				goto err;
+			}
+			r->streams = streams;
+		}
+
+		strcpy(copy, line);
+		st = &r->streams[r->nstreams];
+		memset(st, 0, sizeof(*st));
+		rc = psfp_replay_line(copy, st, &bad);
+		if (rc < 0) {
+			if (bad)
+				fprintf(stderr, "%s:%u: Invalid [%s]!\n", name,
+					n, bad);
+			else
+				fprintf(stderr, "Out of memory!\n");
+			goto err;
+		}
+		r->nstreams += rc;
+	}
+	fclose(f);
+
+	for (r->nslots = 16; r->nslots < 2 * r->nstreams; r->nslots *= 2)
+		;
+	r->slots = calloc(r->nslots, sizeof(*r->slots));
+	if (!r->slots) {
+		fprintf(stderr, "Out of memory!\n");
+		return -1;
+	}
+
+	for (i = 0; i < r->nstreams; i++) {
+		if (psfp_replay_lookup(r, r->streams[i].key)) {
+			fprintf(stderr, "%s: Stream %u is there twice!\n", name,
+				i + 1);
+			return -1;
+		}
+		for (j = psfp_replay_hash(r->streams[i].key);; j++) {
+			if (!r->slots[j & (r->nslots - 1)]) {
+				r->slots[j & (r->nslots - 1)] = i + 1;
+				break;
+			}
+		}
+	}
+
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
+}
+
+static void *psfp_replay_worker(void *data)
+{
+	struct psfp_replay_worker *w = data;
+	struct psfp_replay *r = w->r;
+	struct psfp_replay_stream *st;
+	enum psfp_model_verdict v;
+	struct pcap_merge m;
+	struct pcap_pkt *pkt;
+	int file, ipv;
+	u64 key;
+
+	pcap_merge_init(&m, r->files, r->nfiles);
+	while ((file = pcap_merge_peek(&m)) >= 0) {
+		pkt = &m.pkt[file];
+		st = NULL;
+		if (psfp_replay_parse(pkt, &key) == 0)
+			st = psfp_replay_lookup(r, key);
+		if (!st) {
+			if (w->id == 0)
+				w->unmatched++;
+		} else if ((st - r->streams) % r->nworkers == w->id) {
+			v = psfp_model_rx(&st->model, pkt->ts_ns + r->offset_ns,
+					  pkt->len, &ipv);
+			st->verdicts[v]++;
+			w->frames++;
+		}
+		pcap_merge_pop(&m, file, w->id == 0);
+	}
+
+	return NULL;
+}
+
+static void psfp_replay_run(struct psfp_replay *r, pthread_t *threads)
+{
+	unsigned int i, started;
+
+	for (i = 0; i < r->nworkers; i++) {
+		r->workers[i].r = r;
+		r->workers[i].id = i;
+	}
+
+	for (started = 0; started < r->nworkers; started++)
+		if (pthread_create(&threads[started], NULL, psfp_replay_worker,
+				   &r->workers[started]))
+			break;
+
+	for (i = started; i < r->nworkers; i++)
+		psfp_replay_worker(&r->workers[i]);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static void psfp_replay_report(const struct psfp_replay *r)
+{
+	const struct mchp_psfp_sf_counters *cnt;
+	const struct psfp_replay_stream *st;
+	const struct psfp_model *p;
+	unsigned int i;
+	u64 mac;
+
+	printf("%-17s %4s %12s %12s %12s %12s %12s %12s %12s  %s\n", "dmac",
+	       "vid", "Matching", "Passing", "NotPassing", "PassingSDU",
+	       "NotPassingSDU", "Red", "Forwarded", "State");
+
+	for (i = 0; i < r->nstreams; i++) {
+		st = &r->streams[i];
+		p = &st->model;
+		cnt = &p->cnt;
+		mac = st->key >> 16;
+		printf("%02x:%02x:%02x:%02x:%02x:%02x ",
+		       (u8)(mac >> 40), (u8)(mac >> 32), (u8)(mac >> 24),
+		       (u8)(mac >> 16), (u8)(mac >> 8), (u8)mac);
+		if ((st->key & 0xffff) == PSFP_REPLAY_NO_VID)
+			printf("%4s", "-");
+		else
+			printf("%4u", (u16)st->key);
+		printf(" %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+		       " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " ",
+		       cnt->matching_frames_count, cnt->passing_frames_count,
+		       cnt->not_passing_frames_count, cnt->passing_sdu_count,
+		       cnt->not_passing_sdu_count, cnt->red_frames_count,
+		       st->verdicts[PSFP_MODEL_PASS]);
+		if (p->sf.block_oversize)
+			printf(" blocked");
+		if (p->sg.close_invalid_rx)
+			printf(" closed_invalid_rx");
+		if (p->sg.close_octets_exceeded)
+			printf(" closed_octets_exceeded");
+		if (p->metered && p->fm.mark_red[0])
+			printf(" mark_red");
+		printf("\n");
+	}
+}
+
+static long psfp_replay_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	struct psfp_replay r = {};
+	u64 frames = 0, unmatched = 0;
+	pthread_t *threads;
+	long nthreads = 0;
+	size_t bytes = 0;
+	unsigned int i;
+	long start;
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			r.offset_ns = strtoll(optarg, NULL, 0);
+			break;
+		case 'b':
+			nthreads = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			help();
+			return 0;
+		}
+	}
+
+	if (argc - optind < 2 || argc - optind > PCAP_MERGE_MAX + 1) {
+		help();
+		return 1;
+	}
+
+	if (psfp_replay_load(&r, argv[optind++]) < 0)
+		return 1;
+
+	for (; optind < argc; optind++) {
+		if (pcap_open(&r.files[r.nfiles], argv[optind]) < 0)
+			return 1;
+		if (r.files[r.nfiles].linktype != PCAP_LINKTYPE_ETHERNET) {
+			fprintf(stderr, "%s: Not an Ethernet capture!\n",
+				argv[optind]);
+			return 1;
+		}
+		bytes += r.files[r.nfiles].size;
+		r.nfiles++;
+	}
+
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+	if (nthreads > PSFP_REPLAY_THREADS)
+		nthreads = PSFP_REPLAY_THREADS;
+	/* A worker without streams would only walk the captures */
+	if (nthreads > r.nstreams)
+		nthreads = r.nstreams ? r.nstreams : 1;
+	r.nworkers = nthreads;
+
+	r.workers = calloc(r.nworkers, sizeof(*r.workers));
+	threads = calloc(r.nworkers, sizeof(*threads));
+	if (!r.workers || !threads) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	start = psfp_replay_now_ms();
+	psfp_replay_run(&r, threads);
+
+	for (i = 0; i < r.nworkers; i++) {
+		frames += r.workers[i].frames;
+		unmatched += r.workers[i].unmatched;
+	}
+
+	psfp_replay_report(&r);
+	printf("%u streams, %" PRIu64 " frames, %" PRIu64 " unmatched, %zu MB in %ld ms, %u threads\n",
+	       r.nstreams, frames, unmatched, bytes >> 20,
+	       psfp_replay_now_ms() - start, r.nworkers);
+
+	for (i = 0; i < r.nstreams; i++)
+		psfp_model_free(&r.streams[i].model);
+	for (i = 0; i < r.nfiles; i++)
+		pcap_close(&r.files[i]);
+
+	return 0;
+}
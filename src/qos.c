@@ -4,11 +4,16 @@
  */
 
 #include "common.h"
+#include "pool.h"
 #include <getopt.h>
 #include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 #include <net/if.h>
+#include <sys/stat.h>
 #include "kernel_types.h"
 #include "mchp_ui_qos.h"
+#include "qos_model.h"
 
 struct command
 {
@@ -29,6 +34,11 @@ static struct nla_policy mchp_qos_genl_policy[MCHP_QOS_ATTR_END] = {
 	[MCHP_QOS_ATTR_DSCP_PRIO_DPL] = { .type = NLA_BINARY },
 };
 
+static struct mchp_genl_session qos_session =
+	MCHP_GENL_SESSION_INIT(MCHP_QOS_NETLINK, 1);
+static struct mchp_genl_pool qos_pool =
+	MCHP_GENL_POOL_INIT(MCHP_QOS_NETLINK, 1);
+
 static char *i_tag_map_help(void)
 {
 	return " --prio:   Ingress map of TAG PCP,DEI to (SKB)Priority.\n"
@@ -86,43 +96,33 @@ static char *e_mode_help(void)
 	       "  --help:       Show this help text\n";
 }
 
-static int mchp_qos_genl_port_cfg_set(u32 ifindex,
-					 const struct mchp_qos_port_conf *cfg)
+/* Queue a port configuration set. The pool flushes it, reporting the
+ * result in @err.
+ */
+static int mchp_qos_genl_port_cfg_set(struct mchp_genl_session *s, u32 ifindex,
+				      const struct mchp_qos_port_conf *cfg,
+				      int *err)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
-	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_QOS_NETLINK,
-			MCHP_QOS_GENL_PORT_CFG_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_QOS_GENL_PORT_CFG_SET, NULL, NULL, err);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_QOS_ATTR_DEV, ifindex);
 	NLA_PUT(msg, MCHP_QOS_ATTR_PORT_CFG, sizeof(*cfg), cfg);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
+	return 0;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_qos_genl_port_cfg_get_cb(struct nl_msg *msg, void *arg)
+static int mchp_qos_genl_port_cfg_get_cb(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct nlattr *attrs[MCHP_QOS_ATTR_END];
 	struct mchp_qos_port_conf *cfg = arg;
 
@@ -143,84 +143,58 @@ static int mchp_qos_genl_port_cfg_get_cb(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_qos_genl_port_cfg_get(u32 ifindex,
-					 struct mchp_qos_port_conf *cfg)
+/* Queue a port configuration get, see mchp_qos_genl_port_cfg_set() */
+static int mchp_qos_genl_port_cfg_get(struct mchp_genl_session *s, u32 ifindex,
+				      struct mchp_qos_port_conf *cfg, int *err)
 {
 	RETURN_IF_PC;
-	struct mchp_qos_port_conf tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
-	int rc = 0;
-
-	rc = mchp_genl_start(MCHP_QOS_NETLINK,
-				MCHP_QOS_GENL_PORT_CFG_GET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_qos_genl_port_cfg_get_cb, &tmp);
+	msg = mchp_genl_req(s, MCHP_QOS_GENL_PORT_CFG_GET,
+			    mchp_qos_genl_port_cfg_get_cb, cfg, err);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_QOS_ATTR_DEV, ifindex);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
-	}
-
-	memcpy(cfg, &tmp, sizeof(tmp));
+	return 0;
 
 nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
-	return rc;
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_qos_genl_dscp_prio_dpl_set(u32 dscp,
-					      const struct mchp_qos_dscp_prio_dpl *cfg)
+static int mchp_qos_genl_dscp_prio_dpl_set(struct mchp_genl_session *s,
+					   u32 dscp,
+					   const struct mchp_qos_dscp_prio_dpl *cfg)
 {
 	RETURN_IF_PC;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_QOS_NETLINK,
-				MCHP_QOS_GENL_DSCP_PRIO_DPL_SET, 1, &sk, &msg);
-	if (rc < 0)
-		return rc;
+	msg = mchp_genl_req(s, MCHP_QOS_GENL_DSCP_PRIO_DPL_SET, NULL, NULL,
+			    NULL);
+	if (!msg)
+		return -1;
 
 	NLA_PUT_U32(msg, MCHP_QOS_ATTR_DSCP, dscp);
 	NLA_PUT(msg, MCHP_QOS_ATTR_DSCP_PRIO_DPL, sizeof(*cfg), cfg);
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
-	}
-
-	rc = nl_recvmsgs_default(sk);
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
 		       nl_geterror(rc));
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
-
 	return rc;
+
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
 }
 
-static int mchp_qos_genl_dscp_prio_dpl_get_cb(struct nl_msg *msg, void *arg)
+static int mchp_qos_genl_dscp_prio_dpl_get_cb(struct nlmsghdr *nlh, void *arg)
 {
-	struct genlmsghdr *hdr = nlmsg_data(nlmsg_hdr(msg));
+	struct genlmsghdr *hdr = nlmsg_data(nlh);
 	struct nlattr *attrs[MCHP_QOS_ATTR_END];
 	struct mchp_qos_dscp_prio_dpl *cfg = arg;
 
@@ -241,48 +215,179 @@ static int mchp_qos_genl_dscp_prio_dpl_get_cb(struct nl_msg *msg, void *arg)
 	return NL_OK;
 }
 
-static int mchp_qos_genl_dscp_prio_dpl_get(u32 dscp,
-					      struct mchp_qos_dscp_prio_dpl *cfg)
+static int mchp_qos_genl_dscp_prio_dpl_get(struct mchp_genl_session *s,
+					   u32 dscp,
+					   struct mchp_qos_dscp_prio_dpl *cfg)
 {
 	RETURN_IF_PC;
-	struct mchp_qos_dscp_prio_dpl tmp;
-	struct nl_sock *sk;
 	struct nl_msg *msg;
 	int rc = 0;
 
-	rc = mchp_genl_start(MCHP_QOS_NETLINK,
-				MCHP_QOS_GENL_DSCP_PRIO_DPL_GET, 1, &sk, &msg);
+	msg = mchp_genl_req(s, MCHP_QOS_GENL_DSCP_PRIO_DPL_GET,
+			    mchp_qos_genl_dscp_prio_dpl_get_cb, cfg, NULL);
+	if (!msg)
+		return -1;
+
+	NLA_PUT_U32(msg, MCHP_QOS_ATTR_DSCP, dscp);
+
+	rc = mchp_genl_flush(s);
 	if (rc < 0)
-		return rc;
+		printf("mchp_genl_flush() failed, rc: %d (%s)\n", rc,
+		       nl_geterror(rc));
 
-	nl_socket_modify_cb(sk, NL_CB_VALID, NL_CB_CUSTOM,
-			    mchp_qos_genl_dscp_prio_dpl_get_cb, &tmp);
+	return rc;
 
-	NLA_PUT_U32(msg, MCHP_QOS_ATTR_DSCP, dscp);
+nla_put_failure:
+	mchp_genl_req_abort(s);
+	return -NLE_MSGSIZE;
+}
+
+/* A port named in the dev list of a port command */
+struct qos_port {
+	char name[IF_NAMESIZE];
+	u32 ifindex;
+	struct mchp_qos_port_conf cfg;
+	struct mchp_qos_port_conf tmp;
+	bool valid;
+	bool set;
+	int rc;
+};
+
+/* Applies the options of a port command to the configuration of a port.
+ * Returns 1 on an invalid option value.
+ */
+typedef int (*qos_port_opts_t)(int argc, char *const *argv,
+			       struct mchp_qos_port_conf *cfg, int *do_help);
+typedef void (*qos_port_show_t)(const struct mchp_qos_port_conf *cfg);
+
+static void qos_port_get_work(struct mchp_genl_session *s, unsigned int idx,
+			      void *arg)
+{
+	struct qos_port *port = (struct qos_port *)arg + idx;
+	int rc;
+
+	rc = mchp_qos_genl_port_cfg_get(s, port->ifindex, &port->cfg,
+					&port->rc);
+	if (rc < 0)
+		port->rc = rc;
+}
+
+static void qos_port_set_work(struct mchp_genl_session *s, unsigned int idx,
+			      void *arg)
+{
+	struct qos_port *port = (struct qos_port *)arg + idx;
+	int rc;
+
+	if (!port->set)
+		return;
+
+	rc = mchp_qos_genl_port_cfg_set(s, port->ifindex, &port->cfg,
+					&port->rc);
+	if (rc < 0)
+		port->rc = rc;
+}
 
-	rc = nl_send_auto(sk, msg);
-	if (rc < 0) {
-		printf("nl_send_auto() failed, rc: %d\n", rc);
-		goto nla_put_failure;
+/* Read the configuration of ports, all requests pipelined by the pool.
+ * Returns -1 if a port does not exist, ports failing to read are left
+ * invalid.
+ */
+static int qos_ports_read(char (*names)[IF_NAMESIZE], int cnt,
+			  struct qos_port *ports)
+{
+	struct qos_port *port;
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		memset(port, 0, sizeof(*port));
+		strcpy(port->name, names[i]);
+		port->ifindex = if_nametoindex(port->name);
+		if (port->ifindex == 0) {
+			fprintf(stderr, "%s: %s!\n", port->name, strerror(errno));
+			return -1;
+		}
 	}
 
-	rc = nl_recvmsgs_default(sk);
-	if (rc < 0) {
-		printf("nl_recvmsgs_default() failed, rc: %d (%s)\n", rc,
-		       nl_geterror(rc));
-		goto nla_put_failure;
+	mchp_genl_pool_run(&qos_pool, cnt, qos_port_get_work, ports);
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (port->rc < 0)
+			printf("%s: mchp_genl_flush() failed, rc: %d (%s)\n",
+			       port->name, port->rc, nl_geterror(port->rc));
+		else
+			port->valid = true;
 	}
 
-	memcpy(cfg, &tmp, sizeof(tmp));
+	return 0;
+}
 
-nla_put_failure:
-	nlmsg_free(msg);
-	nl_socket_free(sk);
+/* Run a port command on every port of the dev list in argv[0], e.g.
+ * "swp1,swp2,swp[3-24]". The configurations are read and written by the
+ * worker pool, while options are applied and results printed here, in the
+ * order the ports were listed.
+ */
+static int qos_port_cmd(const struct command *cmd, int argc, char *const *argv,
+			qos_port_opts_t opts, qos_port_show_t show)
+{
+	static struct qos_port ports[MCHP_DEV_LIST_MAX];
+	char names[MCHP_DEV_LIST_MAX][IF_NAMESIZE];
+	struct qos_port *port;
+	int do_help = 0;
+	int cnt, i, rc = 0;
+
+	/* read device list and skip it */
+	cnt = mchp_dev_list_parse(argv[0], names, MCHP_DEV_LIST_MAX);
+	if (cnt < 0 || qos_ports_read(names, cnt, ports) < 0)
+		return 1;
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (!port->valid) {
+			if (!rc)
+				rc = port->rc;
+			continue;
+		}
+
+		memcpy(&port->tmp, &port->cfg, sizeof(port->cfg));
+
+		/* Rescan the options for every port */
+		optind = 0;
+		if (opts(argc, argv, &port->cfg, &do_help))
+			return 1;
+
+		if (do_help) {
+			command_help(cmd);
+			return 0;
+		}
+
+		port->set = memcmp(&port->tmp, &port->cfg, sizeof(port->cfg)) != 0;
+	}
+
+	mchp_genl_pool_run(&qos_pool, cnt, qos_port_set_work, ports);
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (!port->valid)
+			continue;
+
+		if (!port->set) {
+			if (cnt > 1)
+				printf("%s: ", port->name);
+			show(&port->cfg);
+		} else if (port->rc < 0) {
+			printf("%s: mchp_genl_flush() failed, rc: %d (%s)\n",
+			       port->name, port->rc, nl_geterror(port->rc));
+			if (!rc)
+				rc = port->rc;
+		}
+	}
 
 	return rc;
 }
 
-static int cmd_i_tag_map(const struct command *cmd, int argc, char *const *argv)
+static int i_tag_map_opts(int argc, char *const *argv,
+			  struct mchp_qos_port_conf *cfg, int *do_help)
 {
 	static struct option long_options[] =
 	{
@@ -291,24 +396,8 @@ static int cmd_i_tag_map(const struct command *cmd, int argc, char *const *argv)
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
-	int do_help = 0;
-	u32 ifindex = 0;
 	int ch, len, i;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
-	}
-
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
-		return 0;
-
-	memcpy(&tmp, &cfg, sizeof(cfg));
-
 	while ((ch = getopt_long(argc, argv, "a:b:c:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
@@ -319,11 +408,11 @@ static int cmd_i_tag_map(const struct command *cmd, int argc, char *const *argv)
 				return 1;
 			}
 			for (i = 0; i < PCP_COUNT; ++i) {
-				cfg.i_pcp_dei_prio_dpl_map[i][0].prio = (u8)optarg[i] - 48;
+				cfg->i_pcp_dei_prio_dpl_map[i][0].prio = (u8)optarg[i] - 48;
 			}
 			if (len == 16) {
 				for (i = 0; i < PCP_COUNT; ++i) {
-					cfg.i_pcp_dei_prio_dpl_map[i][1].prio = optarg[i + 8] - 48;
+					cfg->i_pcp_dei_prio_dpl_map[i][1].prio = optarg[i + 8] - 48;
 				}
 			}
 			break;
@@ -335,46 +424,48 @@ static int cmd_i_tag_map(const struct command *cmd, int argc, char *const *argv)
 				return 1;
 			}
 			for (i = 0; i < PCP_COUNT; ++i) {
-				cfg.i_pcp_dei_prio_dpl_map[i][0].dpl = (u8)optarg[i] - 48;
+				cfg->i_pcp_dei_prio_dpl_map[i][0].dpl = (u8)optarg[i] - 48;
 			}
 			if (len == 16) {
 				for (i = 0; i < PCP_COUNT; ++i) {
-					cfg.i_pcp_dei_prio_dpl_map[i][1].dpl = optarg[i + 8] - 48;
+					cfg->i_pcp_dei_prio_dpl_map[i][1].dpl = optarg[i + 8] - 48;
 				}
 			}
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
+			*do_help = 1;
 			break;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+	return 0;
+}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("i_tag_map --prio ");
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.i_pcp_dei_prio_dpl_map[i][0].prio);
-		}
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.i_pcp_dei_prio_dpl_map[i][1].prio);
-		}
-		printf(" --dpl ");
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.i_pcp_dei_prio_dpl_map[i][0].dpl);
-		}
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.i_pcp_dei_prio_dpl_map[i][1].dpl);
-		}
-		printf("\n");
-		return 0;
+static void i_tag_map_show(const struct mchp_qos_port_conf *cfg)
+{
+	int i;
+
+	printf("i_tag_map --prio ");
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->i_pcp_dei_prio_dpl_map[i][0].prio);
+	}
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->i_pcp_dei_prio_dpl_map[i][1].prio);
+	}
+	printf(" --dpl ");
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->i_pcp_dei_prio_dpl_map[i][0].dpl);
 	}
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->i_pcp_dei_prio_dpl_map[i][1].dpl);
+	}
+	printf("\n");
+}
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+static int cmd_i_tag_map(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, i_tag_map_opts, i_tag_map_show);
 }
 
 static int cmd_i_dscp_map(const struct command *cmd, int argc, char *const *argv)
@@ -396,7 +487,7 @@ static int cmd_i_dscp_map(const struct command *cmd, int argc, char *const *argv
 	/* read the DSCP value to map */
 	dscp = atoi(argv[0]);
 
-	if (mchp_qos_genl_dscp_prio_dpl_get(dscp, &cfg) < 0)
+	if (mchp_qos_genl_dscp_prio_dpl_get(&qos_session, dscp, &cfg) < 0)
 		return 0;
 
 	memcpy(&tmp, &cfg, sizeof(cfg));
@@ -425,14 +516,15 @@ static int cmd_i_dscp_map(const struct command *cmd, int argc, char *const *argv
 	}
 
 	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("i_dscp_map --enable %u --prio %u --dpl %u\n", (cfg.trust) ? 1 : 0, cfg.prio, cfg.dpl);
+		printf("i_dscp_map %u --enable %u --prio %u --dpl %u\n", dscp, (cfg.trust) ? 1 : 0, cfg.prio, cfg.dpl);
 		return 0;
 	}
 
-	return mchp_qos_genl_dscp_prio_dpl_set(dscp, &cfg);
+	return mchp_qos_genl_dscp_prio_dpl_set(&qos_session, dscp, &cfg);
 }
 
-static int cmd_i_def(const struct command *cmd, int argc, char *const *argv)
+static int i_def_opts(int argc, char *const *argv,
+		      struct mchp_qos_port_conf *cfg, int *do_help)
 {
 	static struct option long_options[] =
 	{
@@ -443,60 +535,45 @@ static int cmd_i_def(const struct command *cmd, int argc, char *const *argv)
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
-	int do_help = 0;
-	u32 ifindex = 0;
 	int ch;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
-	}
-
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
-		return 0;
-
-	memcpy(&tmp, &cfg, sizeof(cfg));
-
 	while ((ch = getopt_long(argc, argv, "a:b:c:d:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.i_default_prio = atoi(optarg);
+			cfg->i_default_prio = atoi(optarg);
 			break;
 		case 'b':
-			cfg.i_default_pcp = atoi(optarg);
+			cfg->i_default_pcp = atoi(optarg);
 			break;
 		case 'c':
-			cfg.i_default_dei = atoi(optarg);
+			cfg->i_default_dei = atoi(optarg);
 			break;
 		case 'd':
-			cfg.i_default_dpl = atoi(optarg);
+			cfg->i_default_dpl = atoi(optarg);
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
+			*do_help = 1;
 			break;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+	return 0;
+}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("i_def --prio %u --pcp %u --dei %u --dpl %u\n",
-		       cfg.i_default_prio, cfg.i_default_pcp, cfg.i_default_dei, cfg.i_default_dpl);
-		return 0;
-	}
+static void i_def_show(const struct mchp_qos_port_conf *cfg)
+{
+	printf("i_def --prio %u --pcp %u --dei %u --dpl %u\n",
+	       cfg->i_default_prio, cfg->i_default_pcp, cfg->i_default_dei, cfg->i_default_dpl);
+}
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+static int cmd_i_def(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, i_def_opts, i_def_show);
 }
 
-static int cmd_i_mode(const struct command *cmd, int argc, char *const *argv)
+static int i_mode_opts(int argc, char *const *argv,
+		       struct mchp_qos_port_conf *cfg, int *do_help)
 {
 	static struct option long_options[] =
 	{
@@ -505,54 +582,39 @@ static int cmd_i_mode(const struct command *cmd, int argc, char *const *argv)
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
-	int do_help = 0;
-	u32 ifindex = 0;
 	int ch;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
-	}
-
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
-		return 0;
-
-	memcpy(&tmp, &cfg, sizeof(cfg));
-
 	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.i_mode.tag_map_enable = !!atoi(optarg);
+			cfg->i_mode.tag_map_enable = !!atoi(optarg);
 			break;
 		case 'b':
-			cfg.i_mode.dscp_map_enable = !!atoi(optarg);
+			cfg->i_mode.dscp_map_enable = !!atoi(optarg);
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
+			*do_help = 1;
 			break;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+	return 0;
+}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("i_mode --tag %u --dscp %u\n",
-		       cfg.i_mode.tag_map_enable, cfg.i_mode.dscp_map_enable);
-		return 0;
-	}
+static void i_mode_show(const struct mchp_qos_port_conf *cfg)
+{
+	printf("i_mode --tag %u --dscp %u\n",
+	       cfg->i_mode.tag_map_enable, cfg->i_mode.dscp_map_enable);
+}
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+static int cmd_i_mode(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, i_mode_opts, i_mode_show);
 }
 
-static int cmd_e_tag_map(const struct command *cmd, int argc, char *const *argv)
+static int e_tag_map_opts(int argc, char *const *argv,
+			  struct mchp_qos_port_conf *cfg, int *do_help)
 {
 	static struct option long_options[] =
 	{
@@ -561,24 +623,8 @@ static int cmd_e_tag_map(const struct command *cmd, int argc, char *const *argv)
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
-	int do_help = 0;
-	u32 ifindex = 0;
 	int ch, len, i;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
-	}
-
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
-		return 0;
-
-	memcpy(&tmp, &cfg, sizeof(cfg));
-
 	while ((ch = getopt_long(argc, argv, "a:b:c:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
@@ -589,11 +635,11 @@ static int cmd_e_tag_map(const struct command *cmd, int argc, char *const *argv)
 				return 1;
 			}
 			for (i = 0; i < PRIO_COUNT; ++i) {
-				cfg.e_prio_dpl_pcp_dei_map[i][0].pcp = (u8)optarg[i] - 48;
+				cfg->e_prio_dpl_pcp_dei_map[i][0].pcp = (u8)optarg[i] - 48;
 			}
 			if (len == 16) {
 				for (i = 0; i < PRIO_COUNT; ++i) {
-					cfg.e_prio_dpl_pcp_dei_map[i][1].pcp = optarg[i + 8] - 48;
+					cfg->e_prio_dpl_pcp_dei_map[i][1].pcp = optarg[i + 8] - 48;
 				}
 			}
 			break;
@@ -605,49 +651,52 @@ static int cmd_e_tag_map(const struct command *cmd, int argc, char *const *argv)
 				return 1;
 			}
 			for (i = 0; i < PRIO_COUNT; ++i) {
-				cfg.e_prio_dpl_pcp_dei_map[i][0].dei = (u8)optarg[i] - 48;
+				cfg->e_prio_dpl_pcp_dei_map[i][0].dei = (u8)optarg[i] - 48;
 			}
 			if (len == 16) {
 				for (i = 0; i < PRIO_COUNT; ++i) {
-					cfg.e_prio_dpl_pcp_dei_map[i][1].dei = optarg[i + 8] - 48;
+					cfg->e_prio_dpl_pcp_dei_map[i][1].dei = optarg[i + 8] - 48;
 				}
 			}
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
+			*do_help = 1;
 			break;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
-	}
+	return 0;
+}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("e_tag_map --pcp ");
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.e_prio_dpl_pcp_dei_map[i][0].pcp);
-		}
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.e_prio_dpl_pcp_dei_map[i][1].pcp);
-		}
-		printf(" --dei ");
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.e_prio_dpl_pcp_dei_map[i][0].dei);
-		}
-		for (i = 0; i < PCP_COUNT; ++i) {
-			printf("%d", cfg.e_prio_dpl_pcp_dei_map[i][1].dei);
-		}
-		printf("\n");
-		return 0;
+static void e_tag_map_show(const struct mchp_qos_port_conf *cfg)
+{
+	int i;
+
+	printf("e_tag_map --pcp ");
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->e_prio_dpl_pcp_dei_map[i][0].pcp);
+	}
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->e_prio_dpl_pcp_dei_map[i][1].pcp);
 	}
+	printf(" --dei ");
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->e_prio_dpl_pcp_dei_map[i][0].dei);
+	}
+	for (i = 0; i < PCP_COUNT; ++i) {
+		printf("%d", cfg->e_prio_dpl_pcp_dei_map[i][1].dei);
+	}
+	printf("\n");
+}
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+static int cmd_e_tag_map(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, e_tag_map_opts, e_tag_map_show);
 }
 
-static int cmd_e_def(const struct command *cmd, int argc, char *const *argv)
+static int e_def_opts(int argc, char *const *argv,
+		      struct mchp_qos_port_conf *cfg, int *do_help)
 {
 	static struct option long_options[] =
 	{
@@ -656,91 +705,590 @@ static int cmd_e_def(const struct command *cmd, int argc, char *const *argv)
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
-	int do_help = 0;
-	u32 ifindex = 0;
 	int ch;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
-		return 1;
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:h", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			cfg->e_default_pcp = atoi(optarg);
+			break;
+		case 'b':
+			cfg->e_default_dei = atoi(optarg);
+			break;
+		case 'h':
+		case '?':
+			*do_help = 1;
+			break;
+		}
 	}
 
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
-		return 0;
+	return 0;
+}
 
-	memcpy(&tmp, &cfg, sizeof(cfg));
+static void e_def_show(const struct mchp_qos_port_conf *cfg)
+{
+	printf("e_def --pcp %u --dei %u\n",
+	       cfg->e_default_pcp, cfg->e_default_dei);
+}
 
-	while ((ch = getopt_long(argc, argv, "a:b:c:d:h", long_options, NULL)) != -1) {
+static int cmd_e_def(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, e_def_opts, e_def_show);
+}
+
+static int e_mode_opts(int argc, char *const *argv,
+		       struct mchp_qos_port_conf *cfg, int *do_help)
+{
+	static struct option long_options[] =
+	{
+		{"default", required_argument, NULL, 'a'},
+		{"classified", required_argument, NULL, 'b'},
+		{"mapped", required_argument, NULL, 'c'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.e_default_pcp = atoi(optarg);
+			cfg->e_mode = MCHP_E_MODE_DEFAULT;
 			break;
 		case 'b':
-			cfg.e_default_dei = atoi(optarg);
+			cfg->e_mode = MCHP_E_MODE_CLASSIFIED;
+			break;
+		case 'c':
+			cfg->e_mode = MCHP_E_MODE_MAPPED;
 			break;
 		case 'h':
 		case '?':
-			do_help = 1;
+			*do_help = 1;
 			break;
 		}
 	}
 
-	if (do_help) {
-		command_help(cmd);
-		return 0;
+	return 0;
+}
+
+static void e_mode_show(const struct mchp_qos_port_conf *cfg)
+{
+	printf("e_mode --default %u --classified %u --mapped %u\n",
+	       (cfg->e_mode == MCHP_E_MODE_DEFAULT) ? 1 : 0,
+	       (cfg->e_mode == MCHP_E_MODE_CLASSIFIED) ? 1 : 0,
+	       (cfg->e_mode == MCHP_E_MODE_MAPPED) ? 1 : 0);
+}
+
+static int cmd_e_mode(const struct command *cmd, int argc, char *const *argv)
+{
+	return qos_port_cmd(cmd, argc, argv, e_mode_opts, e_mode_show);
+}
+
+/* profile */
+#define QOS_PROFILE_DIR      "/etc/mchp_qos"
+#define QOS_PROFILE_FILE     QOS_PROFILE_DIR "/profiles"
+#define QOS_PROFILE_NAME_MAX 32
+
+/* A named configuration of whole ports. The profiles file has the lines
+ * shown by the port commands, each profile after a "profile <name>" line
+ * and starting out of reset.
+ */
+struct qos_profile {
+	char name[QOS_PROFILE_NAME_MAX];
+	struct mchp_qos_port_conf cfg;
+};
+
+struct qos_profiles {
+	const char *file;
+	struct qos_profile *entries;
+	unsigned int cnt;
+};
+
+static char *profile_help(void)
+{
+	return " --file:   Profiles file (default " QOS_PROFILE_FILE ")\n"
+	       "  --help:   Show this help text\n"
+	       "  apply:    Write a profile to the ports not already matching it\n"
+	       "  save:     Save the configuration of a port as a profile\n"
+	       "  del:      Delete a profile\n"
+	       "  show:     Show a profile, or all, as in the profiles file\n";
+}
+
+static struct qos_profile *qos_profile_find(const struct qos_profiles *p,
+					    const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < p->cnt; i++)
+		if (!strcmp(p->entries[i].name, name))
+			return &p->entries[i];
+
+	return NULL;
+}
+
+static struct qos_profile *qos_profile_add(struct qos_profiles *p,
+					   const char *name)
+{
+	struct qos_profile *entries, *e;
+
+	if (strlen(name) >= QOS_PROFILE_NAME_MAX || qos_profile_find(p, name))
+		return NULL;
+
+	entries = realloc(p->entries, (p->cnt + 1) * sizeof(*entries));
+	if (!entries)
+		return NULL;
+	p->entries = entries;
+
+	e = &p->entries[p->cnt++];
+	strcpy(e->name, name);
+	qos_model_port_init(&e->cfg);
+
+	return e;
+}
+
+/* A missing file has no profiles */
+static int qos_profile_load(struct qos_profiles *p)
+{
+	char line[QOS_MODEL_LINE], copy[QOS_MODEL_LINE], *tok, *save;
+	struct mchp_qos_port_conf none;
+	struct qos_profile *e = NULL;
+	unsigned int n = 0;
+	const char *bad;
+	FILE *f;
+	int rc;
+
+	f = fopen(p->file, "re");
+	if (!f) {
+		if (errno == ENOENT)
+			return 0;
+		fprintf(stderr, "%s: %s!\n", p->file, strerror(errno));
+		return -1;
 	}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("e_def --pcp %u --dei %u\n",
-		       cfg.e_default_pcp, cfg.e_default_dei);
-		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		strcpy(copy, line);
+		copy[strcspn(copy, "#\n")] = '\0';
+		tok = strtok_r(copy, " \t", &save);
+		if (tok && !strcmp(tok, "profile")) {
+			tok = strtok_r(NULL, " \t", &save);
+			e = tok ? qos_profile_add(p, tok) : NULL;
+			if (!e || strtok_r(NULL, " \t", &save)) {
+				fprintf(stderr, "%s:%u: Invalid profile [%s]!\n",
+					p->file, n, tok ? tok : "");
+				goto err;
+			}
+			continue;
+		}
+
+		strcpy(copy, line);
+		rc = qos_model_parse(e ? &e->cfg : &none, NULL, copy, &bad);
+		if (rc < 0 || (rc && !e)) {
+			fprintf(stderr, "%s:%u: Invalid [%s]!\n", p->file, n,
+				e ? bad : line);
+			goto err;
+		}
 	}
+	fclose(f);
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
 }
 
-static int cmd_e_mode(const struct command *cmd, int argc, char *const *argv)
+static void qos_profile_print(FILE *f, const struct qos_profile *e)
+{
+	fprintf(f, "profile %s # hash %016" PRIx64 "\n", e->name,
+		qos_model_hash(&e->cfg));
+	qos_model_print(f, &e->cfg);
+}
+
+/* Rewrite the file, readers see either the old or the new one */
+static int qos_profile_save(const struct qos_profiles *p)
+{
+	char tmp[PATH_MAX];
+	unsigned int i;
+	FILE *f;
+
+	if (!strcmp(p->file, QOS_PROFILE_FILE) &&
+	    mkdir(QOS_PROFILE_DIR, 0755) < 0 && errno != EEXIST)
+		goto err;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", p->file);
+	f = fopen(tmp, "we");
+	if (!f)
+		goto err;
+
+	for (i = 0; i < p->cnt; i++) {
+		if (i)
+			fprintf(f, "\n");
+		qos_profile_print(f, &p->entries[i]);
+	}
+
+	if (fflush(f) || fsync(fileno(f))) {
+		fclose(f);
+		goto err;
+	}
+	if (fclose(f) || rename(tmp, p->file) < 0)
+		goto err;
+
+	return 0;
+
+err:
+	fprintf(stderr, "%s: %s!\n", p->file, strerror(errno));
+	unlink(tmp);
+	return -1;
+}
+
+/* Ports already configured as the profile, by hash, are not written */
+static int qos_profile_apply(const struct qos_profile *e, const char *list)
+{
+	static struct qos_port ports[MCHP_DEV_LIST_MAX];
+	char names[MCHP_DEV_LIST_MAX][IF_NAMESIZE];
+	unsigned int same = 0, written = 0, failed = 0;
+	struct qos_port *port;
+	u64 hash;
+	int cnt, i;
+
+	cnt = mchp_dev_list_parse(list, names, MCHP_DEV_LIST_MAX);
+	if (cnt < 0 || qos_ports_read(names, cnt, ports) < 0)
+		return 1;
+
+	hash = qos_model_hash(&e->cfg);
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (!port->valid) {
+			failed++;
+			continue;
+		}
+		if (qos_model_hash(&port->cfg) == hash) {
+			same++;
+			continue;
+		}
+		port->cfg = e->cfg;
+		port->set = true;
+	}
+
+	mchp_genl_pool_run(&qos_pool, cnt, qos_port_set_work, ports);
+
+	for (i = 0; i < cnt; i++) {
+		port = &ports[i];
+		if (!port->set)
+			continue;
+		if (port->rc < 0) {
+			printf("%s: mchp_genl_flush() failed, rc: %d (%s)\n",
+			       port->name, port->rc, nl_geterror(port->rc));
+			failed++;
+			continue;
+		}
+		printf("%s: %s written\n", port->name, e->name);
+		written++;
+	}
+
+	printf("%d ports, %u matching %s, %u written, %u failed\n", cnt, same,
+	       e->name, written, failed);
+
+	return failed ? 1 : 0;
+}
+
+/* Save the configuration of one port as a profile, new or not */
+static int qos_profile_take(struct qos_profiles *p, const char *name,
+			    const char *dev)
+{
+	char names[MCHP_DEV_LIST_MAX][IF_NAMESIZE];
+	struct qos_port port;
+	struct qos_profile *e;
+
+	if (mchp_dev_list_parse(dev, names, MCHP_DEV_LIST_MAX) != 1) {
+		fprintf(stderr, "One port expected!\n");
+		return 1;
+	}
+	if (qos_ports_read(names, 1, &port) < 0 || !port.valid)
+		return 1;
+
+	e = qos_profile_find(p, name);
+	if (!e)
+		e = qos_profile_add(p, name);
+	if (!e) {
+		fprintf(stderr, "Invalid profile [%s]\n", name);
+		return 1;
+	}
+	e->cfg = port.cfg;
+
+	if (qos_profile_save(p) < 0)
+		return 1;
+	qos_profile_print(stdout, e);
+
+	return 0;
+}
+
+static int cmd_profile(const struct command *cmd, int argc, char *const *argv)
 {
 	static struct option long_options[] =
 	{
-		{"default", required_argument, NULL, 'a'},
-		{"classified", required_argument, NULL, 'b'},
-		{"mapped", required_argument, NULL, 'c'},
+		{"file", required_argument, NULL, 'a'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
-	struct mchp_qos_port_conf cfg = {};
-	struct mchp_qos_port_conf tmp;
+	struct qos_profiles p = { .file = QOS_PROFILE_FILE };
+	const char *sub = argv[0], *name, *dev;
+	struct qos_profile *e;
+	unsigned int i;
 	int do_help = 0;
-	u32 ifindex = 0;
-	int ch;
+	int ch, n, rc = 1;
 
-	/* read device and skip it */
-	ifindex = if_nametoindex(argv[0]);
-	if (ifindex == 0) {
-		fprintf(stderr, "%s: %s!\n", argv[0], strerror(errno));
+	/* show and del take a name, apply and save a name and devices */
+	n = !strcmp(sub, "apply") || !strcmp(sub, "save") ? 3 : 2;
+	if (argc < n || (!strncmp(argv[1], "--", 2) && strcmp(argv[1], "--all")) ||
+	    (n == 3 && !strncmp(argv[2], "--", 2))) {
+		fprintf(stderr, "Missing argument!\n");
+		command_help(cmd);
 		return 1;
 	}
+	name = argv[1];
+	dev = n == 3 ? argv[2] : NULL;
 
-	if (mchp_qos_genl_port_cfg_get(ifindex, &cfg) < 0)
+	/* The options follow, the last argument stands in for argv[0] */
+	while ((ch = getopt_long(argc - n + 1, argv + n - 1, "a:h", long_options,
+				 NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			p.file = optarg;
+			break;
+		case 'h':
+		case '?':
+			do_help = 1;
+			break;
+		}
+	}
+
+	if (do_help) {
+		command_help(cmd);
 		return 0;
+	}
 
-	memcpy(&tmp, &cfg, sizeof(cfg));
+	if (qos_profile_load(&p) < 0)
+		return 1;
+
+	if (!strcmp(sub, "save")) {
+		rc = qos_profile_take(&p, name, dev);
+		goto out;
+	}
+
+	if (!strcmp(sub, "show") && !strcmp(name, "--all")) {
+		for (i = 0; i < p.cnt; i++) {
+			if (i)
+				printf("\n");
+			qos_profile_print(stdout, &p.entries[i]);
+		}
+		rc = 0;
+		goto out;
+	}
+
+	e = qos_profile_find(&p, name);
+	if (!e) {
+		fprintf(stderr, "Unknown profile [%s]!\n", name);
+		goto out;
+	}
+
+	if (!strcmp(sub, "apply")) {
+		rc = qos_profile_apply(e, dev);
+	} else if (!strcmp(sub, "show")) {
+		qos_profile_print(stdout, e);
+		rc = 0;
+	} else if (!strcmp(sub, "del")) {
+		*e = p.entries[--p.cnt];
+		rc = qos_profile_save(&p) < 0;
+	} else {
+		fprintf(stderr, "Unknown command [%s]\n", sub);
+		command_help(cmd);
+	}
+
+out:
+	free(p.entries);
+	return rc;
+}
+
+/* check */
+#define QOS_CHECK_ENDS 32 /* Ports of a path, entered and left in turn */
+
+struct qos_check {
+	char names[MCHP_DEV_LIST_MAX][IF_NAMESIZE];
+	struct qos_port ports[MCHP_DEV_LIST_MAX];
+	int cnt;
+	unsigned int listed;  /* Ports of the dev list, checked on their own */
+	struct qos_profiles profiles;
+	unsigned int paths;
+	unsigned int failed;
+	unsigned int bad;     /* Code points not preserved */
+};
+
+static char *check_help(void)
+{
+	return " --topology: File of paths to check, one per line\n"
+	       "  --file:     Profiles file, see profile (default " QOS_PROFILE_FILE ")\n"
+	       "  --help:     Show this help text\n"
+	       "Frames of every PCP/DEI are classified at ingress and tagged at\n"
+	       "egress of a port, and reported if they leave with other values.\n"
+	       "A path lists the ports frames enter and leave in turn, the ports\n"
+	       "of other switches given by their profile, e.g.\n"
+	       "  swp1 swp2 @core @core\n"
+	       "for frames received on swp1 and sent on swp2 to a switch with\n"
+	       "ports configured as profile core.\n";
+}
+
+static int qos_check_port(struct qos_check *c, const char *name)
+{
+	int i;
+
+	for (i = 0; i < c->cnt; i++)
+		if (!strcmp(c->names[i], name))
+			return i;
+
+	if (c->cnt == MCHP_DEV_LIST_MAX || strlen(name) >= IF_NAMESIZE)
+		return -1;
+	strcpy(c->names[c->cnt], name);
+
+	return c->cnt++;
+}
+
+/* Follow the frames of every PCP/DEI along a path. Returns the number of
+ * code points not preserved.
+ */
+static unsigned int qos_check_path(const char *label,
+				   const struct mchp_qos_port_conf **ends,
+				   unsigned int n)
+{
+	struct qos_model_class hop[QOS_CHECK_ENDS / 2];
+	unsigned int k, i, bad = 0;
+	u8 pcp, dei;
+
+	for (k = 0; k < PCP_COUNT * DEI_COUNT; k++) {
+		pcp = k / DEI_COUNT;
+		dei = k % DEI_COUNT;
+		for (i = 0; i < n / 2; i++) {
+			qos_model_ingress(ends[2 * i], NULL,
+					  qos_model_key(true, pcp, dei, false, 0),
+					  &hop[i]);
+			qos_model_egress(ends[2 * i + 1], pcp, dei, &hop[i]);
+			pcp = hop[i].pcp;
+			dei = hop[i].dei;
+		}
+		if (pcp == k / DEI_COUNT && dei == k % DEI_COUNT)
+			continue;
+
+		printf("%s: pcp/dei %u/%u", label, k / DEI_COUNT, k % DEI_COUNT);
+		for (i = 0; i < n / 2; i++)
+			printf(" -> prio/dpl %u/%u -> pcp/dei %u/%u", hop[i].prio,
+			       hop[i].dpl, hop[i].pcp, hop[i].dei);
+		printf("\n");
+		bad++;
+	}
+
+	return bad;
+}
+
+/* Collect the ports of a topology line, or check it once they are read */
+static int qos_check_line(struct qos_check *c, char *line, bool run)
+{
+	const struct mchp_qos_port_conf *ends[QOS_CHECK_ENDS];
+	char label[QOS_MODEL_LINE] = "", *tok, *save;
+	const struct qos_profile *e;
+	unsigned int n = 0;
+	int i;
+
+	line[strcspn(line, "#\n")] = '\0';
+	for (tok = strtok_r(line, " \t", &save); tok;
+	     tok = strtok_r(NULL, " \t", &save)) {
+		if (n == QOS_CHECK_ENDS)
+			return -1;
+		if (n)
+			strcat(label, " ");
+		strcat(label, tok);
+
+		if (tok[0] == '@') {
+			e = qos_profile_find(&c->profiles, tok + 1);
+			if (!e) {
+				fprintf(stderr, "Unknown profile [%s]!\n", tok + 1);
+				return -1;
+			}
+			ends[n++] = &e->cfg;
+			continue;
+		}
+
+		i = qos_check_port(c, tok);
+		if (i < 0)
+			return -1;
+		if (run && !c->ports[i].valid)
+			return 0;
+		ends[n++] = &c->ports[i].cfg;
+	}
+
+	if (n % 2)
+		return -1;
+	if (!n || !run)
+		return 0;
+
+	c->paths++;
+	c->bad += qos_check_path(label, ends, n);
+
+	return 0;
+}
+
+static int qos_check_topology(struct qos_check *c, const char *name,
+			      bool run)
+{
+	char line[QOS_MODEL_LINE], copy[QOS_MODEL_LINE];
+	unsigned int n = 0;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		strcpy(copy, line);
+		if (qos_check_line(c, copy, run) < 0) {
+			fprintf(stderr, "%s:%u: Invalid path!\n", name, n);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+
+	return 0;
+}
+
+static int cmd_check(const struct command *cmd, int argc, char *const *argv)
+{
+	static struct option long_options[] =
+	{
+		{"topology", required_argument, NULL, 'a'},
+		{"file", required_argument, NULL, 'b'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	const struct mchp_qos_port_conf *ends[2];
+	static struct qos_check c;
+	const char *topology = NULL;
+	int do_help = 0;
+	int ch, rc = 1;
+	unsigned int i;
+
+	memset(&c, 0, sizeof(c));
+	c.profiles.file = QOS_PROFILE_FILE;
 
 	while ((ch = getopt_long(argc, argv, "a:b:h", long_options, NULL)) != -1) {
 		switch (ch) {
 		case 'a':
-			cfg.e_mode = MCHP_E_MODE_DEFAULT;
+			topology = optarg;
 			break;
 		case 'b':
-			cfg.e_mode = MCHP_E_MODE_CLASSIFIED;
-			break;
-		case 'c':
-			cfg.e_mode = MCHP_E_MODE_MAPPED;
+			c.profiles.file = optarg;
 			break;
 		case 'h':
 		case '?':
@@ -749,20 +1297,45 @@ static int cmd_e_mode(const struct command *cmd, int argc, char *const *argv)
 		}
 	}
 
-	if (do_help) {
+	if (do_help || strcmp(argv[0], "--help") == 0) {
 		command_help(cmd);
 		return 0;
 	}
 
-	if (memcmp(&tmp, &cfg, sizeof(cfg)) == 0) {
-		printf("e_mode --default %u --classified %u --mapped %u\n",
-		       (cfg.e_mode == MCHP_E_MODE_DEFAULT) ? 1 : 0,
-		       (cfg.e_mode == MCHP_E_MODE_CLASSIFIED) ? 1 : 0,
-		       (cfg.e_mode == MCHP_E_MODE_MAPPED) ? 1 : 0);
-		return 0;
+	c.cnt = mchp_dev_list_parse(argv[0], c.names, MCHP_DEV_LIST_MAX);
+	if (c.cnt < 0)
+		return 1;
+	c.listed = c.cnt;
+
+	/* The ports of the paths are read along with those of the list */
+	if (topology && (qos_profile_load(&c.profiles) < 0 ||
+			 qos_check_topology(&c, topology, false) < 0))
+		goto out;
+
+	if (qos_ports_read(c.names, c.cnt, c.ports) < 0)
+		goto out;
+
+	for (i = 0; i < (unsigned int)c.cnt; i++)
+		if (!c.ports[i].valid)
+			c.failed++;
+
+	for (i = 0; i < c.listed; i++) {
+		if (!c.ports[i].valid)
+			continue;
+		ends[0] = ends[1] = &c.ports[i].cfg;
+		c.bad += qos_check_path(c.names[i], ends, 2);
 	}
 
-	return mchp_qos_genl_port_cfg_set(ifindex, &cfg);
+	if (topology && qos_check_topology(&c, topology, true) < 0)
+		goto out;
+
+	printf("%d ports, %u paths, %u failed, %u code points not preserved\n",
+	       c.cnt, c.paths, c.failed, c.bad);
+	rc = c.failed || c.bad;
+
+out:
+	free(c.profiles.entries);
+	return rc;
 }
 
 /* commands */
@@ -775,6 +1348,8 @@ static const struct command commands[] =
 	{1, "e_tag_map", cmd_e_tag_map, "e_tag_map dev [options]", e_tag_map_help},
 	{1, "e_def", cmd_e_def, "e_def dev [options]", e_def_help},
 	{1, "e_mode", cmd_e_mode, "e_mode dev [options]", e_mode_help},
+	{1, "check", cmd_check, "check dev [options]", check_help},
+	{2, "profile", cmd_profile, "profile apply|save name dev | profile show|del name|--all [options]", profile_help},
 };
 
 static void command_help(const struct command *cmd)
@@ -790,9 +1365,13 @@ static void command_help_all(void)
 
 static void help(void)
 {
-	printf("Usage: qos i_tag_map|i_dscp_map|i_def|i_mode|e_tag_map|e_def|e_mode [options]\n");
+	printf("Usage: qos i_tag_map|i_dscp_map|i_def|i_mode|e_tag_map|e_def|e_mode|profile|check [options]\n");
 	printf("options:\n");
 	printf(" --help                    Show this help text\n");
+	printf(" --batch <file|->          Run the commands of a file, one per line\n");
+	printf("   --progress              Print \"@line <n>\" before every command\n");
+	printf("dev:\n");
+	printf(" One device or a list, e.g. swp1,swp2,swp[3-24]\n");
 	printf("commands:\n");
 	command_help_all();
 }
@@ -826,20 +1405,11 @@ static const struct command *command_lookup_and_validate(int argc,
 	return cmd;
 }
 
-int main(int argc, char *argv[])
+static int command_run(int argc, char **argv, int line_num)
 {
 	const struct command *cmd;
 
-	/* skip program name ('qos') */
-	argv++;
-	argc--;
-
-	if (!argc || (strcmp(argv[0], "--help") == 0)) {
-		help();
-		return 1;
-	}
-
-	cmd = command_lookup_and_validate(argc, argv, 0);
+	cmd = command_lookup_and_validate(argc, argv, line_num);
 	if (!cmd)
 		return 1;
 
@@ -848,10 +1418,45 @@ int main(int argc, char *argv[])
 	argc--;
 
 	if (argc < cmd->nargs) {
+		if (line_num > 0)
+			fprintf(stderr, "Error on line %d:\n", line_num);
 		fprintf(stderr, "Missing argument!\n");
 		command_help(cmd);
 		return 1;
 	}
 
+	/* getopt state is kept between the commands of a batch */
+	optind = 0;
+
 	return cmd->func(cmd, argc, argv);
 }
+
+int main(int argc, char *argv[])
+{
+	int rc;
+
+	/* skip program name ('qos') */
+	argv++;
+	argc--;
+
+	if (!argc || (strcmp(argv[0], "--help") == 0)) {
+		help();
+		return 1;
+	}
+
+	if (strcmp(argv[0], "--batch") == 0) {
+		if (argc < 2) {
+			fprintf(stderr, "Missing argument!\n");
+			return 1;
+		}
+		rc = mchp_batch_run(argv[1], argc > 2 &&
+				   strcmp(argv[2], "--progress") == 0,
+				   command_run);
+	} else {
+		rc = command_run(argc, argv, 0);
+	}
+	mchp_genl_session_close(&qos_session);
+	mchp_genl_pool_close(&qos_pool);
+
+	return rc;
+}
@@ -0,0 +1,330 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qos_model.h"
+
+void qos_model_init(struct qos_model *m)
+{
+	memset(m, 0, sizeof(*m));
+	qos_model_port_init(&m->port);
+}
+
+void qos_model_port_init(struct mchp_qos_port_conf *port)
+{
+	unsigned int i;
+
+	memset(port, 0, sizeof(*port));
+
+	/* PCP to the same priority, DEI to the DPL, and back */
+	for (i = 0; i < PCP_COUNT; i++) {
+		port->i_pcp_dei_prio_dpl_map[i][0].prio = i;
+		port->i_pcp_dei_prio_dpl_map[i][1].prio = i;
+		port->i_pcp_dei_prio_dpl_map[i][1].dpl = 1;
+		port->e_prio_dpl_pcp_dei_map[i][0].pcp = i;
+		port->e_prio_dpl_pcp_dei_map[i][1].pcp = i;
+		port->e_prio_dpl_pcp_dei_map[i][1].dei = 1;
+	}
+	port->e_mode = MCHP_E_MODE_CLASSIFIED;
+}
+
+/* The last enabled source wins: the default, then the tag, then a trusted
+ * DSCP.
+ */
+void qos_model_ingress(const struct mchp_qos_port_conf *port,
+		       const struct mchp_qos_dscp_prio_dpl *dscp, u16 key,
+		       struct qos_model_class *c)
+{
+	const struct mchp_pcp_dei_prio_dpl *map;
+	const struct mchp_qos_dscp_prio_dpl *d;
+	u8 pcp, dei;
+
+	c->prio = port->i_default_prio;
+	c->dpl = port->i_default_dpl;
+	c->src = QOS_MODEL_SRC_DEFAULT;
+
+	if (key & QOS_MODEL_TAGGED) {
+		pcp = key >> 8 & 7;
+		dei = key >> 7 & 1;
+		if (port->i_mode.tag_map_enable) {
+			map = &port->i_pcp_dei_prio_dpl_map[pcp][dei];
+			c->prio = map->prio;
+			c->dpl = map->dpl;
+			c->src = QOS_MODEL_SRC_TAG;
+		}
+	} else {
+		pcp = port->i_default_pcp;
+		dei = port->i_default_dei;
+	}
+
+	if ((key & QOS_MODEL_IP) && port->i_mode.dscp_map_enable) {
+		d = &dscp[key & (DSCP_COUNT - 1)];
+		if (d->trust) {
+			c->prio = d->prio;
+			c->dpl = d->dpl;
+			c->src = QOS_MODEL_SRC_DSCP;
+		}
+	}
+
+	qos_model_egress(port, pcp, dei, c);
+}
+
+void qos_model_egress(const struct mchp_qos_port_conf *port, u8 pcp, u8 dei,
+		      struct qos_model_class *c)
+{
+	const struct mchp_prio_dpl_pcp_dei *map;
+
+	switch (port->e_mode) {
+	case MCHP_E_MODE_DEFAULT:
+		c->pcp = port->e_default_pcp;
+		c->dei = port->e_default_dei;
+		break;
+	case MCHP_E_MODE_MAPPED:
+		map = &port->e_prio_dpl_pcp_dei_map[c->prio % PRIO_COUNT]
+						   [c->dpl % DPL_COUNT];
+		c->pcp = map->pcp;
+		c->dei = map->dei;
+		break;
+	default:
+		c->pcp = pcp;
+		c->dei = dei;
+		break;
+	}
+}
+
+void qos_model_build(struct qos_model *m)
+{
+	unsigned int key;
+
+	for (key = 0; key < QOS_MODEL_KEYS; key++)
+		qos_model_ingress(&m->port, m->dscp, key, &m->table[key]);
+}
+
+/* A single digit up to @max */
+static int qos_model_digit(const char *val, u8 max, u8 *v)
+{
+	if (val[0] < '0' || val[0] - '0' > max || val[1])
+		return -1;
+	*v = val[0] - '0';
+
+	return 0;
+}
+
+/* A map of 8 or 16 digits up to @max, the first 8 for DEI/DPL 0 */
+static int qos_model_map(const char *val, u8 max, u8 *v, unsigned int *len)
+{
+	unsigned int i;
+
+	*len = strlen(val);
+	if (*len != 8 && *len != 16)
+		return -1;
+
+	for (i = 0; i < *len; i++) {
+		if (val[i] < '0' || val[i] - '0' > max)
+			return -1;
+		v[i] = val[i] - '0';
+	}
+
+	return 0;
+}
+
+/* Apply one option of a configuration line */
+static int qos_model_param(struct mchp_qos_port_conf *port,
+			   struct mchp_qos_dscp_prio_dpl *dscp,
+			   const char *cmd, const char *key, const char *val)
+{
+	unsigned int len, i;
+	u8 map[16], v;
+
+	if (!strcmp(cmd, "i_tag_map") || !strcmp(cmd, "e_tag_map")) {
+		if (qos_model_map(val, strcmp(key, "--prio") &&
+				  strcmp(key, "--pcp") ? 1 : 7, map, &len) < 0)
+			return -1;
+		for (i = 0; i < len; i++) {
+			if (!strcmp(cmd, "i_tag_map") && !strcmp(key, "--prio"))
+				port->i_pcp_dei_prio_dpl_map[i % 8][i / 8].prio = map[i];
+			else if (!strcmp(cmd, "i_tag_map") && !strcmp(key, "--dpl"))
+				port->i_pcp_dei_prio_dpl_map[i % 8][i / 8].dpl = map[i];
+			else if (!strcmp(cmd, "e_tag_map") && !strcmp(key, "--pcp"))
+				port->e_prio_dpl_pcp_dei_map[i % 8][i / 8].pcp = map[i];
+			else if (!strcmp(cmd, "e_tag_map") && !strcmp(key, "--dei"))
+				port->e_prio_dpl_pcp_dei_map[i % 8][i / 8].dei = map[i];
+			else
+				return -1;
+		}
+		return 0;
+	}
+
+	if (qos_model_digit(val, strcmp(key, "--prio") &&
+			    strcmp(key, "--pcp") ? 1 : 7, &v) < 0)
+		return -1;
+
+	if (!strcmp(cmd, "i_dscp_map") && dscp) {
+		if (!strcmp(key, "--enable"))
+			dscp->trust = v;
+		else if (!strcmp(key, "--prio"))
+			dscp->prio = v;
+		else if (!strcmp(key, "--dpl"))
+			dscp->dpl = v;
+		else
+			return -1;
+	} else if (!strcmp(cmd, "i_def")) {
+		if (!strcmp(key, "--prio"))
+			port->i_default_prio = v;
+		else if (!strcmp(key, "--pcp"))
+			port->i_default_pcp = v;
+		else if (!strcmp(key, "--dei"))
+			port->i_default_dei = v;
+		else if (!strcmp(key, "--dpl"))
+			port->i_default_dpl = v;
+		else
+			return -1;
+	} else if (!strcmp(cmd, "i_mode")) {
+		if (!strcmp(key, "--tag"))
+			port->i_mode.tag_map_enable = v;
+		else if (!strcmp(key, "--dscp"))
+			port->i_mode.dscp_map_enable = v;
+		else
+			return -1;
+	} else if (!strcmp(cmd, "e_def")) {
+		if (!strcmp(key, "--pcp"))
+			port->e_default_pcp = v;
+		else if (!strcmp(key, "--dei"))
+			port->e_default_dei = v;
+		else
+			return -1;
+	} else if (!strcmp(cmd, "e_mode")) {
+		/* As shown, only the mode set to 1 counts */
+		if (!strcmp(key, "--default")) {
+			if (v)
+				port->e_mode = MCHP_E_MODE_DEFAULT;
+		} else if (!strcmp(key, "--classified")) {
+			if (v)
+				port->e_mode = MCHP_E_MODE_CLASSIFIED;
+		} else if (!strcmp(key, "--mapped")) {
+			if (v)
+				port->e_mode = MCHP_E_MODE_MAPPED;
+		} else {
+			return -1;
+		}
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+int qos_model_parse(struct mchp_qos_port_conf *port,
+		    struct mchp_qos_dscp_prio_dpl *dscp, char *line,
+		    const char **bad)
+{
+	char *cmd, *key, *val, *save, *end;
+	unsigned long n;
+
+	*bad = line;
+	line[strcspn(line, "#\n")] = '\0';
+	cmd = strtok_r(line, " \t", &save);
+	if (cmd && cmd[strlen(cmd) - 1] == ':')
+		cmd = strtok_r(NULL, " \t", &save);
+	if (!cmd)
+		return 0;
+
+	if (!strcmp(cmd, "i_dscp_map")) {
+		if (!dscp)
+			return -1;
+		val = strtok_r(NULL, " \t", &save);
+		*bad = val ? val : cmd;
+		if (!val)
+			return -1;
+		errno = 0;
+		n = strtoul(val, &end, 0);
+		if (end == val || *end || errno || n >= DSCP_COUNT)
+			return -1;
+		dscp += n;
+	}
+
+	while ((key = strtok_r(NULL, " \t", &save))) {
+		*bad = key;
+		val = strtok_r(NULL, " \t", &save);
+		if (!val || qos_model_param(port, dscp, cmd, key, val) < 0)
+			return -1;
+	}
+
+	return 1;
+}
+
+static void qos_model_print_map(FILE *f, const char *opt,
+				const u8 *v, size_t stride)
+{
+	unsigned int i;
+
+	fprintf(f, " %s ", opt);
+	for (i = 0; i < 16; i++)
+		fprintf(f, "%u", v[(i % 8) * 2 * stride + (i / 8) * stride]);
+}
+
+void qos_model_print(FILE *f, const struct mchp_qos_port_conf *port)
+{
+	const size_t in = sizeof(struct mchp_pcp_dei_prio_dpl);
+	const size_t eg = sizeof(struct mchp_prio_dpl_pcp_dei);
+
+	fprintf(f, "i_mode --tag %u --dscp %u\n", port->i_mode.tag_map_enable,
+		port->i_mode.dscp_map_enable);
+	fprintf(f, "i_tag_map");
+	qos_model_print_map(f, "--prio",
+			    &port->i_pcp_dei_prio_dpl_map[0][0].prio, in);
+	qos_model_print_map(f, "--dpl",
+			    &port->i_pcp_dei_prio_dpl_map[0][0].dpl, in);
+	fprintf(f, "\n");
+	fprintf(f, "i_def --prio %u --pcp %u --dei %u --dpl %u\n",
+		port->i_default_prio, port->i_default_pcp,
+		port->i_default_dei, port->i_default_dpl);
+	fprintf(f, "e_mode --default %u --classified %u --mapped %u\n",
+		port->e_mode == MCHP_E_MODE_DEFAULT,
+		port->e_mode == MCHP_E_MODE_CLASSIFIED,
+		port->e_mode == MCHP_E_MODE_MAPPED);
+	fprintf(f, "e_tag_map");
+	qos_model_print_map(f, "--pcp",
+			    &port->e_prio_dpl_pcp_dei_map[0][0].pcp, eg);
+	qos_model_print_map(f, "--dei",
+			    &port->e_prio_dpl_pcp_dei_map[0][0].dei, eg);
+	fprintf(f, "\n");
+	fprintf(f, "e_def --pcp %u --dei %u\n", port->e_default_pcp,
+		port->e_default_dei);
+}
+
+/* FNV-1a of the fields, not of the struct, which has padding */
+u64 qos_model_hash(const struct mchp_qos_port_conf *port)
+{
+	u8 v[4 + 2 * 32 + 2 + 2 + 1], *p = v;
+	u64 h = 0xcbf29ce484222325ULL;
+	unsigned int i, j;
+
+	*p++ = port->i_default_prio;
+	*p++ = port->i_default_dpl;
+	*p++ = port->i_default_pcp;
+	*p++ = port->i_default_dei;
+	for (i = 0; i < PCP_COUNT; i++) {
+		for (j = 0; j < DEI_COUNT; j++) {
+			*p++ = port->i_pcp_dei_prio_dpl_map[i][j].prio;
+			*p++ = port->i_pcp_dei_prio_dpl_map[i][j].dpl;
+			*p++ = port->e_prio_dpl_pcp_dei_map[i][j].pcp;
+			*p++ = port->e_prio_dpl_pcp_dei_map[i][j].dei;
+		}
+	}
+	*p++ = port->i_mode.tag_map_enable;
+	*p++ = port->i_mode.dscp_map_enable;
+	*p++ = port->e_default_pcp;
+	*p++ = port->e_default_dei;
+	*p++ = port->e_mode;
+
+	for (i = 0; i < sizeof(v); i++)
+		h = (h ^ v[i]) * 0x100000001b3ULL;
+
+	return h;
+}
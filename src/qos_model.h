@@ -0,0 +1,91 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+#ifndef _QOS_MODEL_H_
+#define _QOS_MODEL_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "kernel_types.h"
+#include "mchp_ui_qos.h"
+
+#define DSCP_COUNT 64
+
+#define QOS_MODEL_LINE 1024
+
+/* What basic classification looks at in a frame, in 12 bits: the outer
+ * tag, its PCP and DEI, and the DSCP of an IP frame.
+ */
+#define QOS_MODEL_TAGGED (1 << 11)
+#define QOS_MODEL_IP     (1 << 6)
+#define QOS_MODEL_KEYS   (1 << 12)
+
+static inline u16 qos_model_key(bool tagged, u8 pcp, u8 dei, bool ip,
+				u8 dscp)
+{
+	return (tagged ? QOS_MODEL_TAGGED | pcp << 8 | dei << 7 : 0) |
+	       (ip ? QOS_MODEL_IP | dscp : 0);
+}
+
+enum qos_model_src {
+	QOS_MODEL_SRC_DEFAULT, /* i_def */
+	QOS_MODEL_SRC_TAG,     /* i_tag_map */
+	QOS_MODEL_SRC_DSCP,    /* i_dscp_map */
+
+	QOS_MODEL_SRCS,
+};
+
+/* Classification of a frame and the tag it leaves with */
+struct qos_model_class {
+	u8 prio;
+	u8 dpl;
+	u8 pcp; /* Egress */
+	u8 dei;
+	u8 src;
+};
+
+/* Software model of the ingress classification and egress tagging of a
+ * port. The classification of every key is worked out once, into a flat
+ * table, by qos_model_build().
+ */
+struct qos_model {
+	struct mchp_qos_port_conf port;
+	struct mchp_qos_dscp_prio_dpl dscp[DSCP_COUNT];
+	struct qos_model_class table[QOS_MODEL_KEYS];
+};
+
+/* The configuration of a port out of reset, nothing trusted */
+void qos_model_init(struct qos_model *m);
+void qos_model_port_init(struct mchp_qos_port_conf *port);
+
+void qos_model_build(struct qos_model *m);
+
+/* Classify a frame by its key */
+void qos_model_ingress(const struct mchp_qos_port_conf *port,
+		       const struct mchp_qos_dscp_prio_dpl *dscp, u16 key,
+		       struct qos_model_class *c);
+
+/* The egress PCP and DEI of a frame classified to @c->prio and @c->dpl,
+ * with @pcp and @dei classified at ingress
+ */
+void qos_model_egress(const struct mchp_qos_port_conf *port, u8 pcp, u8 dei,
+		      struct qos_model_class *c);
+
+/* Apply a configuration line as shown by the qos commands, e.g.
+ * "i_def --prio 1 --dpl 0", optionally prefixed by the "<dev>:" of a
+ * listing of several ports. @dscp may be NULL to refuse i_dscp_map lines.
+ * Returns 1 for a line applied, 0 for an empty one and -1 on errors, with
+ * @bad the offending part of the line.
+ */
+int qos_model_parse(struct mchp_qos_port_conf *port,
+		    struct mchp_qos_dscp_prio_dpl *dscp, char *line,
+		    const char **bad);
+
+/* Print the lines of a port configuration, as qos_model_parse() reads */
+void qos_model_print(FILE *f, const struct mchp_qos_port_conf *port);
+
+u64 qos_model_hash(const struct mchp_qos_port_conf *port);
+
+#endif /* _QOS_MODEL_H_ */
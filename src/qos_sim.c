@@ -0,0 +1,306 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Offline QoS classification.
+ *
+ * Works out the priority and DPL every frame of a capture gets from the
+ * basic classification of a port, and the PCP and DEI it leaves with,
+ * reporting the frames of every priority.
+ *
+ * Classification only looks at 12 bits of a frame, see qos_model.h, so
+ * the frames are counted by those bits in one pass over the capture, and
+ * the configuration is applied to the 4096 counts afterwards.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pcap.h"
+#include "qos_model.h"
+
+#define ETH_P_IP     0x0800
+#define ETH_P_IPV6   0x86dd
+#define ETH_P_8021Q  0x8100
+#define ETH_P_8021AD 0x88a8
+
+struct qos_sim_count {
+	u64 frames;
+	u64 octets;
+};
+
+struct qos_sim {
+	struct qos_model model;
+	struct qos_sim_count keys[QOS_MODEL_KEYS];
+	u64 frames;
+	u64 tagged;
+	u64 ip;
+	u64 short_frames;
+};
+
+static const char *const qos_sim_srcs[QOS_MODEL_SRCS] = {
+	[QOS_MODEL_SRC_DEFAULT] = "default",
+	[QOS_MODEL_SRC_TAG] = "tag",
+	[QOS_MODEL_SRC_DSCP] = "dscp",
+};
+
+static struct option long_options[] =
+{
+	{"keys", no_argument, NULL, 'a'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+static void help(void)
+{
+	printf("Usage: qos-sim [options] port-config capture.pcap...\n");
+	printf("Classify the frames of captures with the QoS configuration of a port.\n");
+	printf("The configuration has the lines shown by the qos commands, e.g.\n");
+	printf("  i_mode --tag 1 --dscp 1\n");
+	printf("  i_tag_map --prio 0123456701234567 --dpl 0000000011111111\n");
+	printf("  i_dscp_map 46 --enable 1 --prio 7 --dpl 0\n");
+	printf("  i_def --prio 0 --pcp 0 --dei 0 --dpl 0\n");
+	printf("  e_mode --default 0 --classified 0 --mapped 1\n");
+	printf("  e_tag_map --pcp 0123456701234567 --dei 0000000011111111\n");
+	printf("  e_def --pcp 0 --dei 0\n");
+	printf("and anything not given is as out of reset.\n");
+	printf("options:\n");
+	printf(" --keys   Also show the frames of every PCP, DEI and DSCP seen\n");
+	printf(" --help   Show this help text\n");
+}
+
+static int qos_sim_load(struct qos_model *m, const char *name)
+{
+	char line[QOS_MODEL_LINE], copy[QOS_MODEL_LINE];
+	const char *bad;
+	unsigned int n = 0;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	qos_model_init(m);
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		strcpy(copy, line);
+		if (qos_model_parse(&m->port, m->dscp, copy, &bad) < 0) {
+			fprintf(stderr, "%s:%u: Invalid [%s]!\n", name, n, bad);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+
+	qos_model_build(m);
+
+	return 0;
+}
+
+static u16 qos_sim_be16(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+/* Count the frames of a capture by their classification key */
+static void qos_sim_count(struct qos_sim *sim, const struct pcap_file *f)
+{
+	size_t cursor = PCAP_CURSOR_START;
+	u8 pcp = 0, dei = 0, dscp = 0;
+	unsigned int off, tag;
+	struct pcap_pkt pkt;
+	bool tagged, ip;
+	u16 type, key;
+	const u8 *p;
+	int rc;
+
+	while ((rc = pcap_next(f, &cursor, &pkt)) > 0) {
+		p = pkt.data;
+		if (pkt.caplen < 14) {
+			sim->short_frames++;
+			continue;
+		}
+
+		/* The outer tag is classified, an inner one skipped */
+		off = 12;
+		type = qos_sim_be16(p + off);
+		tagged = false;
+		for (tag = 0; tag < 2 && (type == ETH_P_8021Q ||
+					  type == ETH_P_8021AD) &&
+			      pkt.caplen >= off + 6; tag++) {
+			if (!tag) {
+				tagged = true;
+				pcp = p[off + 2] >> 5;
+				dei = p[off + 2] >> 4 & 1;
+				sim->tagged++;
+			}
+			off += 4;
+			type = qos_sim_be16(p + off);
+		}
+		off += 2;
+
+		ip = false;
+		if (type == ETH_P_IP && pkt.caplen >= off + 2) {
+			dscp = p[off + 1] >> 2;
+			ip = true;
+		} else if (type == ETH_P_IPV6 && pkt.caplen >= off + 2) {
+			dscp = (p[off] & 0xf) << 2 | p[off + 1] >> 6;
+			ip = true;
+		}
+		sim->ip += ip;
+
+		key = qos_model_key(tagged, pcp, dei, ip, dscp);
+		sim->keys[key].frames++;
+		sim->keys[key].octets += pkt.len;
+		sim->frames++;
+	}
+
+	if (rc < 0)
+		fprintf(stderr, "%s: Truncated, stopping at offset %zu\n",
+			f->name, cursor);
+}
+
+static void qos_sim_report(const struct qos_sim *sim)
+{
+	struct qos_sim_count egress[PRIO_COUNT][PCP_COUNT * DEI_COUNT] = {};
+	u64 src[PRIO_COUNT][QOS_MODEL_SRCS] = {};
+	u64 dpl[PRIO_COUNT][DPL_COUNT] = {};
+	struct qos_sim_count prio[PRIO_COUNT] = {};
+	const struct qos_model_class *c;
+	unsigned int key, i, j;
+
+	for (key = 0; key < QOS_MODEL_KEYS; key++) {
+		if (!sim->keys[key].frames)
+			continue;
+		c = &sim->model.table[key];
+		i = c->prio % PRIO_COUNT;
+		prio[i].frames += sim->keys[key].frames;
+		prio[i].octets += sim->keys[key].octets;
+		dpl[i][c->dpl % DPL_COUNT] += sim->keys[key].frames;
+		src[i][c->src] += sim->keys[key].frames;
+		egress[i][(c->pcp % PCP_COUNT) * DEI_COUNT + c->dei % DEI_COUNT].frames +=
+			sim->keys[key].frames;
+	}
+
+	printf("%4s %12s %14s %7s %12s %12s %12s %12s %12s  %s\n", "prio",
+	       "frames", "octets", "share", "dpl0", "dpl1", "default", "tag",
+	       "dscp", "egress pcp/dei:frames");
+	for (i = 0; i < PRIO_COUNT; i++) {
+		printf("%4u %12" PRIu64 " %14" PRIu64 " %6.2f%% %12" PRIu64
+		       " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64
+		       " ", i, prio[i].frames, prio[i].octets,
+		       sim->frames ? 100.0 * prio[i].frames / sim->frames : 0,
+		       dpl[i][0], dpl[i][1], src[i][QOS_MODEL_SRC_DEFAULT],
+		       src[i][QOS_MODEL_SRC_TAG], src[i][QOS_MODEL_SRC_DSCP]);
+		for (j = 0; j < PCP_COUNT * DEI_COUNT; j++)
+			if (egress[i][j].frames)
+				printf(" %u/%u:%" PRIu64, j / DEI_COUNT,
+				       j % DEI_COUNT, egress[i][j].frames);
+		printf("\n");
+	}
+}
+
+static void qos_sim_report_keys(const struct qos_sim *sim)
+{
+	const struct qos_model_class *c;
+	unsigned int key;
+
+	printf("%3s %3s %4s  %4s %3s %-7s  %3s %3s %12s\n", "pcp", "dei",
+	       "dscp", "prio", "dpl", "by", "pcp", "dei", "frames");
+	for (key = 0; key < QOS_MODEL_KEYS; key++) {
+		if (!sim->keys[key].frames)
+			continue;
+		c = &sim->model.table[key];
+		if (key & QOS_MODEL_TAGGED)
+			printf("%3u %3u", key >> 8 & 7, key >> 7 & 1);
+		else
+			printf("%3s %3s", "-", "-");
+		if (key & QOS_MODEL_IP)
+			printf(" %4u", key & (DSCP_COUNT - 1));
+		else
+			printf(" %4s", "-");
+		printf("  %4u %3u %-7s  %3u %3u %12" PRIu64 "\n", c->prio,
+		       c->dpl, qos_sim_srcs[c->src], c->pcp, c->dei,
+		       sim->keys[key].frames);
+	}
+	printf("\n");
+}
+
+static long qos_sim_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pcap_file f;
+	struct qos_sim *sim;
+	bool keys = false;
+	size_t bytes = 0;
+	long start, ms;
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "ah", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			keys = true;
+			break;
+		case 'h':
+		case '?':
+			help();
+			return 0;
+		}
+	}
+
+	if (argc - optind < 2) {
+		help();
+		return 1;
+	}
+
+	sim = calloc(1, sizeof(*sim));
+	if (!sim) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	if (qos_sim_load(&sim->model, argv[optind++]) < 0)
+		return 1;
+
+	start = qos_sim_now_ms();
+	for (; optind < argc; optind++) {
+		if (pcap_open(&f, argv[optind]) < 0)
+			return 1;
+		if (f.linktype != PCAP_LINKTYPE_ETHERNET) {
+			fprintf(stderr, "%s: Not an Ethernet capture!\n",
+				argv[optind]);
+			return 1;
+		}
+		qos_sim_count(sim, &f);
+		bytes += f.size;
+		pcap_close(&f);
+	}
+	ms = qos_sim_now_ms() - start;
+
+	if (keys)
+		qos_sim_report_keys(sim);
+	qos_sim_report(sim);
+	printf("%" PRIu64 " frames, %" PRIu64 " tagged, %" PRIu64 " IP, %" PRIu64
+	       " short, %zu MB in %ld ms, %.1f M frames/s\n", sim->frames,
+	       sim->tagged, sim->ip, sim->short_frames, bytes >> 20, ms,
+	       ms ? sim->frames / 1000.0 / ms : 0);
+
+	free(sim);
+
+	return 0;
+}
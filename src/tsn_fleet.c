@@ -0,0 +1,664 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Push one configuration to many switches in parallel.
+ *
+ * The configuration holds command lines of the frer, psfp and qos tools,
+ * e.g. "qos i_def swp[1-24] --prio 3". Consecutive lines of the same tool
+ * form a segment, which is sent to the batch mode of the tool on each node:
+ *
+ *   <transport> <tool> --batch -
+ *
+ * The transport of a node is a command prefix such as "ssh root@sw1", or
+ * empty to run the tools locally. Nodes are configured concurrently, so a
+ * rollout takes about as long as the slowest node.
+ *
+ * Lines already applied are never sent again, as commands like "frer msa"
+ * are not idempotent. The batch runs with --progress, so the controller
+ * knows which lines a failed attempt started:
+ *
+ *   - A line reported failing is retried, resuming the segment there.
+ *   - An attempt that started no line, e.g. as the transport failed or
+ *     timed out first, is retried as a whole.
+ *   - An attempt cut off while running a line, leaving it unknown whether
+ *     the line was applied, is not retried.
+ */
+
+#define _GNU_SOURCE /* pipe2() */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define FLEET_JOBS        32
+#define FLEET_RETRIES     2
+#define FLEET_TIMEOUT     30    /* Seconds per attempt */
+#define FLEET_OUTPUT_MAX  65536 /* Output kept per node */
+
+struct fleet_segment {
+	const char *tool;
+	char *text;
+	size_t len;
+};
+
+/* Progress of one run of a segment, from the batch output */
+struct fleet_attempt {
+	unsigned int started; /* Last line started, 0 for none */
+	unsigned int failed;  /* Line reported failing, 0 for none */
+	char line[256];       /* Output line being assembled */
+	size_t len;
+};
+
+struct fleet_node {
+	char *name;
+	char *transport;
+
+	/* Result */
+	char *output;
+	size_t output_len;
+	unsigned int retries;
+	long latency_ms;
+	int status; /* Exit status, -1 on timeout or failure to run */
+	bool ok;
+};
+
+struct fleet {
+	struct fleet_node *nodes;
+	unsigned int nnodes;
+	struct fleet_segment *segs;
+	unsigned int nsegs;
+
+	unsigned int retries;
+	unsigned int timeout_ms;
+	bool verbose;
+
+	pthread_mutex_t lock;
+	unsigned int next; /* Next node to configure */
+	unsigned int done;
+};
+
+static const char *const fleet_tools[] = { "frer", "psfp", "qos" };
+
+static struct option long_options[] =
+{
+	{"nodes", required_argument, NULL, 'a'},
+	{"config", required_argument, NULL, 'b'},
+	{"jobs", required_argument, NULL, 'c'},
+	{"retries", required_argument, NULL, 'd'},
+	{"timeout", required_argument, NULL, 'e'},
+	{"verbose", no_argument, NULL, 'f'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+static void help(void)
+{
+	printf("Usage: tsn-fleet --nodes <file> --config <file> [options]\n");
+	printf("options:\n"
+	       " --nodes:   Node list, one \"name [transport]\" per line\n"
+	       " --config:  Configuration, one \"frer|psfp|qos command\" per line\n"
+	       " --jobs:    Nodes configured in parallel (default %d)\n"
+	       " --retries: Retries of a failing segment, resumed at the line\n"
+	       "            failing (default %d)\n"
+	       " --timeout: Seconds allowed per segment (default %d)\n"
+	       " --verbose: Print the output of every node\n"
+	       " --help:    Show this help text\n",
+	       FLEET_JOBS, FLEET_RETRIES, FLEET_TIMEOUT);
+}
+
+static long fleet_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Skip leading white space and strip comments and the line ending */
+static char *fleet_line_trim(char *line)
+{
+	char *end;
+
+	while (*line == ' ' || *line == '\t')
+		line++;
+
+	if (*line == '#')
+		*line = 0;
+
+	end = line + strlen(line);
+	while (end > line && strchr(" \t\r\n", end[-1]))
+		*--end = 0;
+
+	return line;
+}
+
+static int fleet_nodes_read(struct fleet *fl, const char *name)
+{
+	char *line = NULL, *p, *sep;
+	struct fleet_node *node;
+	size_t size = 0;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &size, f) != -1) {
+		p = fleet_line_trim(line);
+		if (!*p)
+			continue;
+
+		node = realloc(fl->nodes, (fl->nnodes + 1) * sizeof(*node));
+		if (!node)
+			goto err_nomem;
+		fl->nodes = node;
+		node = &fl->nodes[fl->nnodes];
+		memset(node, 0, sizeof(*node));
+
+		sep = p + strcspn(p, " \t");
+		if (*sep) {
+			*sep++ = 0;
+			sep += strspn(sep, " \t");
+		}
+		node->name = strdup(p);
+		node->transport = strdup(sep);
+		if (!node->name || !node->transport)
+			goto err_nomem;
+		fl->nnodes++;
+	}
+
+	free(line);
+	fclose(f);
+
+	if (!fl->nnodes) {
+		fprintf(stderr, "%s: No nodes!\n", name);
+		return -1;
+	}
+
+	return 0;
+
+err_nomem:
+	fprintf(stderr, "Out of memory!\n");
+	free(line);
+	fclose(f);
+	return -1;
+}
+
+static const char *fleet_tool_lookup(const char *name, size_t len)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(fleet_tools) / sizeof(fleet_tools[0]); i++)
+		if (strlen(fleet_tools[i]) == len &&
+		    strncmp(fleet_tools[i], name, len) == 0)
+			return fleet_tools[i];
+
+	return NULL;
+}
+
+/* Split the configuration into segments of consecutive lines of one tool,
+ * keeping the order of the file.
+ */
+static int fleet_config_read(struct fleet *fl, const char *name)
+{
+	struct fleet_segment *seg = NULL;
+	char *line = NULL, *p, *args;
+	int line_num = 0;
+	const char *tool;
+	size_t size = 0, len;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f) {
+		fprintf(stderr, "%s: %s!\n", name, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &size, f) != -1) {
+		line_num++;
+
+		p = fleet_line_trim(line);
+		if (!*p)
+			continue;
+
+		len = strcspn(p, " \t");
+		tool = fleet_tool_lookup(p, len);
+		if (!tool) {
+			fprintf(stderr, "Error on line %d:\n", line_num);
+			fprintf(stderr, "Unknown tool [%.*s]\n", (int)len, p);
+			goto err;
+		}
+		args = p + len + strspn(p + len, " \t");
+
+		if (!seg || seg->tool != tool) {
+			seg = realloc(fl->segs, (fl->nsegs + 1) * sizeof(*seg));
+			if (!seg)
+				goto err_nomem;
+			fl->segs = seg;
+			seg = &fl->segs[fl->nsegs++];
+			memset(seg, 0, sizeof(*seg));
+			seg->tool = tool;
+		}
+
+		len = strlen(args);
+		p = realloc(seg->text, seg->len + len + 2);
+		if (!p)
+			goto err_nomem;
+		seg->text = p;
+		memcpy(seg->text + seg->len, args, len);
+		seg->len += len;
+		seg->text[seg->len++] = '\n';
+		seg->text[seg->len] = 0;
+	}
+
+	free(line);
+	fclose(f);
+
+	if (!fl->nsegs) {
+		fprintf(stderr, "%s: No commands!\n", name);
+		return -1;
+	}
+
+	return 0;
+
+err_nomem:
+	fprintf(stderr, "Out of memory!\n");
+err:
+	free(line);
+	fclose(f);
+	return -1;
+}
+
+static void fleet_output_add(struct fleet_node *node, const char *buf,
+			     size_t len)
+{
+	char *p;
+
+	if (node->output_len + len > FLEET_OUTPUT_MAX)
+		len = FLEET_OUTPUT_MAX - node->output_len;
+	if (!len)
+		return;
+
+	p = realloc(node->output, node->output_len + len + 1);
+	if (!p)
+		return;
+
+	node->output = p;
+	memcpy(node->output + node->output_len, buf, len);
+	node->output_len += len;
+	node->output[node->output_len] = 0;
+}
+
+/* Keep an output line of the node, or take note of a progress line */
+static void fleet_attempt_line(struct fleet_node *node,
+			       struct fleet_attempt *a)
+{
+	unsigned int n;
+
+	a->line[a->len] = 0;
+	if (sscanf(a->line, "@line %u", &n) == 1) {
+		a->started = n;
+	} else {
+		if (sscanf(a->line, "Command failed on line %u", &n) == 1)
+			a->failed = n;
+		fleet_output_add(node, a->line, a->len);
+	}
+	a->len = 0;
+}
+
+static void fleet_attempt_feed(struct fleet_node *node,
+			       struct fleet_attempt *a, const char *buf,
+			       size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		/* Too long for a progress line, pass it on */
+		if (a->len == sizeof(a->line) - 1) {
+			fleet_output_add(node, a->line, a->len);
+			a->len = 0;
+		}
+		a->line[a->len++] = buf[i];
+		if (buf[i] == '\n')
+			fleet_attempt_line(node, a);
+	}
+}
+
+/* Run "<transport> <tool> --batch - --progress" with the segment from
+ * @offset on its stdin, and collect stdout and stderr. Line numbers in @a
+ * count from @offset. Returns the exit status, or -1 when the command could
+ * not be run or was killed at the deadline.
+ */
+static int fleet_exec(const struct fleet *fl, struct fleet_node *node,
+		      const struct fleet_segment *seg, size_t offset,
+		      struct fleet_attempt *a)
+{
+	char cmdline[1024], buf[4096];
+	int in[2], out[2], status;
+	struct pollfd pfd[2];
+	size_t written = offset;
+	long deadline;
+	bool timeout = false;
+	ssize_t len;
+	int nfds;
+	pid_t pid;
+
+	memset(a, 0, sizeof(*a));
+	snprintf(cmdline, sizeof(cmdline), "%s%s%s --batch - --progress",
+		 node->transport,
+		 *node->transport ? " " : "", seg->tool);
+
+	/* Close on exec, so children of other workers do not keep our pipes
+	 * open and hide the end of the output.
+	 */
+	if (pipe2(in, O_CLOEXEC) < 0)
+		return -1;
+	if (pipe2(out, O_CLOEXEC) < 0) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(out[1], STDERR_FILENO);
+		execl("/bin/sh", "sh", "-c", cmdline, (char *)NULL);
+		_exit(127);
+	}
+
+	close(in[0]);
+	close(out[1]);
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+
+	deadline = fleet_now_ms() + fl->timeout_ms;
+
+	for (;;) {
+		nfds = 0;
+		pfd[nfds].fd = out[0];
+		pfd[nfds++].events = POLLIN;
+		if (in[1] >= 0) {
+			pfd[nfds].fd = in[1];
+			pfd[nfds++].events = POLLOUT;
+		}
+
+		len = deadline - fleet_now_ms();
+		if (len <= 0 || poll(pfd, nfds, len) == 0) {
+			timeout = true;
+			kill(pid, SIGKILL);
+			break;
+		}
+
+		if (nfds > 1 && pfd[1].revents) {
+			len = write(in[1], seg->text + written, seg->len - written);
+			if (len > 0)
+				written += len;
+			if (len < 0 || written == seg->len) {
+				close(in[1]);
+				in[1] = -1;
+			}
+		}
+
+		if (pfd[0].revents) {
+			len = read(out[0], buf, sizeof(buf));
+			if (len <= 0)
+				break;
+			fleet_attempt_feed(node, a, buf, len);
+		}
+	}
+
+	/* Output not ending with a line break */
+	if (a->len)
+		fleet_attempt_line(node, a);
+
+	if (in[1] >= 0)
+		close(in[1]);
+	close(out[0]);
+
+	if (waitpid(pid, &status, 0) < 0 || timeout) {
+		fleet_output_add(node, "timeout\n", 8);
+		return -1;
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Print the result of a node as soon as it is done */
+static void fleet_report(struct fleet *fl, const struct fleet_node *node)
+{
+	const char *p, *nl;
+
+	pthread_mutex_lock(&fl->lock);
+
+	fl->done++;
+	printf("[%*u/%u] %s: %s", (int)snprintf(NULL, 0, "%u", fl->nnodes),
+	       fl->done, fl->nnodes, node->name, node->ok ? "ok" : "failed");
+	if (!node->ok && node->status < 0)
+		printf(" (timeout or error)");
+	else if (!node->ok)
+		printf(" (exit %d)", node->status);
+	printf(", %ld ms, %u retries\n", node->latency_ms, node->retries);
+
+	if (node->output && (fl->verbose || !node->ok)) {
+		for (p = node->output; *p; p = nl) {
+			nl = strchr(p, '\n');
+			nl = nl ? nl + 1 : p + strlen(p);
+			printf("    %.*s", (int)(nl - p), p);
+			if (nl[-1] != '\n')
+				printf("\n");
+		}
+	}
+	fflush(stdout);
+
+	pthread_mutex_unlock(&fl->lock);
+}
+
+/* Offset of the @n'th line of a segment text from @offset on, 1 based */
+static size_t fleet_line_offset(const struct fleet_segment *seg,
+				size_t offset, unsigned int n)
+{
+	const char *nl;
+
+	while (--n && offset < seg->len) {
+		nl = memchr(seg->text + offset, '\n', seg->len - offset);
+		offset = nl ? (size_t)(nl - seg->text) + 1 : seg->len;
+	}
+
+	return offset;
+}
+
+/* Run a segment on a node, retrying as described at the top */
+static void fleet_segment_run(struct fleet *fl, struct fleet_node *node,
+			      const struct fleet_segment *seg)
+{
+	unsigned int attempt, done = 0;
+	struct fleet_attempt a;
+	size_t offset = 0, mark;
+	char note[80];
+
+	for (attempt = 0; ; attempt++) {
+		mark = node->output_len;
+		node->status = fleet_exec(fl, node, seg, offset, &a);
+		if (node->status == 0)
+			return;
+
+		if (attempt == fl->retries)
+			break;
+
+		if (a.failed) {
+			done += a.failed - 1;
+			offset = fleet_line_offset(seg, offset, a.failed);
+			snprintf(note, sizeof(note),
+				 "%s: line %u failed, resuming\n", seg->tool,
+				 done + 1);
+		} else if (!a.started) {
+			snprintf(note, sizeof(note),
+				 "%s: no line started, retrying\n", seg->tool);
+		} else {
+			/* The line cut off may or may not be applied */
+			snprintf(note, sizeof(note),
+				 "%s: cut off in line %u, not retried\n",
+				 seg->tool, done + a.started);
+			fleet_output_add(node, note, strlen(note));
+			break;
+		}
+
+		/* Only the output of the last attempt is kept */
+		node->output_len = mark;
+		if (node->output)
+			node->output[mark] = 0;
+		fleet_output_add(node, note, strlen(note));
+
+		node->retries++;
+		usleep(100000 * (attempt + 1));
+	}
+
+	node->ok = false;
+}
+
+static void fleet_node_run(struct fleet *fl, struct fleet_node *node)
+{
+	long start = fleet_now_ms();
+	unsigned int i;
+
+	node->ok = true;
+
+	for (i = 0; i < fl->nsegs && node->ok; i++)
+		fleet_segment_run(fl, node, &fl->segs[i]);
+
+	node->latency_ms = fleet_now_ms() - start;
+}
+
+static void *fleet_worker(void *data)
+{
+	struct fleet *fl = data;
+	unsigned int idx;
+
+	for (;;) {
+		pthread_mutex_lock(&fl->lock);
+		idx = fl->next++;
+		pthread_mutex_unlock(&fl->lock);
+
+		if (idx >= fl->nnodes)
+			break;
+
+		fleet_node_run(fl, &fl->nodes[idx]);
+		fleet_report(fl, &fl->nodes[idx]);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct fleet fl = {
+		.retries = FLEET_RETRIES,
+		.timeout_ms = FLEET_TIMEOUT * 1000,
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	const char *nodes = NULL, *config = NULL;
+	unsigned int jobs = FLEET_JOBS, i, started, failed = 0;
+	const struct fleet_node *slowest = NULL;
+	pthread_t *threads;
+	long start;
+	int ch;
+
+	while ((ch = getopt_long(argc, argv, "a:b:c:d:e:fh", long_options, NULL)) != -1) {
+		switch (ch) {
+		case 'a':
+			nodes = optarg;
+			break;
+		case 'b':
+			config = optarg;
+			break;
+		case 'c':
+			jobs = atoi(optarg);
+			break;
+		case 'd':
+			fl.retries = atoi(optarg);
+			break;
+		case 'e':
+			fl.timeout_ms = atoi(optarg) * 1000;
+			break;
+		case 'f':
+			fl.verbose = true;
+			break;
+		case 'h':
+		case '?':
+			help();
+			return 0;
+		}
+	}
+
+	if (!nodes || !config) {
+		help();
+		return 1;
+	}
+
+	if (fleet_nodes_read(&fl, nodes) < 0 ||
+	    fleet_config_read(&fl, config) < 0)
+		return 1;
+
+	/* A node closing its stdin early must not kill the controller */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!jobs)
+		jobs = 1;
+	if (jobs > fl.nnodes)
+		jobs = fl.nnodes;
+
+	threads = calloc(jobs, sizeof(*threads));
+	if (!threads) {
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	start = fleet_now_ms();
+
+	for (started = 0; started < jobs; started++)
+		if (pthread_create(&threads[started], NULL, fleet_worker, &fl))
+			break;
+
+	/* Configure the remaining nodes here if no thread could start */
+	if (!started)
+		fleet_worker(&fl);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < fl.nnodes; i++) {
+		if (!fl.nodes[i].ok)
+			failed++;
+		if (!slowest || fl.nodes[i].latency_ms > slowest->latency_ms)
+			slowest = &fl.nodes[i];
+	}
+
+	printf("%u nodes: %u ok, %u failed, slowest %s %ld ms, total %ld ms\n",
+	       fl.nnodes, fl.nnodes - failed, failed, slowest->name,
+	       slowest->latency_ms, fleet_now_ms() - start);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * License: Dual MIT/GPL
+ * Copyright (c) 2020 Microchip Corporation
+ */
+
+/* Counts the heap allocations of netlink requests once the sessions are
+ * set up, which must be none. The requests go to the generic netlink
+ * controller, present in every kernel, so no switch is needed: a get, a
+ * request with ack and a dump on a session, and gets fanned out over the
+ * worker pool.
+ */
+
+#include <linux/genetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "common.h"
+#include "pool.h"
+
+#define ROUNDS_WARMUP 2
+#define ROUNDS        100
+#define POOL_ITEMS    8
+#define CTRL_NAME     "nlctrl"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int counting;
+static unsigned long allocs;
+
+static void count(void)
+{
+	if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+	count();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	count();
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	count();
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+/* Family IDs of a dump, the array kept and only grown across dumps */
+struct family_list {
+	uint16_t *ids;
+	unsigned int cnt;
+	unsigned int size;
+};
+
+static struct mchp_genl_session session =
+	MCHP_GENL_SESSION_INIT(CTRL_NAME, 1);
+static struct mchp_genl_pool pool =
+	MCHP_GENL_POOL_INIT(CTRL_NAME, 1);
+
+static int family_id_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+	uint16_t *id = arg;
+
+	if (genlmsg_parse(nlh, 0, attrs, CTRL_ATTR_MAX, NULL) < 0 ||
+	    !attrs[CTRL_ATTR_FAMILY_ID])
+		return -NLE_MISSING_ATTR;
+
+	*id = nla_get_u16(attrs[CTRL_ATTR_FAMILY_ID]);
+
+	return NL_OK;
+}
+
+static int family_list_cb(struct nlmsghdr *nlh, void *arg)
+{
+	struct family_list *l = arg;
+	uint16_t *ids;
+
+	if (l->cnt == l->size) {
+		ids = realloc(l->ids, (l->size + 64) * sizeof(*ids));
+		if (!ids)
+			return -NLE_NOMEM;
+		l->ids = ids;
+		l->size += 64;
+	}
+
+	return family_id_cb(nlh, &l->ids[l->cnt++]);
+}
+
+static struct nl_msg *family_get(struct mchp_genl_session *s, int flags,
+				 mchp_genl_parse_t parse, void *arg, int *err)
+{
+	struct nl_msg *msg;
+
+	msg = mchp_genl_req_reserve(s, CTRL_CMD_GETFAMILY, flags,
+				    MCHP_GENL_MSG_SMALL_SIZE, parse, arg, err);
+	if (msg && !(flags & NLM_F_DUMP) &&
+	    nla_put_string(msg, CTRL_ATTR_FAMILY_NAME, CTRL_NAME) < 0) {
+		mchp_genl_req_abort(s);
+		return NULL;
+	}
+
+	return msg;
+}
+
+struct pool_item {
+	uint16_t id;
+	int err;
+};
+
+static void pool_work(struct mchp_genl_session *s, unsigned int idx,
+		      void *arg)
+{
+	struct pool_item *item = (struct pool_item *)arg + idx;
+
+	if (!family_get(s, NLM_F_REQUEST, family_id_cb, &item->id,
+			&item->err))
+		item->err = -1;
+}
+
+/* One round of requests. Returns 0 if all of them got the ID of the
+ * controller back.
+ */
+static int round_run(struct family_list *l)
+{
+	struct pool_item items[POOL_ITEMS] = {};
+	uint16_t get_id = 0, ack_id = 0;
+	unsigned int i;
+	int rc;
+
+	l->cnt = 0;
+	if (!family_get(&session, NLM_F_REQUEST, family_id_cb, &get_id,
+			NULL) ||
+	    !family_get(&session, NLM_F_REQUEST | NLM_F_ACK, family_id_cb,
+			&ack_id, NULL) ||
+	    !family_get(&session, NLM_F_REQUEST | NLM_F_DUMP, family_list_cb,
+			l, NULL))
+		return -1;
+
+	rc = mchp_genl_flush(&session);
+	if (rc < 0)
+		return rc;
+	if (get_id != GENL_ID_CTRL || ack_id != GENL_ID_CTRL || !l->cnt)
+		return -1;
+
+	rc = mchp_genl_pool_run(&pool, POOL_ITEMS, pool_work, items);
+	if (rc < 0)
+		return rc;
+	for (i = 0; i < POOL_ITEMS; i++)
+		if (items[i].err || items[i].id != GENL_ID_CTRL)
+			return -1;
+
+	return 0;
+}
+
+int main(void)
+{
+	struct family_list l = {};
+	int i, rc = 0;
+
+	/* Sessions connect and dump arrays grow in the first rounds */
+	for (i = 0; i < ROUNDS_WARMUP; i++) {
+		rc = round_run(&l);
+		if (rc) {
+			printf("No generic netlink controller, rc: %d\n", rc);
+			rc = 77;
+			goto out;
+		}
+	}
+
+	__atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < ROUNDS && !rc; i++)
+		rc = round_run(&l);
+	__atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+
+	if (rc) {
+		printf("Round %d failed, rc: %d\n", i, rc);
+		rc = 1;
+		goto out;
+	}
+
+	printf("%lu allocations in %d rounds of %d requests\n", allocs,
+	       ROUNDS, 3 + POOL_ITEMS);
+	rc = allocs ? 1 : 0;
+
+out:
+	mchp_genl_session_close(&session);
+	mchp_genl_pool_close(&pool);
+	free(l.ids);
+
+	return rc;
+}